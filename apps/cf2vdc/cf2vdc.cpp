@@ -8,6 +8,7 @@
 #include <vapor/CFuncs.h>
 #include <vapor/VDCNetCDF.h>
 #include <vapor/DCCF.h>
+#include <vapor/VDCPartition.h>
 
 using namespace Wasp;
 using namespace VAPoR;
@@ -17,6 +18,9 @@ struct opt_t {
 	int nthreads;
 	int numts;
     std::vector <string> vars;
+	int nprocs;
+	int rank;
+	OptionParser::Boolean_T	finalize;
 	OptionParser::Boolean_T	help;
 } opt;
 
@@ -35,6 +39,24 @@ OptionParser::OptDescRec_T	set_opts[] = {
 		"to be included in "
 		"the VDC"
 	},
+	{
+		"nprocs",    1,  "1",
+		"Number of processes converting in parallel. Unless -rank or "
+		"-finalize is given, nprocs processes are started on this host "
+		"and the conversion is finalized once they finish"
+	},
+	{
+		"rank",    1,  "-1",
+		"Convert only the share of process rank (0 to nprocs-1) and "
+		"exit. Used to spread a conversion across hosts sharing a file "
+		"system. Every process must be given the same options"
+	},
+	{
+		"finalize",    0,  "",
+		"Write the variables stored in the master file, and check that "
+		"all the others were written, after every -rank process has "
+		"finished"
+	},
 	{"help",	0,	"",	"Print this message and exit"},
 	{NULL}
 };
@@ -44,6 +66,9 @@ OptionParser::Option_T	get_options[] = {
 	{"nthreads",Wasp::CvtToInt,		&opt.nthreads,	sizeof(opt.nthreads)},
 	{"numts",	Wasp::CvtToInt,		&opt.numts,		sizeof(opt.numts)},
 	{"vars",	Wasp::CvtToStrVec,	&opt.vars,		sizeof(opt.vars)},
+	{"nprocs",	Wasp::CvtToInt,		&opt.nprocs,	sizeof(opt.nprocs)},
+	{"rank",	Wasp::CvtToInt,		&opt.rank,		sizeof(opt.rank)},
+	{"finalize",	Wasp::CvtToBoolean,	&opt.finalize,	sizeof(opt.finalize)},
 	{"help",	Wasp::CvtToBoolean,	&opt.help,		sizeof(opt.help)},
 	{NULL}
 };
@@ -232,6 +257,147 @@ int CopyVar2d3dMask(
 	return(rc);
 }
 
+// Mask variables written in their own right, and the data variable each
+// is derived from
+//
+map <string, string> MaskSources;
+
+// Every variable and time step to be copied: coordinate variables, then
+// the masks of the data variables, then the data variables
+//
+vector <VDCPartition::Unit> get_units(const DC &dc, const VDC &vdc) {
+	vector <string> coordvars = dc.GetCoordVarNames();
+	vector <string> datavars = opt.vars.size() ? opt.vars : dc.GetDataVarNames();
+
+	MaskSources.clear();
+	vector <string> maskvars;
+	for (int i=0; i<datavars.size(); i++) {
+		DC::DataVar varInfo;
+		if (! vdc.GetDataVarInfo(datavars[i], varInfo)) continue;
+
+		string maskvar = varInfo.GetMaskvar();
+		if (maskvar.empty() || MaskSources.count(maskvar)) continue;
+
+		MaskSources[maskvar] = datavars[i];
+		maskvars.push_back(maskvar);
+	}
+
+	vector <string> varnames = coordvars;
+	varnames.insert(varnames.end(), maskvars.begin(), maskvars.end());
+	varnames.insert(varnames.end(), datavars.begin(), datavars.end());
+
+	vector <VDCPartition::Unit> units;
+	for (int i=0; i<varnames.size(); i++) {
+		string srcvar = MaskSources.count(varnames[i]) ?
+			MaskSources[varnames[i]] : varnames[i];
+
+		int nts = dc.GetNumTimeSteps(srcvar);
+		nts = opt.numts != -1 && nts > opt.numts ? opt.numts : nts;
+		assert(nts >= 0);
+
+		for (int ts=0; ts<nts; ts++) {
+			units.push_back(VDCPartition::Unit(varnames[i], ts));
+		}
+	}
+	return(units);
+}
+
+// Copy coordinate variables and masks despite errors, but give up on
+// the first data variable that fails
+//
+int copy_units(
+	DC &dc, VDC &vdc, const vector <VDCPartition::Unit> &units
+) {
+	int status = 0;
+	for (int i=0; i<units.size(); i++) {
+		string varname = units[i].varname;
+		size_t ts = units[i].ts;
+
+		if (i == 0 || varname != units[i-1].varname) {
+			cout << "Copying variable " << varname << endl;
+		}
+		cout << "  Time step " << ts << endl;
+
+		int rc;
+		if (MaskSources.count(varname)) {
+			rc = CopyVar2d3dMask(dc, vdc, ts, MaskSources[varname], -1);
+		}
+		else {
+			rc = vdc.CopyVar(dc, ts, varname, -1, -1);
+		}
+		if (rc < 0) {
+			MyBase::SetErrMsg("Failed to copy variable %s", varname.c_str());
+			status = -1;
+			if (vdc.IsDataVar(varname) && ! MaskSources.count(varname)) {
+				return(-1);
+			}
+		}
+	}
+	return(status);
+}
+
+// Copy the share of process rank of nprocs, or everything if rank is
+// negative
+//
+int convert(
+	const vector <string> &cffiles, string master, int rank, int nprocs
+) {
+	VDCNetCDF    vdc(opt.nthreads);
+
+	size_t chunksize = 1024*1024*4;
+	vector <size_t> bs;
+	int rc = vdc.Initialize(master, vector <string> (), VDC::A, bs, chunksize);
+	if (rc<0) return(-1);
+
+	DCCF	dccf;
+	rc = dccf.Initialize(cffiles, vector <string> ());
+	if (rc<0) return(-1);
+
+	vector <VDCPartition::Unit> units = get_units(dccf, vdc);
+
+	if (rank < 0) return(copy_units(dccf, vdc, units));
+
+	VDCPartition partition;
+	rc = partition.Initialize(vdc, units, nprocs);
+	if (rc<0) return(-1);
+
+	rc = partition.ClearDone(vdc, rank);
+	if (rc<0) return(-1);
+
+	rc = copy_units(dccf, vdc, partition.GetUnits(rank));
+	if (rc<0) return(-1);
+
+	return(partition.MarkDone(vdc, rank));
+}
+
+// Check that the worker processes wrote everything else, then copy the
+// variables stored in the master file, which they leave alone
+//
+int finalize(const vector <string> &cffiles, string master, int nprocs) {
+	VDCNetCDF    vdc(opt.nthreads);
+
+	size_t chunksize = 1024*1024*4;
+	vector <size_t> bs;
+	int rc = vdc.Initialize(master, vector <string> (), VDC::A, bs, chunksize);
+	if (rc<0) return(-1);
+
+	DCCF	dccf;
+	rc = dccf.Initialize(cffiles, vector <string> ());
+	if (rc<0) return(-1);
+
+	VDCPartition partition;
+	rc = partition.Initialize(vdc, get_units(dccf, vdc), nprocs);
+	if (rc<0) return(-1);
+
+	rc = partition.CheckDone(vdc);
+	if (rc<0) return(-1);
+
+	rc = copy_units(dccf, vdc, partition.GetMasterUnits());
+	if (rc<0) return(-1);
+
+	return(partition.ClearDone(vdc, -1));
+}
+
 int	main(int argc, char **argv) {
 
 	OptionParser op;
@@ -271,69 +437,32 @@ int	main(int argc, char **argv) {
 	for (int i=0; i<argc-1; i++) cffiles.push_back(argv[i]);
 	string master = argv[argc-1];
 
-	VDCNetCDF    vdc(opt.nthreads);
-
-
-	size_t chunksize = 1024*1024*4;
-	vector <size_t> bs;
-	int rc = vdc.Initialize(master, vector <string> (), VDC::A, bs, chunksize);
-	if (rc<0) exit(1);
-
-	DCCF	dccf;
-	rc = dccf.Initialize(cffiles, vector <string> ());
-	if (rc<0) {
+	if (opt.nprocs < 1 || opt.rank >= opt.nprocs) {
+		MyBase::SetErrMsg(
+			"Invalid process rank or count : %d, %d", opt.rank, opt.nprocs
+		);
 		exit(1);
 	}
 
-	vector <string> varnames = dccf.GetCoordVarNames();
-	int status = 0;
-	for (int i=0; i<varnames.size(); i++) {
-		int nts = dccf.GetNumTimeSteps(varnames[i]);
-		nts = opt.numts != -1 && nts > opt.numts ? opt.numts : nts;
-		assert(nts >= 0);
-
-		cout << "Copying variable " << varnames[i] << endl;
-
-		for (int ts=0; ts<nts; ts++) {
-			cout << "  Time step " << ts << endl;
-			int rc = vdc.CopyVar(dccf, ts, varnames[i], -1, -1);
-			if (rc < 0) {
-				MyBase::SetErrMsg("Failed to copy variable %s", varnames[i].c_str());
-				status = 1;
-			}
-		}
+	int rc;
+	if (opt.finalize) {
+		rc = finalize(cffiles, master, opt.nprocs);
 	}
+	else if (opt.rank >= 0) {
+		rc = convert(cffiles, master, opt.rank, opt.nprocs);
+	}
+	else if (opt.nprocs > 1) {
 
-	if (opt.vars.size()) 
-		varnames = opt.vars;
-	else 
-		varnames = dccf.GetDataVarNames();
-	
-	for (int i=0; i<varnames.size(); i++) {
-		int nts = dccf.GetNumTimeSteps(varnames[i]);
-		nts = opt.numts != -1 && nts > opt.numts ? opt.numts : nts;
-		assert(nts >= 0);
-
-		cout << "Copying variable " << varnames[i] << endl;
-
-		for (int ts=0; ts<nts; ts++) {
-
-			cout << "  Time step " << ts << endl;
-
-			int rc = CopyVar2d3dMask(dccf, vdc, ts, varnames[i], -1);
-			if (rc < 0) {
-				MyBase::SetErrMsg("Failed to copy variable %s", varnames[i].c_str());
-				status = 1;
-			}
-
-			rc = vdc.CopyVar(dccf, ts, varnames[i], -1, -1);
-			if (rc < 0) {
-				MyBase::SetErrMsg("Failed to copy variable %s", varnames[i].c_str());
-				status = 1;
-			}
-			if (rc<0) exit(1);
-		}
+		// Nothing is opened before the workers are forked
+		//
+		rc = VDCPartition::RunLocal(opt.nprocs, [&](int rank) {
+			return(convert(cffiles, master, rank, opt.nprocs));
+		});
+		if (rc == 0) rc = finalize(cffiles, master, opt.nprocs);
+	}
+	else {
+		rc = convert(cffiles, master, -1, 1);
 	}
 
-	return( status );
+	return(rc<0 ? 1 : 0);
 }
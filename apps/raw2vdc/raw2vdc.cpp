@@ -3,10 +3,23 @@
 #include <vector>
 #include <sstream>
 #include <cerrno>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+#include <stdint.h>
 #include <stdio.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include <vapor/CFuncs.h>
 #include <vapor/OptionParser.h>
+#include <vapor/EasyThreads.h>
+#include <vapor/ThreadPool.h>
 #include <vapor/VDCNetCDF.h>
+#include <vapor/WASP.h>
 
 using namespace Wasp;
 using namespace VAPoR;
@@ -21,6 +34,8 @@ struct opt_t {
 	int lod;
 	int nthreads;
 	int ts;
+	int nts;
+	int memsize;
 	OptionParser::Boolean_T	swapbytes;
 	OptionParser::Boolean_T	debug;
 	OptionParser::Boolean_T	help;
@@ -28,13 +43,18 @@ struct opt_t {
 
 OptionParser::OptDescRec_T	set_opts[] = {
 	{"varname",	1, 	"var1",	"Name of variable"},
-	{"type",	1, 	"float32",	"Primitive type of input data"},
+	{"type",	1, 	"float32",	"Primitive type of input data "
+		"(float32, float64, or int8)"},
 	{"lod",	1, 	"-1",	"Compression levels saved. 0 => coarsest, 1 => "
 		"next refinement, etc. -1 => all levels defined by the netcdf file"},
 	{"nthreads",	1, 	"0",	"Specify number of execution threads "
 		"0 => use number of cores"},
 	{"ts",	1, 	"0",	"Specify time step offset"},
-    {"swapbytes",   0,  "", "Swap bytes in data as they are read from disk"}, 
+	{"nts",	1, 	"1",	"Number of consecutive time steps stored in each "
+		"data file. Time steps are numbered from -ts across all data files"},
+	{"memsize",	1, 	"4096",	"Approximate memory limit in megabytes. "
+		"As many time steps are converted concurrently as fit within it"},
+    {"swapbytes",   0,  "", "Swap bytes in data as they are read from disk"},
 	{"debug",	0,	"",	"Enable diagnostic"},
 	{"help",	0,	"",	"Print this message and exit"},
 	{NULL}
@@ -47,6 +67,8 @@ OptionParser::Option_T	get_options[] = {
 	{"lod", Wasp::CvtToInt, &opt.lod, sizeof(opt.lod)},
 	{"nthreads", Wasp::CvtToInt, &opt.nthreads, sizeof(opt.nthreads)},
 	{"ts", Wasp::CvtToInt, &opt.ts, sizeof(opt.ts)},
+	{"nts", Wasp::CvtToInt, &opt.nts, sizeof(opt.nts)},
+	{"memsize", Wasp::CvtToInt, &opt.memsize, sizeof(opt.memsize)},
 	{"swapbytes", Wasp::CvtToBoolean, &opt.swapbytes, sizeof(opt.swapbytes)},
 	{"debug", Wasp::CvtToBoolean, &opt.debug, sizeof(opt.debug)},
 	{"help", Wasp::CvtToBoolean, &opt.help, sizeof(opt.help)},
@@ -58,83 +80,262 @@ size_t size_of_type(string type) {
 	if (type.compare("float32") == 0) return(4);
 	if (type.compare("float64") == 0) return(8);
 	if (type.compare("int8") == 0) return(1);
-	return(1);
+	return(0);
 }
-		
-void    swapbytes(
-	void *vptr,
-	int size,
-	int	n
-) {
-	unsigned char   *ucptr = (unsigned char *) vptr;
-	unsigned char   uc;
-	int             i,j;
 
-	for (j=0; j<n; j++) {
-		for (i=0; i<size/2; i++) {
-			uc = ucptr[i];
-			ucptr[i] = ucptr[size-i-1];
-			ucptr[size-i-1] = uc;
-		}
-		ucptr += size;
+//
+// Read-only access to a raw data file. The file is memory mapped where
+// possible, so data are converted straight out of the page cache without
+// staging the volume in memory.
+//
+class RawFile {
+public:
+	RawFile() {
+#ifdef WIN32
+		_fp = NULL;
+#else
+		_fd = -1;
+		_addr = NULL;
+#endif
+		_size = 0;
 	}
-}
 
-int read_data(
-	FILE	*fp, 
-	string type,	// element type
-	bool swap,
-	size_t n,
-	float *slice
-) {
+	~RawFile() {
+#ifdef WIN32
+		if (_fp) fclose(_fp);
+#else
+		if (_addr) munmap(_addr, _size);
+		if (_fd >= 0) close(_fd);
+#endif
+	}
 
-	static SmartBuf smart_buf;
+	int Open(string path) {
+#ifdef WIN32
+		_fp = fopen(path.c_str(), "rb");
+		if (! _fp) {
+			MyBase::SetErrMsg("fopen(%s) : %M", path.c_str());
+			return(-1);
+		}
+		_fseeki64(_fp, 0, SEEK_END);
+		_size = _ftelli64(_fp);
+#else
+		_fd = open(path.c_str(), O_RDONLY);
+		if (_fd < 0) {
+			MyBase::SetErrMsg("open(%s) : %M", path.c_str());
+			return(-1);
+		}
 
-	size_t element_sz = size_of_type(type);
-	unsigned char *buffer = (unsigned char *) smart_buf.Alloc(n * element_sz);
-	
-	int rc = fread(buffer, element_sz, n, fp);
-	if (rc != n) {
-		if (rc<0) { 
-			MyBase::SetErrMsg("Error reading input file : %M");
-		} else {
+		struct stat statbuf;
+		if (fstat(_fd, &statbuf) < 0) {
+			MyBase::SetErrMsg("fstat(%s) : %M", path.c_str());
+			return(-1);
+		}
+		_size = statbuf.st_size;
+		if (! _size) return(0);
+
+		void *addr = mmap(NULL, _size, PROT_READ, MAP_SHARED, _fd, 0);
+		if (addr == MAP_FAILED) {
+			MyBase::SetErrMsg("mmap(%s) : %M", path.c_str());
+			return(-1);
+		}
+		_addr = (unsigned char *) addr;
+		(void) madvise(_addr, _size, MADV_SEQUENTIAL);
+#endif
+		return(0);
+	}
+
+	size_t GetSize() const { return(_size); }
+
+	// Return a pointer to len bytes starting at offset. The pointer is
+	// valid until the next call.
+	//
+	const unsigned char *GetData(size_t offset, size_t len) {
+		if (offset + len > _size) {
 			MyBase::SetErrMsg("Short read on input file");
+			return(NULL);
+		}
+#ifdef WIN32
+		unsigned char *buf = (unsigned char *) _buf.Alloc(len);
+		_fseeki64(_fp, offset, SEEK_SET);
+		if (fread(buf, 1, len, _fp) != len) {
+			MyBase::SetErrMsg("Error reading input file : %M");
+			return(NULL);
 		}
-		return(-1);
+		return(buf);
+#else
+		return(_addr + offset);
+#endif
 	}
 
-	// Swap bytes in place if needed
+	// Hint that len bytes starting at offset will be needed soon
 	//
-	if (swap) {
-		swapbytes(buffer, element_sz, n); 
+	void Prefetch(size_t offset, size_t len) {
+#ifndef WIN32
+		if (offset >= _size) return;
+		len = std::min(len, _size - offset);
+		size_t start = _pageAlign(offset);
+		(void) madvise(_addr + start, len + offset - start, MADV_WILLNEED);
+#endif
 	}
 
-	float *dptr = slice;
-	if (type.compare("float32")==0) {
-		float *sptr = (float *) buffer;
+	// Drop the pages holding len bytes starting at offset from the
+	// process, so mapped data already converted does not accumulate
+	//
+	void Release(size_t offset, size_t len) {
+#ifndef WIN32
+		size_t start = _pageAlign(offset);
+		(void) madvise(_addr + start, len + offset - start, MADV_DONTNEED);
+#endif
+	}
+
+private:
+#ifdef WIN32
+	FILE *_fp;
+	SmartBuf _buf;
+#else
+	int _fd;
+	unsigned char *_addr;
+
+	static size_t _pageAlign(size_t offset) {
+		static size_t pagesize = sysconf(_SC_PAGESIZE);
+		return(offset / pagesize * pagesize);
+	}
+#endif
+	size_t _size;
+};
+
+// Byte swaps written with shifts, which compilers vectorize
+//
+inline uint32_t swap32(uint32_t v) {
+	return(
+		(v >> 24) | ((v >> 8) & 0x0000ff00u) |
+		((v << 8) & 0x00ff0000u) | (v << 24)
+	);
+}
+
+inline uint64_t swap64(uint64_t v) {
+	return(
+		((uint64_t) swap32((uint32_t) v) << 32) | swap32((uint32_t) (v >> 32))
+	);
+}
+
+template <typename T, typename U>
+void convert_block(const unsigned char *src, bool swap, size_t n, float *dst) {
+	const size_t sz = sizeof(T);
+
+	if (swap) {
 		for (size_t i=0; i<n; i++) {
-			*dptr++ = (float) *sptr++;
+			U u;
+			memcpy(&u, src + i*sz, sz);
+			u = sz == 8 ? (U) swap64(u) : (U) swap32((uint32_t) u);
+			T v;
+			memcpy(&v, &u, sz);
+			dst[i] = (float) v;
 		}
 	}
-	else if (type.compare("float64")==0) {
-		double *sptr = (double *) buffer;
+	else {
 		for (size_t i=0; i<n; i++) {
-			*dptr++ = (float) *sptr++;
+			T v;
+			memcpy(&v, src + i*sz, sz);
+			dst[i] = (float) v;
 		}
 	}
-	else if (type.compare("int8")==0) {
-		char *sptr = (char *) buffer;
-		for (size_t i=0; i<n; i++) {
-			*dptr++ = (float) *sptr++;
+}
+
+// Convert n elements of raw data to float, swapping bytes if needed. The
+// work is divided into cache sized blocks converted in parallel.
+//
+void convert(
+	const unsigned char *src, string type, bool swap, size_t n, float *dst
+) {
+	const size_t grain = 64 * 1024;
+
+	ThreadPool::Instance()->ParallelFor(0, n, grain,
+		[&](size_t begin, size_t end) {
+		size_t sz = size_of_type(type);
+		const unsigned char *s = src + begin * sz;
+
+		if (type.compare("float32")==0) {
+			convert_block<float, uint32_t>(s, swap, end-begin, dst+begin);
+		}
+		else if (type.compare("float64")==0) {
+			convert_block<double, uint64_t>(s, swap, end-begin, dst+begin);
+		}
+		else if (type.compare("int8")==0) {
+			const signed char *sptr = (const signed char *) s;
+			for (size_t i=0; i<end-begin; i++) {
+				dst[begin+i] = (float) sptr[i];
+			}
 		}
+	});
+}
+
+// A time step of the variable and where its data are found
+//
+struct job_t {
+	string datafile;
+	size_t file_ts;	// time step within the data file
+	size_t ts;		// time step in the VDC
+};
+
+// Opening and closing netCDF files is not thread safe, and time steps
+// may be converted concurrently
+//
+int close_variable(VDCNetCDF &vdc, int fd) {
+	std::lock_guard<std::mutex> guard(WASP::GetNetCDFMutex());
+	return(vdc.CloseVariableWrite(fd));
+}
+
+// Convert one time step, streaming it through WriteSlice() one block
+// aligned slab at a time
+//
+int convert_timestep(
+	VDCNetCDF &vdc, const job_t &job, size_t ntotal, size_t nelements,
+	size_t nslice, float *slab
+) {
+	RawFile file;
+	int rc = file.Open(job.datafile);
+	if (rc<0) return(-1);
+
+	size_t element_sz = size_of_type(opt.type);
+	size_t offset = job.file_ts * ntotal * element_sz;
+
+	int fdr;
+	{
+		std::lock_guard<std::mutex> guard(WASP::GetNetCDFMutex());
+		fdr = vdc.OpenVariableWrite(job.ts, opt.varname, opt.lod);
 	}
+	if (fdr<0) return(-1);
 
-	return(0);
+	for (size_t i=0; i<nslice; i++) {
+		size_t n = nelements < ntotal ? nelements : ntotal;
+
+		const unsigned char *data = file.GetData(offset, n * element_sz);
+		if (! data) {
+			close_variable(vdc, fdr);
+			return(-1);
+		}
+		file.Prefetch(offset + n * element_sz, n * element_sz);
+
+		convert(data, opt.type, opt.swapbytes, n, slab);
+
+		file.Release(offset, n * element_sz);
+		offset += n * element_sz;
+		ntotal -= n;
+
+		rc = vdc.WriteSlice(fdr, slab);
+		if (rc<0) {
+			close_variable(vdc, fdr);
+			return(-1);
+		}
+	}
+
+	return(close_variable(vdc, fdr));
 }
 
 const char	*ProgName;
 
-	
+
 int	main(int argc, char **argv) {
 
 	OptionParser op;
@@ -156,19 +357,31 @@ int	main(int argc, char **argv) {
 	}
 
 	if (opt.help) {
-		cerr << "Usage: " << ProgName << " [options] netcdffile datafile" << endl;
+		cerr << "Usage: " << ProgName << " [options] netcdffile datafile "
+			"[datafile ...]" << endl;
 		op.PrintOptionHelp(stderr);
 		exit(0);
 	}
 
-	if (argc != 3) {
-		cerr << "Usage: " << ProgName << " [options] netcdffile datafile" << endl;
+	if (argc < 3) {
+		cerr << "Usage: " << ProgName << " [options] netcdffile datafile "
+			"[datafile ...]" << endl;
 		op.PrintOptionHelp(stderr);
 		exit(1);
 	}
 
+	if (! size_of_type(opt.type)) {
+		MyBase::SetErrMsg("Invalid type : %s", opt.type.c_str());
+		exit(1);
+	}
+	if (opt.nts < 1) {
+		MyBase::SetErrMsg("Invalid number of time steps : %d", opt.nts);
+		exit(1);
+	}
+
 	string master = argv[1];	// Path to VDC master file
-	string datafile = argv[2];	// Path to raw data file 
+	vector <string> datafiles;	// Paths to raw data files
+	for (int i=2; i<argc; i++) datafiles.push_back(argv[i]);
 
     if (opt.debug) MyBase::SetDiagMsgFilePtr(stderr);
 
@@ -176,6 +389,7 @@ int	main(int argc, char **argv) {
 
 	vector <size_t> bs;
 	int rc = vdc.Initialize(master, vector <string> (), VDC::A, bs,4*1024*1024);
+	if (rc<0) exit(1);
 
 	vector <size_t> hslice_dims;
 	size_t nslice;
@@ -199,32 +413,108 @@ int	main(int argc, char **argv) {
 		ntotal *= dimlens[i];
 	}
 
-	float *slice = new float[nelements];
+	// Time steps stored in the same VDC file are written one after the
+	// other, by the same thread. Distinct files may be written concurrently.
+	//
+	vector <vector <job_t> > groups;
+	vector <string> paths;
+	bool inMaster = false;
+	for (int i=0; i<datafiles.size(); i++) {
+		for (int j=0; j<opt.nts; j++) {
+			job_t job;
+			job.datafile = datafiles[i];
+			job.file_ts = j;
+			job.ts = opt.ts + i*opt.nts + j;
+
+			string path;
+			size_t file_ts, max_ts;
+			rc = vdc.GetPath(opt.varname, job.ts, path, file_ts, max_ts);
+			if (rc<0) exit(1);
+			if (path == master) inMaster = true;
+
+			vector <string>::iterator itr = find(
+				paths.begin(), paths.end(), path
+			);
+			if (itr == paths.end()) {
+				paths.push_back(path);
+				groups.push_back(vector <job_t> ());
+				itr = paths.end() - 1;
+			}
+			groups[itr - paths.begin()].push_back(job);
+		}
+	}
 
-	FILE *fp = fopen(datafile.c_str(), "r");
-	if (! fp) {
-		MyBase::SetErrMsg("fopen(%s) : %M", datafile.c_str());
-		exit(1);
+	// Each time step in progress holds a slab of converted data, and
+	// the VDC holds about as much again while compressing it
+	//
+	size_t slab_bytes = nelements * sizeof(float);
+	size_t memsize = (size_t) std::max(opt.memsize, 1) * 1024 * 1024;
+	size_t nworkers = std::max(memsize / (3 * slab_bytes), (size_t) 1);
+	nworkers = std::min(nworkers, groups.size());
+	nworkers = std::min(nworkers, (size_t) std::max(EasyThreads::NProc(), 1));
+
+	// Variables stored in the master file can't be written concurrently
+	//
+	if (inMaster) nworkers = 1;
+
+	if (nworkers == 1) {
+		float *slab = new float[nelements];
+		for (int i=0; i<groups.size(); i++) {
+			for (int j=0; j<groups[i].size(); j++) {
+				rc = convert_timestep(
+					vdc, groups[i][j], ntotal, nelements, nslice, slab
+				);
+				if (rc<0) exit(1);
+			}
+		}
+		delete [] slab;
+		exit(0);
 	}
 
-	int fdr = vdc.OpenVariableWrite(opt.ts, opt.varname, opt.lod);
-	if (fdr<0) exit(1);
+	// Each thread writes through its own VDC since a VDC may not be
+	// written by more than one thread at a time
+	//
+	std::atomic <size_t> next(0);
+	std::atomic <bool> failed(false);
+
+	auto task = [&]() {
+		std::mutex &ncmutex = WASP::GetNetCDFMutex();
+
+		ncmutex.lock();
+		VDCNetCDF *myvdc = new VDCNetCDF(opt.nthreads);
+		vector <size_t> mybs;
+		int rc = myvdc->Initialize(
+			master, vector <string> (), VDC::A, mybs, 4*1024*1024
+		);
+		ncmutex.unlock();
+		if (rc<0) {
+			failed = true;
+		}
 
-	for (size_t i=0; i<nslice; i++) {
-		nelements = nelements < ntotal ? nelements : ntotal;
-		int rc = read_data(fp, opt.type, opt.swapbytes, nelements, slice);
-		if (rc<0) exit(1);
+		vector <float> slab(nelements);
+		size_t i;
+		while (! failed && (i = next++) < groups.size()) {
+			for (int j=0; j<groups[i].size() && ! failed; j++) {
+				rc = convert_timestep(
+					*myvdc, groups[i][j], ntotal, nelements, nslice, slab.data()
+				);
+				if (rc<0) failed = true;
+			}
+		}
 
-		ntotal -= nelements;
+		ncmutex.lock();
+		delete myvdc;
+		ncmutex.unlock();
+	};
 
-		rc = vdc.WriteSlice(fdr, slice);
-		if (rc<0) exit(1);
+	ThreadPool pool(nworkers);
+	ThreadPool::TaskGroup group(&pool);
+	for (int i=0; i<nworkers; i++) {
+		group.Run(task);
 	}
+	group.Wait();
 
-	rc = vdc.CloseVariableWrite(fdr);
-	if (rc<0) exit(1);
+	if (failed) exit(1);
 
-	fclose(fp);
-	
 	exit(0);
 }
@@ -0,0 +1,498 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#include <GL/glew.h>
+#include <GL/osmesa.h>
+
+#include <vapor/OptionParser.h>
+#include <vapor/CFuncs.h>
+#include <vapor/XmlNode.h>
+#include <vapor/ParamsMgr.h>
+#include <vapor/ViewpointParams.h>
+#include <vapor/RenderParams.h>
+#include <vapor/DataStatus.h>
+#include <vapor/GLManager.h>
+#include <vapor/LegacyGL.h>
+#include <vapor/ControlExecutive.h>
+
+using namespace Wasp;
+using namespace VAPoR;
+using namespace std;
+
+struct opt_t {
+	int width;
+	int height;
+	int ts0;
+	int ts1;
+	int nprocs;
+	int nthreads;
+	int cachesize;
+	string output;
+	string viz;
+	string dataset;
+	string ftype;
+	OptionParser::Boolean_T	quiet;
+	OptionParser::Boolean_T	help;
+} opt;
+
+OptionParser::OptDescRec_T	set_opts[] = {
+	{
+		"width", 1, "0", "Image width in pixels. Zero (the default) "
+		"uses the window size saved in the session"
+	},
+	{
+		"height", 1, "0", "Image height in pixels. Zero (the default) "
+		"uses the window size saved in the session"
+	},
+	{"ts0", 1, "0", "First time step to render"},
+	{
+		"ts1", 1, "-1", "Last time step to render. Default (-1) renders "
+		"through the last time step"
+	},
+	{
+		"nprocs", 1, "1", "Number of rendering processes. Each process "
+		"has its own offscreen context and renders a contiguous range of "
+		"time steps"
+	},
+	{
+		"nthreads", 1, "0", "Specify number of execution threads per "
+		"process. 0 => use number of cores"
+	},
+	{"cachesize", 1, "1000", "Data cache size per process in megabytes"},
+	{
+		"output", 1, "vapor.png", "Output image file. The zero padded "
+		"time step is inserted before the suffix, which selects the image "
+		"format (.png, .jpg, or .tif)"
+	},
+	{
+		"viz", 1, "", "Name of the visualizer to render. Default is the "
+		"first visualizer in the session"
+	},
+	{
+		"dataset", 1, "", "Name the session uses for the data set given "
+		"on the command line. Required if data files are given"
+	},
+	{"ftype", 1, "vdc", "Data set type: vdc, wrf, cf, or mpas"},
+	{"quiet", 0, "", "Don't print the names of the images written"},
+	{"help", 0, "", "Print this message and exit"},
+	{NULL}
+};
+
+OptionParser::Option_T	get_options[] = {
+	{"width",	Wasp::CvtToInt,		&opt.width,		sizeof(opt.width)},
+	{"height",	Wasp::CvtToInt,		&opt.height,	sizeof(opt.height)},
+	{"ts0",		Wasp::CvtToInt,		&opt.ts0,		sizeof(opt.ts0)},
+	{"ts1",		Wasp::CvtToInt,		&opt.ts1,		sizeof(opt.ts1)},
+	{"nprocs",	Wasp::CvtToInt,		&opt.nprocs,	sizeof(opt.nprocs)},
+	{"nthreads",Wasp::CvtToInt,		&opt.nthreads,	sizeof(opt.nthreads)},
+	{"cachesize",Wasp::CvtToInt,	&opt.cachesize,	sizeof(opt.cachesize)},
+	{"output",	Wasp::CvtToCPPStr,	&opt.output,	sizeof(opt.output)},
+	{"viz",		Wasp::CvtToCPPStr,	&opt.viz,		sizeof(opt.viz)},
+	{"dataset",	Wasp::CvtToCPPStr,	&opt.dataset,	sizeof(opt.dataset)},
+	{"ftype",	Wasp::CvtToCPPStr,	&opt.ftype,		sizeof(opt.ftype)},
+	{"quiet",	Wasp::CvtToBoolean,	&opt.quiet,		sizeof(opt.quiet)},
+	{"help",	Wasp::CvtToBoolean,	&opt.help,		sizeof(opt.help)},
+	{NULL}
+};
+
+string ProgName;
+
+// A data set to be opened, either recorded in the session or given
+// on the command line
+//
+struct dataset_t {
+	string name;
+	string format;
+	vector <string> paths;
+};
+
+void find_nodes(XmlNode *node, string tag, vector <XmlNode *> &nodes) {
+	if (node->GetTag() == tag) nodes.push_back(node);
+	for (int i=0; i<node->GetNumChildren(); i++) {
+		find_nodes(node->GetChild(i), tag, nodes);
+	}
+}
+
+XmlNode *find_element(XmlNode *node, string tag) {
+	if (node->HasElementString(tag)) return(node);
+	for (int i=0; i<node->GetNumChildren(); i++) {
+		XmlNode *n = find_element(node->GetChild(i), tag);
+		if (n) return(n);
+	}
+	return(NULL);
+}
+
+// The data sets open when a session was saved are recorded by the GUI's
+// state params, which aren't available outside of the GUI. Read them
+// directly from the session file.
+//
+int session_datasets(string sessionFile, vector <dataset_t> &datasets) {
+	datasets.clear();
+
+	XmlParser parser;
+	XmlNode root;
+	int rc = parser.LoadFromFile(&root, sessionFile);
+	if (rc<0) {
+		MyBase::SetErrMsg("Invalid session file : %s", sessionFile.c_str());
+		return(-1);
+	}
+
+	vector <XmlNode *> nodes;
+	find_nodes(&root, "GUIStateParams", nodes);
+	if (nodes.empty() || ! nodes[0]->HasChild("OpenDataSetsTag")) return(0);
+
+	XmlNode *openDataSets = nodes[0]->GetChild("OpenDataSetsTag");
+	for (int i=0; i<openDataSets->GetNumChildren(); i++) {
+		XmlNode *sep = openDataSets->GetChild(i);
+		XmlNode *node = find_element(sep, "DataSetFormatTag");
+		if (! node) continue;
+
+		dataset_t ds;
+		ds.name = sep->GetTag();
+		ds.format = node->GetElementString("DataSetFormatTag");
+		if (node->HasElementString("DataSetPathsTag")) {
+			node->GetElementStringVec("DataSetPathsTag", ds.paths);
+		}
+		ds.paths.erase(
+			std::remove(ds.paths.begin(), ds.paths.end(), "NULL"),
+			ds.paths.end()
+		);
+		datasets.push_back(ds);
+	}
+	return(0);
+}
+
+// Insert the zero padded time step before the file name suffix
+//
+string frame_name(string output, size_t ts) {
+	char buf[32];
+	sprintf(buf, "%04d", (int) ts);
+
+	size_t dot = output.find_last_of('.');
+	size_t slash = output.find_last_of("/\\");
+	if (dot == string::npos || (slash != string::npos && dot < slash)) {
+		return(output + buf);
+	}
+	return(output.substr(0, dot) + buf + output.substr(dot));
+}
+
+// Create an offscreen context rendering into buffer. A 3.3
+// compatibility profile is requested where OSMesa supports choosing
+// one; the renderers use both shaders and legacy GL.
+//
+OSMesaContext create_context(
+	int width, int height, vector <GLubyte> &buffer
+) {
+	OSMesaContext ctx = NULL;
+
+#ifdef OSMESA_CONTEXT_MAJOR_VERSION
+	const int attribs[] = {
+		OSMESA_FORMAT, OSMESA_RGBA,
+		OSMESA_DEPTH_BITS, 24,
+		OSMESA_STENCIL_BITS, 8,
+		OSMESA_PROFILE, OSMESA_COMPAT_PROFILE,
+		OSMESA_CONTEXT_MAJOR_VERSION, 3,
+		OSMESA_CONTEXT_MINOR_VERSION, 3,
+		0
+	};
+	ctx = OSMesaCreateContextAttribs(attribs, NULL);
+#endif
+	if (! ctx) ctx = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, NULL);
+	if (! ctx) {
+		MyBase::SetErrMsg("Failed to create offscreen OpenGL context");
+		return(NULL);
+	}
+
+	buffer.resize((size_t) width * (size_t) height * 4);
+	if (! OSMesaMakeCurrent(ctx, buffer.data(), GL_UNSIGNED_BYTE, width, height)) {
+		MyBase::SetErrMsg("Failed to make offscreen OpenGL context current");
+		OSMesaDestroyContext(ctx);
+		return(NULL);
+	}
+
+	// OSMesa's default origin is the lower left, as glReadPixels expects
+	//
+	OSMesaPixelStore(OSMESA_Y_UP, 1);
+	return(ctx);
+}
+
+// Set the current time step of every renderer on the visualizer. Each
+// data set has its own time coordinates, so the global time step is
+// mapped to the data set's local one.
+//
+void set_timestep(ControlExec *ce, string viz, size_t ts) {
+	ParamsMgr *paramsMgr = ce->GetParamsMgr();
+	DataStatus *dataStatus = ce->GetDataStatus();
+
+	vector <string> dataSetNames = dataStatus->GetDataMgrNames();
+	for (int i=0; i<dataSetNames.size(); i++) {
+		size_t local_ts = dataStatus->MapGlobalToLocalTimeStep(
+			dataSetNames[i], ts
+		);
+
+		vector <RenderParams *> rParams;
+		paramsMgr->GetRenderParams(viz, dataSetNames[i], rParams);
+		for (int j=0; j<rParams.size(); j++) {
+			rParams[j]->SetCurrentTimestep(local_ts);
+		}
+	}
+}
+
+// Return true if any renderer of the visualizer selects its own 
+// refinement level (see RenderParams::SetAutoLevel())
+//
+bool auto_level(ControlExec *ce, string viz) {
+	ParamsMgr *paramsMgr = ce->GetParamsMgr();
+	DataStatus *dataStatus = ce->GetDataStatus();
+
+	vector <string> dataSetNames = dataStatus->GetDataMgrNames();
+	for (int i=0; i<dataSetNames.size(); i++) {
+		vector <RenderParams *> rParams;
+		paramsMgr->GetRenderParams(viz, dataSetNames[i], rParams);
+		for (int j=0; j<rParams.size(); j++) {
+			if (rParams[j]->GetAutoLevel()) return(true);
+		}
+	}
+	return(false);
+}
+
+// Render this process's share of the time steps. Processes are
+// numbered 0..nprocs-1 and each renders a contiguous range, which
+// keeps consecutive time steps (and any read ahead) in one process.
+//
+int render(
+	string sessionFile, const vector <dataset_t> &datasets,
+	int rank, int nprocs
+) {
+	ControlExec *ce = new ControlExec(
+		vector <string> (), vector <string> (), opt.cachesize, opt.nthreads
+	);
+
+	int rc = ce->LoadState(sessionFile);
+	if (rc<0) {
+		delete ce;
+		return(-1);
+	}
+
+	for (int i=0; i<datasets.size(); i++) {
+		rc = ce->OpenData(
+			datasets[i].paths, vector <string> (), datasets[i].name,
+			datasets[i].format
+		);
+		if (rc<0) {
+			delete ce;
+			return(-1);
+		}
+	}
+
+	string viz = opt.viz;
+	if (viz.empty()) {
+		vector <string> vizNames = ce->GetVisualizerNames();
+		if (vizNames.empty()) {
+			MyBase::SetErrMsg("No visualizers in session");
+			delete ce;
+			return(-1);
+		}
+		viz = vizNames[0];
+	}
+
+	ParamsMgr *paramsMgr = ce->GetParamsMgr();
+	ViewpointParams *vpParams = paramsMgr->GetViewpointParams(viz);
+	if (! vpParams) {
+		MyBase::SetErrMsg("Invalid visualizer : %s", viz.c_str());
+		delete ce;
+		return(-1);
+	}
+
+	size_t width, height;
+	vpParams->GetWindowSize(width, height);
+	if (opt.width > 0) width = opt.width;
+	if (opt.height > 0) height = opt.height;
+
+	vector <GLubyte> buffer;
+	OSMesaContext ctx = create_context(width, height, buffer);
+	if (! ctx) {
+		delete ce;
+		return(-1);
+	}
+
+	GLManager *glManager = new GLManager();
+	rc = ce->InitializeViz(viz, glManager);
+	if (rc == 0) {
+		glManager->legacy->Initialize();
+		rc = ce->ResizeViz(viz, width, height);
+	}
+
+	bool enabled = ce->GetSaveStateEnabled();
+	ce->SetSaveStateEnabled(false);
+	vpParams->SetWindowSize(width, height);
+
+	long nts = (long) ce->GetDataStatus()->GetTimeCoordinates().size();
+	long ts0 = std::max(0L, (long) opt.ts0);
+	long ts1 = opt.ts1 < 0 ? nts - 1 : std::min((long) opt.ts1, nts - 1);
+
+	long n = std::max(0L, ts1 - ts0 + 1);
+	long first = ts0 + n * rank / nprocs;
+	long last = ts0 + n * (rank + 1) / nprocs;
+
+	bool refine = auto_level(ce, viz);
+
+	for (long ts = first; ts < last && rc == 0; ts++) {
+		set_timestep(ce, viz, ts);
+
+		// Renderers that select their own level may draw a new time step
+		// coarser than the display warrants, refining on later paints.
+		// Only the fully refined image is captured.
+		//
+		if (refine) {
+			rc = ce->Paint(viz, false);
+			while (rc == 0 && ce->NeedsRefinement(viz)) {
+				rc = ce->Paint(viz, false);
+			}
+			if (rc<0) break;
+		}
+
+		string file = frame_name(opt.output, ts);
+		rc = ce->EnableImageCapture(file, viz);
+		if (rc == 0 && ! opt.quiet) cout << file << endl;
+	}
+
+	ce->SetSaveStateEnabled(enabled);
+
+	// Deleting the ControlExec waits for queued images to be written
+	//
+	delete ce;
+	delete glManager;
+	OSMesaDestroyContext(ctx);
+
+	return(rc);
+}
+
+int	main(int argc, char **argv) {
+
+	OptionParser op;
+
+	MyBase::SetErrMsgFilePtr(stderr);
+	//
+	// Parse command line arguments
+	//
+	ProgName = Basename(argv[0]);
+
+	if (op.AppendOptions(set_opts) < 0) {
+		exit(1);
+	}
+
+	if (op.ParseOptions(&argc, argv, get_options) < 0) {
+		exit(1);
+	}
+
+	if (argc < 2 || opt.help) {
+		cerr << "Usage: " << ProgName << " [options] session_file [data_files...]" << endl;
+		cerr << "Valid file types: vdc, wrf, cf, mpas" << endl;
+		op.PrintOptionHelp(stderr, 80, false);
+		exit(1);
+	}
+
+	argc--;
+	argv++;
+
+	string sessionFile = argv[0];
+	argc--;
+	argv++;
+
+	vector <string> files;
+	while (*argv) {
+		files.push_back(*argv);
+		argv++;
+	}
+
+	// Data files given on the command line replace the paths recorded
+	// in the session for the named data set, so a session saved on one
+	// machine can be rendered against data stored elsewhere
+	//
+	vector <dataset_t> datasets;
+	if (session_datasets(sessionFile, datasets) < 0) exit(1);
+
+	if (! files.empty()) {
+		if (opt.dataset.empty()) {
+			if (datasets.size() != 1) {
+				MyBase::SetErrMsg("Data set name (-dataset) required");
+				exit(1);
+			}
+			opt.dataset = datasets[0].name;
+		}
+
+		dataset_t ds;
+		ds.name = opt.dataset;
+		ds.format = opt.ftype;
+		ds.paths = files;
+
+		bool found = false;
+		for (int i=0; i<datasets.size(); i++) {
+			if (datasets[i].name == ds.name) {
+				datasets[i] = ds;
+				found = true;
+			}
+		}
+		if (! found) datasets.push_back(ds);
+	}
+
+	if (datasets.empty()) {
+		MyBase::SetErrMsg("No data sets in session or on command line");
+		exit(1);
+	}
+
+	int nprocs = std::max(1, opt.nprocs);
+
+#ifdef WIN32
+	nprocs = 1;
+#endif
+
+	if (nprocs == 1) {
+		return(render(sessionFile, datasets, 0, 1) < 0 ? 1 : 0);
+	}
+
+#ifndef WIN32
+
+	// Neither the ControlExec nor the embedded Python interpreter may be
+	// shared between threads, so time steps are rendered in parallel by
+	// separate processes, each with its own context. Nothing is opened
+	// before forking.
+	//
+	vector <pid_t> pids;
+	for (int rank=0; rank<nprocs; rank++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			MyBase::SetErrMsg("fork() : %M");
+			break;
+		}
+		if (pid == 0) {
+			int rc = render(sessionFile, datasets, rank, nprocs);
+			_exit(rc < 0 ? 1 : 0);
+		}
+		pids.push_back(pid);
+	}
+
+	int status = pids.size() == nprocs ? 0 : 1;
+	for (int i=0; i<pids.size(); i++) {
+		int wstatus;
+		if (waitpid(pids[i], &wstatus, 0) < 0) {
+			status = 1;
+			continue;
+		}
+		if (! WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) status = 1;
+	}
+	return(status);
+#endif
+}
@@ -2397,7 +2397,7 @@ void MainForm::startAnimCapture()
 	//Turn on "image capture mode" in the current active visualizer
 	GUIStateParams *p = GetStateParams();
 	string vizName = p->GetActiveVizName();
-	_controlExec->EnableAnimationCapture(vizName, true, fpath);
+	_vizWinMgr->EnableAnimationCapture(vizName, true, fpath);
 	_capturingAnimationVizName = vizName;
 
 	_captureEndJpegCaptureAction->setEnabled(true);
@@ -2415,7 +2415,7 @@ void MainForm::endAnimCapture(){
 	if (vizName != _capturingAnimationVizName){
 		MSG_WARN("Terminating capture in non-active visualizer");
 	}
-	if (_controlExec->EnableAnimationCapture(_capturingAnimationVizName, false))
+	if (_vizWinMgr->EnableAnimationCapture(_capturingAnimationVizName, false))
 		MSG_WARN("Image Capture Warning;\nCurrent active visualizer is not capturing images");
 	
 	_capturingAnimationVizName = "";
@@ -26,6 +26,7 @@
 #include <QMouseEvent>
 #include <QCloseEvent>
 #include <QIcon>
+#include <QTimer>
 #include <vapor/ControlExecutive.h>
 #include <vapor/ViewpointParams.h>
 #include <vapor/Viewpoint.h>
@@ -614,6 +615,17 @@ void VizWin::Render(bool fast) {
     _glManager->matrixManager->PopMatrix();
 	_glManager->matrixManager->MatrixModeModelView();
     _glManager->matrixManager->PopMatrix();
+
+	// Keep repainting while the camera is idle until renderers using
+	// automatic level selection have reached their target resolution
+	//
+	if (! fast && ! _mouseClicked && _controlExec->NeedsRefinement(_winName)) {
+		QTimer::singleShot(0, this, SLOT(_refine()));
+	}
+}
+
+void VizWin::_refine() {
+	Render(false);
 }
 
 VAPoR::RenderParams* VizWin::_getRenderParams() {
@@ -102,6 +102,11 @@ signals:
 public slots:
 	virtual void setFocus();
 
+private slots:
+	// Repaint to progressively refine a scene drawn at reduced resolution
+	//
+	void _refine();
+
 private:
 	VizWin() {}
 
@@ -350,10 +350,23 @@ void VizWinMgr::Update(bool fast){
 
 int VizWinMgr::EnableImageCapture(string filename, string winName)
 {
-    _vizWindow[winName]->makeCurrent();
+	// If there is no such window the ControlExec reports the error
+	//
+	std::map<string, VizWin*>::iterator itr = _vizWindow.find(winName);
+	if (itr != _vizWindow.end()) itr->second->makeCurrent();
+
     return _controlExec->EnableImageCapture(filename, winName);
 }
 
+int VizWinMgr::EnableAnimationCapture(
+	string winName, bool doEnable, string filename
+) {
+	std::map<string, VizWin*>::iterator itr = _vizWindow.find(winName);
+	if (itr != _vizWindow.end()) itr->second->makeCurrent();
+
+    return _controlExec->EnableAnimationCapture(winName, doEnable, filename);
+}
+
 void VizWinMgr::Shutdown() {
 
 	vector <string> vizNames = _getVisualizerNames();
@@ -82,6 +82,11 @@ public:
  //! \copydoc VAPoR::ControlExec::EnableImageCapture()
  int EnableImageCapture(string filename, string winName);
 
+ //! \copydoc VAPoR::ControlExec::EnableAnimationCapture()
+ int EnableAnimationCapture(
+	string winName, bool doEnable, string filename = ""
+ );
+
 public slots:
 
  //! Method launches a new visualizer, sets up appropriate
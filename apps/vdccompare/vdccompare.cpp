@@ -3,9 +3,18 @@
 #include <string.h>
 #include <vector>
 #include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
 
 #include <vapor/OptionParser.h>
 #include <vapor/CFuncs.h>
+#include <vapor/EasyThreads.h>
+#include <vapor/ThreadPool.h>
+#include <vapor/WASP.h>
 #include <vapor/VDCNetCDF.h>
 #include <vapor/DCWRF.h>
 #include <vapor/DCCF.h>
@@ -18,7 +27,10 @@ using namespace VAPoR;
 struct opt_t {
 	int nthreads;
 	int numts;
+	int tilesize;
     std::vector <string> vars;
+	string json;
+	OptionParser::Boolean_T	finest;
 	OptionParser::Boolean_T	quiet;
 	OptionParser::Boolean_T	help;
 } opt;
@@ -38,6 +50,21 @@ OptionParser::OptDescRec_T	set_opts[] = {
 		"to be included in "
 		"the VDC"
 	},
+	{
+		"tilesize",    1,  "4194304",    "Maximum number of grid points "
+		"read at once by each thread from each data collection. Regions are "
+		"aligned to the storage blocks"
+	},
+	{
+		"json",	1,	"",	"Write the full report as JSON to this file "
+		"(\"-\" for the standard output)"
+	},
+	{
+		"finest",	0,	"",	"Only compare the finest refinement level "
+		"and level of detail. By default every refinement level common to "
+		"both data collections is compared at every level of detail of the "
+		"secondary data collection"
+	},
 	{"quiet",	0,	"",	"Don't print individual variable results"},
 	{"help",	0,	"",	"Print this message and exit"},
 	{NULL}
@@ -47,7 +74,10 @@ OptionParser::OptDescRec_T	set_opts[] = {
 OptionParser::Option_T	get_options[] = {
 	{"nthreads",Wasp::CvtToInt,		&opt.nthreads,	sizeof(opt.nthreads)},
 	{"numts",	Wasp::CvtToInt,		&opt.numts,		sizeof(opt.numts)},
+	{"tilesize",Wasp::CvtToInt,		&opt.tilesize,	sizeof(opt.tilesize)},
 	{"vars",	Wasp::CvtToStrVec,	&opt.vars,		sizeof(opt.vars)},
+	{"json",	Wasp::CvtToCPPStr,	&opt.json,		sizeof(opt.json)},
+	{"finest",	Wasp::CvtToBoolean,	&opt.finest,	sizeof(opt.finest)},
 	{"quiet",	Wasp::CvtToBoolean,	&opt.quiet,		sizeof(opt.quiet)},
 	{"help",	Wasp::CvtToBoolean,	&opt.help,		sizeof(opt.help)},
 	{NULL}
@@ -55,9 +85,9 @@ OptionParser::Option_T	get_options[] = {
 
 string ProgName;
 
-DC *DCCreate(string ftype) {
+DC *DCCreate(string ftype, int nthreads) {
 	if (ftype.compare("vdc") == 0) {
-		return(new VDCNetCDF(opt.nthreads));
+		return(new VDCNetCDF(nthreads));
 	} else if (ftype.compare("wrf") == 0) {
 		return(new DCWRF());
 	}
@@ -73,83 +103,396 @@ DC *DCCreate(string ftype) {
 	}
 }
 
-float *Buffer1;
-size_t BufSize1 = 0;
-float *Buffer2;
-size_t BufSize2 = 0;
+// Error statistics accumulated over any number of regions. Differences
+// are secondary minus source.
+//
+struct stats_t {
+	size_t count;		// points valid in both
+	size_t mismatch;	// points missing in exactly one
+	size_t missing;		// points missing in both
+	double sum_diff;
+	double sum_sq;
+	double linf;
+	double min;			// range of the valid source values
+	double max;
+
+	stats_t() {
+		count = mismatch = missing = 0;
+		sum_diff = sum_sq = linf = 0.0;
+		min = std::numeric_limits<double>::max();
+		max = -std::numeric_limits<double>::max();
+	}
+
+	void merge(const stats_t &s) {
+		count += s.count;
+		mismatch += s.mismatch;
+		missing += s.missing;
+		sum_diff += s.sum_diff;
+		sum_sq += s.sum_sq;
+		linf = std::max(linf, s.linf);
+		min = std::min(min, s.min);
+		max = std::max(max, s.max);
+	}
 
-void computeLMax(
-	const float *buf1, const float *buf2, size_t nelements, 
-	double &lmax, double &min, double &max
+	double range() const { return(count ? max - min : 0.0); }
+	double rmse() const { return(count ? sqrt(sum_sq / count) : 0.0); }
+	double bias() const { return(count ? sum_diff / count : 0.0); }
+	double nlinf() const { return(range() != 0.0 ? linf / range() : linf); }
+
+	// Infinite if the data are identical
+	//
+	double psnr() const {
+		double r = rmse();
+		if (r == 0.0) return(std::numeric_limits<double>::infinity());
+		return(20.0 * log10(range() / r));
+	}
+};
+
+// A variable compared at one refinement level and level of detail
+//
+struct group_t {
+	string varname;
+	int level;		// refinement level, counted from the finest (-1)
+	int lod1;		// source level of detail
+	int lod2;		// secondary level of detail
+	size_t nts;
+	vector <size_t> dims;
+	vector <size_t> tile;	// dimensions of the regions read
+	bool has_mv1, has_mv2;
+	double mv1, mv2;
+	stats_t stats;
+	string error;
+};
+
+// One region of one time step of a group
+//
+struct item_t {
+	size_t group;
+	size_t ts;
+	vector <size_t> min;
+	vector <size_t> max;
+};
+
+// Choose block aligned region dimensions of at most maxsize points,
+// growing from a single block along the fastest varying axis first so
+// regions are contiguous in storage
+//
+vector <size_t> tile_dims(
+	const vector <size_t> &dims, const vector <size_t> &bs, size_t maxsize
 ) {
-	lmax = 0.0;
-	min = 0.0;
-	max = 0.0;
-	if (nelements < 1) return;
-
-	min = max = *buf1;
-	
-	for (size_t i=0; i<nelements; i++) {
-		if (min > buf1[i]) {
-			min = buf1[i];
-		}
-		if (max < buf1[i]) {
-			max = buf1[i];
-		}
+	vector <size_t> tile(dims.size(), 1);
+	for (int i=0; i<dims.size(); i++) {
+		if (i < bs.size() && bs[i] > 0) tile[i] = std::min(bs[i], dims[i]);
+	}
 
-		double diff = fabs(buf1[i] - buf2[i]);
-		if (diff > lmax) {
-			lmax = diff;
+	for (int i=0; i<dims.size(); i++) {
+		size_t others = 1;
+		for (int j=0; j<dims.size(); j++) {
+			if (j != i) others *= tile[j];
+		}
+		size_t step = tile[i];
+		while (tile[i] < dims[i] && (tile[i] + step) * others <= maxsize) {
+			tile[i] = std::min(tile[i] + step, dims[i]);
 		}
+		if (tile[i] < dims[i]) break;
 	}
+	return(tile);
 }
 
-bool compare(DC *dc1, DC *dc2, size_t nts, string varname, double &nlmax_all) {
-
-	vector <size_t> dims, bs;
-	int rc = dc1->GetDimLensAtLevel(varname, -1, dims, bs);
-	if (rc<0) return(false);
+void make_items(
+	const group_t &g, size_t gidx, vector <item_t> &items
+) {
+	int n = g.dims.size();
+	vector <size_t> ntiles(n);
+	size_t total = 1;
+	for (int i=0; i<n; i++) {
+		ntiles[i] = (g.dims[i] + g.tile[i] - 1) / g.tile[i];
+		total *= ntiles[i];
+	}
 
-	vector <size_t> dims2, bs2;
-	rc = dc2->GetDimLensAtLevel(varname, -1, dims2, bs2);
-	if (rc<0) return(false);
+	for (size_t ts=0; ts<g.nts; ts++) {
+		for (size_t t=0; t<total; t++) {
+			item_t item;
+			item.group = gidx;
+			item.ts = ts;
+			size_t idx = t;
+			for (int i=0; i<n; i++) {
+				size_t c = idx % ntiles[i];
+				idx /= ntiles[i];
+				item.min.push_back(c * g.tile[i]);
+				item.max.push_back(
+					std::min((c+1) * g.tile[i], g.dims[i]) - 1
+				);
+			}
+			items.push_back(item);
+		}
+	}
+}
 
-	assert(dims == dims2);
+// Set up the groups of variable varname to compare
+//
+bool make_groups(
+	DC *dc1, DC *dc2, string varname, size_t nts, vector <group_t> &groups
+) {
+	DC::DataVar dvar1, dvar2;
+	if (! dc1->GetDataVarInfo(varname, dvar1)) {
+		MyBase::SetErrMsg("Undefined variable : %s", varname.c_str());
+		return(false);
+	}
+	if (! dc2->GetDataVarInfo(varname, dvar2)) {
+		MyBase::SetErrMsg("Undefined variable : %s", varname.c_str());
+		return(false);
+	}
 
-	size_t nelements = 1;
-	for (int i=0; i<dims.size(); i++) {
-		nelements *= dims[i];
+	// Levels are matched counting from the finest
+	//
+	int nlevels = std::min(
+		dc1->GetNumRefLevels(varname), dc2->GetNumRefLevels(varname)
+	);
+	int nlods = dvar2.GetCRatios().size();
+	if (nlevels < 1) nlevels = 1;
+	if (nlods < 1) nlods = 1;
+	if (opt.finest) {
+		nlevels = 1;
+		nlods = 1;
 	}
 
-	if (BufSize1 < nelements) {
-		if (Buffer1) delete [] Buffer1;
-		Buffer1 = new float[nelements];
-		BufSize1 = nelements;
-		if (Buffer2) delete [] Buffer2;
-		Buffer2 = new float[nelements];
-		BufSize2 = nelements;
+	for (int l=0; l<nlevels; l++) {
+		for (int d=0; d<nlods; d++) {
+			group_t g;
+			g.varname = varname;
+			g.level = -1 - l;
+			g.lod1 = -1;
+			g.lod2 = -1 - d;
+			g.nts = nts;
+			g.has_mv1 = dvar1.GetHasMissing();
+			g.has_mv2 = dvar2.GetHasMissing();
+			g.mv1 = dvar1.GetMissingValue();
+			g.mv2 = dvar2.GetMissingValue();
+
+			vector <size_t> bs1, dims2, bs2;
+			int rc = dc1->GetDimLensAtLevel(varname, g.level, g.dims, bs1);
+			if (rc<0) return(false);
+
+			rc = dc2->GetDimLensAtLevel(varname, g.level, dims2, bs2);
+			if (rc<0) return(false);
+
+			if (g.dims != dims2) {
+				g.error = "dimensions differ";
+				g.nts = 0;
+			}
+
+			// Prefer the secondary's blocking, typically the compressed
+			// data
+			//
+			g.tile = tile_dims(g.dims, bs2.size() ? bs2 : bs1, opt.tilesize);
+
+			groups.push_back(g);
+		}
 	}
+	return(true);
+}
 
-	nlmax_all = 0.0;
-	for (int ts = 0; ts<nts; ts++) {
-		rc = dc1->GetVar(ts, varname, -1, -1, Buffer1);
-		if (rc<0) return(false);
+// The NetCDF library is not thread safe, so every call that reaches it
+// is made holding the NetCDF mutex. A VDC reads its data through WASP,
+// which takes the mutex itself, so only its open and close are locked
+// here. Other formats read with plain NetCDF calls and hold the mutex
+// for the whole read.
+//
+int read_region(
+	DC *dc, bool lockRead, size_t ts, string varname, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	std::mutex &ncmutex = WASP::GetNetCDFMutex();
 
-		rc = dc2->GetVar(ts, varname, -1, -1, Buffer2);
-		if (rc<0) return(false);
+	std::unique_lock <std::mutex> lock(ncmutex);
+	int fd = dc->OpenVariableRead(ts, varname, level, lod);
+	if (fd<0) return(-1);
 
-		double lmax, min, max;
-		computeLMax(Buffer1, Buffer2, nelements, lmax, min, max);
-		if ((max - min) != 0.0) {
-			lmax /= (max-min);
+	if (! lockRead) lock.unlock();
+	int rc = dc->ReadRegion(fd, min, max, region);
+	if (! lockRead) lock.lock();
+
+	dc->CloseVariable(fd);
+	return(rc);
+}
+
+void compare_region(
+	const group_t &g, const float *buf1, const float *buf2, size_t n,
+	stats_t &s
+) {
+	for (size_t i=0; i<n; i++) {
+		bool missing1 = g.has_mv1 && buf1[i] == (float) g.mv1;
+		bool missing2 = g.has_mv2 && buf2[i] == (float) g.mv2;
+		if (missing1 || missing2) {
+			if (missing1 && missing2) s.missing++;
+			else s.mismatch++;
+			continue;
 		}
-		if (lmax > nlmax_all) {
-			nlmax_all = lmax;
+
+		double v1 = buf1[i];
+		double diff = (double) buf2[i] - v1;
+
+		s.count++;
+		s.sum_diff += diff;
+		s.sum_sq += diff * diff;
+		if (fabs(diff) > s.linf) s.linf = fabs(diff);
+		if (v1 < s.min) s.min = v1;
+		if (v1 > s.max) s.max = v1;
+	}
+}
+
+// Compare all items. Each task opens its own pair of data collections
+// since a DC may not be read by more than one thread at a time. See
+// read_region() for how NetCDF calls are serialized.
+//
+bool compare(
+	string ftype1, const vector <string> &files1,
+	string ftype2, const vector <string> &files2,
+	vector <group_t> &groups, const vector <item_t> &items, int nthreads
+) {
+	std::atomic <size_t> next(0);
+	std::atomic <bool> failed(false);
+	std::mutex mutex;
+
+	// Threads left over go to decompression within each DC
+	//
+	int dcthreads = std::max(1, EasyThreads::NProc() / nthreads);
+
+	bool lockRead1 = ftype1 != "vdc";
+	bool lockRead2 = ftype2 != "vdc";
+
+	auto task = [&]() {
+		std::unique_lock <std::mutex> nclock(WASP::GetNetCDFMutex());
+		DC *dc1 = DCCreate(ftype1, dcthreads);
+		DC *dc2 = DCCreate(ftype2, dcthreads);
+		bool ok = dc1 && dc2 &&
+			dc1->Initialize(files1, vector <string> ()) >= 0 &&
+			dc2->Initialize(files2, vector <string> ()) >= 0;
+		nclock.unlock();
+
+		vector <float> buf1, buf2;
+		size_t i;
+		while (ok && ! failed && (i = next++) < items.size()) {
+			const item_t &item = items[i];
+			const group_t &g = groups[item.group];
+
+			size_t n = 1;
+			for (int j=0; j<item.min.size(); j++) {
+				n *= item.max[j] - item.min[j] + 1;
+			}
+			buf1.resize(n);
+			buf2.resize(n);
+
+			int rc = read_region(
+				dc1, lockRead1, item.ts, g.varname, g.level, g.lod1, item.min, item.max,
+				buf1.data()
+			);
+			if (rc<0) {
+				ok = false;
+				break;
+			}
+			rc = read_region(
+				dc2, lockRead2, item.ts, g.varname, g.level, g.lod2, item.min, item.max,
+				buf2.data()
+			);
+			if (rc<0) {
+				ok = false;
+				break;
+			}
+
+			stats_t s;
+			compare_region(g, buf1.data(), buf2.data(), n, s);
+
+			std::lock_guard <std::mutex> guard(mutex);
+			groups[item.group].stats.merge(s);
 		}
+		if (! ok) failed = true;
+
+		nclock.lock();
+		if (dc1) delete dc1;
+		if (dc2) delete dc2;
+	};
+
+	ThreadPool pool(nthreads);
+	ThreadPool::TaskGroup group(&pool);
+	for (int i=0; i<nthreads; i++) {
+		group.Run(task);
 	}
+	group.Wait();
 
+	return(! failed);
+}
 
-	return(true);
+// JSON has no representation for non-finite numbers
+//
+string json_number(double v) {
+	if (! std::isfinite(v)) return("null");
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%.9g", v);
+	return(buf);
+}
+
+string json_string(string s) {
+	string out = "\"";
+	for (int i=0; i<s.size(); i++) {
+		if (s[i] == '"' || s[i] == '\\') out += '\\';
+		out += s[i];
+	}
+	return(out + "\"");
+}
+
+void write_json(
+	std::ostream &os, const vector <string> &varnames,
+	const vector <group_t> &groups, double max_nlinf, bool success
+) {
+	os << "{" << endl;
+	os << "  \"success\": " << (success ? "true" : "false") << "," << endl;
+	os << "  \"max_nlinf\": " << json_number(max_nlinf) << "," << endl;
+	os << "  \"variables\": [" << endl;
+	for (int v=0; v<varnames.size(); v++) {
+		os << "    {" << endl;
+		os << "      \"name\": " << json_string(varnames[v]) << "," << endl;
+		os << "      \"levels\": [" << endl;
+
+		bool first = true;
+		for (int i=0; i<groups.size(); i++) {
+			const group_t &g = groups[i];
+			if (g.varname != varnames[v]) continue;
+			const stats_t &s = g.stats;
+
+			if (! first) os << "," << endl;
+			first = false;
+
+			os << "        {";
+			os << "\"level\": " << g.level << ", ";
+			os << "\"lod\": " << g.lod2 << ", ";
+			os << "\"dims\": [";
+			for (int j=0; j<g.dims.size(); j++) {
+				os << (j ? ", " : "") << g.dims[j];
+			}
+			os << "], ";
+			os << "\"timesteps\": " << g.nts << ", ";
+			if (! g.error.empty()) {
+				os << "\"error\": " << json_string(g.error) << "}";
+				continue;
+			}
+			os << "\"count\": " << s.count << ", ";
+			os << "\"min\": " << json_number(s.count ? s.min : 0.0) << ", ";
+			os << "\"max\": " << json_number(s.count ? s.max : 0.0) << ", ";
+			os << "\"linf\": " << json_number(s.linf) << ", ";
+			os << "\"nlinf\": " << json_number(s.nlinf()) << ", ";
+			os << "\"rmse\": " << json_number(s.rmse()) << ", ";
+			os << "\"psnr\": " << json_number(s.psnr()) << ", ";
+			os << "\"bias\": " << json_number(s.bias()) << ", ";
+			os << "\"missing\": " << s.missing << ", ";
+			os << "\"missing_mismatch\": " << s.mismatch << "}";
+		}
+		os << endl << "      ]" << endl;
+		os << "    }" << (v < varnames.size()-1 ? "," : "") << endl;
+	}
+	os << "  ]" << endl;
+	os << "}" << endl;
 }
 
 int	main(int argc, char **argv) {
@@ -189,7 +532,7 @@ int	main(int argc, char **argv) {
 	argc--;
 	argv++;
 
-	
+
 	vector <string> files1;
 	string sep("--");
 	while (*argv && string(*argv) != sep) {
@@ -204,14 +547,21 @@ int	main(int argc, char **argv) {
 		argv++;
 	}
 
+	if (opt.tilesize < 1) opt.tilesize = 1;
+
+	int nthreads = opt.nthreads > 0 ? opt.nthreads : EasyThreads::NProc();
+	if (nthreads < 1) nthreads = 1;
+
+	// The main thread's data collections only provide metadata
+	//
 	DC *dc1 = NULL;
 	DC *dc2 = NULL;
 
-	dc1 = DCCreate(ftype1);
-	dc2 = DCCreate(ftype2);
+	dc1 = DCCreate(ftype1, 1);
+	dc2 = DCCreate(ftype2, 1);
 
 	if (! dc1 || ! dc2) return(1);
-	
+
 	int rc = dc1->Initialize(files1, vector <string> ());
 	if (rc<0) return(1);
 
@@ -219,39 +569,83 @@ int	main(int argc, char **argv) {
 	if (rc<0) return(1);
 
 	vector <string> varnames;
-	if (opt.vars.size()) { 
+	if (opt.vars.size()) {
 		varnames = opt.vars;
 	}
 	else {
 		varnames = dc1->GetDataVarNames();
 	}
 
-	double max_nlmax = 0;
-	bool success = true;
+	vector <group_t> groups;
 	for (int i=0; i<varnames.size(); i++) {
 		int nts = dc1->GetNumTimeSteps(varnames[i]);
 		nts = opt.numts != -1 && nts > opt.numts ? opt.numts : nts;
 		assert(nts >= 0);
 
-		if (! opt.quiet) {
-			cout << "Testing variable " << varnames[i] << endl;
+		if (! make_groups(dc1, dc2, varnames[i], nts, groups)) return(1);
+	}
+	delete dc1;
+	delete dc2;
+
+	vector <item_t> items;
+	for (int i=0; i<groups.size(); i++) {
+		make_items(groups[i], i, items);
+	}
+
+	bool success = compare(
+		ftype1, files1, ftype2, files2, groups, items, nthreads
+	);
+
+	// Keep the standard output for the JSON report when it goes there
+	//
+	std::ostream &report = opt.json == "-" ? cerr : cout;
+
+	if (! success) {
+		report << "failed!" << endl;
+	}
+
+	double max_nlinf = 0;
+	for (int i=0; i<groups.size(); i++) {
+		const group_t &g = groups[i];
+		if (! g.error.empty()) success = false;
+
+		if (g.level == -1 && g.lod2 == -1 && g.stats.nlinf() > max_nlinf) {
+			max_nlinf = g.stats.nlinf();
 		}
+		if (opt.quiet) continue;
 
-		double nlmax;
-		bool ok = compare(dc1, dc2, nts, varnames[i], nlmax);
-		if (! ok) {
-			cout << "failed!" << endl;
-			success = false;
-			break;
+		if (i == 0 || groups[i-1].varname != g.varname) {
+			report << "Testing variable " << g.varname << endl;
+		}
+		report << "	level " << g.level << " lod " << g.lod2 << ": ";
+		if (! g.error.empty()) {
+			report << g.error << endl;
+			continue;
 		}
-		if (! opt.quiet) {
-			cout << "	NLmax = " << nlmax << endl;
+		report << "NLmax = " << g.stats.nlinf()
+			<< " Lmax = " << g.stats.linf
+			<< " RMSE = " << g.stats.rmse()
+			<< " PSNR = " << g.stats.psnr()
+			<< " bias = " << g.stats.bias()
+			<< " missing mismatches = " << g.stats.mismatch << endl;
+	}
+	report << "Max NLmax = " << max_nlinf << endl;
+
+	if (! opt.json.empty()) {
+		if (opt.json == "-") {
+			write_json(cout, varnames, groups, max_nlinf, success);
 		}
-		if (nlmax > max_nlmax) {
-			max_nlmax = nlmax;
+		else {
+			std::ofstream ofs(opt.json.c_str());
+			if (! ofs) {
+				MyBase::SetErrMsg(
+					"Failed to open file %s : %M", opt.json.c_str()
+				);
+				return(1);
+			}
+			write_json(ofs, varnames, groups, max_nlinf, success);
 		}
 	}
-	cout << "Max NLmax = " << max_nlmax << endl;
 
 	return success ? 0 : 1;
 }
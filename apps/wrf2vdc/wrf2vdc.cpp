@@ -8,6 +8,7 @@
 #include <vapor/CFuncs.h>
 #include <vapor/VDCNetCDF.h>
 #include <vapor/DCWRF.h>
+#include <vapor/VDCPartition.h>
 
 using namespace Wasp;
 using namespace VAPoR;
@@ -17,6 +18,9 @@ struct opt_t {
 	int nthreads;
 	int numts;
     std::vector <string> vars;
+	int nprocs;
+	int rank;
+	OptionParser::Boolean_T	finalize;
 	OptionParser::Boolean_T	help;
 } opt;
 
@@ -35,6 +39,24 @@ OptionParser::OptDescRec_T	set_opts[] = {
 		"to be included in "
 		"the VDC"
 	},
+	{
+		"nprocs",    1,  "1",
+		"Number of processes converting in parallel. Unless -rank or "
+		"-finalize is given, nprocs processes are started on this host "
+		"and the conversion is finalized once they finish"
+	},
+	{
+		"rank",    1,  "-1",
+		"Convert only the share of process rank (0 to nprocs-1) and "
+		"exit. Used to spread a conversion across hosts sharing a file "
+		"system. Every process must be given the same options"
+	},
+	{
+		"finalize",    0,  "",
+		"Write the variables stored in the master file, and check that "
+		"all the others were written, after every -rank process has "
+		"finished"
+	},
 	{"help",	0,	"",	"Print this message and exit"},
 	{NULL}
 };
@@ -44,12 +66,118 @@ OptionParser::Option_T	get_options[] = {
 	{"nthreads",Wasp::CvtToInt,		&opt.nthreads,	sizeof(opt.nthreads)},
 	{"numts",	Wasp::CvtToInt,		&opt.numts,		sizeof(opt.numts)},
 	{"vars",	Wasp::CvtToStrVec,	&opt.vars,		sizeof(opt.vars)},
+	{"nprocs",	Wasp::CvtToInt,		&opt.nprocs,	sizeof(opt.nprocs)},
+	{"rank",	Wasp::CvtToInt,		&opt.rank,		sizeof(opt.rank)},
+	{"finalize",	Wasp::CvtToBoolean,	&opt.finalize,	sizeof(opt.finalize)},
 	{"help",	Wasp::CvtToBoolean,	&opt.help,		sizeof(opt.help)},
 	{NULL}
 };
 
 string ProgName;
 
+// Every variable and time step to be copied, coordinate variables first
+//
+vector <VDCPartition::Unit> get_units(const DC &dc) {
+	vector <VDCPartition::Unit> units;
+
+	vector <string> varnames = dc.GetCoordVarNames();
+	if (opt.vars.size()) {
+		varnames.insert(varnames.end(), opt.vars.begin(), opt.vars.end());
+	}
+	else {
+		vector <string> datavars = dc.GetDataVarNames();
+		varnames.insert(varnames.end(), datavars.begin(), datavars.end());
+	}
+
+	for (int i=0; i<varnames.size(); i++) {
+		int nts = dc.GetNumTimeSteps(varnames[i]);
+		nts = opt.numts != -1 && nts > opt.numts ? opt.numts : nts;
+		assert(nts >= 0);
+
+		for (int ts=0; ts<nts; ts++) {
+			units.push_back(VDCPartition::Unit(varnames[i], ts));
+		}
+	}
+	return(units);
+}
+
+int copy_units(
+	DC &dc, VDCNetCDF &vdc, const vector <VDCPartition::Unit> &units
+) {
+	for (int i=0; i<units.size(); i++) {
+		if (i == 0 || units[i].varname != units[i-1].varname) {
+			cout << "Copying variable " << units[i].varname << endl;
+		}
+		cout << "  Time step " << units[i].ts << endl;
+
+		int rc = vdc.CopyVar(dc, units[i].ts, units[i].varname, -1, -1);
+		if (rc<0) return(-1);
+	}
+	return(0);
+}
+
+// Copy the share of process rank of nprocs, or everything if rank is
+// negative
+//
+int convert(
+	const vector <string> &wrffiles, string master, int rank, int nprocs
+) {
+	VDCNetCDF    vdc(opt.nthreads);
+
+	size_t chunksize = 1024*1024*4;
+	vector <size_t> bs;
+	int rc = vdc.Initialize(master, vector <string> (), VDC::A, bs, chunksize);
+	if (rc<0) return(-1);
+
+	DCWRF	dcwrf;
+	rc = dcwrf.Initialize(wrffiles, vector <string> ());
+	if (rc<0) return(-1);
+
+	vector <VDCPartition::Unit> units = get_units(dcwrf);
+
+	if (rank < 0) return(copy_units(dcwrf, vdc, units));
+
+	VDCPartition partition;
+	rc = partition.Initialize(vdc, units, nprocs);
+	if (rc<0) return(-1);
+
+	rc = partition.ClearDone(vdc, rank);
+	if (rc<0) return(-1);
+
+	rc = copy_units(dcwrf, vdc, partition.GetUnits(rank));
+	if (rc<0) return(-1);
+
+	return(partition.MarkDone(vdc, rank));
+}
+
+// Check that the worker processes wrote everything else, then copy the
+// variables stored in the master file, which they leave alone
+//
+int finalize(const vector <string> &wrffiles, string master, int nprocs) {
+	VDCNetCDF    vdc(opt.nthreads);
+
+	size_t chunksize = 1024*1024*4;
+	vector <size_t> bs;
+	int rc = vdc.Initialize(master, vector <string> (), VDC::A, bs, chunksize);
+	if (rc<0) return(-1);
+
+	DCWRF	dcwrf;
+	rc = dcwrf.Initialize(wrffiles, vector <string> ());
+	if (rc<0) return(-1);
+
+	VDCPartition partition;
+	rc = partition.Initialize(vdc, get_units(dcwrf), nprocs);
+	if (rc<0) return(-1);
+
+	rc = partition.CheckDone(vdc);
+	if (rc<0) return(-1);
+
+	rc = copy_units(dcwrf, vdc, partition.GetMasterUnits());
+	if (rc<0) return(-1);
+
+	return(partition.ClearDone(vdc, -1));
+}
+
 int	main(int argc, char **argv) {
 
 	OptionParser op;
@@ -88,57 +216,33 @@ int	main(int argc, char **argv) {
 	for (int i=0; i<argc-1; i++) wrffiles.push_back(argv[i]);
 	string master = argv[argc-1];
 
-	VDCNetCDF    vdc(opt.nthreads);
-
-
-	size_t chunksize = 1024*1024*4;
-	vector <size_t> bs;
-	int rc = vdc.Initialize(master, vector <string> (), VDC::A, bs, chunksize);
-	if (rc<0) exit(1);
-
-	DCWRF	dcwrf;
-	rc = dcwrf.Initialize(wrffiles, vector <string> ());
-	if (rc<0) {
+	if (opt.nprocs < 1 || opt.rank >= opt.nprocs) {
+		MyBase::SetErrMsg(
+			"Invalid process rank or count : %d, %d", opt.rank, opt.nprocs
+		);
 		exit(1);
 	}
 
-	vector <string> varnames = dcwrf.GetCoordVarNames();
-	for (int i=0; i<varnames.size(); i++) {
-		int nts = dcwrf.GetNumTimeSteps(varnames[i]);
-		nts = opt.numts != -1 && nts > opt.numts ? opt.numts : nts;
-		assert(nts >= 0);
-
-		cout << "Copying variable " << varnames[i] << endl;
-
-		for (int ts=0; ts<nts; ts++) {
-			cout << "  Time step " << ts << endl;
-			int rc = vdc.CopyVar(dcwrf, ts, varnames[i], -1, -1);
-			if (rc<0) exit(1);
-		}
+	int rc;
+	if (opt.finalize) {
+		rc = finalize(wrffiles, master, opt.nprocs);
 	}
-
-	if (opt.vars.size()) { 
-		varnames = opt.vars;
+	else if (opt.rank >= 0) {
+		rc = convert(wrffiles, master, opt.rank, opt.nprocs);
 	}
-	else {
-		varnames = dcwrf.GetDataVarNames();
+	else if (opt.nprocs > 1) {
+
+		// Nothing is opened before the workers are forked
+		//
+		rc = VDCPartition::RunLocal(opt.nprocs, [&](int rank) {
+			return(convert(wrffiles, master, rank, opt.nprocs));
+		});
+		if (rc == 0) rc = finalize(wrffiles, master, opt.nprocs);
 	}
-	for (int i=0; i<varnames.size(); i++) {
-		int nts = dcwrf.GetNumTimeSteps(varnames[i]);
-		nts = opt.numts != -1 && nts > opt.numts ? opt.numts : nts;
-		assert(nts >= 0);
-
-		cout << "Copying variable " << varnames[i] << endl;
-
-		for (int ts=0; ts<nts; ts++) {
-
-			cout << "  Time step " << ts << endl;
-
-			int rc = vdc.CopyVar(dcwrf, ts, varnames[i], -1, -1);
-			if (rc<0) exit(1);
-		}
+	else {
+		rc = convert(wrffiles, master, -1, 1);
 	}
-
+	if (rc<0) exit(1);
 
 	return(0);
 
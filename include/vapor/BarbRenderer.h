@@ -48,29 +48,46 @@ namespace VAPoR {
 		return("Barb");
 	}
 
+  protected:
+
+//! \copydoc Renderer::_prepare()
+	virtual int _prepare(bool fast);
+
   private:
 
 	vector <string> _fieldVariables;	// old, used instead of _currentVarname
 	double _vectorScaleFactor;
 	double _maxThickness;
 	
-	vector<double> _currentBoxMinExts;
-	vector<double> _currentBoxMaxExts;	
-
-	string _currentHgtVar;			
-	vector<double> _currentBoxMinExtsTex;
-	vector<double> _currentBoxMaxExtsTex;
-      
-
-	double _maxValue;
-	
-	void _getMagnitudeAtPoint(
-		std::vector<VAPoR::Grid*> variables,
-		float point[3]
-	);
+	// The vector field sampled at each point of the rake. Sampling
+	// requires reading the data and locating every point in each
+	// component grid, so the samples are kept until the time step, 
+	// the variables, or the rake change
+	//
+	class sample_t {
+	public:
+	 float start[3];	// rake point, offset by the height variable
+	 float dir[3];		// field vector at start
+	 float value;		// color variable at start
+	 bool missing;		// field or height missing at start
+	 bool valueMissing;	// color variable missing at start
+	};
+	std::vector <sample_t> _samples;
+
+	double _maxValue;	// largest vector component magnitude sampled
+
+	// Each instance is a barb: start point, vector from start to end
+	// point, and RGBA color
+	//
+	std::vector <float> _instances;
+	size_t _nInstances;
+	bool _instancesPending;
+	bool _instancesDirty;
+
+	GLuint _VAO, _meshVBO, _instanceVBO;
+	int _nMeshVertices;
 
 	void _recalculateScales(
-		std::vector<VAPoR::Grid*> &varData, 
 		int ts
 	);
 
@@ -80,7 +97,6 @@ namespace VAPoR {
 
 	void _setDefaultLengthAndThicknessScales(
 		size_t ts, 
-		const std::vector<VAPoR::Grid*> &varData,
 		const BarbParams* bParams
 	);
 
@@ -118,110 +134,36 @@ namespace VAPoR {
 		std::vector<VAPoR::Grid*> &varData
 	);
 
-	void _setUpLightingAndColor();
-
 	void _reFormatExtents(vector<float> &rakeExts) const;
 
 	void _makeRakeGrid(vector<int> &rakeGrid) const;
 
-//! Protected method that performs rendering of all barbs.
-//! \param[in] DataMgr* current DataMgr
-//! \param[in] const BarbParams* associated BarbParams
-//! \param[in] int actualRefLevel refinement level to be rendered.
-//! \param[in] float vectorScale Scale factor to be applied to barbs.
-//! \param[in] float barbRadius Radius of barbs in voxel diameters.
-//! \param[in] Grid Grid used in rendering.
-//! The first three are the vector field, Grid[3] is the Height variable, Grid[4] is the color variable.
-//! \retval int zero if successful
-//	int performRendering(BarbParams* rParams,
-//		int actualRefLevel, 
-//		vector <Grid *> variableData
-//	);
-
-	float _getHeightOffset(Grid* heightVar, float xCoord,
-		float yCoord, bool& missing) const;	
-
 	bool _makeCLUT(float clut[1024]) const;
 
-	void _getDirection(
-		float direction[3], 
-		std::vector<Grid*> varData,
-		float xCoord,
-		float yCoord,
-		float zCoord,
-		bool &missing
-	) const;
-
 	vector<double> _getScales();
 
-	float _calculateLength(float start[3], float end[3]) const; 
-
-	void _makeStartAndEndPoint(
-		float start[3],
-		float end[3],
-		float direction[3]
-	);
-
 	void _getStrides(
 		vector<float> &strides, 
 		vector<int> &rakeGrid, 
 		vector<float> &rakeExts
 	) const;
 
-	bool _defineBarb(
-		std::vector<Grid*>, 
-		float start[3], 
-		float end[3],
-		bool doColorMapping,
-		float clut[1024]);
+	//! Sample the field, height, and color variables at every rake
+	//! point into _samples
+	//
+	int _sampleRake();
 
-	void _operateOnGrid(
-		vector <Grid *> variableData,
-		bool drawBarb=true);
+	//! Generate the per-barb instance attributes from _samples
+	//
+	void _buildInstances();
 
-	bool _getColorMapping(float val, float clut[256*4]);
+	//! Generate the vertices of a single barb, in a frame local to 
+	//! the barb, into the mesh vertex buffer
+	//
+	void _buildBarbMesh();
 
-	float _calculateDirVec(
-		const float start[3], 
-		const float end[3],
-		float dirVec[3]
-	);
-
-	void _drawBackOfBarb(
-		const float dirVec[3], 
-		const float startVertex[3]
-	) const;
+	void _uploadInstances();
 
-	void _drawCylinderSides(
-		const float nextNormal[3],
-		const float nextVertex[3],
-		const float startNormal[3],
-		const float startVertex[3]
-	) const;
-
-	void _drawBarbHead(
-	    const float dirVec[3], 
-	    const float vertexPoint[3], 
-	    const float startNormal[3], 
-	    const float startVertex[3]
-	) const; 
-
-//! Protected method to draw one barb (a hexagonal tube with a cone barbhead)
-//! \param[in] const float startPoint[3] beginning position of barb
-//! \param[in] const float endPoint[3] ending position of barb
-	//void drawBarb(const float startPoint[3], const float endPoint[3]);
-	void _drawBarb(
-		const std::vector<Grid*> variableData,
-		float startPoint[3],
-		bool doColorMapping,
-		float clut[1024]
-	);
-		
-     
-#ifdef DEBUG
-	_printBackDiameter(const float startVertex[18]) const;
-#endif
- 
       struct {
           vector<string> fieldVarNames;
           string heightVarName;
@@ -229,21 +171,26 @@ namespace VAPoR {
           size_t ts;
           int level;
           int lod;
+          vector<long> grid;
+          vector<double> boxMin, boxMax;
+      } _sampleParams;
+
+      struct {
           bool useSingleColor;
           float constantColor[3];
           double lineThickness;
           double opacity;
           double lengthScale;
-          vector<long> grid;
-          vector<double> boxMin, boxMax;
+          vector<double> scales;
           float minMapValue;
           float maxMapValue;
           float colorSamples[10][3];
           float alphaSamples[10];
-		  bool needToRecalc;
       } _cacheParams;
       
-      bool _isCacheDirty() const;
+      bool _isSampleDirty() const;
+      void _saveSampleParams();
+      bool _isCacheDirty();
       void _saveCacheParams();
       
   };
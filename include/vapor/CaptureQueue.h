@@ -0,0 +1,148 @@
+//
+//	File:		CaptureQueue.h
+//
+//	Description:	Encode and write captured images on background
+//					threads
+//
+
+#ifndef	_CaptureQueue_h_
+#define	_CaptureQueue_h_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <vapor/MyBase.h>
+#include <vapor/ThreadPool.h>
+#include <vapor/common.h>
+
+namespace VAPoR {
+
+//! \class CaptureQueue
+//! \ingroup Public_Render
+//! \brief Encode captured frames to image files in the background
+//!
+//! CaptureQueue accepts RGB frames read back from the frame buffer and
+//! writes them to JPEG, TIFF, or PNG files (the format is determined by
+//! the file name suffix) using a fixed number of encoder threads, so
+//! that the render thread does not wait for encoding.
+//!
+//! Frame buffers are obtained from the queue with GetBuffer() and
+//! handed back with Submit(). Buffers are recycled rather than
+//! allocated per frame, and at most a fixed number of buffers are
+//! in use at any time: GetBuffer() blocks until an encoder releases
+//! one, which bounds memory use when encoding falls behind rendering.
+//!
+//! Frames are encoded concurrently but each is written to a temporary
+//! file that is renamed into place in submission order, so a frame
+//! never appears on disk before the frames submitted ahead of it.
+//!
+//! PNG files are written with the embedded Python interpreter, which
+//! may only be used from the thread that owns it, so PNG frames are
+//! encoded by the thread that submits them.
+//
+class RENDER_API CaptureQueue : public Wasp::MyBase {
+public:
+
+ //! Construct a queue
+ //!
+ //! \param[in] nencoders Number of encoder threads. If less than one
+ //! a value based on the number of processors is used.
+ //! \param[in] maxBuffers Maximum number of frame buffers in use,
+ //! including those waiting to be encoded. If less than one twice
+ //! the number of encoders is used.
+ //
+ CaptureQueue(int nencoders = 0, int maxBuffers = 0);
+
+ //! Destroy the queue after waiting for all submitted frames to be
+ //! written
+ //
+ virtual ~CaptureQueue();
+
+ //! Obtain a buffer for a frame
+ //!
+ //! Returns a buffer of at least \p nbytes bytes, blocking while the
+ //! maximum number of buffers is in use. The buffer must be handed
+ //! back with either Submit() or Release().
+ //
+ unsigned char *GetBuffer(size_t nbytes);
+
+ //! Return a buffer obtained with GetBuffer() without writing it
+ //
+ void Release(unsigned char *buf);
+
+ //! Queue a frame for encoding
+ //!
+ //! \param[in] buf Buffer obtained with GetBuffer() containing
+ //! \p width x \p height RGB pixels, first row at the top. Ownership
+ //! of the buffer passes to the queue.
+ //! \param[in] width Width of frame in pixels
+ //! \param[in] height Height of frame in pixels
+ //! \param[in] filename Output file. The suffix determines the format
+ //!
+ //! \retval status A negative int is returned if a previously
+ //! submitted frame could not be written. The frame in \p buf is queued
+ //! regardless.
+ //
+ int Submit(
+	unsigned char *buf, size_t width, size_t height, std::string filename
+ );
+
+ //! Wait until all submitted frames have been written
+ //!
+ //! \retval status A negative int is returned if any frame submitted
+ //! since the last call to Flush() could not be written
+ //
+ int Flush();
+
+ //! Encode and write a single frame in the calling thread
+ //!
+ //! \sa Submit()
+ //
+ static int WriteImage(
+	std::string filename, const unsigned char *buf,
+	size_t width, size_t height
+ );
+
+private:
+ Wasp::ThreadPool *_pool;
+ Wasp::ThreadPool::TaskGroup *_group;
+ int _maxBuffers;
+
+ std::mutex _mutex;
+ std::condition_variable _cv;
+ std::vector <unsigned char *> _free;
+ std::map <unsigned char *, size_t> _sizes;	// capacity of every buffer
+ int _nInUse;
+
+ class result_t {
+ public:
+  std::string tmpfile;
+  std::string filename;
+  std::string errmsg;	// empty if the frame was encoded successfully
+ };
+
+ // Frames are committed (renamed into place) in sequence order.
+ // _done holds the results of frames that finished encoding ahead of
+ // their turn.
+ //
+ long _nextSeq;
+ long _nextCommit;
+ std::map <long, result_t> _done;
+ std::vector <std::string> _errors;
+
+ void _encode(
+	long seq, unsigned char *buf, size_t width, size_t height,
+	std::string filename
+ );
+ void _commit(long seq, const result_t &result);
+ int _reportErrors();
+
+ CaptureQueue(const CaptureQueue &);
+ CaptureQueue &operator=(const CaptureQueue &);
+};
+
+};
+
+#endif
@@ -66,11 +66,27 @@ public:
 	//! \copydoc Renderer::_paintGL()
     virtual int		_paintGL(bool fast);
 
+protected:
+	//! \copydoc Renderer::_prepare()
+	virtual int		_prepare(bool fast);
+
 private:
     GLuint _VAO, _VBO;
     unsigned int _nVertices;
     
-    struct VertexData;
+#pragma pack(push, 4)
+    struct VertexData {
+        float x, y, z;
+        float r, g, b, a;
+    };
+#pragma pack(pop)
+
+    // Vertices built by _buildCache() that have not been uploaded to
+    // _VBO yet
+    //
+    vector<VertexData> _vertices;
+    bool _uploadPending;
+
     struct {
         string varName;
         string heightVarName;
@@ -87,6 +103,7 @@ private:
     } _cacheParams;
 
     int  _buildCache();
+    void _uploadCache();
     bool _isCacheDirty() const;
     void _saveCacheParams();
 };
@@ -131,6 +131,11 @@ public:
  //! \param[in] name handle to existing visualizer returned by 
  //! NewVisualizer(). This method is a no-op if a Visualizer named
  //! \p name doesn't exist
+ //!
+ //! An animation capture in progress should first be ended with 
+ //! EnableAnimationCapture(). Otherwise frames still being read back 
+ //! from the frame buffer are discarded, since the visualizer's 
+ //! OpenGL context need not be current.
  //
  void RemoveVisualizer(string name);
 
@@ -196,6 +201,20 @@ public:
  //!
  int Paint(string name, bool force=false);
 
+ //! Return true if the most recent Paint() of a visualizer drew
+ //! a coarse approximation of the scene
+ //!
+ //! When automatic level selection is enabled (see
+ //! RenderParams::SetAutoLevel()) renderers draw coarse data while
+ //! the view is changing. This method returns true until repeated
+ //! calls to Paint() with \p force false and an unchanged view have
+ //! refined the scene to the levels appropriate for the display.
+ //!
+ //! \param[in] name handle to existing visualizer returned by 
+ //! NewVisualizer(). 
+ //
+ bool NeedsRefinement(string name) const;
+
  //! Activate or Deactivate a renderer
 
  //!
@@ -312,6 +331,55 @@ public:
  //!
  void CloseData(string dataSetName);
 
+ //! Define a derived variable with an arithmetic expression
+ //!
+ //! Adds, or redefines, the variable \p varName of the data set
+ //! \p dataSetName, computed from other variables of the data set with
+ //! the expression \p formula. The formula is recorded in the session
+ //! state, so the definition is saved with the session and may be
+ //! undone.
+ //!
+ //! \retval status A negative int is returned, and the session state
+ //! is unchanged, if the data set is not open or the formula is invalid
+ //!
+ //! \sa DataMgr::AddExpressionVar(), DerivedVarParams
+ //
+ int AddExpressionVar(string dataSetName, string varName, string formula);
+
+ //! Remove a variable defined with AddExpressionVar()
+ //!
+ //! \retval status A negative int is returned, and the session state
+ //! is unchanged, if other variables are computed from \p varName
+ //!
+ //! \sa DataMgr::RemoveExpressionVar()
+ //
+ int RemoveExpressionVar(string dataSetName, string varName);
+
+ //! Define a derived variable computed by a Python script
+ //!
+ //! Adds, or redefines, the variable \p varName of the data set
+ //! \p dataSetName, computed by \p script from the variables
+ //! \p inputs of the data set. Like the formula of an expression
+ //! variable, the definition is recorded in the session state.
+ //!
+ //! \retval status A negative int is returned, and the session state
+ //! is unchanged, if the data set is not open or the variable can not be
+ //! defined
+ //!
+ //! \sa DerivedDataVarPython, DataMgr::AddDerivedVar()
+ //
+ int AddPythonVar(
+	string dataSetName, string varName, string script,
+	const std::vector <string> &inputs
+ );
+
+ //! Remove a variable defined with AddPythonVar()
+ //!
+ //! \retval status A negative int is returned, and the session state
+ //! is unchanged, if other variables are computed from \p varName
+ //
+ int RemovePythonVar(string dataSetName, string varName);
+
  //! Return list of currently open data set names
  //!
  //! \sa OpenData(), CloseData()
@@ -516,6 +584,9 @@ public:
  //! and the filename will be incremented by 1. 
  //! The starting filename should terminate with digits to permit incrementing.
  //! filename is ignored if capture is being disabled
+ //! Frames are encoded in the background. When capture is disabled
+ //! this method waits until all frames have been written, and must
+ //! be called with the visualizer's OpenGL context current.
 
  //! \param[in] viz Valid visualizer handle
  //! \param[in] doEnable true to start capture, false to end.
@@ -565,6 +636,8 @@ private:
  }
 
  int openDataHelper(bool reportErrs);
+ void syncExpressionVars(bool reportErrs);
+ void syncPythonVars(bool reportErrs);
  void undoRedoHelper();
  int activateClassRenderers(
 	string vizName, string dataSetName,
@@ -1853,6 +1853,24 @@ public:
 	return(_openVariableRead(ts, varname, level, lod));
  }
 
+ //! Keep a variable's coefficients in memory between reads
+ //!
+ //! Advise the class that the variable \p varname will be read 
+ //! at time step \p ts at successively finer refinement levels, 
+ //! e.g. to display a coarse approximation quickly and refine it. 
+ //! Classes that reconstruct every level from the same stored 
+ //! coefficients may keep the coefficients fetched by one read and
+ //! reuse them for the next, rather than fetching them again. 
+ //! Only one variable is retained at a time. An empty \p varname 
+ //! releases the coefficients. The default implementation does nothing.
+ //!
+ //! \param[in] ts Time step of the variable
+ //! \param[in] varname Name of the variable, or the empty string
+ //!
+ //! \sa OpenVariableRead()
+ //
+ virtual void RetainCoeffs(size_t ts, string varname) {}
+
 
  //! Close the currently opened variable
  //!
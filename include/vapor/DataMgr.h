@@ -2,6 +2,13 @@
 #include <iostream>
 #include <list>
 #include <cassert>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <thread>
+#include <functional>
 #include <vapor/BlkMemMgr.h>
 #include <vapor/DC.h>
 #include <vapor/MyBase.h>
@@ -428,6 +435,134 @@ std::vector <size_t> GetCRatios(string varname) const;
 	std::vector <size_t> min, std::vector <size_t> max, bool lock=false
  );
 
+ //! Return a grid shared by all callers making the same request
+ //!
+ //! This method is identical to GetVariable() with a region of interest 
+ //! specified in user coordinates, except that the returned grid is
+ //! read-only and may be shared. Requests that resolve to the same 
+ //! time step, variable, refinement level, level of detail, and
+ //! grid region (in voxels) return the same grid, so that several 
+ //! renderers displaying the same data during a frame construct the
+ //! grid, including its coordinate grids, only once.
+ //!
+ //! The most recently requested grids are retained in a cache of
+ //! bounded size (see SetSharedGridCacheSize()). The blocks of a shared
+ //! grid remain locked, as if by GetVariable() with \p lock true, until
+ //! the grid has been evicted from the cache and the last reference
+ //! to it has been released. Grids referenced only by the cache are
+ //! evicted, least recently used first, when memory is needed for
+ //! other data. A grid must not be accessed after the DataMgr has
+ //! been destroyed, though the reference may still be released.
+ //!
+ //! \retval grid The shared grid, or an empty pointer on failure
+ //!
+ //! \sa GetVariable(), SetSharedGridCacheSize()
+ //
+ std::shared_ptr <const VAPoR::Grid> GetSharedVariable(
+	size_t ts, string varname, int level, int lod, 
+	std::vector <double> min, std::vector <double> max
+ );
+
+ //! Set the number of grids retained by GetSharedVariable()
+ //!
+ //! Grids beyond the \p n most recently requested are evicted. A value
+ //! of zero disables retention: grids are then only shared while a 
+ //! reference to them is held.
+ //!
+ //! \sa GetSharedVariable()
+ //
+ void SetSharedGridCacheSize(size_t n);
+
+ //! \class ProgressiveRead
+ //! \brief Handle to an outstanding progressive read
+ //!
+ //! \sa GetVariableProgressive()
+ //
+ class VDF_API ProgressiveRead {
+ public:
+	ProgressiveRead() : _cancel(false) {}
+
+	//! Request that no further refinements be delivered
+	//!
+	//! A refinement that is being read when Cancel() is called is
+	//! discarded rather than passed to the callback.
+	//
+	void Cancel() { _cancel = true; }
+
+	bool IsCancelled() const { return(_cancel); }
+
+	//! Return a future that becomes ready once the final refinement
+	//! has been delivered, or the read stops. Its value is 0 if all
+	//! refinements were delivered, and negative if the read failed
+	//! or was cancelled.
+	//
+	std::shared_future <int> GetFuture() const { return(_future); }
+
+	//! Block until the read completes and return its status
+	//!
+	//! \sa GetFuture()
+	//
+	int Wait() const { return(_future.get()); }
+
+ private:
+	friend class DataMgr;
+	std::atomic <bool> _cancel;
+	std::shared_future <int> _future;
+ };
+
+ //! Callback invoked by GetVariableProgressive() for each refinement
+ //!
+ //! The callback receives the refinement level and level-of-detail of
+ //! the grid, and the grid itself. Ownership of the grid passes to
+ //! the callback, which is invoked from a thread other than the one
+ //! that called GetVariableProgressive(). The grid is locked, as by
+ //! GetVariable() with \p lock true, and the callback is responsible
+ //! for calling UnlockGrid() before deleting it.
+ //
+ typedef std::function <
+	void (int level, int lod, VAPoR::Grid *grid)
+ > ProgressiveCB;
+
+ //! Read a variable hyperslab progressively, from coarse to fine
+ //!
+ //! This method returns immediately with a grid at the coarsest
+ //! refinement level and level-of-detail, which is typically
+ //! orders of magnitude cheaper to read than the full resolution
+ //! data. Successively finer refinement levels, up to \p level and
+ //! \p lod, are then read in the background and passed to 
+ //! \p callback, in order, as each becomes available. This allows
+ //! an interactive application to display a preview at once and
+ //! refine it as data arrive.
+ //!
+ //! The DataMgr serializes access to its cache, so other
+ //! DataMgr methods may be called while a progressive read is in
+ //! progress; they will block while a refinement is being read.
+ //! Refinements are read by a single thread, one progressive read
+ //! after another. Where the DC supports it (see DC::RetainCoeffs())
+ //! the coefficients fetched for one refinement are kept in memory
+ //! and reused for the next, so that each is not read from scratch.
+ //! All outstanding reads are cancelled when the DataMgr is destroyed.
+ //!
+ //! The arguments \p ts, \p varname, \p level, \p lod, \p min
+ //! and \p max are as for GetVariable(). 
+ //!
+ //! \param[in] callback Function invoked with each refinement
+ //! \param[out] request A handle that may be used to cancel or wait
+ //! for the remaining refinements
+ //!
+ //! \retval grid The grid at the coarsest resolution, or NULL on failure.
+ //! The grid is allocated from the heap and locked, so that reading
+ //! the refinements cannot free its data. The caller must call
+ //! UnlockGrid() and then delete the grid.
+ //!
+ //! \sa GetVariable()
+ //
+ VAPoR::Grid *GetVariableProgressive(
+	size_t ts, string varname, int level, int lod,
+	std::vector <double> min, std::vector <double> max,
+	ProgressiveCB callback, std::shared_ptr <ProgressiveRead> &request
+ );
+
  //! Compute the coordinate extents of a variable
  //!
  //! This method finds the spatial domain extents of a variable
@@ -497,6 +632,84 @@ std::vector <size_t> GetCRatios(string varname) const;
  //
  void	Clear();
 
+ //! Define a derived variable with an arithmetic expression
+ //!
+ //! Add a data variable named \p varname whose values are computed
+ //! from other data variables, native or derived, with the expression
+ //! \p formula. See Expression for the syntax. A formula consisting of
+ //! a single finite difference operator, such as "curl_z(U, V)", is
+ //! evaluated with stencils instead; see DerivedDataVarFinDiff. The
+ //! operators cannot appear within an expression: to scale a 
+ //! divergence, for example, define "divUV" as "div(U, V)" and then
+ //! the expression "divUV * 2". The new
+ //! variable is sampled on the same mesh as its inputs, and is cached
+ //! like any other variable. If an expression variable named \p varname
+ //! already exists it is replaced, and the data cached for it and for
+ //! the variables computed from it are discarded. Grids already
+ //! returned for these variables remain valid until unlocked.
+ //!
+ //! \param[in] varname Name of the derived variable
+ //! \param[in] formula The expression defining the variable
+ //! \param[in] units Units of the derived variable
+ //!
+ //! \retval status A negative int is returned if \p formula is
+ //! invalid, \p varname names a native or built-in derived variable, or
+ //! the definition is circular
+ //!
+ //! \sa RemoveExpressionVar(), Expression, DerivedDataVarFinDiff
+ //
+ int AddExpressionVar(string varname, string formula, string units = "");
+
+ //! Remove a variable added with AddExpressionVar()
+ //!
+ //! \retval status A negative int is returned, and nothing is removed,
+ //! if other derived variables are computed from \p varname. They
+ //! must be removed first.
+ //
+ int RemoveExpressionVar(string varname);
+
+ //! Return the names of the variables added with AddExpressionVar()
+ //
+ std::vector <string> GetExpressionVarNames() const;
+
+ //! Return the formula of an expression variable, or the empty string
+ //! if \p varname is not an expression variable
+ //
+ string GetExpressionVarFormula(string varname) const;
+
+ //! Add a derived data variable implemented outside of this library
+ //!
+ //! The DataMgr takes ownership of \p var, which must not yet be
+ //! initialized. A derived variable may read its inputs back through
+ //! this DataMgr, e.g. with GetVariable(), from within its
+ //! DerivedDataVar::ReadRegion() method. If a variable previously added
+ //! with AddDerivedVar() has the same name it is replaced, and the data
+ //! cached for it and for the variables computed from it are discarded.
+ //!
+ //! \retval status A negative int is returned, and \p var is deleted,
+ //! if \p var fails to initialize, names a native, built-in derived, or
+ //! expression variable, or its definition is circular
+ //!
+ //! \sa RemoveDerivedVar(), DerivedDataVarPython
+ //
+ int AddDerivedVar(DerivedDataVar *var);
+
+ //! Remove and delete a variable added with AddDerivedVar()
+ //!
+ //! \retval status A negative int is returned, and nothing is removed,
+ //! if other derived variables are computed from \p varname
+ //
+ int RemoveDerivedVar(string varname);
+
+ //! Return the names of the variables added with AddDerivedVar()
+ //
+ std::vector <string> GetDerivedVarNames() const;
+
+ //! Return a variable added with AddDerivedVar(), or NULL if
+ //! \p varname was not added
+ //
+ const DerivedDataVar *GetDerivedVar(string varname) const;
+
  //! Returns true if indicated data volume is available
  //!
  //! Returns true if the variable identified by the timestep, variable
@@ -771,6 +984,11 @@ private:
 		_cacheVoidPtr.clear(); 
 	}
 
+	// Purge the size_t and double values cached for varname. Pointer
+	// values belong to coordinate variables and are kept.
+	//
+	void PurgeVariable(string varname);
+
   static string _make_hash(
 	string key, size_t ts, std::vector <string> cvars, int level, int lod
   );
@@ -796,6 +1014,7 @@ private:
  bool _doTransformHorizontal;
  bool _doTransformVertical;
  string _openVarName;
+ std::vector <string> _addedVarNames;	// Variables added by AddDerivedVar()
 
  std::vector <double> _timeCoordinates;
  string _proj4String;
@@ -817,6 +1036,36 @@ private:
 
  VAPoR::BlkMemMgr  *_blk_mem_mgr;
 
+ // Serializes access to the region cache and the DC by background
+ // progressive reads and the caller's thread
+ //
+ mutable std::recursive_mutex _mutex;
+
+ // Grids returned by GetSharedVariable(), most recently used first.
+ // Grids that are no longer cached but still referenced are found
+ // through _sharedGridRefs. Shared grids hold _self weakly, so that
+ // one released after the DataMgr is gone does not unlock its blocks.
+ //
+ typedef std::pair <string, std::shared_ptr <const VAPoR::Grid> > shared_grid_t;
+ std::list <shared_grid_t> _sharedGrids;
+ std::map <string, std::weak_ptr <const VAPoR::Grid> > _sharedGridRefs;
+ size_t _sharedGridCacheSize;
+ std::shared_ptr <DataMgr *> _self;
+
+ // Progressive reads are serviced in the order requested by a single
+ // thread, started with the first read. _progressiveReads holds the 
+ // outstanding reads. It, _refineQueue, and _refineQuit are protected
+ // by _mutex.
+ //
+ std::list <std::shared_ptr <ProgressiveRead> > _progressiveReads;
+ std::list <std::function <void ()> > _refineQueue;
+ std::condition_variable_any _refineCV;
+ std::thread _refineThread;
+ bool _refineQuit;
+
+ void _refineLoop();
+ void _stopRefinement();
+
 
  std::vector <PipeLine *> _PipeLines;
 
@@ -1151,6 +1400,14 @@ UnstructuredGrid2D *_make_grid_unstructured2d(
 
  int _initVerticalCoordVars();
 
+ int _initDerivedDataVars();
+
+ bool _dependsOn(string varname, string target) const;
+
+ std::vector <string> _getDependants(string varname) const;
+
+ void _invalidateVar(string varname);
+
  bool _hasVerticalXForm() const;
 
  bool _hasVerticalXForm(
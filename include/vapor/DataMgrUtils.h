@@ -163,6 +163,23 @@ namespace DataMgrUtils {
 	bool useLowerAccuracy, int* refLevel, int* lod, Grid ** gridptr
  );
 
+ //! Obtain a shared, read-only grid for a single variable
+ //!
+ //! Identical to GetGrids() for a single variable except that the grid
+ //! is obtained with DataMgr::GetSharedVariable(). The grid must not be
+ //! unlocked: its blocks are released with the last reference to it.
+ //!
+ //! \param[out] grid The shared grid. Empty on failure
+ //!
+ //! \sa DataMgr::GetSharedVariable()
+ //
+ VDF_API int GetSharedGrid(
+	DataMgr *dataMgr, size_t ts, string varname, 
+	const vector <double> &minExtsReq, const vector <double> &maxExtsReq,
+	bool useLowerAccuracy, int* refLevel, int* lod,
+	std::shared_ptr <const Grid> &grid
+ );
+
  //! Get the spatial coordinate axes for a variable
  //!
  //! Returns the ordered (fastest to slowest varying) coordinate axis
@@ -117,6 +117,14 @@ protected:
 	float *region
  ) const;
 
+ //! Reorganize the array \p data with dimensions \p dims into blocks
+ //! of size \p bs, as returned by ReadRegionBlock()
+ //
+ static void _blockit(
+	const float *data, const std::vector <size_t> &dims,
+	const std::vector <size_t> &bs, float *blocks
+ );
+
 };
 
 //!
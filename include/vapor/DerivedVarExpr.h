@@ -0,0 +1,121 @@
+#include <vector>
+#include <vapor/DerivedVar.h>
+#include <vapor/Expression.h>
+
+#ifndef	_DERIVEDVAREXPR_H_
+#define	_DERIVEDVAREXPR_H_
+
+namespace VAPoR {
+
+//!
+//! \class DerivedDataVarExpr
+//!
+//! \brief Data variable defined by an arithmetic expression of other
+//! variables
+//!
+//! The expression, e.g. "sqrt(U*U + V*V)", is compiled once with the
+//! Expression class and evaluated natively over each region requested,
+//! in parallel. Inputs may be native variables or other derived
+//! variables. All inputs must be sampled on the same grid, except that
+//! 2D inputs are broadcast along the vertical axis of a 3D expression.
+//! Where any input has its missing value the result is missing.
+//!
+class VDF_API DerivedDataVarExpr : public DerivedDataVar {
+public:
+
+ //! \param[in] varName Name of the derived variable
+ //! \param[in] dc Data collection providing native inputs
+ //! \param[in] derivedDC Data collection providing derived inputs, or
+ //! NULL. It is searched after \p dc.
+ //! \param[in] formula The expression defining the variable
+ //! \param[in] units Units of the derived variable
+ //
+ DerivedDataVarExpr(
+	string varName, DC *dc, DC *derivedDC, string formula, string units = ""
+ );
+ virtual ~DerivedDataVarExpr() {}
+
+ //! Compile the formula and check its inputs
+ //!
+ //! \retval status A negative int is returned if the formula is
+ //! invalid, refers to itself or to unknown variables, or combines
+ //! variables sampled on different grids
+ //
+ virtual int Initialize();
+
+ //! Return the formula defining the variable
+ //
+ string GetFormula() const { return(_formula); }
+
+ virtual bool GetBaseVarInfo(DC::BaseVar &var) const;
+
+ virtual bool GetDataVarInfo(DC::DataVar &var) const;
+
+ virtual std::vector <string> GetInputs() const {
+	return(_expr.GetVarNames());
+ }
+
+ virtual size_t GetNumRefLevels() const;
+
+ virtual int GetDimLensAtLevel(
+	int level, std::vector <size_t> &dims_at_level,
+	std::vector <size_t> &bs_at_level
+ ) const;
+
+ virtual int OpenVariableRead(
+	size_t ts, int level=0, int lod=0
+ );
+
+ virtual int CloseVariable(int fd);
+
+ virtual int ReadRegionBlock(
+	int fd,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+
+ virtual int ReadRegion(
+	int fd,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+
+ virtual bool VariableExists(
+	size_t ts,
+	int reflevel,
+	int lod
+ ) const;
+
+private:
+ DC *_dc;
+ DC *_derivedDC;
+ string _formula;
+ string _units;
+ Expression _expr;
+ string _refVar;
+ bool _blockwise;
+ std::vector <bool> _broadcast;
+ std::vector <bool> _hasMissing;
+ std::vector <float> _missingValues;
+ DC::DataVar _dataVarInfo;
+
+ DC *_getDC(string varname) const;
+
+ // Evaluate the expression over a region. If \p blocked is true the
+ // inputs are read, and the result returned, in blocked order
+ //
+ int _read(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	bool blocked, float *region
+ );
+
+ void _evaluate(
+	const std::vector <const float *> &inputs,
+	const std::vector <size_t> &periods, size_t n, float *region
+ ) const;
+};
+
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include <vector>
+#include <vapor/DerivedVar.h>
+
+#ifndef	_DERIVEDVARFINDIFF_H_
+#define	_DERIVEDVARFINDIFF_H_
+
+namespace VAPoR {
+
+//!
+//! \class DerivedDataVarFinDiff
+//!
+//! \brief Gradient, divergence, or curl computed with finite differences
+//!
+//! The variable is defined by a formula naming one of the operators
+//!
+//! \li \c grad_x(A), \c grad_y(A), \c grad_z(A) : a component of the
+//! gradient of A
+//! \li \c div(A, B) or \c div(A, B, C) : the divergence of the vector
+//! field (A, B[, C])
+//! \li \c curl_x(A, B, C), \c curl_y(A, B, C), \c curl_z(A, B[, C]) :
+//! a component of the curl of the vector field (A, B, C). For 2D data
+//! \c curl_z(A, B) is the vertical vorticity.
+//!
+//! followed optionally by the order of accuracy, 2, 4, or 6 (the
+//! default), e.g. "curl_z(U, V, 4)". Interior points use centered
+//! differences, and points near the domain boundary one sided
+//! differences, as in the vapor_utils.py functions deriv_findiff() and
+//! wrf_deriv_findiff() these replace.
+//!
+//! Derivatives are taken with respect to the coordinate variables of
+//! the inputs, so stretched grids are handled. If the vertical
+//! coordinate varies horizontally (a layered, terrain following grid)
+//! horizontal derivatives are corrected to constant height.
+//!
+//! Each region is read with a halo of order/2 samples on every side,
+//! so results do not depend on how the domain is partitioned into
+//! blocks, and match those computed on the entire domain.
+//!
+class VDF_API DerivedDataVarFinDiff : public DerivedDataVar {
+public:
+
+ //! \param[in] varName Name of the derived variable
+ //! \param[in] dc Data collection providing native inputs
+ //! \param[in] derivedDC Data collection providing derived inputs, or
+ //! NULL. It is searched after \p dc.
+ //! \param[in] formula Formula defining the variable
+ //! \param[in] coordVars Names of the X, Y, and (for 3D inputs) Z
+ //! coordinate variables of the inputs. A name that is empty, or
+ //! not a variable of either data collection, selects unit grid
+ //! spacing along that axis.
+ //! \param[in] units Units of the derived variable
+ //
+ DerivedDataVarFinDiff(
+	string varName, DC *dc, DC *derivedDC, string formula,
+	const std::vector <string> &coordVars, string units = ""
+ );
+ virtual ~DerivedDataVarFinDiff() {}
+
+ virtual int Initialize();
+
+ //! Return the formula defining the variable
+ //
+ string GetFormula() const { return(_formula); }
+
+ virtual bool GetBaseVarInfo(DC::BaseVar &var) const;
+
+ virtual bool GetDataVarInfo(DC::DataVar &var) const;
+
+ virtual std::vector <string> GetInputs() const;
+
+ virtual size_t GetNumRefLevels() const;
+
+ virtual int GetDimLensAtLevel(
+	int level, std::vector <size_t> &dims_at_level,
+	std::vector <size_t> &bs_at_level
+ ) const;
+
+ virtual int OpenVariableRead(
+	size_t ts, int level=0, int lod=0
+ );
+
+ virtual int CloseVariable(int fd);
+
+ virtual int ReadRegionBlock(
+	int fd,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+
+ virtual int ReadRegion(
+	int fd,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+
+ virtual bool VariableExists(
+	size_t ts,
+	int reflevel,
+	int lod
+ ) const;
+
+ //! Return true if \p formula names one of the finite difference
+ //! operators
+ //!
+ //! The formula must consist of a single operator applied to 
+ //! variables, e.g. "curl_z(U, V)". Finite difference operators are
+ //! not part of the Expression grammar and cannot be combined with
+ //! other terms: for "div(U, V) * 2" this method returns false. Such
+ //! a formula must be split, defining the operator's result as a 
+ //! variable of its own.
+ //
+ static bool IsFinDiffFormula(string formula);
+
+ //! Split a finite difference formula into its operator, operands, and
+ //! order of accuracy
+ //!
+ //! \retval status A negative int is returned if \p formula is not a
+ //! valid finite difference formula
+ //
+ static int ParseFormula(
+	string formula, string &op, std::vector <string> &inputs, int &order
+ );
+
+private:
+
+ // The result is the sum of sign * d(input)/d(axis) over the terms
+ //
+ class term_t {
+ public:
+  int input;
+  int axis;
+  float sign;
+ };
+
+ DC *_dc;
+ DC *_derivedDC;
+ string _formula;
+ std::vector <string> _coordVars;
+ string _units;
+ std::vector <string> _inputs;
+ int _order;
+ std::vector <term_t> _terms;
+ bool _terrainFollowing;
+ DC::DataVar _dataVarInfo;
+
+ DC *_getDC(string varname) const;
+
+ // Read a variable over the region min to max of the input grid.
+ // Coordinate variables of lower rank are broadcast over the region.
+ //
+ int _readField(
+	size_t ts, int level, int lod, string varname, int axis,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	std::vector <float> &buf
+ ) const;
+
+ int _compute(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+};
+
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef DERIVEDVARPARAMS_H
+#define DERIVEDVARPARAMS_H
+
+#include <vector>
+#include <vapor/ParamsBase.h>
+
+namespace VAPoR {
+
+//! \class DerivedVarParams
+//! \ingroup Public_Params
+//! \brief Session state for derived variables defined by expressions
+//!
+//! The DerivedVarParams stores, for each data set, the name and formula
+//! of every derived variable defined with an arithmetic expression
+//! (see Expression), and the name, script, and inputs of every variable
+//! computed by a Python script (see DerivedDataVarPython). Keeping the formulas in the session state means
+//! they are saved and restored with the session, and that defining or
+//! removing a variable can be undone. The variables themselves are
+//! created on each DataMgr by the ControlExec.
+//!
+class PARAMS_API DerivedVarParams : public ParamsBase {
+public:
+
+ DerivedVarParams(ParamsBase::StateSave *ssave);
+
+ DerivedVarParams(ParamsBase::StateSave *ssave, XmlNode *node);
+
+ virtual ~DerivedVarParams() {}
+
+ //! Define, or redefine, the derived variable \p varName of the data
+ //! set \p dataSetName
+ //
+ void SetFormula(string dataSetName, string varName, string formula);
+
+ //! Return the formula of a derived variable, or the empty string if
+ //! there is no such variable
+ //
+ string GetFormula(string dataSetName, string varName) const;
+
+ //! Remove a derived variable. Does nothing if there is no such
+ //! variable.
+ //
+ void RemoveVar(string dataSetName, string varName);
+
+ //! Return the names of the derived variables of a data set, in the
+ //! order they were defined
+ //
+ std::vector <string> GetVarNames(string dataSetName) const;
+
+ //! Return the names of the data sets with derived variables
+ //
+ std::vector <string> GetDataSetNames() const;
+
+ //! Define, or redefine, the derived variable \p varName of the data
+ //! set \p dataSetName, computed by a Python script
+ //!
+ //! \sa DerivedDataVarPython
+ //
+ void SetPythonVar(
+	string dataSetName, string varName, string script,
+	const std::vector <string> &inputs
+ );
+
+ //! Return the script and inputs of a Python variable
+ //!
+ //! \retval found False if there is no such variable
+ //
+ bool GetPythonVar(
+	string dataSetName, string varName, string &script,
+	std::vector <string> &inputs
+ ) const;
+
+ //! Remove a Python variable. Does nothing if there is no such
+ //! variable.
+ //
+ void RemovePythonVar(string dataSetName, string varName);
+
+ //! Return the names of the Python variables of a data set, in the
+ //! order they were defined
+ //
+ std::vector <string> GetPythonVarNames(string dataSetName) const;
+
+ static string GetClassType() {
+	return("DerivedVarParams");
+ }
+
+private:
+ static const string _expressionsTag;
+ static const string _pythonVarsTag;
+
+ // Flattened (data set name, variable name, formula) triples
+ //
+ std::vector <string> _getExpressions() const;
+
+ // Flattened (data set name, variable name, script, inputs) quadruples.
+ // The inputs are separated by spaces.
+ //
+ std::vector <string> _getPythonVars() const;
+};
+
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include <vector>
+#include <vapor/DerivedVar.h>
+
+#ifndef	_DERIVEDVARPYTHON_H_
+#define	_DERIVEDVARPYTHON_H_
+
+namespace VAPoR {
+
+class DataMgr;
+
+//!
+//! \class DerivedDataVarPython
+//!
+//! \brief Data variable computed by a Python script
+//!
+//! The script is run with the embedded interpreter (see MyPython) once
+//! for each region of the variable read. Each input variable is bound
+//! to a read-only numpy array, named after the variable, and the
+//! derived variable itself to a writable numpy array of the same shape.
+//! Arrays are indexed in C order, [z, y, x]. The script either assigns
+//! to the output array in place, e.g.
+//!
+//! \code
+//! PRESSURE[:] = P + PB
+//! \endcode
+//!
+//! or rebinds its name to a result that numpy can broadcast to the
+//! output shape, which is then copied.
+//!
+//! The data are not copied in or out of the interpreter: inputs are
+//! read with DataMgr::GetVariable() with the lock set, and exposed
+//! through the Python buffer protocol as views of the DataMgr's cache,
+//! and the output array is a view of the DataMgr owned region being
+//! filled. Inputs stored in more than one block (e.g. those of a VDC,
+//! unless the region fits in a single block) are copied once into a
+//! contiguous array instead. The input grids are unlocked when the
+//! script returns. Scripts must not keep references to their input or
+//! output arrays, e.g. in global variables, beyond the run: the read
+//! fails if they do, and the inputs stay locked.
+//!
+//! Applications define these variables with ControlExec::AddPythonVar(),
+//! which records them in the session state.
+//!
+//! The interpreter is not thread safe, so the variable may only be
+//! read from the thread that initialized it (see
+//! MyPython::IsInterpreterThread()), normally the application's main
+//! thread. Reads from other threads fail.
+//!
+//! All inputs must be sampled on the same grid. If any input has a
+//! missing value the derived variable has the missing value of the
+//! first such input, and the script should store it wherever its
+//! result is undefined.
+//!
+class RENDER_API DerivedDataVarPython : public DerivedDataVar {
+public:
+
+ //! \param[in] varName Name of the derived variable
+ //! \param[in] dataMgr The DataMgr that the variable will be added to
+ //! with DataMgr::AddDerivedVar(), and from which its inputs are read
+ //! \param[in] script The Python script computing the variable
+ //! \param[in] inputs Names of the data variables the script reads
+ //! \param[in] units Units of the derived variable
+ //
+ DerivedDataVarPython(
+	string varName, DataMgr *dataMgr, string script,
+	const std::vector <string> &inputs, string units = ""
+ );
+ virtual ~DerivedDataVarPython() {}
+
+ //! Initialize the Python interpreter, compile the script, and check
+ //! the inputs
+ //!
+ //! \retval status A negative int is returned if the script has
+ //! syntax errors, an input is undefined, or the inputs are sampled
+ //! on different grids
+ //
+ virtual int Initialize();
+
+ //! Return the script computing the variable
+ //
+ string GetScript() const { return(_script); }
+
+ virtual bool GetBaseVarInfo(DC::BaseVar &var) const;
+
+ virtual bool GetDataVarInfo(DC::DataVar &var) const;
+
+ virtual std::vector <string> GetInputs() const {
+	return(_inputs);
+ }
+
+ virtual size_t GetNumRefLevels() const;
+
+ virtual int GetDimLensAtLevel(
+	int level, std::vector <size_t> &dims_at_level,
+	std::vector <size_t> &bs_at_level
+ ) const;
+
+ virtual int OpenVariableRead(
+	size_t ts, int level=0, int lod=0
+ );
+
+ virtual int CloseVariable(int fd);
+
+ virtual int ReadRegionBlock(
+	int fd,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+
+ virtual int ReadRegion(
+	int fd,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+
+ virtual bool VariableExists(
+	size_t ts,
+	int reflevel,
+	int lod
+ ) const;
+
+private:
+ DataMgr *_dataMgr;
+ string _script;
+ std::vector <string> _inputs;
+ string _units;
+ DC::DataVar _dataVarInfo;
+
+ int _wrongThread() const;
+
+ // Run the script over the region min to max. The result is stored in
+ // \p region, an array with dimensions \p allocDims
+ //
+ int _read(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	const std::vector <size_t> &allocDims, float *region
+ );
+};
+
+};
+
+#endif
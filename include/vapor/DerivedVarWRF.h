@@ -0,0 +1,309 @@
+#include <vector>
+#include <vapor/DerivedVar.h>
+
+#ifndef	_DERIVEDVARWRF_H_
+#define	_DERIVEDVARWRF_H_
+
+namespace VAPoR {
+
+//!
+//! \class DerivedDataVarWRF
+//!
+//! \brief Abstract base class for diagnostics derived from WRF output
+//!
+//! Diagnostics are computed from the native WRF variables (P, PB, T,
+//! QVAPOR, etc.) on the unstaggered (mass) grid, one region at a time,
+//! so that DataMgr can request them block by block and cache the
+//! results like any native variable. Inputs sampled on a staggered
+//! grid are averaged to the mass grid. Optional inputs that are not
+//! present in the data set (e.g. QGRAUP) are treated as zero.
+//!
+//! Column diagnostics (e.g. cloud top temperature) reduce each vertical
+//! column of the inputs to a single value and are sampled on the 2D
+//! horizontal mesh.
+//!
+//! The formulas follow those in the NCL WRF library, as did the Python
+//! versions in vapor_wrf.py they replace.
+//!
+class VDF_API DerivedDataVarWRF : public DerivedDataVar {
+public:
+
+ //! \param[in] varName Name of the derived variable
+ //! \param[in] dc Data collection providing the inputs
+ //! \param[in] units Units of the derived variable
+ //! \param[in] columnFlag If true the variable is 2D and computed from
+ //! entire vertical columns of the inputs
+ //! \param[in] required Names of the required inputs. The first must be
+ //! a 3D variable sampled on the mass grid
+ //! \param[in] optional Names of inputs that are treated as zero if
+ //! absent
+ //
+ DerivedDataVarWRF(
+	string varName, DC *dc, string units, bool columnFlag,
+	const std::vector <string> &required,
+	const std::vector <string> &optional = std::vector <string> ()
+ );
+ virtual ~DerivedDataVarWRF() {}
+
+ virtual int Initialize();
+
+ virtual bool GetBaseVarInfo(DC::BaseVar &var) const;
+
+ virtual bool GetDataVarInfo(DC::DataVar &var) const;
+
+ virtual std::vector <string> GetInputs() const {
+	return(_inNames);
+ }
+
+ virtual size_t GetNumRefLevels() const;
+
+ virtual int GetDimLensAtLevel(
+	int level, std::vector <size_t> &dims_at_level,
+	std::vector <size_t> &bs_at_level
+ ) const;
+
+ virtual int OpenVariableRead(
+	size_t ts, int level=0, int lod=0
+ );
+
+ virtual int CloseVariable(int fd);
+
+ virtual int ReadRegionBlock(
+	int fd,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+
+ virtual int ReadRegion(
+	int fd,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+
+ virtual bool VariableExists(
+	size_t ts,
+	int reflevel,
+	int lod
+ ) const;
+
+ //! Create and initialize all of the WRF diagnostics that can be
+ //! computed from the variables in \p dc
+ //!
+ //! Diagnostics whose required inputs are missing, or whose names
+ //! collide with variables already in \p dc, are skipped. The caller
+ //! takes ownership of the returned objects.
+ //
+ static std::vector <DerivedDataVarWRF *> CreateAll(DC *dc);
+
+protected:
+ DC *_dc;
+
+ bool _hasInput(string name) const;
+
+ //! Read an input over the mass grid region \p min to \p max
+ //!
+ //! Inputs staggered along an axis are averaged to the mass grid. A 2D
+ //! input is read over the horizontal extents of a 3D region. Absent
+ //! optional inputs are returned as zeros.
+ //
+ int _getInput(
+	size_t ts, int level, int lod, string name,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	std::vector <float> &buf
+ ) const;
+
+ //! Mass grid dimensions at \p level
+ //
+ int _getMassDims(int level, std::vector <size_t> &dims) const;
+
+ //! Compute the derived variable
+ //!
+ //! \p min and \p max specify a 3D region of the mass grid. For column
+ //! variables the region spans entire columns and the 2D result is
+ //! written to \p region.
+ //
+ virtual int _compute(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ ) = 0;
+
+ //! Return true if the variable can be derived from the contents of
+ //! the data collection
+ //
+ virtual bool _inputsExist() const;
+
+private:
+ string _units;
+ bool _columnFlag;
+ std::vector <string> _required;
+ std::vector <string> _optional;
+ std::vector <string> _inNames;
+ DC::DataVar _dataVarInfo;
+};
+
+//! \class DerivedDataVarWRF_TK
+//! \brief Temperature in Kelvin
+//
+class VDF_API DerivedDataVarWRF_TK : public DerivedDataVarWRF {
+public:
+ DerivedDataVarWRF_TK(DC *dc);
+
+protected:
+ virtual int _compute(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+};
+
+//! \class DerivedDataVarWRF_TD
+//! \brief Dewpoint temperature in degrees Celsius
+//
+class VDF_API DerivedDataVarWRF_TD : public DerivedDataVarWRF {
+public:
+ DerivedDataVarWRF_TD(DC *dc);
+
+protected:
+ virtual int _compute(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+};
+
+//! \class DerivedDataVarWRF_RH
+//! \brief Relative humidity in percent
+//
+class VDF_API DerivedDataVarWRF_RH : public DerivedDataVarWRF {
+public:
+ DerivedDataVarWRF_RH(DC *dc);
+
+protected:
+ virtual int _compute(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+};
+
+//! \class DerivedDataVarWRF_ETH
+//! \brief Equivalent potential temperature in Kelvin
+//
+class VDF_API DerivedDataVarWRF_ETH : public DerivedDataVarWRF {
+public:
+ DerivedDataVarWRF_ETH(DC *dc);
+
+protected:
+ virtual int _compute(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+};
+
+//! \class DerivedDataVarWRF_DBZ
+//! \brief Simulated radar reflectivity
+//!
+//! Reflectivity assumes constant intercept parameters for rain, snow,
+//! and graupel. If \p maxFlag is true the derived variable, DBZ_MAX,
+//! is the column maximum of the reflectivity.
+//
+class VDF_API DerivedDataVarWRF_DBZ : public DerivedDataVarWRF {
+public:
+ DerivedDataVarWRF_DBZ(DC *dc, bool maxFlag = false);
+
+protected:
+ virtual int _compute(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+
+private:
+ bool _maxFlag;
+};
+
+//! \class DerivedDataVarWRF_CTT
+//! \brief Cloud top temperature in degrees Celsius
+//!
+//! The cloud top is the level at which the optical depth integrated
+//! downward from the model top first exceeds one.
+//
+class VDF_API DerivedDataVarWRF_CTT : public DerivedDataVarWRF {
+public:
+ DerivedDataVarWRF_CTT(DC *dc);
+
+protected:
+ virtual int _compute(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+};
+
+//! \class DerivedDataVarWRF_SLP
+//! \brief Sea level pressure in hPa
+//
+class VDF_API DerivedDataVarWRF_SLP : public DerivedDataVarWRF {
+public:
+ DerivedDataVarWRF_SLP(DC *dc);
+
+protected:
+ virtual int _compute(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+};
+
+//! \class DerivedDataVarWRF_SHEAR
+//! \brief Magnitude of the horizontal wind difference between the 200
+//! and 850 hPa pressure levels
+//
+class VDF_API DerivedDataVarWRF_SHEAR : public DerivedDataVarWRF {
+public:
+ DerivedDataVarWRF_SHEAR(DC *dc, float level1 = 200.0, float level2 = 850.0);
+
+protected:
+ virtual int _compute(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+
+private:
+ float _level1;
+ float _level2;
+};
+
+//! \class DerivedDataVarWRF_PV
+//! \brief Potential vorticity in PVU
+//!
+//! Derivatives are centered differences on the mass grid, one sided
+//! at the domain boundaries. Each region is read with a one point halo
+//! so that results do not depend on how the domain is partitioned.
+//
+class VDF_API DerivedDataVarWRF_PV : public DerivedDataVarWRF {
+public:
+ DerivedDataVarWRF_PV(DC *dc);
+
+ virtual int Initialize();
+
+protected:
+ virtual int _compute(
+	size_t ts, int level, int lod,
+	const std::vector <size_t> &min, const std::vector <size_t> &max,
+	float *region
+ );
+
+ virtual bool _inputsExist() const;
+
+private:
+ double _dx;
+ double _dy;
+};
+
+};
+
+#endif
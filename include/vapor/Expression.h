@@ -0,0 +1,161 @@
+#include <string>
+#include <vector>
+#include <vapor/MyBase.h>
+#include <vapor/common.h>
+
+#ifndef	_EXPRESSION_H_
+#define	_EXPRESSION_H_
+
+namespace VAPoR {
+
+//!
+//! \class Expression
+//! \ingroup Public_VDC
+//!
+//! \brief Compiled arithmetic expression evaluated element-wise over arrays
+//!
+//! An Expression is parsed from a formula such as "sqrt(U*U + V*V)" and
+//! compiled into a short sequence of vector instructions. Each
+//! instruction operates on a chunk of at most ChunkSize elements held in
+//! a small set of scratch registers, so evaluation needs no temporaries
+//! the size of the inputs, and every instruction is a simple loop that
+//! the compiler can vectorize. Constant sub-expressions are folded at
+//! compile time.
+//!
+//! The formula may contain:
+//!
+//! \li Floating point constants, and the named constant \c pi
+//! \li Variable names: a letter or underscore followed by letters, digits,
+//! or underscores
+//! \li The binary operators \c +, \c -, \c *, \c /, and \c ^ (or \c **)
+//! for exponentiation, and unary minus
+//! \li The functions \c sqrt, \c abs, \c exp, \c log, \c log10, \c sin,
+//! \c cos, \c tan, \c asin, \c acos, \c atan, \c floor, \c ceil of one
+//! argument, and \c pow, \c atan2, \c min, \c max of two
+//!
+//! Evaluate() is const and may be called concurrently from multiple
+//! threads, each with its own scratch space.
+//!
+class VDF_API Expression : public Wasp::MyBase {
+public:
+
+ //! Number of elements processed by each instruction at a time
+ //
+ static const size_t ChunkSize = 256;
+
+ Expression();
+ virtual ~Expression() {}
+
+ //! Parse and compile a formula
+ //!
+ //! \retval status A negative int is returned if \p formula contains a
+ //! syntax error, in which case the previous formula, if any, is
+ //! retained
+ //
+ int Parse(std::string formula);
+
+ //! Return the formula most recently parsed successfully
+ //
+ std::string GetFormula() const { return(_formula); }
+
+ //! Return the names of the variables referenced by the formula
+ //!
+ //! The order of the names defines the order of the input arrays
+ //! passed to Evaluate()
+ //
+ std::vector <std::string> GetVarNames() const { return(_varNames); }
+
+ //! Number of floats of scratch space needed by Evaluate()
+ //
+ size_t GetScratchSize() const { return(_nregs * ChunkSize); }
+
+ //! Evaluate the expression element-wise
+ //!
+ //! \param[in] inputs One array of \p n elements for each variable
+ //! returned by GetVarNames()
+ //! \param[in] n Number of elements
+ //! \param[out] out Array of \p n elements receiving the result
+ //! \param[in] scratch Work space of at least GetScratchSize() floats
+ //
+ void Evaluate(
+	const float *const *inputs, size_t n, float *out, float *scratch
+ ) const;
+
+private:
+ enum op_t {
+	COPY, NEG, SQRT, ABS, EXP, LOG, LOG10, SIN, COS, TAN, ASIN, ACOS, ATAN,
+	FLOOR, CEIL,
+	ADD, SUB, MUL, DIV, POW, ATAN2, MIN, MAX
+ };
+
+ // An instruction operand: a scratch register, a chunk of an input
+ // array, or a scalar
+ //
+ class operand_t {
+ public:
+  enum kind_t {REG, INPUT, CONST};
+  kind_t kind;
+  int index;
+  float value;
+ };
+
+ // dst is a register, or -1 for the output array
+ //
+ class instr_t {
+ public:
+  op_t op;
+  int dst;
+  operand_t a;
+  operand_t b;
+ };
+
+ // Parse tree node. Operands are indices into _nodes
+ //
+ class node_t {
+ public:
+  operand_t::kind_t kind;	// REG for an operation
+  op_t op;
+  int left;
+  int right;
+  int index;
+  float value;
+ };
+
+ std::string _formula;
+ std::vector <std::string> _varNames;
+ std::vector <instr_t> _program;
+ int _nregs;
+
+ // Parser and compiler state
+ //
+ std::string _text;
+ size_t _pos;
+ std::vector <node_t> _nodes;
+ std::vector <int> _freeRegs;
+
+ void _skipSpace();
+ bool _accept(const char *token);
+ int _parseExpr();
+ int _parseTerm();
+ int _parseUnary();
+ int _parsePower();
+ int _parsePrimary();
+ int _newNode(op_t op, int left, int right);
+ int _newConst(float value);
+ int _newVar(std::string name);
+
+ operand_t _compile(int node);
+ int _allocReg();
+ void _releaseReg(const operand_t &o);
+
+ static bool _isBinary(op_t op);
+ static float _evalScalar(op_t op, float a, float b);
+ static void _apply(
+	op_t op, size_t n, const float *a, float av, const float *b, float bv,
+	float *dst
+ );
+};
+
+};
+
+#endif
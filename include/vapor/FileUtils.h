@@ -15,6 +15,7 @@ enum class FileType {
 std::string ReadFileToString(const std::string &path);
 std::string Basename(const std::string &path);
 long GetFileModifiedTime(const std::string &path);
+long long GetFileSize(const std::string &path);
 bool FileExists(const std::string &path);
 bool IsRegularFile(const std::string &path);
 bool IsDirectory(const std::string &path);
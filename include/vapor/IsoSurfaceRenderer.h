@@ -24,6 +24,10 @@ public:
 protected:
     void _loadShaders();
     void _3rdPassSpecialHandling( bool );
+    void _classifyMacroCells( std::vector<unsigned char>& occupancy );
+
+    // Enabled iso values, normalized w.r.t. the value range of the volume
+    std::vector<float> _getNormalizedIsoValues() const;
 };
 
 };
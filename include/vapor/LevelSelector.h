@@ -0,0 +1,99 @@
+//
+//	File:		LevelSelector.h
+//
+//	Description:	Choose multiresolution refinement and compression
+//					levels from the projected screen size of a region
+//
+
+#ifndef	_LevelSelector_h_
+#define	_LevelSelector_h_
+
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+#include <vapor/MyBase.h>
+
+namespace VAPoR {
+
+class DataMgr;
+
+//! \class LevelSelector
+//! \ingroup Public_Render
+//! \brief Select the coarsest data resolution that is adequate for display
+//!
+//! LevelSelector chooses a refinement level and a level of detail
+//! (compression level) for a variable such that the number of grid
+//! samples spanning the rendered region along each axis is no smaller
+//! than the number of screen pixels the region covers along that axis.
+//! Drawing a region that covers a few hundred pixels from a
+//! multi-gigabyte finest level wastes I/O and decompression time
+//! without improving the image.
+//!
+//! \sa RenderParams::SetAutoLevel()
+//
+class RENDER_API LevelSelector : public Wasp::MyBase {
+public:
+
+ //! Compute the screen footprint of an axis-aligned box
+ //!
+ //! Projects the eight corners of the box with \p minExts, \p maxExts
+ //! by \p mvp and returns, for each axis of the box, the greatest
+ //! length in pixels of a box edge parallel to that axis.
+ //!
+ //! \param[in] minExts Minimum box extents in user coordinates. Either
+ //! two or three elements
+ //! \param[in] maxExts Maximum box extents in user coordinates
+ //! \param[in] mvp The model view projection matrix
+ //! \param[in] viewport The viewport, as returned by glGetIntegerv(GL_VIEWPORT)
+ //! \param[out] pixels The projected length in pixels of each axis of the
+ //! box. Has the same number of elements as \p minExts
+ //!
+ //! \retval status Returns false if any corner of the box lies on or
+ //! behind the eye plane, in which case the footprint is unbounded and
+ //! \p pixels is not meaningful. Otherwise returns true.
+ //
+ static bool ScreenFootprint(
+	const std::vector <double> &minExts,
+	const std::vector <double> &maxExts,
+	const glm::mat4 &mvp, const int viewport[4],
+	std::vector <double> &pixels
+ );
+
+ //! Select the refinement level and level of detail for a variable
+ //!
+ //! Selects the coarsest refinement level whose grid has at least as
+ //! many samples across the box as the box covers pixels, and the
+ //! coarsest level of detail whose effective resolution (the native
+ //! grid resolution reduced by the cube, or square, root of the
+ //! compression ratio) does likewise. Neither will exceed the limits
+ //! \p maxLevel and \p maxLod.
+ //!
+ //! \param[in] dataMgr Data manager providing \p varname
+ //! \param[in] ts Time step used to determine the variable's domain
+ //! \param[in] varname Name of the variable to be rendered
+ //! \param[in] minExts Minimum extents of the rendered region
+ //! \param[in] maxExts Maximum extents of the rendered region
+ //! \param[in] mvp The model view projection matrix
+ //! \param[in] viewport The viewport
+ //! \param[in] maxLevel Finest refinement level that may be selected
+ //! \param[in] maxLod Finest level of detail that may be selected
+ //! \param[out] level Selected refinement level
+ //! \param[out] lod Selected level of detail
+ //!
+ //! \retval status A negative int is returned if the variable's
+ //! dimensions or extents can't be determined. In this case \p level
+ //! and \p lod are set to \p maxLevel and \p maxLod.
+ //
+ static int SelectLevels(
+	DataMgr *dataMgr, size_t ts, std::string varname,
+	const std::vector <double> &minExts,
+	const std::vector <double> &maxExts,
+	const glm::mat4 &mvp, const int viewport[4],
+	int maxLevel, int maxLod, int &level, int &lod
+ );
+
+};
+
+};
+
+#endif
@@ -5,6 +5,7 @@
 #ifndef	_MYPYTHON_h_
 #define	_MYPYTHON_h_
 
+#include <thread>
 #include <vapor/MyBase.h>
 
 #ifdef WIN32
@@ -91,10 +92,20 @@ public:
     string moduleName, string funcName, string script
  );
 
+ //! Return true if the calling thread may use the interpreter
+ //!
+ //! The interpreter is initialized without thread support, so it may
+ //! only be used by the thread that called Initialize(). Returns true
+ //! if that is the calling thread, or if the interpreter has not yet
+ //! been initialized by any thread.
+ //
+ static bool IsInterpreterThread();
+
 private:
  static MyPython *m_instance;
  static bool m_isInitialized;
  static std::string m_pyHome;
+ static std::thread::id m_thread;
 
  MyPython() {}	// Don't implement
  MyPython(MyPython const&);	// Don't Implement
@@ -132,6 +132,85 @@ public:
 	const std::vector <string> &time_coordvar
  );
 
+ //! Specify a file used to cache the collection's metadata
+ //!
+ //! Scanning the metadata of a large collection of files (thousands
+ //! of hourly WRF files, for example) can take minutes. If an index
+ //! file is specified, Initialize() records in it the
+ //! dimensions, variables, attributes, and time coordinates of each
+ //! file, together with the file's size and modification time. 
+ //! Subsequent calls to Initialize(), from this or any other process,
+ //! take the metadata for unchanged files from the index rather
+ //! than opening them. The index is rewritten whenever a file had 
+ //! to be scanned. Failure to read or write the index is not an error;
+ //! the files are simply scanned.
+ //!
+ //! This method must be called before Initialize() to have an effect.
+ //!
+ //! \param[in] path Path to the index file. If empty, no index is used.
+ //!
+ //! \sa DefaultIndexFile()
+ //
+ void SetIndexFile(string path);
+
+ //! Return the index file set by SetIndexFile()
+ //
+ string GetIndexFile() const { return(_indexFile); }
+
+ //! Return the default index file for a collection
+ //!
+ //! If the environment variable VAPOR_NETCDF_INDEX_DIR names
+ //! a directory this method returns a path to a file in that
+ //! directory whose name is derived from the list of files in 
+ //! \p files. Otherwise an empty string is returned.
+ //!
+ //! \sa SetIndexFile()
+ //
+ static string DefaultIndexFile(const std::vector <string> &files);
+
+ //! Look up values recorded in the index with SetIndexedValues()
+ //!
+ //! \param[in] file Path to a file of the collection
+ //! \param[in] name Name under which the values were recorded
+ //! \param[out] values The recorded values
+ //!
+ //! \retval status True if values are recorded for \p name and
+ //! \p file, and \p file has not changed since they were recorded.
+ //!
+ //! \sa SetIndexedValues()
+ //
+ bool GetIndexedValues(
+	string file, string name, std::vector <double> &values
+ ) const;
+
+ //! Record values computed from a file in the index
+ //!
+ //! Users of the collection may record in the index values that are
+ //! expensive to compute from a file, e.g. times decoded from
+ //! formatted date strings, so that they can be retrieved with 
+ //! GetIndexedValues() when the collection is opened again. The 
+ //! values are discarded if the file changes. This method does 
+ //! nothing if no index file is in use. The index is not
+ //! written until FlushIndex() or Initialize() is called.
+ //!
+ //! \param[in] file Path to a file of the collection
+ //! \param[in] name Name under which the values are recorded
+ //! \param[in] values The values
+ //!
+ //! \sa SetIndexFile(), FlushIndex()
+ //
+ void SetIndexedValues(
+	string file, string name, const std::vector <double> &values
+ );
+
+ //! Write the index if it has changed
+ //!
+ //! \retval status A negative int is returned on failure.
+ //!
+ //! \sa SetIndexedValues()
+ //
+ int FlushIndex();
+
  //! Return a boolean indicating whether a variable exists in the 
  //! data collection.
  //!
@@ -561,7 +640,10 @@ public:
  //! 1. If the opened variable has staggered dimensions, the data are
  //! resampled onto the non-staggered grid. Moreover, the region coordinates
  //! (\p start and \p count) should be specified in the 
- //! non-staggered coordinates.
+ //! non-staggered coordinates. Only the hyperslab needed to reconstruct
+ //! the region (one extra sample along each staggered dimension) is
+ //! read from the file, so the cost scales with the size of the region
+ //! rather than that of the variable.
  //!
  //! 2. If the currently
  //! opened variable is explicitly time-varying (has a time-varying 
@@ -863,6 +945,8 @@ private:
   size_t _slicebufsz;
   unsigned char *_linebuf;
    size_t _linebufsz;
+  unsigned char *_regionbuf;	// native hyperslab for staggered Read()
+  size_t _regionbufsz;
   TimeVaryingVar _tvvars;
   bool _has_missing;
   double _missing_value;
@@ -872,6 +956,31 @@ private:
  //
  std::map<int, NetCDFCollection::fileHandle> _ovr_table;
 
+ //
+ // Metadata for a single file as recorded in the index
+ //
+ class indexEntry {
+ public:
+  indexEntry() : _mtime(0), _size(0) {}
+  long _mtime;
+  long long _size;
+  string _metadata;	// output of NetCDFSimple::Serialize()
+  std::map <string, std::vector <double> > _timeCoords;
+  std::map <string, std::vector <double> > _derivedValues;
+ };
+
+ string _indexFile;
+ std::map <string, indexEntry> _index;
+ bool _indexDirty;
+
+ int _readIndex();
+ int _writeIndex();
+ NetCDFSimple *_scanFile(string file);
+ int _getTimeCoordVar(
+	string file, const NetCDFSimple::Variable &variable,
+	std::vector <double> &times
+ );
+
  void ReInitialize();
 
  int _InitializeTimesMap(
@@ -881,7 +990,7 @@ private:
     std::map <string, std::vector <double> > &timesMap,
 	std::vector <double> &times,
 	int &file_org
- ) const;
+ );
 
  int _InitializeTimesMapCase1(
 	const std::vector <string> &files,
@@ -899,7 +1008,7 @@ private:
 	const std::vector <string> &time_dimnames,
 	const std::vector <string> &time_coordvars,
     std::map <string, std::vector <double> > &timesMap
- ) const;
+ );
 
  void _InterpolateLine(
 	const float *src, size_t n, size_t stride, 
@@ -911,6 +1020,15 @@ private:
 	bool has_missing, float mv, float *slice
  ) const;
 
+ void _InterpolateRegion(
+	const float *src, const size_t count[3], const bool stag[3],
+	bool has_missing, float mv, float *dst
+ ) const;
+
+ int _readStaggered(
+	size_t start[], size_t count[], float *data, int fd
+ );
+
 int _GetTimesMap(
 	NetCDFSimple *netcdf,
 	const std::vector <string> &time_coordvars,
@@ -124,6 +124,18 @@ public:
 		_str_atts.push_back(make_pair(name, values));
 	}
 
+	//! Write the variable definition to a binary stream
+	//!
+	//! \sa Deserialize()
+	//
+	void Serialize(std::ostream &o) const;
+
+	//! Restore a variable definition written by Serialize()
+	//!
+	//! \retval status false if the stream is truncated or corrupt
+	//
+	bool Deserialize(std::istream &i);
+
 	VDF_API friend std::ostream &operator<<(std::ostream &o, const Variable &var);
 	VDF_API friend bool operator==(const Variable &v1, const Variable &v2) {
 		return(
@@ -159,6 +171,28 @@ public:
  //!
  int Initialize(string path);
 
+ //! Write the file metadata to a binary stream
+ //!
+ //! Writes the path, dimensions, global attributes, and variable
+ //! definitions gathered by Initialize() to \p o, so that they
+ //! may later be restored by Deserialize() without opening the
+ //! netCDF file. 
+ //!
+ //! \sa Deserialize(), NetCDFCollection::SetIndexFile()
+ //
+ void Serialize(std::ostream &o) const;
+
+ //! Initialize the class instance from metadata written by Serialize()
+ //!
+ //! After a successful call the class instance behaves as if
+ //! Initialize() had been called on the file. The netCDF file itself
+ //! is not opened until data are read.
+ //!
+ //! \retval status A negative int is returned if the stream is 
+ //! truncated or corrupt
+ //
+ int Deserialize(std::istream &i);
+
  //! Open the named variable for reading
  //!
  //! This method prepares a netCDF variable
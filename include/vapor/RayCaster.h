@@ -62,6 +62,12 @@ protected:
         unsigned char* missingValueMask; // 0 == is missing value; non-zero == not missing value
         float   valueRange[2];           // min and max values of the volume
         size_t  dims[3];                 // num. of samples along each axis
+
+        // Min and max normalized values of the samples that each macro cell
+        //   of MacroCellSize^3 voxels interpolates from, 2 floats per cell.
+        std::vector<float> macroCellRange;
+        size_t  macroCellDims[3];        // num. of macro cells along each axis
+        static const size_t MacroCellSize = 8;
         float   boxMin[3], boxMax[3];    // bounding box of the current volume
                 // !! NOTE boxMin and boxMax most likely differ from extents from  params !!
 
@@ -85,9 +91,14 @@ protected:
         StructuredGrid* GetCurrentGrid( const RayCasterParams* params,
                                               DataMgr*         dataMgr ) const;
         bool IsUpToDate(                const RayCasterParams* params,
-                                              DataMgr*         dataMgr ) const;
+                                              DataMgr*         dataMgr,
+                                              int              refLevel,
+                                              int              compLevel ) const;
         bool UpdateCoordinates(         const RayCasterParams* params,
-                                              DataMgr*         dataMgr );
+                                              DataMgr*         dataMgr,
+                                              int              refLevel,
+                                              int              compLevel );
+        void UpdateMacroCells();
     };  // end of struct UserCoordinates 
 
     UserCoordinates     _userCoordinates;
@@ -101,6 +112,10 @@ protected:
     GLuint              _volumeTextureId;           // GL_TEXTURE2
     GLuint              _missingValueTextureId;     // GL_TEXTURE3
     GLuint              _colorMapTextureId;         // GL_TEXTURE4 
+    GLuint              _macroCellTextureId;        // GL_TEXTURE5
+    GLuint              _sceneDepthTextureId;       // GL_TEXTURE6
+    bool                _hasSceneDepth;             // scene depth was copied to texture
+    std::vector<unsigned char> _macroCellOccupancy; // 0 == skip this macro cell
 
     // buffers
     GLuint              _frameBufferId;
@@ -139,6 +154,23 @@ protected:
 
     virtual void _3rdPassSpecialHandling( bool fast );
 
+    //
+    // Decide which macro cells may contribute to the image, given the
+    //   value range in _userCoordinates.macroCellRange of each cell.
+    //   The default considers the opacity of the transfer function.
+    //
+    virtual void _classifyMacroCells( std::vector<unsigned char>& occupancy );
+
+    //
+    // Classify the macro cells and upload the result if it changed
+    //
+    void _updateMacroCellTexture( bool force );
+
+    //
+    // Copy the depth of the geometry rendered so far so rays stop behind it
+    //
+    void _copySceneDepth();
+
     // 
     // Initialization for 1) framebuffers and 2) textures 
     //
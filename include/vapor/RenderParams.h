@@ -183,6 +183,27 @@ public:
 	//!
 	virtual void SetCompressionLevel(int val);
 
+	//! Enable or disable automatic level selection
+	//!
+	//! When enabled, renderers that support it choose the refinement
+	//! and compression levels from the projected screen size of the
+	//! region being rendered, using the values of GetRefinementLevel()
+	//! and GetCompressionLevel() as upper bounds. Coarser levels are
+	//! drawn while the view is changing and refined once the camera
+	//! is idle. Default is false.
+	//!
+	//! \param[in] val true to enable automatic level selection
+	//!
+	//! \sa GetRefinementLevel(), GetCompressionLevel()
+	//
+	virtual void SetAutoLevel(bool val);
+
+	//! Return true if automatic level selection is enabled
+	//!
+	//! \sa SetAutoLevel()
+	//
+	virtual bool GetAutoLevel() const;
+
 	//! Pure virtual method indicates whether or not the object will render as opaque.
 	//! Important to support multiple transparent (nonoverlapping) objects in the scene
 	//! \retval bool true if all geometry is opaque.
@@ -397,6 +418,7 @@ private:
  static const string _constantOpacityTag;
  static const string _CompressionLevelTag;
  static const string _RefinementLevelTag;
+ static const string _AutoLevelTag;
  static const string _transferFunctionsTag;
  static const string _stretchFactorsTag;
  static const string _currentTimestepTag;
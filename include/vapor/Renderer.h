@@ -25,6 +25,7 @@
 #include <vapor/MyBase.h>
 #include <vapor/ParamsMgr.h>
 #include <vapor/RenderParams.h>
+#include <glm/glm.hpp>
 
 namespace VAPoR {
 
@@ -147,11 +148,50 @@ public:
 	//! \retval default height value for current dataset
 	double _getDefaultZ(DataMgr* dataMgr, size_t ts) const;
 
+	//! Begin drawing a frame
+	//!
+	//! Renderers draw a frame in up to three phases: BeginPaint(),
+	//! Prepare(), and paintGL(). BeginPaint() and paintGL() must be
+	//! invoked from the OpenGL rendering context with the view transform
+	//! in place. BeginPaint() captures the view dependent state (e.g. 
+	//! automatic level selection) needed by Prepare(). Callers that do 
+	//! not need to separate data preparation from drawing may simply 
+	//! invoke paintGL().
+	//!
+	//! \sa Prepare(), paintGL()
+	//
+	virtual int BeginPaint(bool fast);
+
+	//! Prepare the data for the next call to paintGL()
+	//!
+	//! Performs the CPU work, such as reading data from the DataMgr and
+	//! building geometry or textures, needed by the next call to 
+	//! paintGL(). This method makes no OpenGL calls and may be invoked
+	//! from a thread other than the rendering thread, but not
+	//! concurrently with other calls to the DataMgr. It must follow
+	//! BeginPaint(), and does nothing otherwise.
+	//!
+	//! \retval int zero if successful.
+	//!
+	//! \sa BeginPaint(), _prepare()
+	//
+	int Prepare(bool fast);
+
 	//! All OpenGL rendering is performed in the paintGL method.
 	//! This invokes _paintGL on the renderer subclass
 	//! \param[in] dataMgr Current (valid) dataMgr
 	//! \retval int zero if successful.
     virtual int		paintGL(bool fast);
+
+	//! Return true if the most recent paintGL() drew the scene at a
+	//! coarser resolution than automatic level selection calls for.
+	//! A subsequent call to paintGL(false) with an unchanged view will
+	//! draw the scene at a finer resolution. Always false unless
+	//! RenderParams::GetAutoLevel() is true.
+	//!
+	//! \sa RenderParams::SetAutoLevel(), GetRefinementLevel()
+	//
+	bool NeedsRefinement() const;
 	
 
 #ifdef	VAPOR3_0_0_ALPHA
@@ -270,6 +310,37 @@ protected:
 	//! All OpenGL rendering is performed in the pure virtual paintGL method.
     virtual int	_paintGL(bool fast) = 0;
 
+	//! Perform the CPU work for the next _paintGL()
+	//!
+	//! Renderers that read data or build geometry should do so here,
+	//! caching the results for _paintGL(), which should then only
+	//! upload and draw them. _paintGL() must still produce correct 
+	//! results if _prepare() was not invoked first. Implementations 
+	//! must not make OpenGL calls or modify params. The default 
+	//! does nothing.
+	//!
+	//! \sa Prepare()
+	//
+	virtual int _prepare(bool fast) {return(0); }
+
+	//! Return the refinement level to be drawn by _paintGL()
+	//!
+	//! Returns RenderParams::GetRefinementLevel() unless automatic
+	//! level selection is enabled, in which case the level chosen from
+	//! the screen footprint of the render region is returned.
+	//! Renderers that support automatic level selection should call
+	//! this method rather than RenderParams::GetRefinementLevel().
+	//!
+	//! \sa RenderParams::SetAutoLevel(), LevelSelector
+	//
+	int GetRefinementLevel() const;
+
+	//! Return the compression level to be drawn by _paintGL()
+	//!
+	//! \sa GetRefinementLevel()
+	//
+	int GetCompressionLevel() const;
+
 	//! Enable specified clipping planes during the GL rendering. This
 	//! method clips the scene to the bounding box. See 
 	//!! RenderParams::GetBox()
@@ -315,6 +386,22 @@ private:
 
 	size_t _timestep;
 
+	// State of automatic level selection. The target levels are those
+	// selected from the screen footprint, the current levels are the
+	// ones drawn, which lag behind the target while the view changes.
+	//
+	bool _autoLevel;
+	int _targetLevel, _targetLod;
+	int _currentLevel, _currentLod;
+	glm::mat4 _lastMVP;	// zero until the first frame is drawn
+
+	// True between BeginPaint() and paintGL()
+	//
+	bool _paintBegun;
+
+	void _updateAutoLevel(const RenderParams *rParams, bool fast);
+	void _pushTransform(const RenderParams *rParams);
+
 #ifdef	VAPOR3_0_0_ALPHA
 	static ControlExec* _controlExec;
 #endif
@@ -0,0 +1,154 @@
+//
+//	File:		ThreadPool.h
+//
+//	Description:	A persistent, process-wide work-stealing task pool
+//
+
+#ifndef	_ThreadPool_h_
+#define	_ThreadPool_h_
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vapor/MyBase.h>
+
+namespace Wasp {
+
+
+//! \class ThreadPool
+//! \brief A persistent work-stealing pool of worker threads
+//!
+//! ThreadPool maintains a fixed set of worker threads that execute
+//! tasks submitted through a TaskGroup, or through ParallelFor().
+//! Each worker owns a task queue. Tasks submitted from a worker thread
+//! are pushed onto the worker's own queue, and idle workers steal
+//! from the queues of busy ones, so uneven work is balanced without
+//! a static partition.
+//!
+//! A single pool, returned by Instance(), is shared by all modules
+//! so that nested parallel code (e.g. a parallel derived variable
+//! calculation that reads compressed data in parallel) does not
+//! oversubscribe the machine. A thread waiting on a TaskGroup
+//! executes pending tasks while it waits, so nested waits cannot
+//! deadlock the pool.
+//!
+//! \sa EasyThreads
+//
+class COMMON_API ThreadPool : public MyBase {
+public:
+
+ //! Construct a pool
+ //!
+ //! \param[in] nthreads Total number of threads that execute tasks,
+ //! including the calling thread, which participates while waiting.
+ //! nthreads - 1 worker threads are created. If \p nthreads is less
+ //! than one the number of processors is used.
+ //
+ ThreadPool(int nthreads);
+ virtual ~ThreadPool();
+
+ //! Return the process-wide pool
+ //!
+ //! The pool is created on first use. Its size is taken from the
+ //! environment variable VAPOR_NTHREADS, if set, otherwise
+ //! it matches the number of processors.
+ //
+ static ThreadPool *Instance();
+
+ //! Return the number of threads that may execute tasks concurrently,
+ //! including the calling thread
+ //
+ int GetNumThreads() const {return((int) _queues.size() + 1); }
+
+ //! \class TaskGroup
+ //! \brief A collection of tasks that can be waited on together
+ //!
+ //! The destructor waits for any tasks still outstanding.
+ //
+ class COMMON_API TaskGroup {
+ public:
+	TaskGroup(ThreadPool *pool = NULL);
+	~TaskGroup();
+
+	//! Submit a task for asynchronous execution
+	//!
+	//! If the pool has no worker threads the task is run immediately
+	//! by the calling thread.
+	//
+	void Run(const std::function<void()> &task);
+
+	//! Wait for all tasks submitted to the group to complete
+	//!
+	//! The calling thread executes queued tasks while it waits.
+	//
+	void Wait();
+
+ private:
+	friend class ThreadPool;
+	ThreadPool *_pool;
+	std::atomic<int> _pending;
+	std::mutex _mutex;
+	std::condition_variable _cv;
+
+	void _done();
+
+	TaskGroup(const TaskGroup &);
+	TaskGroup &operator=(const TaskGroup &);
+ };
+
+ //! Execute a function over a range of indices in parallel
+ //!
+ //! The half-open range [\p begin, \p end) is divided into chunks
+ //! of at most \p grain indices, and \p f is invoked once for each chunk
+ //! with the chunk's bounds. Chunks are handed out dynamically,
+ //! so chunks with uneven costs are balanced across threads. The calling
+ //! thread participates and the method returns once all chunks
+ //! are complete.
+ //!
+ //! \param[in] begin First index
+ //! \param[in] end One past the last index
+ //! \param[in] grain Maximum number of indices per chunk. If zero a
+ //! grain is chosen that yields several chunks per thread
+ //! \param[in] f Function invoked as f(chunk_begin, chunk_end)
+ //
+ void ParallelFor(
+	size_t begin, size_t end, size_t grain,
+	const std::function<void(size_t, size_t)> &f
+ );
+
+private:
+ struct task_t {
+	std::function<void()> fn;
+	TaskGroup *group;
+ };
+
+ class queue_t {
+ public:
+	std::mutex mutex;
+	std::deque <task_t> tasks;
+ };
+
+ std::vector <queue_t *> _queues;	// one per worker
+ std::vector <std::thread> _workers;
+ std::atomic<int> _queued;
+ std::atomic<unsigned int> _next_queue;
+ std::mutex _sleep_mutex;
+ std::condition_variable _sleep_cv;
+ bool _shutdown;
+
+ void _submit(const task_t &task);
+ bool _run_one(int self);
+ bool _pop(int qidx, bool steal, task_t &task);
+ void _worker(int id);
+
+ ThreadPool(const ThreadPool &);
+ ThreadPool &operator=(const ThreadPool &);
+};
+
+};
+
+#endif
@@ -0,0 +1,157 @@
+//
+//	File:		Trace.h
+//
+//	Description:	Low overhead, compile-time switchable tracing of
+//					scoped spans and counters, exported in the Chrome
+//					trace event JSON format
+//
+
+#ifndef	_Trace_h_
+#define	_Trace_h_
+
+#include <string>
+#include <vapor/MyBase.h>
+
+namespace Wasp {
+
+
+//! \class Trace
+//! \brief Record timed spans and counters for performance analysis
+//!
+//! The Trace class records scoped spans (named intervals of execution,
+//! tagged with the id of the calling thread and nanosecond timestamps)
+//! and counters (e.g. bytes read, blocks decoded, cache hits). The
+//! recorded events may be written to a file in the Chrome trace event
+//! JSON format and viewed with chrome://tracing or Perfetto.
+//!
+//! Instrumentation should be expressed with the VAPOR_TRACE_SCOPE()
+//! and VAPOR_TRACE_COUNTER() macros. These expand to nothing unless
+//! the code is compiled with \c VAPOR_TRACE defined (CMake option
+//! BUILD_TRACE), so instrumented hot paths carry no cost in regular
+//! builds. When compiled in, recording is further controlled at run time
+//! by Enable(). If the environment variable \c VAPOR_TRACE_FILE is set
+//! recording is enabled at start up and the trace is written to
+//! the file it names when the process exits.
+//!
+//! Events are buffered per thread, so recording does not contend
+//! on a global lock.
+//
+class COMMON_API Trace : public MyBase {
+public:
+
+ //! Enable or disable recording of trace events
+ //!
+ //! Events are only recorded while tracing is enabled. Disabling tracing
+ //! does not discard events already recorded.
+ //!
+ //! \sa IsEnabled(), Clear()
+ //
+ static void Enable(bool enable);
+
+ //! Return true if trace events are currently being recorded
+ //
+ static bool IsEnabled();
+
+ //! Return a nanosecond timestamp relative to the trace epoch
+ //
+ static long long Now();
+
+ //! Record a completed span
+ //!
+ //! \param[in] name Name of the span. The string must remain valid
+ //! for the lifetime of the process (e.g. a string literal or a value
+ //! returned by Intern()).
+ //! \param[in] start Start time, in nanoseconds, as returned by Now()
+ //! \param[in] end End time, in nanoseconds, as returned by Now()
+ //
+ static void AddSpan(const char *name, long long start, long long end);
+
+ //! Increment a counter
+ //!
+ //! \param[in] name Name of the counter. The string must remain valid
+ //! for the lifetime of the process.
+ //! \param[in] delta Amount to add to the counter
+ //
+ static void AddCount(const char *name, long long delta);
+
+ //! Return a persistent copy of a string suitable for use as an event name
+ //!
+ //! Returns a pointer to a string with the same contents as \p name that
+ //! remains valid until the process exits. Repeated calls with the
+ //! same contents return the same pointer.
+ //
+ static const char *Intern(const std::string &name);
+
+ //! Discard all recorded events
+ //
+ static void Clear();
+
+ //! Write all recorded events to a file
+ //!
+ //! Write all events recorded so far, from all threads, to the file
+ //! named by \p path using the Chrome trace event JSON format.
+ //!
+ //! \retval status A negative int is returned on failure
+ //
+ static int WriteJSON(const std::string &path);
+
+ //! \class Scope
+ //! \brief Record a span covering the lifetime of the object
+ //
+ class Scope {
+ public:
+	Scope(const char *name) {
+		_name = IsEnabled() ? name : NULL;
+		_start = _name ? Now() : 0;
+	}
+	~Scope() {
+		if (_name) AddSpan(_name, _start, Now());
+	}
+
+ private:
+	const char *_name;
+	long long _start;
+
+	Scope(const Scope &);
+	Scope &operator=(const Scope &);
+ };
+
+};
+
+};
+
+#define VAPOR_TRACE_CONCAT_(a,b) a##b
+#define VAPOR_TRACE_CONCAT(a,b) VAPOR_TRACE_CONCAT_(a,b)
+
+#ifdef	VAPOR_TRACE
+
+//! Record a span, named by the string literal \p name, that lasts until
+//! the end of the enclosing scope
+//
+#define VAPOR_TRACE_SCOPE(name) \
+	Wasp::Trace::Scope VAPOR_TRACE_CONCAT(_vapor_trace_scope_, __LINE__)(name)
+
+//! Record a span with a name computed at run time. \p name is only
+//! evaluated when tracing is enabled.
+//
+#define VAPOR_TRACE_SCOPE_DYNAMIC(name) \
+	Wasp::Trace::Scope VAPOR_TRACE_CONCAT(_vapor_trace_scope_, __LINE__)( \
+		Wasp::Trace::IsEnabled() ? Wasp::Trace::Intern(name) : NULL \
+	)
+
+//! Add \p delta to the counter named by the string literal \p name
+//
+#define VAPOR_TRACE_COUNTER(name, delta) \
+	do { \
+		if (Wasp::Trace::IsEnabled()) Wasp::Trace::AddCount((name), (delta)); \
+	} while (0)
+
+#else
+
+#define VAPOR_TRACE_SCOPE(name)
+#define VAPOR_TRACE_SCOPE_DYNAMIC(name)
+#define VAPOR_TRACE_COUNTER(name, delta) do {} while (0)
+
+#endif
+
+#endif
@@ -19,6 +19,9 @@
 #ifndef TWODDATARENDERER_H
 #define TWODDATARENDERER_H
 
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 #include <GL/glew.h>
 
 #ifdef Darwin
@@ -82,6 +85,8 @@ protected:
                             size_t &texelSize,
                             bool &gridAligned);
 
+ const GLubyte *GetMissingMask() const;
+
 
 	
 private:
@@ -179,16 +184,49 @@ private:
   vector <double> _maxExts;
  };
 
+ // Data values for one time step, and the missing data mask if any 
+ // values are missing
+ //
+ class _texture_c {
+ public:
+  _texture_c() : _width(0), _height(0), _hasMask(false), _valid(false) {
+	_state.clear();
+  }
+  _tex_state_c _state;
+  SmartBuf _sb_values;
+  SmartBuf _sb_mask;
+  GLsizei _width;
+  GLsizei _height;
+  bool _hasMask;
+  bool _valid;
+ };
+
  _grid_state_c _grid_state;
- _tex_state_c _tex_state;
 
- GLsizei _texWidth;
- GLsizei _texHeight;
- size_t _texelSize;
+ // The texture being displayed, and a second texture into which the 
+ // following time step is read in the background while animating
+ //
+ _texture_c _textures[2];
+ int _front;
+ long _lastTs;
+
+ // State of the read ahead, shared with the task that does it, which
+ // may run after the renderer is gone if it was cancelled
+ //
+ class _prefetch_c {
+ public:
+  _prefetch_c() : _queued(false), _running(false) {}
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  bool _queued;
+  bool _running;
+ };
+ std::shared_ptr <_prefetch_c> _prefetch;
+
  SmartBuf _sb_verts;
  SmartBuf _sb_normals;
  SmartBuf _sb_indices;
- SmartBuf _sb_texture;
  GLsizei _vertsWidth;
  GLsizei _vertsHeight;
  GLsizei _nindices;
@@ -203,11 +241,7 @@ private:
 
  void _gridStateSet();
 
- bool _texStateDirty(DataMgr *dataMgr) const; 
-
- void _texStateSet(DataMgr *dataMgr); 
-
- void _texStateClear(); 
+ _tex_state_c _texStateCurrent() const; 
 
 
  int _getMeshStructured(
@@ -240,6 +274,18 @@ private:
 
  const GLvoid *_getTexture(DataMgr* dataMgr);
 
+ int _readTexture(
+	DataMgr *dataMgr, size_t ts, string varname, int refLevel, int lod,
+	vector <double> minExts, vector <double> maxExts, _texture_c &tex
+ ) const;
+
+ void _prefetchTexture(
+	DataMgr *dataMgr, size_t ts, string varname, int refLevel, int lod,
+	vector <double> minExts, vector <double> maxExts
+ );
+
+ void _waitPrefetch();
+
 
  int _getOrientation( DataMgr *dataMgr, string varname);
 
@@ -107,6 +107,7 @@ protected:
  // is true, type must be GL_FLOAT
  //
  // texelSize: Size, in bytes, of a single element returned by GetTexture.
+ // If gridAligned is true each element is a single float data value.
  //
  // gridAligned : bool. If true data are coincident with mesh returned by
  // GetMesh()
@@ -120,6 +121,15 @@ protected:
                                     size_t &texelSize,
                                     bool &gridAligned) = 0;
 
+ // Return the missing data mask for the data most recently returned by
+ // GetTexture(), or NULL if none of the data are missing. The mask 
+ // contains one byte per data value, non-zero if the value is missing.
+ // Only used if the data are grid aligned.
+ //
+ virtual const GLubyte *GetMissingMask() const {
+	return(NULL);
+ }
+
 
  //! \copydoc Renderer::_initializeGL()
  virtual int _initializeGL();
@@ -127,6 +137,13 @@ protected:
  //! \copydoc Renderer::_paintGL()
  virtual int _paintGL(bool fast);
 
+ //! \copydoc Renderer::_prepare()
+ //!
+ //! Invokes GetTexture() and GetMesh(), which are expected to cache
+ //! their results so that the calls made by _paintGL() are cheap.
+ //
+ virtual int _prepare(bool fast);
+
  //! Compute 2D surface normals at each vertex.
  //!
  //! This protected method can be used by derived classes to calculate
@@ -180,7 +197,7 @@ private:
  GLsizei _nindices;
  SmartBuf _sb_texCoords;
     
- GLuint _VAO, _VBO, _dataVBO, _EBO;
+ GLuint _VAO, _VBO, _dataVBO, _maskVBO, _EBO;
  
  
  void _openGLInit();
@@ -782,6 +782,12 @@ public:
 
  ) const = 0;
 
+ //! Return the path to the master file
+ //!
+ //! \sa Initialize(), GetPath()
+ //
+ string GetMasterPath() const { return(_master_path); }
+
 
  //! Open the named variable for writing
  //!
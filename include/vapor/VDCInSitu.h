@@ -0,0 +1,167 @@
+//
+//	File:		VDCInSitu.h
+//
+//	Description:	Write VDC data variables from a running simulation,
+//					compressing and writing on background threads
+//
+
+#ifndef	_VDCInSitu_h_
+#define	_VDCInSitu_h_
+
+#include <string>
+#include <vector>
+#include <list>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <vapor/MyBase.h>
+#include <vapor/ThreadPool.h>
+#include <vapor/common.h>
+
+namespace VAPoR {
+
+class VDCNetCDF;
+
+//! \class VDCInSitu
+//! \ingroup Public_VDC
+//! \brief Emit a VDC directly from a simulation
+//!
+//! VDCInSitu lets a simulation hand its fields to a VDC as they are
+//! computed, without waiting for them to be compressed and written.
+//! Put() copies a field into a queue and returns; a fixed number of
+//! writer threads take fields from the queue and write them with
+//! VDCNetCDF, each through its own VDCNetCDF object. Wavelet
+//! compression of a field is itself spread over the shared thread pool
+//! by WASP.
+//!
+//! The queue is bounded by the memory it may use rather than by a
+//! number of fields: Put() only blocks when the fields waiting to be
+//! written would exceed that limit, so a simulation whose output
+//! bandwidth keeps up on average is never stalled by bursts.
+//!
+//! Several time steps of a variable may be stored in a single file
+//! (see VDCNetCDF::GetPath()), and a file may only be written by one
+//! thread at a time. Fields destined for a file that is being written
+//! wait while fields for other files are written ahead of them.
+//! Variables stored in the master file itself, such as a time
+//! coordinate, are written by Put() before it returns.
+//!
+//! A masked data variable is opened for writing by reading its
+//! mask, so the mask for a time step must be Put() before the 
+//! variables it masks. A masked field waits until its mask has been
+//! written.
+//!
+//! The VDC must have been created, and all of its dimensions and
+//! variables defined, with a VDCNetCDF opened with VDC::W, before
+//! Initialize() is called. Coordinate variables may be written
+//! either before, with VDCNetCDF::PutVar(), or through Put().
+//!
+//! Put() and Flush() must be called from a single thread.
+//
+class VDF_API VDCInSitu : public Wasp::MyBase {
+public:
+
+ //! Construct a writer
+ //!
+ //! \param[in] nwriters Number of fields written concurrently. If less
+ //! than one a value based on the number of processors is used.
+ //! \param[in] maxMemory Maximum number of bytes used by queued fields.
+ //! If zero, 1GB is used. A field larger than \p maxMemory is still
+ //! accepted once the queue has drained.
+ //
+ VDCInSitu(int nwriters = 0, size_t maxMemory = 0);
+
+ //! Destroy the writer after waiting for all queued fields to be
+ //! written
+ //
+ virtual ~VDCInSitu();
+
+ //! Open a VDC for in-situ writing
+ //!
+ //! \param[in] path Path to the VDC master file
+ //!
+ //! \retval status A negative int is returned if the VDC can not be
+ //! opened for appending
+ //
+ int Initialize(std::string path);
+
+ //! Queue a field for writing
+ //!
+ //! Copies the field and returns as soon as enough queue memory is
+ //! available. A variable stored in the master file is written
+ //! before Put() returns.
+ //!
+ //! \param[in] ts Time step of the field
+ //! \param[in] varname Name of a data or coordinate variable of the VDC
+ //! \param[in] data Field values, ordered as for VDC::PutVar(). The
+ //! array may be reused as soon as Put() returns.
+ //!
+ //! \retval status A negative int is returned if \p varname is not
+ //! defined or if a previously queued field could not be written
+ //
+ int Put(size_t ts, std::string varname, const float *data);
+
+ //! Wait until all queued fields have been written
+ //!
+ //! \retval status A negative int is returned if any field queued
+ //! since the last call to Flush() could not be written
+ //
+ int Flush();
+
+ //! Return the total number of bytes of field data written
+ //
+ size_t GetBytesWritten() const;
+
+ //! Return the total time, in seconds, that Put() blocked waiting for
+ //! queue memory
+ //
+ double GetWaitTime() const;
+
+private:
+ class item_t {
+ public:
+  size_t ts;
+  std::string varname;
+  std::string path;	// file the field is written to
+  std::string key;	// identifies the field written
+  std::string maskkey;	// identifies the field's mask, if any
+  std::vector <float> *buf;
+  size_t nbytes;
+ };
+
+ std::string _path;
+ int _nwriters;
+ size_t _maxMemory;
+ Wasp::ThreadPool *_pool;
+ Wasp::ThreadPool::TaskGroup *_group;
+ VDCNetCDF *_meta;	// metadata queries made by the calling thread
+
+ mutable std::mutex _mutex;
+ std::condition_variable _cv;
+ std::list <item_t> _queue;
+ std::set <std::string> _busy;	// files being written
+ std::multiset <std::string> _pending;	// fields queued or being written
+ std::vector <VDCNetCDF *> _idle;	// VDCs not in use by a writer
+ std::vector <std::vector <float> *> _free;
+ size_t _bytesQueued;
+ size_t _bytesFree;
+ size_t _bytesWritten;
+ double _waitTime;
+ int _nRunning;
+ std::vector <std::string> _errors;
+
+ void _writer();
+ int _write(
+	VDCNetCDF *vdc, size_t ts, std::string varname, const float *data
+ );
+ std::vector <float> *_getBuffer(size_t nelements);
+ int _reportErrors();
+ void _close();
+
+ VDCInSitu(const VDCInSitu &);
+ VDCInSitu &operator=(const VDCInSitu &);
+};
+
+};
+
+#endif
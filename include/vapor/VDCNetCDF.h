@@ -1,5 +1,6 @@
 #include <vector>
 #include <map>
+#include <list>
 #include <algorithm>
 #include <iostream>
 #include "vapor/VDC.h"
@@ -177,6 +178,40 @@ public:
 	return(_writeSliceTemplate(fd, slice));
  }
 
+ //! Write the next slices of the currently opened variable
+ //!
+ //! Unlike WriteSlice(), which requires whole, block aligned hyperslices
+ //! (see GetHyperSliceInfo()), this method accepts any number of
+ //! consecutive slices along the slowest varying dimension, e.g. the
+ //! Z planes of a 3D variable as a simulation produces them. Slices are
+ //! buffered until a row of blocks is complete. The row is then
+ //! compressed, a block per thread, and written. Memory used is thus
+ //! proportional to one hyperslice, NX*NY*BZ, rather than to the
+ //! variable. Slabs that start and end on hyperslice boundaries are
+ //! compressed in place without being copied.
+ //!
+ //! The total number of slices written must equal the length of the
+ //! slowest varying dimension. WriteSlab() and WriteSlice() may be
+ //! mixed only on hyperslice boundaries.
+ //!
+ //! \param[in] fd A file descriptor returned by OpenVariableWrite()
+ //! \param[in] slab \p nslices consecutive slices of data
+ //! \param[in] nslices Number of slices in \p slab
+ //! \retval status Returns a negative value if more slices are written
+ //! than the variable has, or if compression or writing fails
+ //!
+ //! \sa WriteSlice(), GetHyperSliceInfo()
+ //
+ int WriteSlab(int fd, const float *slab, size_t nslices) {
+	return(_writeSlabTemplate(fd, slab, nslices));
+ }
+ int WriteSlab(int fd, const int *slab, size_t nslices) {
+	return(_writeSlabTemplate(fd, slab, nslices));
+ }
+ int WriteSlab(int fd, const unsigned char *slab, size_t nslices) {
+	return(_writeSlabTemplate(fd, slab, nslices));
+ }
+
 
  //! \copydoc VDC::PutVar()
  //
@@ -217,6 +252,27 @@ public:
  //
  int SetFill(int fillmode);
 
+ //! Set the maximum number of idle data files kept open
+ //!
+ //! Data files opened to read a variable are kept open after the
+ //! variable is closed, along with their decompression state, so that
+ //! reading a sequence of regions doesn't pay for opening the file and
+ //! parsing its header each time. At most \p n idle files are kept
+ //! open, the least recently used being closed first. Each may hold one
+ //! file descriptor per level-of-detail. A value of zero disables the
+ //! cache. The default is 32.
+ //!
+ //! \param[in] n Maximum number of idle files
+ //
+ void SetOpenFileCacheSize(size_t n);
+
+ //! \copydoc DC::RetainCoeffs()
+ //!
+ //! The wavelet coefficients are kept with the data file that holds
+ //! them, which is kept open while idle (see SetOpenFileCacheSize()).
+ //
+ virtual void RetainCoeffs(size_t ts, string varname);
+
 
 
 protected:
@@ -272,7 +328,7 @@ private:
   )  : FileObject( ts, varname, level, lod), 
 		_file_ts(file_ts), _wasp_data(wasp_data), _wasp_mask(wasp_mask), 
 		_varname_mask(varname_mask), _level_mask(level_mask), 
-		_file_ts_mask(file_ts_mask), _mv(mv)
+		_file_ts_mask(file_ts_mask), _mv(mv), _slab_count(0)
   {}
 
   size_t GetFileTS() const {return(_file_ts);}
@@ -282,6 +338,15 @@ private:
   int GetLevelMask() const {return(_level_mask);}
   size_t GetFileTSMask() const {return(_file_ts_mask);}
   double GetMissingValue() const {return(_mv);}
+
+  // Slices written by WriteSlab() that don't yet fill a hyperslice
+  //
+  size_t GetSlabCount() const {return(_slab_count);}
+  void SetSlabCount(size_t count) {_slab_count = count;}
+  unsigned char *GetSlabBuffer(size_t size) {
+	if (_slab_buf.size() < size) _slab_buf.resize(size);
+	return(_slab_buf.data());
+  }
  private:
   size_t _file_ts;
   WASP *_wasp_data;
@@ -290,12 +355,27 @@ private:
   int _level_mask;
   size_t _file_ts_mask;
   double _mv;
+  size_t _slab_count;
+  std::vector <unsigned char> _slab_buf;
 
  };
 
  Wasp::SmartBuf _sb_slice_buffer;
  Wasp::SmartBuf _mask_buffer;
  
+ // Data files opened for reading. Idle files are kept, most recently
+ // used first, in _waspCache. _waspPaths holds the files in use that
+ // may be cached again when released.
+ //
+ std::list <std::pair <string, WASP *> > _waspCache;
+ std::map <WASP *, string> _waspPaths;
+ size_t _waspCacheSize;
+
+ // Variable, and time step, whose wavelet coefficients are retained
+ //
+ string _retain_varname;
+ size_t _retain_ts;
+
  size_t _chunksizehint;	// NetCDF chunk size hint for file creates
  size_t _master_threshold;
  size_t _variable_threshold;
@@ -318,6 +398,14 @@ private:
  template <class T>
  int _writeSliceTemplate(int fd, const T *slice);
 
+ template <class T>
+ int _writeSlabTemplate(int fd, const T *slab, size_t nslices);
+
+ // Compress and write the next hyperslice of an open variable
+ //
+ template <class T>
+ int _writeHyperSlice(VDCFileObject *o, const T *slice);
+
  int _ReadMasterDimensions();
  int _ReadMasterAttributes (
 	string prefix, map <string, Attribute> &atts
@@ -359,6 +447,10 @@ private:
 	size_t &file_ts
  );
 
+ WASP *_getCachedWASP(string path);
+ void _releaseWASP(WASP *wasp);
+ void _purgeCachedWASP(string path);
+
  int _ReadHelper(
 	vector <size_t> &start,
 	vector <size_t> &count
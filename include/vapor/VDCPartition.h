@@ -0,0 +1,146 @@
+//
+//	File:		VDCPartition.h
+//
+//	Description:	Divide the writing of a VDC among independent
+//					processes
+//
+
+#ifndef	_VDCPartition_h_
+#define	_VDCPartition_h_
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <vapor/MyBase.h>
+#include <vapor/common.h>
+
+namespace VAPoR {
+
+class VDCNetCDF;
+
+//! \class VDCPartition
+//! \ingroup Public_VDC
+//! \brief Divide the writing of a VDC among independent processes
+//!
+//! A converter that copies many variables and time steps into a VDC
+//! may split the work among several processes, on one node or on
+//! several nodes sharing a file system, that do not communicate with
+//! each other. Every process opens the same master file, whose
+//! metadata must be complete (VDC::EndDefine()), and builds a
+//! VDCPartition from the same list of work units. The partition
+//! depends only on the master file and the list, so each process
+//! arrives at the same assignment and writes only its own units.
+//!
+//! A unit is one variable at one time step. Since several units may be
+//! stored in the same file (see VDCNetCDF::GetPath()), units are
+//! assigned by file: all the units stored in a data file are written
+//! by one process, and no two processes write the same file. Files are
+//! balanced across processes by the number of grid points they hold.
+//!
+//! A masked data variable is opened for writing by reading its mask
+//! (see VDCNetCDF::OpenVariableWrite()), so it is assigned to the
+//! process that writes its mask, after the mask.
+//!
+//! Variables stored in the master file itself are not assigned to any
+//! process, nor are variables whose mask is. They are written by a
+//! finalize step, run by a single process once all the others are
+//! done. Each process records that it has written all its units with
+//! MarkDone(), and the finalize step checks this with CheckDone().
+//
+class VDF_API VDCPartition : public Wasp::MyBase {
+public:
+
+ //! A variable at a time step
+ //
+ class Unit {
+ public:
+  Unit() : ts(0) {}
+  Unit(std::string varname_, size_t ts_) : varname(varname_), ts(ts_) {}
+
+  std::string varname;
+  size_t ts;
+ };
+
+ VDCPartition();
+
+ //! Assign units to processes
+ //!
+ //! \param[in] vdc A VDC whose definition is complete
+ //! \param[in] units The units to be written. The order is preserved
+ //! within each process's share.
+ //! \param[in] nranks Number of processes
+ //!
+ //! \retval status A negative int is returned if a unit names a
+ //! variable that is not defined in \p vdc
+ //
+ int Initialize(
+	const VDCNetCDF &vdc, const std::vector <Unit> &units, int nranks
+ );
+
+ //! Return the number of processes
+ //
+ int GetNumRanks() const { return(_rankUnits.size()); }
+
+ //! Return the units to be written by process \p rank
+ //!
+ //! \param[in] rank Process number, 0 to GetNumRanks()-1
+ //
+ std::vector <Unit> GetUnits(int rank) const;
+
+ //! Return the units stored in the master file, to be written by
+ //! the finalize step
+ //
+ std::vector <Unit> GetMasterUnits() const { return(_masterUnits); }
+
+ //! Record that process \p rank has written all of its units
+ //!
+ //! Writes a marker file to the data directory of \p vdc. A process
+ //! should call ClearDone() before it writes any units, and this once
+ //! all of those returned by GetUnits() have been written. The marker
+ //! identifies the partition: the list of units and number of
+ //! processes passed to Initialize(), and the modification time of
+ //! the master file.
+ //!
+ //! \retval status A negative int is returned if the marker can not be
+ //! written
+ //
+ int MarkDone(const VDCNetCDF &vdc, int rank) const;
+
+ //! Remove the marker written by MarkDone() for process \p rank, or
+ //! for all processes if \p rank is negative
+ //
+ int ClearDone(const VDCNetCDF &vdc, int rank) const;
+
+ //! Check that every process has called MarkDone() for this partition
+ //!
+ //! Markers written for a different partition, e.g. left behind by a
+ //! run over a different list of units, or over a master file since
+ //! recreated, are not accepted.
+ //!
+ //! \retval status A negative int is returned if any process has not
+ //! recorded that it wrote all of its units
+ //
+ int CheckDone(const VDCNetCDF &vdc) const;
+
+ //! Run a function in \p nprocs processes
+ //!
+ //! Forks \p nprocs child processes and calls \p worker in each with
+ //! its rank, 0 to \p nprocs-1, then waits for them all to exit. Nothing
+ //! that must not be shared between processes, such as open netCDF
+ //! files, should be open in the calling process. On Windows the ranks
+ //! are run one after the other in the calling process.
+ //!
+ //! \retval status A negative int is returned if a process could not be
+ //! started or \p worker returned a negative int for any rank
+ //
+ static int RunLocal(int nprocs, std::function <int(int rank)> worker);
+
+private:
+ std::vector <std::vector <Unit> > _rankUnits;
+ std::vector <Unit> _masterUnits;
+ unsigned long long _runID;	// identifies the units and the master file
+};
+
+};
+
+#endif
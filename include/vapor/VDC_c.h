@@ -21,7 +21,9 @@
 #ifdef __cplusplus
 
 #include "vapor/VDC.h"
+#include "vapor/VDCInSitu.h"
 typedef VAPoR::VDCNetCDF VDC;
+typedef VAPoR::VDCInSitu VDCInSitu;
 typedef VAPoR::VDC::Dimension VDCDimension;
 typedef VAPoR::VDC::BaseVar   VDCBaseVar;
 typedef VAPoR::VDC::AuxVar    VDCAuxVar;
@@ -32,6 +34,7 @@ extern "C" {
 #else
 
 typedef struct VDCNetCDF VDC;
+typedef struct VDCInSitu VDCInSitu;
 typedef struct VDCDimension VDCDimension;
 typedef struct VDCBaseVar   VDCBaseVar;
 typedef struct VDCAuxVar    VDCAuxVar;
@@ -139,6 +142,18 @@ int VDC_EndDefine(VDC *p);
 int VDC_PutVar(VDC *p, const char *varname, int lod, const float *data);
 int VDC_PutVarAtTimeStep(VDC *p, size_t ts, const char *varname, int lod, const float *data);
 
+// In-situ write. The VDC at path must have been created, and its variables
+// defined, with VDC_EndDefine(). VDCInSitu_Put() returns once the data are
+// queued; VDCInSitu_Flush() and VDCInSitu_delete() wait until they are written
+
+VDCInSitu *VDCInSitu_new(int nwriters, size_t maxMemory);
+void VDCInSitu_delete(VDCInSitu *p);
+int  VDCInSitu_Initialize(VDCInSitu *p, const char *path);
+int  VDCInSitu_Put(VDCInSitu *p, size_t ts, const char *varname, const float *data);
+int  VDCInSitu_Flush(VDCInSitu *p);
+size_t VDCInSitu_GetBytesWritten(const VDCInSitu *p);
+double VDCInSitu_GetWaitTime(const VDCInSitu *p);
+
 // Utility
 const char *VDC_GetErrMsg();
 void VDC_FreeStringArray(char ***str, int *count);
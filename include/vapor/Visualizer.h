@@ -29,6 +29,9 @@
 #include <vapor/Renderer.h>
 #include <vapor/AnnotationRenderer.h>
 
+namespace VAPoR {
+class CaptureQueue;
+};
 
 
 namespace VAPoR {
@@ -76,6 +79,15 @@ public:
 	//! \return zero if successful.
 	int paintEvent(bool fast);
 
+	//! Return true if any renderer drew a coarser representation of
+	//! its data than it will draw on the next paintEvent() with an
+	//! unchanged view. The caller may schedule another paintEvent()
+	//! to progressively refine the scene.
+	//!
+	//! \sa Renderer::NeedsRefinement()
+	//
+	bool NeedsRefinement() const;
+
 	//! Apply user defined transforms to the current renderer being drawn
 	//! \param[in] renIndex The index of the current renderer being drawn,
 	//! referring to the _renderer list 
@@ -186,6 +198,19 @@ public:
 		return 0;
 	}
 
+	//! Write any captured frames that are still being read back or
+	//! encoded
+	//!
+	//! Animation frames are read back from the frame buffer
+	//! asynchronously and encoded in the background. This method
+	//! completes the read of the most recent frame and waits until all
+	//! frames have been written. It must be called with the 
+	//! visualizer's OpenGL context current.
+	//!
+	//! \return zero if successful, -1 if any frame could not be written
+	//
+	int FlushCapture();
+
 	//! Draw a text banner at x, y coordinates
 	//
 	void DrawText(string text, int x, int y, int size, 
@@ -209,6 +234,18 @@ private:
 	//! \return zero if successful
 	int captureImage(string filename);
 
+	//! Start the asynchronous capture of an animation frame to a file,
+	//! and hand the previous frame, if any, to the encoders
+	//! \param[in] filename
+	//! \return zero if successful
+	int startCapture(string filename);
+
+	//! Copy out the frame read into pixel buffer \p i, if any, and
+	//! queue it for encoding
+	int finishCapture(int i);
+
+	CaptureQueue *getCaptureQueue();
+
 #ifdef	VAPOR3_0_0_ALPHA
 	//! Render the current active manip, if we are not in navigation mode
 	void renderManip();
@@ -221,6 +258,11 @@ private:
 
 	bool fbSetup();
 
+	//! Invoke Renderer::Prepare() on each initialized renderer, in
+	//! render order
+	//! \return 0 if successful, -1 if any renderer failed.
+	int prepareRenderers(bool fast);
+
 	//! Renderers can be added early or late, using a "render Order" parameter.
 	//! The order is between 0 and 10; lower order gets rendered first.
 	//! Sorted renderers get sorted before each render
@@ -290,6 +332,17 @@ private:
 	bool _imageCaptureEnabled;
 	bool _animationCaptureEnabled;
 	string _captureImageFile;
+
+	// Animation capture state. Frames are read back into one of two
+	// pixel buffer objects and copied out during the next frame.
+	//
+	CaptureQueue *_captureQueue;
+	unsigned int _capturePBO[2];
+	size_t _capturePBOSize[2];
+	int _captureIndex;	// pixel buffer for the next frame
+	bool _capturePending[2];
+	string _captureFile[2];
+	size_t _captureWidth[2], _captureHeight[2];
 	int _previousTimeStep;
 	int _previousFrameNum;
 	
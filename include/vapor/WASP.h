@@ -4,11 +4,12 @@
 
 #include <vector>
 #include <map>
+#include <mutex>
 #include <iostream>
 #include <netcdf.h>
 #include <vapor/NetCDFCpp.h>
 #include <vapor/Compressor.h>
-#include <vapor/EasyThreads.h>
+#include <vapor/ThreadPool.h>
 #include <vapor/utils.h>
 
 namespace VAPoR {
@@ -103,11 +104,11 @@ public:
  //!
  //! Construct a WASP object
  //!
- //! \param[in] nthreads Number of parallel execution threads 
- //! to be run during encoding and decoding of compressed data. A value 
- //! of 0, the default, indicates that the thread count should be 
- //! determined by the environment in a platform-specific manner, for
- //! example using sysconf(_SC_NPROCESSORS_ONLN) under *nix OSes. 
+ //! \param[in] nthreads Number of concurrent tasks
+ //! to be run during encoding and decoding of compressed data. Tasks
+ //! are executed by the process-wide Wasp::ThreadPool. A value 
+ //! of 0, the default, indicates that the task count should match
+ //! the number of threads in the pool.
  //!
  //
  WASP(int nthreads = 0);
@@ -435,6 +436,25 @@ public:
  //!
  virtual int CloseVar();
 
+ //! Keep the wavelet coefficients of a variable in memory
+ //!
+ //! Once set, the wavelet coefficients fetched by GetVara() and 
+ //! GetVaraBlock() for the variable named \p name are retained, and
+ //! subsequent reads of the same variable at the same level-of-detail
+ //! reconstruct from memory rather than from disk, whatever the
+ //! refinement \p level passed to OpenVarRead(). This allows a 
+ //! variable to be refined progressively without fetching the same
+ //! coefficients once per level. 
+ //!
+ //! Only one variable is retained at a time. Passing an empty
+ //! string releases the retained coefficients.
+ //!
+ //! \param[in] name Name of variable, or the empty string
+ //!
+ //! \sa OpenVarRead()
+ //
+ void RetainCoeffs(string name);
+
  //! Write an array of values to the currently opened variable
  //!
  //! The currently opened variable may or may not be a WASP
@@ -706,10 +726,20 @@ public:
  //! NetCDF attribute name specifying WASP version number
  static string AttNameVersion() {return("WASP.Version");}
 
+ //! Return the mutex serializing calls to the NetCDF library
+ //!
+ //! The NetCDF library is not thread safe. WASP holds this mutex while
+ //! reading and writing variable data, so that different WASP objects
+ //! may transfer data from different threads concurrently. Applications
+ //! that do so must also hold it around all other calls that reach the
+ //! NetCDF library, e.g. opening, creating, defining, and closing
+ //! files.
+ //
+ static std::mutex &GetNetCDFMutex();
+
 
 private:
 
- Wasp::EasyThreads *_et;
  int _nthreads;
  vector <NetCDFCpp> _ncdfcs;
  vector <NetCDFCpp *> _ncdfcptrs;	// pointers into _ncdfcs;
@@ -735,6 +765,25 @@ private:
  nc_type _open_varxtype;  // external type of opened variable
  vector <Compressor *> _open_compressors;  // Compressor for opened variable
 
+ // Wavelet coefficients retained by RetainCoeffs(), one entry for each
+ // block of the variable. Each entry holds the block's data range,
+ // coefficients, and significance maps as fetched from disk, and is 
+ // empty until the block is first read
+ //
+ string _retain_varname;
+ int _retain_lod;
+ size_t _retain_entry_size;
+ vector <vector <unsigned char> > _retained;
+
+ // Compressors are kept after CloseVar() and reused if the next variable
+ // opened has the same wavelet and block size
+ //
+ string _compressors_wname;
+ vector <size_t> _compressors_bs;
+
+ void _alloc_compressors(const vector <size_t> &bs, string wname);
+ void _free_compressors();
+
 
  int _GetBlockAlignedDims(
 	vector <string> dimnames,
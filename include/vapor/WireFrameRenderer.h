@@ -61,11 +61,26 @@ protected:
 	//! \copydoc Renderer::_paintGL()
 	virtual int _paintGL(bool fast);
 
+	//! \copydoc Renderer::_prepare()
+	virtual int _prepare(bool fast);
+
 private:
-	GLuint _VAO, _VBO, _EBO;
+	GLuint _VAO, _VBO, _colorVBO, _EBO;
     unsigned int _nIndices;
 
-	struct VertexData;
+	// The wireframe is an indexed mesh with one vertex per grid node
+	// and each edge appearing once in _indices. Node coordinates,
+	// colors and edges are rebuilt independently, and are released 
+	// once uploaded. The data values are kept so that the mesh can be
+	// recolored without reading the variable.
+	//
+	std::vector <float> _coords;		// 3 per node
+	std::vector <float> _colors;		// 4 per node
+	std::vector <unsigned int> _indices;	// 2 per edge
+	std::vector <float> _values;		// 1 per node
+	float _missingValue;
+	bool _coordsPending, _colorsPending, _indicesPending;
+
 	struct {
 		string varName;
 		string heightVarName;
@@ -81,17 +96,24 @@ private:
 
 	} _cacheParams;
 
+	// Describes the grid whose edges are in the element buffer
+	//
+	struct {
+		string varName;
+		int level;
+		std::vector<double> boxMin, boxMax;
+		string gridType;
+		std::vector <size_t> nodeDims;
+	} _topoParams;
+
 	int  _buildCache();
 	bool _isCacheDirty() const;
+	bool _isDataDirty() const;
 	void _saveCacheParams();
-	void _drawCell(
-            vector<VertexData> &vertices,
-            vector<unsigned int> &indices,
-			const float *verts,
-			const float *colors,
-			int n,
-			bool layered
-			);
+	int  _buildMesh();
+	void _buildEdges(const Grid *grid);
+	void _buildColors();
+	void _uploadCache();
 
 };
 };
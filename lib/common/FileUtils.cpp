@@ -49,6 +49,14 @@ long FileUtils::GetFileModifiedTime(const string &path)
     return attrib.st_mtime;
 }
 
+long long FileUtils::GetFileSize(const string &path)
+{
+    struct stat attrib;
+    if (stat(path.c_str(), &attrib) != 0)
+        return -1;
+    return attrib.st_size;
+}
+
 bool FileUtils::FileExists(const std::string &path)
 {
     return FileUtils::GetFileType(path) != FileType::Does_Not_Exist;
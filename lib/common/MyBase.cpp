@@ -9,6 +9,7 @@
 #include <vector>
 #include <iostream>
 #include <sstream>
+#include <mutex>
 
 #include <vapor/MyBase.h>
 #ifdef WIN32
@@ -61,7 +62,33 @@ FILE	*MyBase::DiagMsgFilePtr = NULL;
 #endif
 void (*MyBase::DiagMsgCB) (const char *msg) = NULL;
 
-bool MyBase::Enabled = true;
+namespace {
+
+// Error reporting is enabled and disabled per thread, so that a thread
+// suppressing errors while it probes for something does not hide those
+// of others, and interleaved save/restore pairs from different threads
+// cannot leave reporting off. Not a class member, since thread local
+// data may not be exported from a DLL.
+//
+thread_local bool Enabled = true;
+
+// Serializes updates to the shared message buffers, which may be set
+// from worker threads. Recursive so that message callbacks may
+// themselves set messages.
+//
+std::recursive_mutex MsgMutex;
+
+};
+
+bool MyBase::EnableErrMsg(bool enable) {
+	bool prev = Enabled;
+	Enabled = enable;
+	return(prev);
+}
+
+bool MyBase::GetEnableErrMsg() {
+	return(Enabled);
+}
 
 MyBase::MyBase() {
 	SetClassName("MyBase");
@@ -132,6 +159,8 @@ void	MyBase::SetErrMsg(
 
 
 	if (! Enabled) return;
+
+	std::lock_guard<std::recursive_mutex> guard(MsgMutex);
 	ErrCode = 1;
 
 	va_start(args, format);
@@ -155,6 +184,8 @@ void	MyBase::SetErrMsg(
 
 
 	if (! Enabled) return;
+
+	std::lock_guard<std::recursive_mutex> guard(MsgMutex);
 	ErrCode = errcode;
 
 	va_start(args, format);
@@ -175,6 +206,8 @@ void	MyBase::SetDiagMsg(
 ) {
 	va_list args;	// initialize to make valgrind shutup
 
+	std::lock_guard<std::recursive_mutex> guard(MsgMutex);
+
 	va_start(args, format);
 	_SetErrMsg(&DiagMsg, &DiagMsgSize, format, args);
 	va_end(args);
@@ -0,0 +1,230 @@
+#include <cstdlib>
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+
+#include <vapor/EasyThreads.h>
+#include <vapor/ThreadPool.h>
+
+using namespace Wasp;
+using namespace std;
+
+namespace {
+
+// Identify the pool and queue owned by the current thread, if it is
+// a worker thread
+//
+thread_local ThreadPool *ThisPool = NULL;
+thread_local int ThisQueue = -1;
+
+};
+
+ThreadPool::ThreadPool(int nthreads) {
+	if (nthreads < 1) nthreads = EasyThreads::NProc();
+	if (nthreads < 1) nthreads = 1;
+
+	_queued = 0;
+	_next_queue = 0;
+	_shutdown = false;
+
+	// The calling thread participates while waiting so only nthreads-1
+	// workers are needed
+	//
+	for (int i=0; i<nthreads-1; i++) {
+		_queues.push_back(new queue_t);
+	}
+	for (int i=0; i<nthreads-1; i++) {
+		_workers.push_back(std::thread(&ThreadPool::_worker, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(_sleep_mutex);
+		_shutdown = true;
+	}
+	_sleep_cv.notify_all();
+
+	for (int i=0; i<_workers.size(); i++) {
+		_workers[i].join();
+	}
+	for (int i=0; i<_queues.size(); i++) {
+		delete _queues[i];
+	}
+}
+
+ThreadPool *ThreadPool::Instance() {
+
+	// Deliberately never deleted: the pool must outlive any static
+	// objects that submit work during program shutdown
+	//
+	static ThreadPool *pool = NULL;
+	static std::once_flag flag;
+	std::call_once(flag, []() {
+		int nthreads = 0;
+		if (const char *s = getenv("VAPOR_NTHREADS")) {
+			nthreads = atoi(s);
+		}
+		pool = new ThreadPool(nthreads);
+	});
+	return(pool);
+}
+
+void ThreadPool::_submit(const task_t &task) {
+
+	// Workers push onto their own queue. Other threads distribute
+	// round robin.
+	//
+	int qidx = ThisPool == this ? ThisQueue : _next_queue++ % _queues.size();
+
+	{
+		std::lock_guard<std::mutex> guard(_queues[qidx]->mutex);
+		_queues[qidx]->tasks.push_back(task);
+	}
+	{
+		std::lock_guard<std::mutex> guard(_sleep_mutex);
+		_queued++;
+	}
+	_sleep_cv.notify_one();
+}
+
+bool ThreadPool::_pop(int qidx, bool steal, task_t &task) {
+	queue_t *q = _queues[qidx];
+
+	std::lock_guard<std::mutex> guard(q->mutex);
+	if (q->tasks.empty()) return(false);
+
+	// Owners work LIFO for locality, thieves take the oldest task
+	//
+	if (steal) {
+		task = q->tasks.front();
+		q->tasks.pop_front();
+	}
+	else {
+		task = q->tasks.back();
+		q->tasks.pop_back();
+	}
+	_queued--;
+	return(true);
+}
+
+bool ThreadPool::_run_one(int self) {
+	if (_queued.load() <= 0) return(false);
+
+	int n = (int) _queues.size();
+	task_t task;
+	bool found = false;
+
+	if (self >= 0) found = _pop(self, false, task);
+
+	int start = self >= 0 ? self + 1 : (int) (_next_queue.load() % n);
+	for (int i=0; i<n && ! found; i++) {
+		int qidx = (start + i) % n;
+		if (qidx == self) continue;
+		found = _pop(qidx, true, task);
+	}
+	if (! found) return(false);
+
+	task.fn();
+	task.group->_done();
+	return(true);
+}
+
+void ThreadPool::_worker(int id) {
+	ThisPool = this;
+	ThisQueue = id;
+
+	for (;;) {
+		if (_run_one(id)) continue;
+
+		std::unique_lock<std::mutex> lock(_sleep_mutex);
+		_sleep_cv.wait(lock, [this]() {
+			return(_shutdown || _queued.load() > 0);
+		});
+		if (_shutdown) return;
+	}
+}
+
+void ThreadPool::ParallelFor(
+	size_t begin, size_t end, size_t grain,
+	const std::function<void(size_t, size_t)> &f
+) {
+	if (end <= begin) return;
+
+	size_t n = end - begin;
+	size_t nthreads = GetNumThreads();
+	if (grain < 1) grain = std::max((size_t) 1, n / (4 * nthreads));
+
+	size_t nchunks = (n + grain - 1) / grain;
+	if (nchunks == 1 || _queues.empty()) {
+		f(begin, end);
+		return;
+	}
+
+	// Chunks are claimed from a shared counter, so it doesn't matter
+	// which tasks actually get to run
+	//
+	std::atomic<size_t> next(0);
+	auto body = [&]() {
+		size_t c;
+		while ((c = next++) < nchunks) {
+			size_t b = begin + c * grain;
+			f(b, std::min(end, b + grain));
+		}
+	};
+
+	TaskGroup group(this);
+	size_t ntasks = std::min(nchunks, nthreads) - 1;
+	for (size_t i=0; i<ntasks; i++) {
+		group.Run(body);
+	}
+	body();
+	group.Wait();
+}
+
+ThreadPool::TaskGroup::TaskGroup(ThreadPool *pool) {
+	_pool = pool ? pool : ThreadPool::Instance();
+	_pending = 0;
+}
+
+ThreadPool::TaskGroup::~TaskGroup() {
+	Wait();
+}
+
+void ThreadPool::TaskGroup::Run(const std::function<void()> &task) {
+	if (_pool->_queues.empty()) {
+		task();
+		return;
+	}
+
+	_pending++;
+	task_t t = {task, this};
+	_pool->_submit(t);
+}
+
+void ThreadPool::TaskGroup::_done() {
+	std::lock_guard<std::mutex> guard(_mutex);
+	if (--_pending == 0) _cv.notify_all();
+}
+
+void ThreadPool::TaskGroup::Wait() {
+	int self = ThisPool == _pool ? ThisQueue : -1;
+
+	while (_pending.load() > 0) {
+
+		// Help out rather than block. Required for nested groups
+		// to make progress when all workers are waiting.
+		//
+		if (_pool->_run_one(self)) continue;
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_cv.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+			return(_pending.load() == 0);
+		});
+	}
+
+	// Don't return (and possibly destroy the group) while the last
+	// task is still inside _done()
+	//
+	std::lock_guard<std::mutex> guard(_mutex);
+}
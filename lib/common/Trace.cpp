@@ -0,0 +1,226 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <vapor/Trace.h>
+
+using namespace Wasp;
+using namespace std;
+
+namespace {
+
+// A single recorded event. For spans ('X') value is the duration,
+// for counters ('C') it is the increment.
+//
+struct event_t {
+	const char *name;
+	long long ts;
+	long long value;
+	char type;
+	int tid;
+};
+
+// Events recorded by a single thread. The mutex is only contended
+// while the trace is being written or cleared.
+//
+class thread_buffer_t {
+public:
+	thread_buffer_t(int tid) : _tid(tid) {}
+
+	void add(const char *name, long long ts, long long value, char type) {
+		event_t e = {name, ts, value, type, _tid};
+		std::lock_guard<std::mutex> guard(_mutex);
+		_events.push_back(e);
+	}
+
+	void copy_to(vector <event_t> &events) {
+		std::lock_guard<std::mutex> guard(_mutex);
+		events.insert(events.end(), _events.begin(), _events.end());
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> guard(_mutex);
+		_events.clear();
+	}
+
+private:
+	int _tid;
+	std::mutex _mutex;
+	vector <event_t> _events;
+};
+
+// Global trace state. Allocated on first use and never freed so that
+// it remains valid for threads and static destructors that run after
+// main() returns.
+//
+struct state_t {
+	std::mutex mutex;
+	vector <std::shared_ptr <thread_buffer_t> > buffers;
+	set <string> names;
+	std::chrono::steady_clock::time_point epoch;
+	string exit_file;
+};
+
+state_t *get_state() {
+	static state_t *state = NULL;
+	static std::once_flag flag;
+	std::call_once(flag, []() {
+		state = new state_t;
+		state->epoch = std::chrono::steady_clock::now();
+	});
+	return(state);
+}
+
+thread_buffer_t *get_thread_buffer() {
+	static std::atomic<int> next_tid(0);
+	static thread_local thread_buffer_t *buffer = NULL;
+
+	if (! buffer) {
+		state_t *state = get_state();
+		std::shared_ptr <thread_buffer_t> sp(new thread_buffer_t(next_tid++));
+
+		std::lock_guard<std::mutex> guard(state->mutex);
+		state->buffers.push_back(sp);
+		buffer = sp.get();
+	}
+	return(buffer);
+}
+
+void write_at_exit() {
+	state_t *state = get_state();
+	if (! state->exit_file.empty()) {
+		(void) Trace::WriteJSON(state->exit_file);
+	}
+}
+
+// Tracing is enabled at start up if VAPOR_TRACE_FILE is set
+//
+bool init_enabled() {
+	const char *s = getenv("VAPOR_TRACE_FILE");
+	if (! s || ! *s) return(false);
+
+	get_state()->exit_file = s;
+	atexit(write_at_exit);
+	return(true);
+}
+
+std::atomic<bool> TraceEnabled(init_enabled());
+
+// Escape a string for inclusion in a JSON document
+//
+string json_escape(const char *s) {
+	string out;
+	for ( ; *s; s++) {
+		if (*s == '"' || *s == '\\') out += '\\';
+		if ((unsigned char) *s < 0x20) continue;
+		out += *s;
+	}
+	return(out);
+}
+
+bool event_cmp(const event_t &a, const event_t &b) {
+	return(a.ts < b.ts);
+}
+
+};
+
+void Trace::Enable(bool enable) {
+	(void) get_state();
+	TraceEnabled = enable;
+}
+
+bool Trace::IsEnabled() {
+	return(TraceEnabled.load(std::memory_order_relaxed));
+}
+
+long long Trace::Now() {
+	std::chrono::steady_clock::duration d =
+		std::chrono::steady_clock::now() - get_state()->epoch;
+
+	return(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+void Trace::AddSpan(const char *name, long long start, long long end) {
+	get_thread_buffer()->add(name, start, end - start, 'X');
+}
+
+void Trace::AddCount(const char *name, long long delta) {
+	get_thread_buffer()->add(name, Now(), delta, 'C');
+}
+
+const char *Trace::Intern(const std::string &name) {
+	state_t *state = get_state();
+
+	std::lock_guard<std::mutex> guard(state->mutex);
+	return(state->names.insert(name).first->c_str());
+}
+
+void Trace::Clear() {
+	state_t *state = get_state();
+
+	std::lock_guard<std::mutex> guard(state->mutex);
+	for (int i=0; i<state->buffers.size(); i++) {
+		state->buffers[i]->clear();
+	}
+}
+
+int Trace::WriteJSON(const std::string &path) {
+	state_t *state = get_state();
+
+	vector <event_t> events;
+	{
+		std::lock_guard<std::mutex> guard(state->mutex);
+		for (int i=0; i<state->buffers.size(); i++) {
+			state->buffers[i]->copy_to(events);
+		}
+	}
+	std::stable_sort(events.begin(), events.end(), event_cmp);
+
+	FILE *fp = fopen(path.c_str(), "w");
+	if (! fp) {
+		SetErrMsg("fopen(%s) : %M", path.c_str());
+		return(-1);
+	}
+
+	// Chrome trace timestamps are in microseconds. Counters are
+	// reported as running totals.
+	//
+	map <string, long long> totals;
+	fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+	for (int i=0; i<events.size(); i++) {
+		const event_t &e = events[i];
+		string name = json_escape(e.name);
+		if (e.type == 'X') {
+			fprintf(
+				fp, "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+				"\"ts\": %.3f, \"dur\": %.3f}",
+				name.c_str(), e.tid, e.ts / 1000.0, e.value / 1000.0
+			);
+		}
+		else {
+			long long &total = totals[e.name];
+			total += e.value;
+			fprintf(
+				fp, "{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"tid\": %d, "
+				"\"ts\": %.3f, \"args\": {\"value\": %lld}}",
+				name.c_str(), e.tid, e.ts / 1000.0, total
+			);
+		}
+		fprintf(fp, "%s\n", i < events.size()-1 ? "," : "");
+	}
+	fprintf(fp, "]}\n");
+
+	if (fclose(fp) != 0) {
+		SetErrMsg("fclose(%s) : %M", path.c_str());
+		return(-1);
+	}
+	return(0);
+}
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <sstream>
+#include <vapor/DerivedVarParams.h>
+
+using namespace VAPoR;
+
+const string DerivedVarParams::_expressionsTag = "Expressions";
+const string DerivedVarParams::_pythonVarsTag = "PythonVars";
+
+//
+// Register class with object factory!!!
+//
+static ParamsRegistrar<DerivedVarParams> registrar(
+	DerivedVarParams::GetClassType()
+);
+
+DerivedVarParams::DerivedVarParams(
+	ParamsBase::StateSave *ssave
+) : ParamsBase(ssave, DerivedVarParams::GetClassType()) {
+}
+
+DerivedVarParams::DerivedVarParams(
+	ParamsBase::StateSave *ssave, XmlNode *node
+) : ParamsBase(ssave, node) {
+
+	// If node isn't tagged correctly we correct the tag and reinitialize
+	// from scratch;
+	//
+	if (node->GetTag() != DerivedVarParams::GetClassType()) {
+		node->SetTag(DerivedVarParams::GetClassType());
+		SetValueStringVec(_expressionsTag, "", vector <string> ());
+		SetValueStringVec(_pythonVarsTag, "", vector <string> ());
+	}
+}
+
+void DerivedVarParams::SetFormula(
+	string dataSetName, string varName, string formula
+) {
+	vector <string> exprs = _getExpressions();
+
+	bool found = false;
+	for (int i=0; i<exprs.size(); i+=3) {
+		if (exprs[i] == dataSetName && exprs[i+1] == varName) {
+			exprs[i+2] = formula;
+			found = true;
+		}
+	}
+	if (! found) {
+		exprs.push_back(dataSetName);
+		exprs.push_back(varName);
+		exprs.push_back(formula);
+	}
+
+	SetValueStringVec(
+		_expressionsTag, "Define derived variable " + varName, exprs
+	);
+}
+
+string DerivedVarParams::GetFormula(
+	string dataSetName, string varName
+) const {
+	vector <string> exprs = _getExpressions();
+
+	for (int i=0; i<exprs.size(); i+=3) {
+		if (exprs[i] == dataSetName && exprs[i+1] == varName) {
+			return(exprs[i+2]);
+		}
+	}
+	return("");
+}
+
+void DerivedVarParams::RemoveVar(string dataSetName, string varName) {
+	vector <string> exprs = _getExpressions();
+
+	vector <string> newExprs;
+	for (int i=0; i<exprs.size(); i+=3) {
+		if (exprs[i] == dataSetName && exprs[i+1] == varName) continue;
+
+		newExprs.insert(newExprs.end(), exprs.begin()+i, exprs.begin()+i+3);
+	}
+	if (newExprs.size() == exprs.size()) return;
+
+	SetValueStringVec(
+		_expressionsTag, "Remove derived variable " + varName, newExprs
+	);
+}
+
+vector <string> DerivedVarParams::GetVarNames(string dataSetName) const {
+	vector <string> exprs = _getExpressions();
+
+	vector <string> names;
+	for (int i=0; i<exprs.size(); i+=3) {
+		if (exprs[i] == dataSetName) names.push_back(exprs[i+1]);
+	}
+	return(names);
+}
+
+vector <string> DerivedVarParams::GetDataSetNames() const {
+	vector <string> exprs = _getExpressions();
+
+	vector <string> names;
+	for (int i=0; i<exprs.size(); i+=3) {
+		if (find(names.begin(), names.end(), exprs[i]) == names.end()) {
+			names.push_back(exprs[i]);
+		}
+	}
+
+	vector <string> pvars = _getPythonVars();
+	for (int i=0; i<pvars.size(); i+=4) {
+		if (find(names.begin(), names.end(), pvars[i]) == names.end()) {
+			names.push_back(pvars[i]);
+		}
+	}
+	return(names);
+}
+
+vector <string> DerivedVarParams::_getExpressions() const {
+	vector <string> exprs = GetValueStringVec(
+		_expressionsTag, vector <string> ()
+	);
+
+	// Discard a malformed trailing entry
+	//
+	exprs.resize(exprs.size() - exprs.size() % 3);
+	return(exprs);
+}
+
+void DerivedVarParams::SetPythonVar(
+	string dataSetName, string varName, string script,
+	const vector <string> &inputs
+) {
+	vector <string> pvars = _getPythonVars();
+
+	string inputStr;
+	for (int i=0; i<inputs.size(); i++) {
+		if (i) inputStr += " ";
+		inputStr += inputs[i];
+	}
+
+	bool found = false;
+	for (int i=0; i<pvars.size(); i+=4) {
+		if (pvars[i] == dataSetName && pvars[i+1] == varName) {
+			pvars[i+2] = script;
+			pvars[i+3] = inputStr;
+			found = true;
+		}
+	}
+	if (! found) {
+		pvars.push_back(dataSetName);
+		pvars.push_back(varName);
+		pvars.push_back(script);
+		pvars.push_back(inputStr);
+	}
+
+	SetValueStringVec(
+		_pythonVarsTag, "Define derived variable " + varName, pvars
+	);
+}
+
+bool DerivedVarParams::GetPythonVar(
+	string dataSetName, string varName, string &script,
+	vector <string> &inputs
+) const {
+	script.clear();
+	inputs.clear();
+
+	vector <string> pvars = _getPythonVars();
+
+	for (int i=0; i<pvars.size(); i+=4) {
+		if (pvars[i] == dataSetName && pvars[i+1] == varName) {
+			script = pvars[i+2];
+
+			istringstream iss(pvars[i+3]);
+			string input;
+			while (iss >> input) inputs.push_back(input);
+			return(true);
+		}
+	}
+	return(false);
+}
+
+void DerivedVarParams::RemovePythonVar(string dataSetName, string varName) {
+	vector <string> pvars = _getPythonVars();
+
+	vector <string> newPVars;
+	for (int i=0; i<pvars.size(); i+=4) {
+		if (pvars[i] == dataSetName && pvars[i+1] == varName) continue;
+
+		newPVars.insert(newPVars.end(), pvars.begin()+i, pvars.begin()+i+4);
+	}
+	if (newPVars.size() == pvars.size()) return;
+
+	SetValueStringVec(
+		_pythonVarsTag, "Remove derived variable " + varName, newPVars
+	);
+}
+
+vector <string> DerivedVarParams::GetPythonVarNames(
+	string dataSetName
+) const {
+	vector <string> pvars = _getPythonVars();
+
+	vector <string> names;
+	for (int i=0; i<pvars.size(); i+=4) {
+		if (pvars[i] == dataSetName) names.push_back(pvars[i+1]);
+	}
+	return(names);
+}
+
+vector <string> DerivedVarParams::_getPythonVars() const {
+	vector <string> pvars = GetValueStringVec(
+		_pythonVarsTag, vector <string> ()
+	);
+
+	// Discard a malformed trailing entry
+	//
+	pvars.resize(pvars.size() - pvars.size() % 4);
+	return(pvars);
+}
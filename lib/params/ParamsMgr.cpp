@@ -26,6 +26,7 @@
 #include <vapor/ParamsMgr.h>
 #include <vapor/ViewpointParams.h>
 #include <vapor/regionparams.h>
+#include <vapor/DerivedVarParams.h>
 
 
 using namespace VAPoR;
@@ -80,6 +81,12 @@ void ParamsMgr::_init(
 		);
 	}
 
+	if (! _otherParams->GetParams(DerivedVarParams::GetClassType())) {
+		_otherParams->Create(
+			DerivedVarParams::GetClassType(), DerivedVarParams::GetClassType()
+		);
+	}
+
 	// Deal with any Params registered by the application
 	//
 	for (int i=0; i<appParams.size(); i++) {
@@ -45,6 +45,7 @@ const string RenderParams::_constantColorTag = "ConstantColor";
 const string RenderParams::_constantOpacityTag = "ConstantOpacity";
 const string RenderParams::_CompressionLevelTag = "CompressionLevel";
 const string RenderParams::_RefinementLevelTag = "RefinementLevel";
+const string RenderParams::_AutoLevelTag = "AutoLevel";
 const string RenderParams::_transferFunctionsTag = "MapperFunctions";
 const string RenderParams::_stretchFactorsTag = "StretchFactors";
 const string RenderParams::_currentTimestepTag = "CurrentTimestep";
@@ -317,6 +318,14 @@ int RenderParams::GetRefinementLevel() const {
 	return (GetValueLong(_RefinementLevelTag,0));
 }
 
+void RenderParams::SetAutoLevel(bool val) {
+	SetValueLong(_AutoLevelTag, "Enable automatic level selection", val);
+}
+
+bool RenderParams::GetAutoLevel() const {
+	return ((bool) GetValueLong(_AutoLevelTag, (int) false));
+}
+
 
 void RenderParams::SetHistoStretch(float factor) {
 	if (factor < 0.0) factor = 0.0;
@@ -30,6 +30,7 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <cmath>
 #include <limits>
 
 #ifndef WIN32
@@ -47,6 +48,8 @@
 #include <vapor/MyBase.h>
 #include <vapor/errorcodes.h>
 #include <vapor/DataMgr.h>
+#include <vapor/ThreadPool.h>
+#include <vapor/Trace.h>
 #include "vapor/LegacyGL.h"
 #include "vapor/GLManager.h"
 #include <glm/gtc/type_ptr.hpp>
@@ -70,6 +73,31 @@ static RendererRegistrar<BarbRenderer> registrar(
 	BarbRenderer::GetClassType(), BarbParams::GetClassType()
 );
 
+namespace {
+
+// Floats per barb instance: start point, vector to end point, and color
+//
+const int INSTANCE_SIZE = 10;
+
+// Floats per mesh vertex. See BarbRenderer::_buildBarbMesh()
+//
+const int MESH_VERTEX_SIZE = 8;
+
+// Index of val in a lookup table with n entries spanning [min, max].
+// Same quantization as MapperFunction::mapFloatToIndex(). An empty
+// range maps everything to the first entry
+//
+int lut_index(float val, float min, float max, int n) {
+	if (! (max > min)) return(0);
+
+	double psn = 0.5 + ((double) val - min) * (n-1) / ((double) max - min);
+	if (psn < 0.0) return(0);
+	if (psn > n-1) return(n-1);
+	return((int) psn);
+}
+
+};
+
 BarbRenderer::BarbRenderer(
 	const ParamsMgr *pm, string winName, string dataSetName,
 	string instName, DataMgr *dataMgr
@@ -80,6 +108,13 @@ BarbRenderer::BarbRenderer(
 	_vectorScaleFactor = .2;
 	_maxThickness = .2;
 	_maxValue = 0.f;
+	_nInstances = 0;
+	_instancesPending = false;
+	_instancesDirty = true;
+	_VAO = _meshVBO = _instanceVBO = 0;
+	_nMeshVertices = 0;
+	_sampleParams.ts = 0;
+	_sampleParams.level = _sampleParams.lod = 0;
 }
 
 //----------------------------------------------------------------------------
@@ -87,37 +122,176 @@ BarbRenderer::BarbRenderer(
 //----------------------------------------------------------------------------
 BarbRenderer::~BarbRenderer()
 {
+	if (_VAO) glDeleteVertexArrays(1, &_VAO);
+	if (_meshVBO) glDeleteBuffers(1, &_meshVBO);
+	if (_instanceVBO) glDeleteBuffers(1, &_instanceVBO);
 }
 
-// Totally unnecessary?
-//
 int BarbRenderer::_initializeGL(){
-	//_initialized = true;
+	glGenVertexArrays(1, &_VAO);
+	glGenBuffers(1, &_meshVBO);
+	glGenBuffers(1, &_instanceVBO);
+
+	glBindVertexArray(_VAO);
+
+	// Per vertex attributes of the barb mesh
+	//
+	size_t stride = MESH_VERTEX_SIZE * sizeof(float);
+	glBindBuffer(GL_ARRAY_BUFFER, _meshVBO);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, NULL);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *) (3*sizeof(float)));
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void *) (5*sizeof(float)));
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+
+	// Per instance attributes, one set per barb
+	//
+	stride = INSTANCE_SIZE * sizeof(float);
+	glBindBuffer(GL_ARRAY_BUFFER, _instanceVBO);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, NULL);
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void *) (3*sizeof(float)));
+	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, stride, (void *) (6*sizeof(float)));
+	glEnableVertexAttribArray(3);
+	glEnableVertexAttribArray(4);
+	glEnableVertexAttribArray(5);
+	glVertexAttribDivisor(3, 1);
+	glVertexAttribDivisor(4, 1);
+	glVertexAttribDivisor(5, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	_buildBarbMesh();
+
+	// Instances must be uploaded to the new buffer
+	//
+	_instancesDirty = true;
 	return(0);
 }
 
+void BarbRenderer::_buildBarbMesh() {
+
+	// The barb is a hexagonal tube, the shading makes it look round,
+	// capped with a hexagonal cone. Every vertex is given in a frame 
+	// local to the barb, formed by the unit barb direction d and two 
+	// unit vectors u and b orthogonal to it, as
+	//
+	//   cos, sin, r, a, k, nu, nb, nd
+	//
+	// The vertex is at start + (a * length + k * radius) * d + 
+	// (cos * u + sin * b) * r * radius and its normal is 
+	// nu * u + nb * b + nd * d.
+	//
+	const float sines[6] = {
+		0.f, (float) (sqrt(3.)/2.), (float) (sqrt(3.)/2.), 0.f, 
+		(float) (-sqrt(3.)/2.), (float ) (-sqrt(3.)/2.)
+	};
+	const float coses[6] = {1.f, 0.5, -0.5, -1., -.5, 0.5};
+
+	// The tube runs from the start point to the point where the head
+	// attaches. The head's base lies BARB_HEAD_FACTOR - 1 radii behind
+	// that point, and the tip one radius in front of it (a vertex 
+	// angle of 45 degrees).
+	//
+	const float a = BARB_LENGTH_FACTOR;
+	const float headK = -(BARB_HEAD_FACTOR - 1.0);
+
+	vector <float> mesh;
+	auto vertex = [&mesh](
+		float c, float s, float r, float a, float k,
+		float nu, float nb, float nd
+	) {
+		float v[] = {c, s, r, a, k, nu, nb, nd};
+		mesh.insert(mesh.end(), v, v+MESH_VERTEX_SIZE);
+	};
+
+	for (int i=0; i<6; i++) {
+		int j = (i+1) % 6;
+		float ci = coses[i], si = sines[i];
+		float cj = coses[j], sj = sines[j];
+
+		// Two triangles for each side of the tube
+		//
+		vertex(ci, si, 1.0, 0.0, 0.0, ci, si, 0.0);
+		vertex(ci, si, 1.0, a, 0.0, ci, si, 0.0);
+		vertex(cj, sj, 1.0, 0.0, 0.0, cj, sj, 0.0);
+
+		vertex(cj, sj, 1.0, 0.0, 0.0, cj, sj, 0.0);
+		vertex(ci, si, 1.0, a, 0.0, ci, si, 0.0);
+		vertex(cj, sj, 1.0, a, 0.0, cj, sj, 0.0);
+
+		// One triangle for each face of the head, with the normals
+		// tilted in the direction of the barb
+		//
+		vertex(0.0, 0.0, 0.0, a, 1.0, 0.0, 0.0, 1.0);
+		vertex(
+			ci, si, BARB_HEAD_FACTOR, a, headK, 0.5*ci, 0.5*si, 0.5
+		);
+		vertex(
+			cj, sj, BARB_HEAD_FACTOR, a, headK, 0.5*cj, 0.5*sj, 0.5
+		);
+	}
+
+	_nMeshVertices = mesh.size() / MESH_VERTEX_SIZE;
+
+	glBindBuffer(GL_ARRAY_BUFFER, _meshVBO);
+	glBufferData(
+		GL_ARRAY_BUFFER, mesh.size() * sizeof(float), mesh.data(), 
+		GL_STATIC_DRAW
+	);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void BarbRenderer::_saveSampleParams()
+{
+	BarbParams* p = dynamic_cast<BarbParams*>(GetActiveParams());
+	assert(p);
+	_sampleParams.fieldVarNames = p->GetFieldVariableNames();
+	_sampleParams.heightVarName = p->GetHeightVariableName();
+	_sampleParams.colorVarName = p->GetColorMapVariableName();
+	_sampleParams.ts = p->GetCurrentTimestep();
+	_sampleParams.level = GetRefinementLevel();
+	_sampleParams.lod = GetCompressionLevel();
+	_sampleParams.grid = p->GetGrid();
+	p->GetBox()->GetExtents(_sampleParams.boxMin, _sampleParams.boxMax);
+}
+
+bool BarbRenderer::_isSampleDirty() const
+{
+	BarbParams* p = dynamic_cast<BarbParams*>(GetActiveParams());
+	assert(p);
+	if (_sampleParams.fieldVarNames != p->GetFieldVariableNames()) return true;
+	if (_sampleParams.heightVarName != p->GetHeightVariableName()) return true;
+	if (_sampleParams.colorVarName != p->GetColorMapVariableName()) return true;
+	if (_sampleParams.ts      != p->GetCurrentTimestep()) return true;
+	if (_sampleParams.level   != GetRefinementLevel()) return true;
+	if (_sampleParams.lod     != GetCompressionLevel()) return true;
+	if (_sampleParams.grid != p->GetGrid()) return true;
+
+	vector<double> min, max;
+	p->GetBox()->GetExtents(min, max);
+
+	if (_sampleParams.boxMin != min) return true;
+	if (_sampleParams.boxMax != max) return true;
+
+	return false;
+}
+
 void BarbRenderer::_saveCacheParams()
 {
 	BarbParams* p = dynamic_cast<BarbParams*>(GetActiveParams());
 	assert(p);
-    _cacheParams.fieldVarNames = p->GetFieldVariableNames();
-    _cacheParams.heightVarName = p->GetHeightVariableName();
-    _cacheParams.colorVarName = p->GetColorMapVariableName();
-    _cacheParams.ts = p->GetCurrentTimestep();
-    _cacheParams.level = p->GetRefinementLevel();
-    _cacheParams.lod = p->GetCompressionLevel();
     _cacheParams.useSingleColor = p->UseSingleColor();
     _cacheParams.lineThickness = p->GetLineThickness();
     _cacheParams.lengthScale = p->GetLengthScale();
-    _cacheParams.grid = p->GetGrid();
-	_cacheParams.needToRecalc = p->GetNeedToRecalculateScales();
+    _cacheParams.scales = _getScales();
     p->GetConstantColor(_cacheParams.constantColor);
-    p->GetBox()->GetExtents(_cacheParams.boxMin, _cacheParams.boxMax);
     
     if (_cacheParams.useSingleColor)
         return;
     
-    MapperFunction *tf = p->GetMapperFunc(_cacheParams.colorVarName);
+    MapperFunction *tf = p->GetMapperFunc(p->GetColorMapVariableName());
     _cacheParams.opacity = tf->getOpacityScale();
     _cacheParams.minMapValue = tf->getMinMapValue();
     _cacheParams.maxMapValue = tf->getMaxMapValue();
@@ -128,28 +302,14 @@ void BarbRenderer::_saveCacheParams()
     }
 }
 
-bool BarbRenderer::_isCacheDirty() const
+bool BarbRenderer::_isCacheDirty()
 {
 	BarbParams* p = dynamic_cast<BarbParams*>(GetActiveParams());
 	assert(p);
-    if (_cacheParams.fieldVarNames != p->GetFieldVariableNames()) return true;
-    if (_cacheParams.heightVarName != p->GetHeightVariableName()) return true;
-    if (_cacheParams.colorVarName != p->GetColorMapVariableName()) return true;
-    if (_cacheParams.ts      != p->GetCurrentTimestep()) return true;
-    if (_cacheParams.level   != p->GetRefinementLevel()) return true;
-    if (_cacheParams.lod     != p->GetCompressionLevel()) return true;
     if (_cacheParams.useSingleColor != p->UseSingleColor()) return true;
     if (_cacheParams.lineThickness != p->GetLineThickness()) return true;
     if (_cacheParams.lengthScale != p->GetLengthScale()) return true;
-    if (_cacheParams.grid != p->GetGrid()) return true;
-	if (_cacheParams.needToRecalc != p->GetNeedToRecalculateScales())
-		return true;
-    
-    vector<double> min, max, contourValues;
-    p->GetBox()->GetExtents(min, max);
-    
-    if (_cacheParams.boxMin != min) return true;
-    if (_cacheParams.boxMax != max) return true;
+    if (_cacheParams.scales != _getScales()) return true;
     
     float constantColor[3];
     p->GetConstantColor(constantColor);
@@ -158,7 +318,7 @@ bool BarbRenderer::_isCacheDirty() const
     if (_cacheParams.useSingleColor)
         return false;
     
-    MapperFunction *tf = p->GetMapperFunc(_cacheParams.colorVarName);
+    MapperFunction *tf = p->GetMapperFunc(p->GetColorMapVariableName());
     if (_cacheParams.opacity != tf->getOpacityScale()) return true;
     if (_cacheParams.minMapValue != tf->getMinMapValue()) return true;
     if (_cacheParams.maxMapValue != tf->getMaxMapValue()) return true;
@@ -177,8 +337,6 @@ bool BarbRenderer::_isCacheDirty() const
 }
 
 void BarbRenderer::_recalculateScales(
-	//std::vector<string> varnames,
-	std::vector<VAPoR::Grid*> &varData,
 	int ts
 ) {
 	BarbParams* bParams = dynamic_cast<BarbParams*>(GetActiveParams());
@@ -190,10 +348,10 @@ void BarbRenderer::_recalculateScales(
 	if (varnames != _fieldVariables ||
 		recalculateScales
 	) {
-		//_setDefaultLengthAndThicknessScales(ts, varnames, bParams);
-		_setDefaultLengthAndThicknessScales(ts, varData, bParams);
+		_setDefaultLengthAndThicknessScales(ts, bParams);
 		_fieldVariables = varnames;
 		bParams->SetNeedToRecalculateScales(false);
+		_instancesDirty = true;
 	}
 }
 
@@ -236,8 +394,8 @@ void BarbRenderer::_getGridRequirements(
 
 	ts = bParams->GetCurrentTimestep();
 
-	refLevel = bParams->GetRefinementLevel();
-	lod = bParams->GetCompressionLevel();
+	refLevel = GetRefinementLevel();
+	lod = GetCompressionLevel();
 	bParams->GetBox()->GetExtents(minExts, maxExts);
 }
 
@@ -262,7 +420,6 @@ int BarbRenderer::_getVarGrid(
 			for (int i = 0; i<varData.size(); i++){
 				if (varData[i]) _dataMgr->UnlockGrid(varData[i]);
 			}
-    		glEndList();
 			return(rc);
 		}
 		varData[varData.size()-1] = sg;
@@ -271,11 +428,13 @@ int BarbRenderer::_getVarGrid(
 	return 0;
 }
 
-int BarbRenderer::_paintGL(bool) {
-    int rc = 0;
-    
-    // _saveCacheParams();
-    
+int BarbRenderer::_sampleRake() {
+	VAPOR_TRACE_SCOPE("BarbRenderer::_sampleRake");
+
+	_saveSampleParams();
+	_samples.clear();
+	_instancesDirty = true;
+
 	// Set up the variable data required, while determining data 
 	// extents to use in rendering
 	//
@@ -286,9 +445,8 @@ int BarbRenderer::_paintGL(bool) {
 	_getGridRequirements(ts, refLevel, lod, minExts, maxExts);
 	
 	// Get vector variables
-	rc = _getVectorVarGrids(ts, refLevel, lod, minExts, maxExts, varData);
+	int rc = _getVectorVarGrids(ts, refLevel, lod, minExts, maxExts, varData);
 	if(rc<0) {
-    	glEndList();
 		SetErrMsg("One or more selected field variables does not exist");
 		return -1;
 	}
@@ -311,302 +469,249 @@ int BarbRenderer::_paintGL(bool) {
 		SetErrMsg("Color variable does not exist");
 		return -1;
 	}
-	
-	_recalculateScales(varData, ts);
+	assert(varData.size() == 5);
 
-	_setUpLightingAndColor();
+	vector<int> rakeGrid;
+	_makeRakeGrid(rakeGrid);
 
-	// Render the barbs
-	_operateOnGrid(varData);
+	vector<float> rakeExts;
+	_reFormatExtents(rakeExts);
 
-	//Release the locks on the data
-	for (int i = 0; i<varData.size(); i++){
-		if (varData[i]) _dataMgr->UnlockGrid(varData[i]);
-	}
-    
-	return(rc);
-}
+	vector<float> strides;
+	_getStrides(strides, rakeGrid, rakeExts);
 
-float BarbRenderer::_calculateDirVec(
-	const float start[3], 
-	const float end[3], 
-	float dirVec[3]
-) {
-	vsub(end, start, dirVec);
-	float len = vlength(dirVec);
-	if (len != 0.f)
-		vscale(dirVec,1./len);
-	return len;
-}
+	size_t nx = std::max(rakeGrid[X], 0);
+	size_t ny = std::max(rakeGrid[Y], 0);
+	size_t nz = std::max(rakeGrid[Z], 0);
+	_samples.resize(nx * ny * nz);
 
-void BarbRenderer::_drawBackOfBarb(
-	const float dirVec[3], 
-	const float startVertex[3]) 
-const {
-    // TODO GL
-    /*
-	glBegin(GL_POLYGON);
-	glNormal3fv(dirVec);
-	for (int k = 0; k<6; k++){
-		glVertex3fv(startVertex+3*k);
-	}
-	glEnd();
-     */
-}
+	// Every rake point is independent. Grid::GetValue() doesn't modify 
+	// the grid so the points can be sampled concurrently.
+	//
+	const Grid *heightGrid = varData[3];
+	const Grid *colorGrid = varData[4];
+	Wasp::ThreadPool::Instance()->ParallelFor(
+		0, _samples.size(), 0, [&](size_t begin, size_t end) {
+
+		for (size_t n=begin; n<end; n++) {
+			size_t i = n / (ny * nz) + 1;
+			size_t j = (n / nz) % ny + 1;
+			size_t k = n % nz + 1;
+
+			sample_t &s = _samples[n];
+			s.start[X] = strides[X] * i + rakeExts[X];
+			s.start[Y] = strides[Y] * j + rakeExts[Y];
+			s.start[Z] = strides[Z] * k + rakeExts[Z];
+			s.missing = false;
+			s.valueMissing = false;
+			s.value = 0.f;
+
+			if (heightGrid) {
+				float offset = heightGrid->GetValue(
+					s.start[X], s.start[Y], 0.f
+				);
+				if (offset == heightGrid->GetMissingValue()) {
+					s.missing = true;
+				}
+				else {
+					s.start[Z] += offset;
+				}
+			}
 
-void BarbRenderer::_drawCylinderSides(
-	const float nextNormal[3], 
-	const float nextVertex[3],
-	const float startNormal[3],
-	const float startVertex[3]
-) const {
-    LegacyGL *lgl = _glManager->legacy;
-    
-	lgl->Begin(GL_TRIANGLE_STRIP);
-	
-	for (int i = 0; i< 6; i++){
-			
-		lgl->Normal3fv(nextNormal+3*i);
-		lgl->Vertex3fv(nextVertex+3*i);
-			
-		lgl->Normal3fv(startNormal+3*i);
-		lgl->Vertex3fv(startVertex+3*i);
-	}
-	//repeat first two vertices to close cylinder:
-		
-	lgl->Normal3fv(nextNormal);
-	lgl->Vertex3fv(nextVertex);
-		
-	lgl->Normal3fv(startNormal);
-	lgl->Vertex3fv(startVertex);
-	
-	lgl->End();
-}
+			for (int dim=0; dim<3; dim++) {
+				s.dir[dim] = 0.f;
+				if (! varData[dim]) continue;
 
+				s.dir[dim] = varData[dim]->GetValue(
+					s.start[X], s.start[Y], s.start[Z]
+				);
+				if (s.dir[dim] == varData[dim]->GetMissingValue()) {
+					s.missing = true;
+				}
+			}
 
-void BarbRenderer::_drawBarbHead(
-	const float dirVec[3], 
-	const float vertexPoint[3], 
-	const float startNormal[3], 
-	const float startVertex[3]
-) const {
-    LegacyGL *lgl = _glManager->legacy;
-    
-	//Create a triangle fan from these 6 vertices.  
-	lgl->Begin(GL_TRIANGLE_FAN);
-	lgl->Normal3fv(dirVec);
-	lgl->Vertex3fv(vertexPoint);
-	for (int i = 0; i< 6; i++){
-		lgl->Normal3fv(startNormal+3*i);
-		lgl->Vertex3fv(startVertex+3*i);
+			if (colorGrid) {
+				s.value = colorGrid->GetValue(
+					s.start[X], s.start[Y], s.start[Z]
+				);
+				s.valueMissing = s.value == colorGrid->GetMissingValue();
+			}
+		}
+	});
+
+	// Largest vector component magnitude, used to scale barb lengths
+	//
+	_maxValue = 0.0;
+	for (size_t n=0; n<_samples.size(); n++) {
+		for (int dim=0; dim<3; dim++) {
+			if (! varData[dim]) continue;
+			double value = fabs(_samples[n].dir[dim]);
+			if (_samples[n].dir[dim] == varData[dim]->GetMissingValue()) {
+				continue;
+			}
+			if (value > _maxValue &&
+			value < std::numeric_limits<double>::max() &&
+			!std::isnan(value))
+				_maxValue = value;
+		}
+	}
+
+	//Release the locks on the data
+	for (int i = 0; i<varData.size(); i++){
+		if (varData[i]) _dataMgr->UnlockGrid(varData[i]);
 	}
-	//Repeat first point to close fan:
-	lgl->Normal3fv(startNormal);
-	lgl->Vertex3fv(startVertex);
-	lgl->End();
-}
 
-#ifdef DEBUG
-void BarbRenderer::_printBackDiameter(const float startVertex[18]) const {
-	float pointA[3] = {startVertex[0], startVertex[1], startVertex[2]};
-	float pointB[3] = {startVertex[3], startVertex[4], startVertex[5]};
-	float pointC[3] = {startVertex[6], startVertex[7], startVertex[8]};
-	float pointD[3] = {startVertex[9], startVertex[10], startVertex[11]};
-	float pointE[3] = {startVertex[12], startVertex[13], startVertex[14]};
-	float pointF[3] = {startVertex[15], startVertex[16], startVertex[17]};
-	cout << "   " << pointA[0] << "\t\t" << pointB[0] << "\t\t\t" << pointC[0];
-	cout << "\t\t" << pointD[0] << "\t\t" << pointE[0] << "\t\t" << pointF[0] << endl;
-
-	cout << "   " << pointA[1] << "\t\t" << pointB[1] << "\t\t" << pointC[1];
-	cout << "\t" << pointD[1] << "\t" << pointE[1] << "\t\t" << pointF[1] << endl;
-
-	cout << "   " << pointA[2] << "\t\t" << pointB[2] << "\t\t" << pointC[2];
-	cout << "\t\t" << pointD[2] << "\t\t" << pointE[2] << "\t\t" << pointF[2] << endl;
-	cout << "Back Diameter " << _calculateLength(pointA, pointD) << endl;
+	return(0);
 }
-#endif
 
-//Issue OpenGL calls to draw a cylinder with orthogonal ends from 
-//one point to another.  Then put an barb head on the end
-//
-void BarbRenderer::_drawBarb(
-	const std::vector<Grid*> variableData,
-	float startPoint[3],
-	bool doColorMapping,
-	float clut[1024]
-) {
-	assert(variableData.size() == 5);
-    MatrixManager *mm = _glManager->matrixManager;
+void BarbRenderer::_buildInstances() {
+	VAPOR_TRACE_SCOPE("BarbRenderer::_buildInstances");
 
-	float endPoint[3];
-	bool missing = _defineBarb(
-		variableData, 
-		startPoint, endPoint,
-		doColorMapping, clut
-	);
+	BarbParams* bParams = dynamic_cast<BarbParams*>(GetActiveParams());
+	assert(bParams);
+
+	float clut[1024];
+	bool doColorMapping = _makeCLUT(clut);
+	float minMap = 0.0, maxMap = 1.0;
+	int nEntries = 256;
+	if (doColorMapping) {
+		MapperFunction *tf = bParams->GetMapperFunc(
+			bParams->GetColorMapVariableName()
+		);
+		minMap = tf->getMinMapValue();
+		maxMap = tf->getMaxMapValue();
+		nEntries = tf->getNumEntries();
+	}
 
-	if (missing) return;
+	float color[4] = {0.f, 0.f, 0.f, 1.f};
+	bParams->GetConstantColor(color);
 
-    mm->MatrixModeModelView();
-    mm->PushMatrix();
+	float length = bParams->GetLengthScale() * _vectorScaleFactor;
 	vector<double> scales = _getScales();
-	mm->Scale(1.f/scales[0], 1.f/scales[1], 1.f/scales[2]);
 
-	//Constants are needed for cosines and sines, at 
-	//60 degree intervals. The barb is really a hexagonal tube, 
-	//but the shading makes it look round.
-	const float sines[6] = {
-		0.f, (float) (sqrt(3.)/2.), (float) (sqrt(3.)/2.), 0.f, 
-		(float) (-sqrt(3.)/2.), (float ) (-sqrt(3.)/2.)
-	};
-	const float coses[6] = {1.f, 0.5, -0.5, -1., -.5, 0.5};
+	// Generate an instance for every barb that is drawn, then compact
+	//
+	vector <char> keep(_samples.size());
+	_instances.resize(_samples.size() * INSTANCE_SIZE);
+	Wasp::ThreadPool::Instance()->ParallelFor(
+		0, _samples.size(), 0, [&](size_t begin, size_t end) {
 
-	float nextPoint[3];
-	float vertexPoint[3];
-	float headCenter[3];
-	float startNormal[18];
-	float nextNormal[18];
-	float startVertex[18];
-	float nextVertex[18];
-	float testVec[3];
-	float testVec2[3];
-	
-	//Calculate an orthonormal frame
-
-	//dirVec is the barb direction
-	float dirVec[3];
-	float len = _calculateDirVec(startPoint, endPoint, dirVec);
-
-	//Calculate uVec, orthogonal to dirVec
-	//Not sure what bVec is.  Up direction?
-	float uVec[3], bVec[3];
-	vset(testVec, 1.,0.,0.);
-	vcross(dirVec, testVec, uVec);
-	len = vdot(uVec,uVec);
-	if (len == 0.f){
-		vset(testVec, 0.,1.,0.);
-		vcross(dirVec, testVec, uVec);
-		len = vdot(uVec, uVec);
-	} 
-	vscale(uVec, 1.f/sqrt(len));
-	vcross(uVec, dirVec, bVec);
-	
-	BarbParams* bParams = dynamic_cast<BarbParams*>(GetActiveParams());
-	assert(bParams);
+		for (size_t n=begin; n<end; n++) {
+			const sample_t &s = _samples[n];
+			float *inst = _instances.data() + n * INSTANCE_SIZE;
 
-	float radius = bParams->GetLineThickness() * _maxThickness;
-	
-	//calculate 6 points in plane orthog to dirVec, in plane of point
-	for (int i = 0; i<6; i++){
-		//testVec and testVec2 are components of point in plane
-		vmult(uVec, coses[i], testVec);
-		vmult(bVec, sines[i], testVec2);
+			keep[n] = ! s.missing && ! (doColorMapping && s.valueMissing);
 
-		//Calc outward normal as a sideEffect..
-		//It is the vector sum of x,y components (norm 1)
-		vadd(testVec, testVec2, startNormal+3*i);
+			for (int dim=0; dim<3; dim++) {
+				inst[dim] = s.start[dim];
+				inst[3+dim] = scales[dim] * s.dir[dim] * length;
+			}
 
-		//stretch by radius to get current displacement
-		vmult(startNormal+3*i, radius, startVertex+3*i);
+			// A barb with no direction has no geometry
+			//
+			if (inst[3] == 0.f && inst[4] == 0.f && inst[5] == 0.f) {
+				keep[n] = false;
+			}
 
-		//add to current point
-		vadd(startVertex+3*i, startPoint, startVertex+3*i);
+			if (doColorMapping) {
+				int lutIndex = lut_index(s.value, minMap, maxMap, nEntries);
+				for (int i=0; i<4; i++) inst[6+i] = clut[4*lutIndex+i];
+			}
+			else {
+				for (int i=0; i<4; i++) inst[6+i] = color[i];
+			}
+		}
+	});
+
+	_nInstances = 0;
+	for (size_t n=0; n<_samples.size(); n++) {
+		if (! keep[n]) continue;
+		if (n != _nInstances) {
+			std::copy(
+				_instances.begin() + n * INSTANCE_SIZE,
+				_instances.begin() + (n+1) * INSTANCE_SIZE,
+				_instances.begin() + _nInstances * INSTANCE_SIZE
+			);
+		}
+		_nInstances++;
 	}
+	_instances.resize(_nInstances * INSTANCE_SIZE);
+	_instancesPending = true;
+}
 
-#ifdef DEBUG
-	_printBackDiameter(startVertex);
-#endif
+void BarbRenderer::_uploadInstances() {
+	if (! _instancesPending) return;
 
-	_drawBackOfBarb(dirVec, startVertex);
+	glBindBuffer(GL_ARRAY_BUFFER, _instanceVBO);
+	glBufferData(
+		GL_ARRAY_BUFFER, _instances.size() * sizeof(float), 
+		_instances.data(), GL_DYNAMIC_DRAW
+	);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	vector <float>().swap(_instances);
+	_instancesPending = false;
+}
 
-	// The variables are located as follows:
-	//		- - - - >
-	//	   ^       ^ ^
-	// start    next end
+int BarbRenderer::_prepare(bool) {
+
+	// Only the sampling is done here. Updating the scales may modify 
+	// the params, which is left to the GL thread.
+	//
+	if (_isSampleDirty()) return(_sampleRake());
+	return(0);
+}
 
-	//Calculate nextPoint and vertexPoint, for barbhead
-	for (int i = 0; i< 3; i++){
-		nextPoint[i] = (1. - BARB_LENGTH_FACTOR)*startPoint[i]+ BARB_LENGTH_FACTOR*endPoint[i];
-		//Assume a vertex angle of 45 degrees:
-		vertexPoint[i] = nextPoint[i] + dirVec[i]*radius;
-		headCenter[i] = nextPoint[i] - dirVec[i]*(BARB_HEAD_FACTOR*radius-radius); 
+int BarbRenderer::_paintGL(bool) {
+    int rc = 0;
+    
+	if (_isSampleDirty()) {
+		rc = _sampleRake();
+		if (rc<0) return(-1);
 	}
-			
-	//calc for endpoints:
-	for (int i = 0; i<6; i++){
-		//testVec and testVec2 are components of point in plane
-		vmult(uVec, coses[i], testVec);
-		vmult(bVec, sines[i], testVec2);
-	
-		//Calc outward normal as a sideEffect..
-		//It is the vector sum of x,y components (norm 1)
-		vadd(testVec, testVec2, nextNormal+3*i);
 
-		//stretch by radius to get current displacement
-		vmult(nextNormal+3*i, radius, nextVertex+3*i);
+	BarbParams* bParams = dynamic_cast<BarbParams*>(GetActiveParams());
+	assert(bParams);
 
-		//add to current point
-		vadd(nextVertex+3*i, nextPoint, nextVertex+3*i);		
-	}
+	_recalculateScales(bParams->GetCurrentTimestep());
 
-	_drawCylinderSides(nextNormal, nextVertex, startNormal, startVertex);	
-	
-	//Now draw the barb head.  First calc 6 vertices at back of barbhead
-	//Reuse startNormal and startVertex vectors
-	//calc for endpoints:
-	for (int i = 0; i<6; i++){
-		//testVec and testVec2 are components of point in plane
-		//Can reuse them from previous (cylinder end) calculation
-		vmult(uVec, coses[i], testVec);
-		vmult(bVec, sines[i], testVec2);
-
-		//Calc outward normal as a sideEffect..
-		//It is the vector sum of x,y components (norm 1)
-		vadd(testVec, testVec2, startNormal+3*i);
-
-		//stretch by radius to get current displacement
-		vmult(startNormal+3*i, BARB_HEAD_FACTOR*radius, startVertex+3*i);
-
-		//add to current point
-		vadd(startVertex+3*i, headCenter, startVertex+3*i);
-
-		//Now tilt normals in direction of barb:
-		for (int k = 0; k<3; k++){
-			startNormal[3*i+k] = 0.5*startNormal[3*i+k] + 0.5*dirVec[k];
-		}
+	if (_instancesDirty || _isCacheDirty()) {
+		_saveCacheParams();
+		_buildInstances();
+		_instancesDirty = false;
 	}
+	_uploadInstances();
 
-	_drawBarbHead(dirVec, vertexPoint, startNormal, startVertex);
+	if (! _nInstances) return(0);
 
-    mm->PopMatrix();
-}
+	SmartShaderProgram shader = _glManager->shaderManager->GetSmartShader("Barb");
+	if (!shader.IsValid()) return(-1);
 
-void BarbRenderer::_setUpLightingAndColor() {
-    LegacyGL *lgl = _glManager->legacy;
 	string winName = GetVisualizer(); // GetVisualizer is not const :(
 	ViewpointParams* vpParams =  _paramsMgr->GetViewpointParams(winName);
+	float lightDir[3] = {0.f, 0.f, 0.f};
 	int nLights = vpParams->getNumLights();
-	
-	float fcolor[3];
-	BarbParams* bParams = dynamic_cast<BarbParams*>(GetActiveParams());
-	assert(bParams);
-	bParams->GetConstantColor(fcolor);
-	if (nLights == 0) {
-        lgl->DisableLighting();
+	for (int i=0; i<3 && nLights>0; i++) {
+		lightDir[i] = vpParams->getLightDirection(0, i);
 	}
-	else {
-		LEGACY_TODO(glShadeModel(GL_SMOOTH));
-		LEGACY_TODO(glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE,fcolor));
-		LEGACY_TODO(glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, vpParams->getExponent()));
-		//All the geometry will get a white specular color:
-		float specColor[4];
-		specColor[0]=specColor[1]=specColor[2]=0.8f;
-		specColor[3] = 1.f;
-		LEGACY_TODO(glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, specColor));
-		LEGACY_TODO(glEnable(GL_COLOR_MATERIAL));
-        lgl->EnableLighting();
-	}
-	lgl->Color3fv(fcolor);
+
+    MatrixManager *mm = _glManager->matrixManager;
+    mm->MatrixModeModelView();
+    mm->PushMatrix();
+	vector<double> scales = _getScales();
+	mm->Scale(1.f/scales[0], 1.f/scales[1], 1.f/scales[2]);
+
+	shader->SetUniform("P", mm->GetProjectionMatrix());
+	shader->SetUniform("MV", mm->GetModelViewMatrix());
+	shader->SetUniform("radius", (float) (bParams->GetLineThickness() * _maxThickness));
+	shader->SetUniform("lightingEnabled", nLights > 0);
+	shader->SetUniform("lightDir", glm::make_vec3(lightDir));
+
+	glBindVertexArray(_VAO);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, _nMeshVertices, _nInstances);
+	glBindVertexArray(0);
+
+    mm->PopMatrix();
+	return(rc);
 }
 
 void BarbRenderer::_reFormatExtents(
@@ -639,46 +744,6 @@ void BarbRenderer::_makeRakeGrid(
 	rakeGrid.push_back((int)longGrid[Z]);
 }
 
-float BarbRenderer::_getHeightOffset(
-	Grid* heightVar, 
-	float xCoord, 
-	float yCoord, 
-	bool& missing
-) const {
-	assert(heightVar);	
-	float missingVal = heightVar->GetMissingValue();
-	float offset = heightVar->GetValue(xCoord, yCoord, 0.f);
-	if (offset == missingVal) {
-		missing = true;
-		offset = 0.f;
-	}
-	return offset;
-}
-
-void BarbRenderer::_getDirection(
-	float direction[3], 
-	vector<Grid*> variableData,
-	float xCoord,
-	float yCoord,
-	float zCoord,
-	bool &missing
-) const {
-	for (int dim=0; dim<3; dim++) {
-		direction[dim]=0.f;
-		if (variableData[dim]) {
-			direction[dim] = variableData[dim]->GetValue(
-				xCoord, yCoord, zCoord
-			);
-
-
-			float missingVal = variableData[dim]->GetMissingValue();
-			if (direction[dim] == missingVal) {
-				missing = true;
-			}
-		}
-	}
-}
-
 bool BarbRenderer::_makeCLUT(float clut[1024]) const {
 	BarbParams* bParams = dynamic_cast<BarbParams*>(GetActiveParams());
 	assert(bParams);
@@ -706,30 +771,6 @@ vector<double> BarbRenderer::_getScales() {
 	return scales;
 }
 
-float BarbRenderer::_calculateLength(float start[3], float end[3]) const {
-	float xDist = start[X]-end[X];
-	float yDist = start[Y]-end[Y];
-	float zDist = start[Z]-end[Z];
-	float length = sqrt(xDist*xDist + yDist*yDist + zDist*zDist);
-	return length;
-}
-
-void BarbRenderer::_makeStartAndEndPoint(
-	float start[3], 
-	float end[3], 
-	float direction[3]
-) {
-	BarbParams* bParams = dynamic_cast<BarbParams*>(GetActiveParams());
-	assert(bParams);
-	float length = bParams->GetLengthScale() * _vectorScaleFactor;
-
-	vector<double> scales = _getScales();
-	
-	end[X] = start[X] + scales[X]*direction[X]*length;
-	end[Y] = start[Y] + scales[Y]*direction[Y]*length;
-	end[Z] = start[Z] + scales[Z]*direction[Z]*length;
-}
-
 void BarbRenderer::_getStrides(
 	vector<float> &strides, 
 	vector<int> &rakeGrid,
@@ -747,137 +788,6 @@ void BarbRenderer::_getStrides(
 	strides.push_back(zStride);
 }
 
-bool BarbRenderer::_defineBarb(
-	std::vector<Grid*> variableData,
-	float start[3],
-	float end[3],
-	bool doColorMapping,
-	float clut[1024]
-) {
-	bool missing = false;
-	
-	Grid* heightVar = variableData[3];
-	if (heightVar) {
-		start[Z] += _getHeightOffset(heightVar, 
-			start[X], start[Y], missing
-		);
-	}
-
-	float direction[3] = {0.f, 0.f, 0.f};
-	_getDirection(direction, variableData, 
-		start[X], start[Y], start[Z], missing
-	);
-
-	_makeStartAndEndPoint(start, end, direction);
-
-	if (doColorMapping) {
-		float val = variableData[4]->GetValue(
-			start[X],start[Y],start[Z]
-		);
-
-		if (val == variableData[4]->GetMissingValue()) 
-			missing=true;
-		else{
-			missing = _getColorMapping(val, clut);
-		}
-	}
-	return missing;
-}
-
-void BarbRenderer::_operateOnGrid(
-	vector <Grid *> variableData,
-	bool drawBarb
-) {
-	vector<int> rakeGrid;
-	_makeRakeGrid(rakeGrid);
-
-	vector<float> rakeExts;
-	_reFormatExtents(rakeExts);
-
-	vector<float> strides;
-	_getStrides(strides, rakeGrid, rakeExts);
-
-	float clut[1024];
-	bool doColorMapping = _makeCLUT(clut);
-
-	float start[3];//, end[3];
-	for (int i = 1; i<=rakeGrid[X]; i++){
-		start[X]= strides[X] * i + rakeExts[X];// + xStride/2.0;
-		for (int j = 1; j<=rakeGrid[Y]; j++){
-			start[Y] = strides[Y] * j + rakeExts[Y];// + yStride/2.0;
-			for (int k = 1; k<=rakeGrid[Z]; k++){
-				start[Z] = strides[Z] * k + rakeExts[Z]; //+ zStride/2.0;
-
-				if (drawBarb) {
-					_drawBarb(
-						variableData,
-						start,
-						doColorMapping, 
-						clut
-					);
-				}
-				else {
-					_getMagnitudeAtPoint(
-						variableData,
-						start
-					);
-				}
-			}
-		}
-	}
-	return;
-}
-
-void BarbRenderer::_getMagnitudeAtPoint(
-	std::vector<VAPoR::Grid*> variables, 
-	float point[3]
-) {
-	VAPoR::Grid* grid;
-	double maxValue = 0.f;
-	for (int i=0; i<3; i++) {
-		grid = variables[i];
-		if (grid==NULL) 
-			continue;
-		else {
-			double value = grid->GetValue(point[X], point[Y], point[Z]);
-			double missingValue = grid->GetMissingValue();
-
-			if (value == missingValue){
-				continue;
-			}
-			value = abs(value);
-
-			if (value > maxValue &&
-			value < std::numeric_limits<double>::max() &&
-			value > std::numeric_limits<double>::lowest() &&
-			!std::isnan(value))
-				maxValue = value;
-		}
-	}
-	if (maxValue > _maxValue){
-		_maxValue = maxValue;
-	}
-}
-
-bool BarbRenderer::_getColorMapping(float val, float clut[256*4]) {
-	bool missing = false;
-
-	MapperFunction* tf=0;
-	BarbParams* bParams = dynamic_cast<BarbParams*>(GetActiveParams());
-	assert(bParams);
-   	string colorVar = bParams->GetColorMapVariableName();
-	tf = (MapperFunction*)bParams->GetMapperFunc(colorVar);
-	assert(tf);
-
-	float mappedColor[4] = {0.,0.,0.,0.};
-	//Use the transfer function to map the data:
-	int lutIndex = tf->mapFloatToIndex(val);
-	for (int i = 0; i<4; i++)
-		mappedColor[i] = clut[4*lutIndex+i];
-    _glManager->legacy->Color4fv(mappedColor);
-	return missing;
-}
-
 double BarbRenderer::_getDomainHypotenuse(
 	size_t ts
 ) const {
@@ -912,15 +822,10 @@ double BarbRenderer::_getDomainHypotenuse(
 
 void BarbRenderer::_setDefaultLengthAndThicknessScales(
 	size_t ts, 
-	const std::vector<VAPoR::Grid*> &varData, 
 	const BarbParams* bParams
 ) {
-	assert(varData.size() >= 3);
-
-	_maxValue = 0;
-
-	_operateOnGrid(varData, false);
-	
+	// _maxValue is found while sampling the rake
+	//
 	double hypotenuse = _getDomainHypotenuse(ts);
 
 	if (hypotenuse == 0.f) return;
@@ -0,0 +1,278 @@
+#include <cstdio>
+#include <cassert>
+#include <algorithm>
+#ifdef WIN32
+#include <tiff/tiffio.h>
+#else
+#include <tiffio.h>
+#endif
+
+#ifdef WIN32
+#pragma warning(disable : 4996)
+#endif
+
+#include <vapor/EasyThreads.h>
+#include <vapor/jpegapi.h>
+#include <vapor/Trace.h>
+#include <vapor/CaptureQueue.h>
+
+using namespace VAPoR;
+using namespace Wasp;
+using namespace std;
+
+#include "imagewriter.hpp"
+
+namespace {
+
+// The image format is determined by the last four characters of the
+// file name
+//
+string get_suffix(const string &filename) {
+	if (filename.length() < 4) return("");
+	return(filename.substr(filename.length()-4, 4));
+}
+
+bool is_tiff(const string &filename) {
+	string suffix = get_suffix(filename);
+	return(suffix == ".tif" || suffix == "tiff");
+}
+
+bool is_jpeg(const string &filename) {
+	string suffix = get_suffix(filename);
+	return(suffix == ".jpg" || suffix == "jpeg");
+}
+
+// Name of the file a frame is encoded into before it is renamed into
+// place. The extension is preserved since the PNG writer relies on it.
+//
+string temp_name(const string &filename) {
+	size_t dot = filename.find_last_of('.');
+	size_t slash = filename.find_last_of("/\\");
+	if (dot == string::npos || (slash != string::npos && dot < slash)) {
+		return(filename + ".partial");
+	}
+	return(filename.substr(0, dot) + ".partial" + filename.substr(dot));
+}
+
+};
+
+CaptureQueue::CaptureQueue(int nencoders, int maxBuffers) {
+	if (nencoders < 1) {
+		nencoders = std::max(1, std::min(EasyThreads::NProc() - 1, 4));
+	}
+
+	// The submitting thread only helps out while flushing, so the pool
+	// needs a worker for every encoder
+	//
+	_pool = new ThreadPool(nencoders + 1);
+	_group = new ThreadPool::TaskGroup(_pool);
+	_maxBuffers = maxBuffers > 0 ? maxBuffers : 2 * nencoders;
+	_nInUse = 0;
+	_nextSeq = 0;
+	_nextCommit = 0;
+}
+
+CaptureQueue::~CaptureQueue() {
+	_group->Wait();
+	delete _group;
+	delete _pool;
+
+	map <unsigned char *, size_t>::iterator itr;
+	for (itr = _sizes.begin(); itr != _sizes.end(); ++itr) {
+		delete [] itr->first;
+	}
+}
+
+unsigned char *CaptureQueue::GetBuffer(size_t nbytes) {
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	if (_nInUse >= _maxBuffers) {
+		VAPOR_TRACE_SCOPE("CaptureQueue::GetBuffer wait");
+		_cv.wait(lock, [this]() {return(_nInUse < _maxBuffers); });
+	}
+	_nInUse++;
+
+	unsigned char *buf = NULL;
+	if (! _free.empty()) {
+		buf = _free.back();
+		_free.pop_back();
+		if (_sizes[buf] < nbytes) {
+			_sizes.erase(buf);
+			delete [] buf;
+			buf = NULL;
+		}
+	}
+	if (! buf) {
+		buf = new unsigned char[nbytes];
+		_sizes[buf] = nbytes;
+	}
+	return(buf);
+}
+
+void CaptureQueue::Release(unsigned char *buf) {
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		assert(_sizes.find(buf) != _sizes.end());
+		_free.push_back(buf);
+		_nInUse--;
+	}
+	_cv.notify_all();
+}
+
+int CaptureQueue::Submit(
+	unsigned char *buf, size_t width, size_t height, string filename
+) {
+	long seq;
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		seq = _nextSeq++;
+	}
+
+	if (! is_tiff(filename) && ! is_jpeg(filename)) {
+
+		// PNG files are written by Python, which must not be entered
+		// from the encoder threads
+		//
+		_encode(seq, buf, width, height, filename);
+	}
+	else {
+		_group->Run([this, seq, buf, width, height, filename]() {
+			_encode(seq, buf, width, height, filename);
+		});
+	}
+
+	return(_reportErrors());
+}
+
+int CaptureQueue::Flush() {
+	VAPOR_TRACE_SCOPE("CaptureQueue::Flush");
+	_group->Wait();
+	return(_reportErrors());
+}
+
+void CaptureQueue::_encode(
+	long seq, unsigned char *buf, size_t width, size_t height,
+	string filename
+) {
+	VAPOR_TRACE_SCOPE("CaptureQueue::Encode");
+
+	result_t result;
+	result.filename = filename;
+	result.tmpfile = temp_name(filename);
+
+	int rc = WriteImage(result.tmpfile, buf, width, height);
+	if (rc<0) {
+		result.errmsg = "Image Capture Error; Error writing file " + filename;
+	}
+	Release(buf);
+
+	_commit(seq, result);
+}
+
+void CaptureQueue::_commit(long seq, const result_t &result) {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	_done[seq] = result;
+	while (! _done.empty() && _done.begin()->first == _nextCommit) {
+		const result_t &r = _done.begin()->second;
+
+		if (r.errmsg.empty()) {
+			(void) remove(r.filename.c_str());
+			if (rename(r.tmpfile.c_str(), r.filename.c_str()) != 0) {
+				_errors.push_back(
+					"Image Capture Error; Error renaming " + r.tmpfile +
+					" to " + r.filename
+				);
+			}
+		}
+		else {
+			(void) remove(r.tmpfile.c_str());
+			_errors.push_back(r.errmsg);
+		}
+		_done.erase(_done.begin());
+		_nextCommit++;
+	}
+}
+
+int CaptureQueue::_reportErrors() {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	if (_errors.empty()) return(0);
+
+	if (_errors.size() == 1) {
+		SetErrMsg("%s", _errors[0].c_str());
+	}
+	else {
+		SetErrMsg(
+			"%s (and %d more)", _errors[0].c_str(), (int) _errors.size() - 1
+		);
+	}
+	_errors.clear();
+	return(-1);
+}
+
+int CaptureQueue::WriteImage(
+	string filename, const unsigned char *buf, size_t width, size_t height
+) {
+	unsigned char *data = (unsigned char *) buf;
+
+	if (is_tiff(filename)) {
+		TIFF* tiffFile = TIFFOpen((const char*)filename.c_str(), "wb");
+		if (!tiffFile) {
+			SetErrMsg("Image Capture Error: Error opening output Tiff file: %s",(const char*)filename.c_str());
+			return -1;
+		}
+
+		// capture the tiff file, one scanline at a time
+		//
+		uint32 imagelength = (uint32) height;
+		uint32 imagewidth = (uint32) width;
+		TIFFSetField(tiffFile, TIFFTAG_IMAGELENGTH, imagelength);
+		TIFFSetField(tiffFile, TIFFTAG_IMAGEWIDTH, imagewidth);
+		TIFFSetField(tiffFile, TIFFTAG_PLANARCONFIG, 1);
+		TIFFSetField(tiffFile, TIFFTAG_SAMPLESPERPIXEL, 3);
+		TIFFSetField(tiffFile, TIFFTAG_ROWSPERSTRIP, 8);
+		TIFFSetField(tiffFile, TIFFTAG_BITSPERSAMPLE, 8);
+		TIFFSetField(tiffFile, TIFFTAG_PHOTOMETRIC, 2);
+		int status = 0;
+		for (int row = 0; row < imagelength; row++){
+			int rc = TIFFWriteScanline(tiffFile, data+row*3*imagewidth, row);
+			if (rc != 1){
+				SetErrMsg("Image Capture Error; Error writing tiff file %s",
+				(const char*)filename.c_str());
+				status = -1;
+				break;
+			}
+		}
+		TIFFClose(tiffFile);
+		return status;
+	}
+	else if (is_jpeg(filename)) {
+		FILE *jpegFile = fopen((const char*)filename.c_str(), "wb");
+		if (!jpegFile) {
+			SetErrMsg("Image Capture Error: Error opening output Jpeg file: %s",(const char*)filename.c_str());
+			return -1;
+		}
+
+		int quality = 95;
+		int rc = write_JPEG_file(jpegFile, width, height, data, quality);
+		fclose( jpegFile );
+		if (rc){
+			SetErrMsg("Image Capture Error; Error writing jpeg file %s",
+				(const char*)filename.c_str());
+			return -1;
+		}
+	}
+	else {
+
+		// The Write_PNG() function handles fopen et al. by itself.
+		//
+		int rc = Write_PNG( filename.c_str(), width, height, data );
+		if (rc) {
+			SetErrMsg("Image Capture Error; Error writing PNG file %s",
+				(const char*)filename.c_str());
+			return -1;
+		}
+	}
+	return 0;
+}
@@ -42,13 +42,6 @@
 
 using namespace VAPoR;
 
-#pragma pack(push, 4)
-struct ContourRenderer::VertexData {
-    float x, y, z;
-    float r, g, b, a;
-};
-#pragma pack(pop)
-
 static RendererRegistrar<ContourRenderer> registrar(
                                                     ContourRenderer::GetClassType(), ContourParams::GetClassType()
                                                     );
@@ -58,7 +51,7 @@ ContourRenderer::ContourRenderer(const ParamsMgr* pm, string winName,
                                  DataMgr* dataMgr)
 : Renderer(pm, winName, dataSetName, ContourParams::GetClassType(),
            ContourRenderer::GetClassType(), instName, dataMgr),
-_VAO(0), _VBO(0), _nVertices(0) {}
+_VAO(0), _VBO(0), _nVertices(0), _uploadPending(false) {}
 
 ContourRenderer::~ContourRenderer()
 {
@@ -73,8 +66,8 @@ void ContourRenderer::_saveCacheParams()
     _cacheParams.varName = p->GetVariableName();
     _cacheParams.heightVarName = p->GetHeightVariableName();
     _cacheParams.ts = p->GetCurrentTimestep();
-    _cacheParams.level = p->GetRefinementLevel();
-    _cacheParams.lod = p->GetCompressionLevel();
+    _cacheParams.level = GetRefinementLevel();
+    _cacheParams.lod = GetCompressionLevel();
     _cacheParams.useSingleColor = p->UseSingleColor();
     _cacheParams.lineThickness = p->GetLineThickness();
     p->GetConstantColor(_cacheParams.constantColor);
@@ -94,8 +87,8 @@ bool ContourRenderer::_isCacheDirty() const
     if (_cacheParams.varName != p->GetVariableName()) return true;
     if (_cacheParams.heightVarName != p->GetHeightVariableName()) return true;
     if (_cacheParams.ts      != p->GetCurrentTimestep()) return true;
-    if (_cacheParams.level   != p->GetRefinementLevel()) return true;
-    if (_cacheParams.lod     != p->GetCompressionLevel()) return true;
+    if (_cacheParams.level   != GetRefinementLevel()) return true;
+    if (_cacheParams.lod     != GetCompressionLevel()) return true;
     if (_cacheParams.useSingleColor != p->UseSingleColor()) return true;
     if (_cacheParams.lineThickness != p->GetLineThickness()) return true;
     
@@ -126,12 +119,11 @@ int ContourRenderer::_buildCache()
     ContourParams* cParams = (ContourParams*)GetActiveParams();
     _saveCacheParams();
     
-    vector<VertexData> vertices;
-    vector<pair<int, glm::vec4>> colors;
+    vector<VertexData> &vertices = _vertices;
+    vertices.clear();
     
     if (cParams->GetVariableName().empty())
     {
-        glEndList();
         return 0;
     }
     MapperFunction *tf = cParams->GetMapperFunc(_cacheParams.varName);
@@ -157,7 +149,7 @@ int ContourRenderer::_buildCache()
     }
     
     if (grid == NULL || (heightGrid == NULL && !_cacheParams.heightVarName.empty())) {
-        glEndList();
+        delete [] contourColors;
         return -1;
     }
     
@@ -226,14 +218,28 @@ int ContourRenderer::_buildCache()
         delete [] values;
     }
     
-    _nVertices = vertices.size();
+    delete [] contourColors;
+    _uploadPending = true;
+    return 0;
+}
+
+void ContourRenderer::_uploadCache()
+{
+    _nVertices = _vertices.size();
     glBindVertexArray(_VAO);
     glBindBuffer(GL_ARRAY_BUFFER, _VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(VertexData), vertices.data(), GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(VertexData), _vertices.data(), GL_DYNAMIC_DRAW);
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     
-    delete [] contourColors;
+    _vertices.clear();
+    _uploadPending = false;
+}
+
+int ContourRenderer::_prepare(bool)
+{
+    if (_isCacheDirty())
+        return _buildCache();
     return 0;
 }
 
@@ -242,6 +248,8 @@ int ContourRenderer::_paintGL(bool)
     int rc = 0;
     if (_isCacheDirty())
         rc = _buildCache();
+    if (_uploadPending)
+        _uploadCache();
     
     ShaderProgram *shader = _glManager->shaderManager->GetShader("Contour");
     if (shader == nullptr)
@@ -10,6 +10,8 @@
 
 #include <vapor/GetAppPath.h>
 #include <vapor/ParamsMgr.h>
+#include <vapor/DerivedVarParams.h>
+#include <vapor/DerivedVarPython.h>
 #include <vapor/ControlExecutive.h>
 
 using namespace VAPoR;
@@ -145,6 +147,13 @@ int ControlExec::Paint(string winName, bool fast){
 	return rc;
 }
 
+bool ControlExec::NeedsRefinement(string winName) const {
+	Visualizer* v = getVisualizer(winName);
+	if (!v) return(false);
+
+	return(v->NeedsRefinement());
+}
+
 int ControlExec::ActivateRender(
 	string winName, string dataSetName, string renderType, 
 	string renderName, bool on
@@ -406,6 +415,11 @@ int ControlExec::activateClassRenderers(
 
 int ControlExec::openDataHelper(bool reportErrs) {
 
+	// Define the derived variables recorded in the session state
+	//
+	syncExpressionVars(reportErrs);
+	syncPythonVars(reportErrs);
+
 	// Activate/Create renderers as needed. This is a no-op if renderers
 	// already exist
 	//
@@ -561,6 +575,10 @@ int ControlExec::EnableAnimationCapture(
 	}
 
 	if(v->setAnimationCaptureEnabled(onOff, filename)) return -1;
+
+	// Write the frames still being read back or encoded
+	//
+	if (! onOff && v->FlushCapture() < 0) return -1;
 	return 0;
 }
 
@@ -589,6 +607,265 @@ string ControlExec::MakeStringConformant(string s) {
 }
 
 
+int ControlExec::AddExpressionVar(
+	string dataSetName, string varName, string formula
+) {
+	DataMgr *dataMgr = _dataStatus->GetDataMgr(dataSetName);
+	if (! dataMgr) {
+		SetErrMsg("Invalid data set : %s", dataSetName.c_str());
+		return(-1);
+	}
+
+	int rc = dataMgr->AddExpressionVar(varName, formula);
+	if (rc<0) return(-1);
+
+	DerivedVarParams *params = (DerivedVarParams *) _paramsMgr->GetParams(
+		DerivedVarParams::GetClassType()
+	);
+	assert(params);
+
+	params->SetFormula(dataSetName, varName, formula);
+
+	return(0);
+}
+
+int ControlExec::RemoveExpressionVar(string dataSetName, string varName) {
+
+	DataMgr *dataMgr = _dataStatus->GetDataMgr(dataSetName);
+	if (dataMgr) {
+		int rc = dataMgr->RemoveExpressionVar(varName);
+		if (rc<0) return(-1);
+	}
+
+	DerivedVarParams *params = (DerivedVarParams *) _paramsMgr->GetParams(
+		DerivedVarParams::GetClassType()
+	);
+	assert(params);
+
+	params->RemoveVar(dataSetName, varName);
+
+	return(0);
+}
+
+// Make the expression variables defined on each DataMgr match the
+// session state. Definitions that fail, e.g. because the data set no
+// longer contains their inputs, are skipped.
+//
+void ControlExec::syncExpressionVars(bool reportErrs) {
+
+	DerivedVarParams *params = (DerivedVarParams *) _paramsMgr->GetParams(
+		DerivedVarParams::GetClassType()
+	);
+	if (! params) return;
+
+	bool errEnabled = MyBase::GetEnableErrMsg();
+	if (! reportErrs) EnableErrMsg(false);
+
+	vector <string> dataSetNames = _paramsMgr->GetDataMgrNames();
+	for (int i=0; i<dataSetNames.size(); i++) {
+		DataMgr *dataMgr = _dataStatus->GetDataMgr(dataSetNames[i]);
+		if (! dataMgr) continue;
+
+		// A variable can not be removed while others are computed from
+		// it, so repeat until no more can be removed. Those still in use
+		// are left in place, or redefined below.
+		//
+		bool progress = true;
+		while (progress) {
+			progress = false;
+
+			vector <string> varNames = dataMgr->GetExpressionVarNames();
+			for (int j=0; j<varNames.size(); j++) {
+				string formula = params->GetFormula(
+					dataSetNames[i], varNames[j]
+				);
+				if (formula == dataMgr->GetExpressionVarFormula(varNames[j])) {
+					continue;
+				}
+
+				EnableErrMsg(false);
+				int rc = dataMgr->RemoveExpressionVar(varNames[j]);
+				EnableErrMsg(reportErrs && errEnabled);
+
+				if (rc == 0) progress = true;
+			}
+		}
+
+		// Variables may be defined in terms of each other, so repeat
+		// until no more can be added
+		//
+		vector <string> pending = params->GetVarNames(dataSetNames[i]);
+		progress = true;
+		while (progress && ! pending.empty()) {
+			progress = false;
+
+			vector <string> failed;
+			for (int j=0; j<pending.size(); j++) {
+				string formula = params->GetFormula(
+					dataSetNames[i], pending[j]
+				);
+				if (formula == dataMgr->GetExpressionVarFormula(pending[j])) {
+					continue;
+				}
+
+				EnableErrMsg(false);
+				int rc = dataMgr->AddExpressionVar(pending[j], formula);
+				EnableErrMsg(reportErrs && errEnabled);
+
+				if (rc<0) failed.push_back(pending[j]);
+				else progress = true;
+			}
+			pending = failed;
+		}
+
+		for (int j=0; j<pending.size(); j++) {
+			SetErrMsg(
+				"Failed to define variable %s of data set %s",
+				pending[j].c_str(), dataSetNames[i].c_str()
+			);
+		}
+	}
+
+	EnableErrMsg(errEnabled);
+}
+
+int ControlExec::AddPythonVar(
+	string dataSetName, string varName, string script,
+	const vector <string> &inputs
+) {
+	DataMgr *dataMgr = _dataStatus->GetDataMgr(dataSetName);
+	if (! dataMgr) {
+		SetErrMsg("Invalid data set : %s", dataSetName.c_str());
+		return(-1);
+	}
+
+	int rc = dataMgr->AddDerivedVar(
+		new DerivedDataVarPython(varName, dataMgr, script, inputs)
+	);
+	if (rc<0) return(-1);
+
+	DerivedVarParams *params = (DerivedVarParams *) _paramsMgr->GetParams(
+		DerivedVarParams::GetClassType()
+	);
+	assert(params);
+
+	params->SetPythonVar(dataSetName, varName, script, inputs);
+
+	return(0);
+}
+
+int ControlExec::RemovePythonVar(string dataSetName, string varName) {
+
+	DataMgr *dataMgr = _dataStatus->GetDataMgr(dataSetName);
+	if (dataMgr) {
+		int rc = dataMgr->RemoveDerivedVar(varName);
+		if (rc<0) return(-1);
+	}
+
+	DerivedVarParams *params = (DerivedVarParams *) _paramsMgr->GetParams(
+		DerivedVarParams::GetClassType()
+	);
+	assert(params);
+
+	params->RemovePythonVar(dataSetName, varName);
+
+	return(0);
+}
+
+namespace {
+
+// Return true if var is a Python variable with the given definition
+//
+bool samePythonVar(
+	const DerivedDataVar *var, string script, const vector <string> &inputs
+) {
+	const DerivedDataVarPython *pvar =
+		dynamic_cast <const DerivedDataVarPython *> (var);
+
+	return(pvar && pvar->GetScript() == script && pvar->GetInputs() == inputs);
+}
+
+};
+
+// As syncExpressionVars(), for the variables computed by Python
+//
+void ControlExec::syncPythonVars(bool reportErrs) {
+
+	DerivedVarParams *params = (DerivedVarParams *) _paramsMgr->GetParams(
+		DerivedVarParams::GetClassType()
+	);
+	if (! params) return;
+
+	bool errEnabled = MyBase::GetEnableErrMsg();
+	if (! reportErrs) EnableErrMsg(false);
+
+	vector <string> dataSetNames = _paramsMgr->GetDataMgrNames();
+	for (int i=0; i<dataSetNames.size(); i++) {
+		DataMgr *dataMgr = _dataStatus->GetDataMgr(dataSetNames[i]);
+		if (! dataMgr) continue;
+
+		bool progress = true;
+		while (progress) {
+			progress = false;
+
+			vector <string> varNames = dataMgr->GetDerivedVarNames();
+			for (int j=0; j<varNames.size(); j++) {
+				string script;
+				vector <string> inputs;
+				bool found = params->GetPythonVar(
+					dataSetNames[i], varNames[j], script, inputs
+				);
+				if (found && samePythonVar(
+					dataMgr->GetDerivedVar(varNames[j]), script, inputs
+				)) continue;
+
+				EnableErrMsg(false);
+				int rc = dataMgr->RemoveDerivedVar(varNames[j]);
+				EnableErrMsg(reportErrs && errEnabled);
+
+				if (rc == 0) progress = true;
+			}
+		}
+
+		vector <string> pending = params->GetPythonVarNames(dataSetNames[i]);
+		progress = true;
+		while (progress && ! pending.empty()) {
+			progress = false;
+
+			vector <string> failed;
+			for (int j=0; j<pending.size(); j++) {
+				string script;
+				vector <string> inputs;
+				params->GetPythonVar(dataSetNames[i], pending[j], script, inputs);
+				if (samePythonVar(
+					dataMgr->GetDerivedVar(pending[j]), script, inputs
+				)) continue;
+
+				EnableErrMsg(false);
+				int rc = dataMgr->AddDerivedVar(
+					new DerivedDataVarPython(
+						pending[j], dataMgr, script, inputs
+					)
+				);
+				EnableErrMsg(reportErrs && errEnabled);
+
+				if (rc<0) failed.push_back(pending[j]);
+				else progress = true;
+			}
+			pending = failed;
+		}
+
+		for (int j=0; j<pending.size(); j++) {
+			SetErrMsg(
+				"Failed to define variable %s of data set %s",
+				pending[j].c_str(), dataSetNames[i].c_str()
+			);
+		}
+	}
+
+	EnableErrMsg(errEnabled);
+}
+
 void ControlExec::undoRedoHelper() {
 
 	bool enabled = GetSaveStateEnabled();
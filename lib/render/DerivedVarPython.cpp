@@ -0,0 +1,699 @@
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <vapor/MyPython.h>
+#include <vapor/ThreadPool.h>
+#include <vapor/DataMgr.h>
+#include <vapor/DerivedVarPython.h>
+
+using namespace VAPoR;
+using namespace Wasp;
+
+namespace {
+
+size_t numElements(const vector <size_t> &dims) {
+	size_t nElements = 1;
+	for (int i=0; i<dims.size(); i++) nElements *= dims[i];
+	return(nElements);
+}
+
+// A Python object exposing an array of floats, possibly embedded in a
+// larger array, through the buffer protocol so that numpy can view it
+// in place. If grid is not NULL the array belongs to a grid locked in
+// the cache of dataMgr, which is unlocked, unless dataMgr has been 
+// reset, and deleted along with the object. If copy is not NULL the
+// array is owned by the object.
+//
+typedef struct {
+	PyObject_HEAD
+	float *data;
+	int ndim;
+	Py_ssize_t shape[3];
+	Py_ssize_t strides[3];
+	int readOnly;
+	DataMgr *dataMgr;
+	Grid *grid;
+	float *copy;
+} floatBuffer_t;
+
+int floatBufferGet(PyObject *obj, Py_buffer *view, int flags) {
+	floatBuffer_t *self = (floatBuffer_t *) obj;
+
+	view->obj = NULL;
+	if ((flags & PyBUF_WRITABLE) && self->readOnly) {
+		PyErr_SetString(PyExc_BufferError, "Array is read-only");
+		return(-1);
+	}
+
+	bool contiguous = true;
+	Py_ssize_t len = sizeof(float);
+	for (int i=self->ndim-1; i>=0; i--) {
+		if (self->strides[i] != len) contiguous = false;
+		len *= self->shape[i];
+	}
+
+	bool wantContiguous =
+		(flags & PyBUF_STRIDES) != PyBUF_STRIDES ||
+		(flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS ||
+		(flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS ||
+		(flags & PyBUF_ANY_CONTIGUOUS) == PyBUF_ANY_CONTIGUOUS;
+	if (wantContiguous && ! contiguous) {
+		PyErr_SetString(PyExc_BufferError, "Array is not contiguous");
+		return(-1);
+	}
+
+	view->buf = self->data;
+	view->obj = obj;
+	Py_INCREF(obj);
+	view->len = len;
+	view->readonly = self->readOnly;
+	view->itemsize = sizeof(float);
+	view->format = (flags & PyBUF_FORMAT) ? (char *) "f" : NULL;
+	view->ndim = self->ndim;
+	view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ?
+		self->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+
+	return(0);
+}
+
+void floatBufferDealloc(PyObject *obj) {
+	floatBuffer_t *self = (floatBuffer_t *) obj;
+
+	if (self->grid) {
+		if (self->dataMgr) self->dataMgr->UnlockGrid(self->grid);
+		delete self->grid;
+	}
+	if (self->copy) delete [] self->copy;
+
+	PyObject_Del(obj);
+}
+
+PyBufferProcs floatBufferProcs;
+PyTypeObject floatBufferType;
+
+bool floatBufferTypeReady() {
+	static bool ready = false;
+	if (ready) return(true);
+
+	floatBufferProcs.bf_getbuffer = floatBufferGet;
+	floatBufferProcs.bf_releasebuffer = NULL;
+
+	((PyObject *) &floatBufferType)->ob_refcnt = 1;
+	floatBufferType.tp_name = "vapor.FloatBuffer";
+	floatBufferType.tp_basicsize = sizeof(floatBuffer_t);
+	floatBufferType.tp_dealloc = floatBufferDealloc;
+	floatBufferType.tp_as_buffer = &floatBufferProcs;
+	floatBufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+#ifdef	Py_TPFLAGS_HAVE_NEWBUFFER
+	floatBufferType.tp_flags |= Py_TPFLAGS_HAVE_NEWBUFFER;
+#endif
+	floatBufferType.tp_doc = "Array of floats owned by VAPOR";
+
+	if (PyType_Ready(&floatBufferType) < 0) return(false);
+
+	ready = true;
+	return(true);
+}
+
+// Return a buffer object viewing data, an array with dimensions dims,
+// fastest varying first, embedded in an array with dimensions allocDims.
+// Python sees the dimensions in C order.
+//
+floatBuffer_t *newFloatBuffer(
+	float *data, const vector <size_t> &dims,
+	const vector <size_t> &allocDims, bool readOnly
+) {
+	assert(dims.size() <= 3);
+	assert(dims.size() == allocDims.size());
+
+	if (! floatBufferTypeReady()) return(NULL);
+
+	floatBuffer_t *self = PyObject_New(floatBuffer_t, &floatBufferType);
+	if (! self) return(NULL);
+
+	self->data = data;
+	self->ndim = dims.size();
+	Py_ssize_t stride = sizeof(float);
+	for (int i=0; i<dims.size(); i++) {
+		self->shape[self->ndim-1-i] = dims[i];
+		self->strides[self->ndim-1-i] = stride;
+		stride *= allocDims[i];
+	}
+	self->readOnly = readOnly;
+	self->dataMgr = NULL;
+	self->grid = NULL;
+	self->copy = NULL;
+
+	return(self);
+}
+
+// Copy the region with dimensions dims, starting at voxel offset, out of
+// the blocks of a grid
+//
+void copyFromBlocks(
+	const Grid *grid, const vector <size_t> &offset,
+	const vector <size_t> &dims, float *region
+) {
+	const vector <float *> &blks = grid->GetBlks();
+	vector <size_t> bs = grid->GetBlockSize();
+	vector <size_t> bdims = grid->GetDimensionInBlks();
+	vector <size_t> o = offset;
+	vector <size_t> d = dims;
+	while (bs.size() < 3) {
+		bs.push_back(1);
+		bdims.push_back(1);
+		o.push_back(0);
+		d.push_back(1);
+	}
+
+	ThreadPool::Instance()->ParallelFor(0, d[1] * d[2], 0,
+		[&](size_t begin, size_t end) {
+		for (size_t r=begin; r<end; r++) {
+			size_t y = o[1] + r % d[1];
+			size_t z = o[2] + r / d[1];
+			size_t blkRow = (z / bs[2] * bdims[1] + y / bs[1]) * bdims[0];
+			size_t blkOffset = ((z % bs[2]) * bs[1] + y % bs[1]) * bs[0];
+
+			float *dst = region + r * d[0];
+			for (size_t x=0; x<d[0]; ) {
+				size_t gx = o[0] + x;
+				size_t n = std::min(bs[0] - gx % bs[0], d[0] - x);
+				memcpy(
+					dst + x, blks[blkRow + gx / bs[0]] + blkOffset + gx % bs[0],
+					n * sizeof(float)
+				);
+				x += n;
+			}
+		}
+	});
+}
+
+// Return a read-only buffer object for the region of a locked grid with
+// dimensions dims starting at voxel offset. A grid stored in a single
+// block is viewed in place, and stays locked until the object is
+// deleted. Otherwise the region is copied and the grid released at once.
+// In either case the buffer object takes ownership of grid.
+//
+PyObject *newGridBuffer(
+	DataMgr *dataMgr, Grid *grid,
+	const vector <size_t> &offset, const vector <size_t> &dims
+) {
+	const vector <float *> &blks = grid->GetBlks();
+	const vector <size_t> &bs = grid->GetBlockSize();
+
+	if (blks.size() == 1) {
+		float *data = blks[0];
+		size_t stride = 1;
+		for (int i=0; i<offset.size(); i++) {
+			data += offset[i] * stride;
+			stride *= bs[i];
+		}
+
+		floatBuffer_t *self = newFloatBuffer(data, dims, bs, true);
+		if (! self) {
+			dataMgr->UnlockGrid(grid);
+			delete grid;
+			return(NULL);
+		}
+		self->dataMgr = dataMgr;
+		self->grid = grid;
+		return((PyObject *) self);
+	}
+
+	float *copy = new float[numElements(dims)];
+	copyFromBlocks(grid, offset, dims, copy);
+	dataMgr->UnlockGrid(grid);
+	delete grid;
+
+	floatBuffer_t *self = newFloatBuffer(copy, dims, dims, true);
+	if (! self) {
+		delete [] copy;
+		return(NULL);
+	}
+	self->copy = copy;
+	return((PyObject *) self);
+}
+
+};
+
+DerivedDataVarPython::DerivedDataVarPython(
+	string varName, DataMgr *dataMgr, string script,
+	const vector <string> &inputs, string units
+) : DerivedDataVar(varName) {
+
+	_dataMgr = dataMgr;
+	_script = script;
+	_inputs = inputs;
+	_units = units;
+}
+
+int DerivedDataVarPython::Initialize() {
+
+	if (_inputs.empty()) {
+		SetErrMsg(
+			"Python variable %s has no inputs", _derivedVarName.c_str()
+		);
+		return(-1);
+	}
+
+	vector <DC::DataVar> dvars(_inputs.size());
+	vector <size_t> refDims;
+	for (int i=0; i<_inputs.size(); i++) {
+		if (_inputs[i] == _derivedVarName) {
+			SetErrMsg(
+				"Python variable %s is an input to itself",
+				_derivedVarName.c_str()
+			);
+			return(-1);
+		}
+
+		if (! _dataMgr->GetDataVarInfo(_inputs[i], dvars[i])) {
+			SetErrMsg(
+				"Undefined input variable \"%s\" of %s",
+				_inputs[i].c_str(), _derivedVarName.c_str()
+			);
+			return(-1);
+		}
+
+		vector <size_t> dims, bs;
+		int rc = _dataMgr->GetDimLensAtLevel(_inputs[i], -1, dims, bs);
+		if (rc<0) return(-1);
+
+		if (i == 0) refDims = dims;
+		if (dims != refDims || dims.size() > 3) {
+			SetErrMsg(
+				"Input variables \"%s\" and \"%s\" of %s have different "
+				"dimensions",
+				_inputs[0].c_str(), _inputs[i].c_str(), _derivedVarName.c_str()
+			);
+			return(-1);
+		}
+	}
+
+	// Check the script for syntax errors
+	//
+	if (! MyPython::IsInterpreterThread()) return(_wrongThread());
+	if (MyPython::Instance()->Initialize() < 0) return(-1);
+
+	PyObject *code = Py_CompileString(
+		_script.c_str(), _derivedVarName.c_str(), Py_file_input
+	);
+	if (! code) {
+		SetErrMsg(
+			"Invalid script for variable %s : %s",
+			_derivedVarName.c_str(), MyPython::Instance()->PyErr().c_str()
+		);
+		return(-1);
+	}
+	Py_DECREF(code);
+
+	const DC::DataVar &ref = dvars[0];
+
+	string timeCoordVar;
+	for (int i=0; i<dvars.size() && timeCoordVar.empty(); i++) {
+		timeCoordVar = dvars[i].GetTimeCoordVar();
+	}
+
+	int missingIndex = -1;
+	for (int i=0; i<dvars.size() && missingIndex < 0; i++) {
+		if (dvars[i].GetHasMissing()) missingIndex = i;
+	}
+
+	if (missingIndex >= 0) {
+		_dataVarInfo = DC::DataVar(
+			_derivedVarName, _units, DC::FLOAT, ref.GetWName(),
+			ref.GetCRatios(), ref.GetPeriodic(), ref.GetMeshName(),
+			timeCoordVar, ref.GetSamplingLocation(),
+			dvars[missingIndex].GetMissingValue()
+		);
+	}
+	else {
+		_dataVarInfo = DC::DataVar(
+			_derivedVarName, _units, DC::FLOAT, ref.GetWName(),
+			ref.GetCRatios(), ref.GetPeriodic(), ref.GetMeshName(),
+			timeCoordVar, ref.GetSamplingLocation()
+		);
+	}
+
+	return(0);
+}
+
+bool DerivedDataVarPython::GetBaseVarInfo(DC::BaseVar &var) const {
+	var = _dataVarInfo;
+	return(true);
+}
+
+bool DerivedDataVarPython::GetDataVarInfo(DC::DataVar &var) const {
+	var = _dataVarInfo;
+	return(true);
+}
+
+size_t DerivedDataVarPython::GetNumRefLevels() const {
+	size_t nlevels = 0;
+	for (int i=0; i<_inputs.size(); i++) {
+		size_t n = _dataMgr->GetNumRefLevels(_inputs[i]);
+		nlevels = i == 0 ? n : std::min(nlevels, n);
+	}
+	return(std::max(nlevels, (size_t) 1));
+}
+
+int DerivedDataVarPython::GetDimLensAtLevel(
+	int level, std::vector <size_t> &dims_at_level,
+	std::vector <size_t> &bs_at_level
+) const {
+	dims_at_level.clear();
+	bs_at_level.clear();
+
+	if (_inputs.empty()) return(-1);
+
+	return(_dataMgr->GetDimLensAtLevel(
+		_inputs[0], level, dims_at_level, bs_at_level
+	));
+}
+
+int DerivedDataVarPython::OpenVariableRead(
+	size_t ts, int level, int lod
+) {
+
+	DC::FileTable::FileObject *f = new DC::FileTable::FileObject(
+		ts, _derivedVarName, level, lod
+	);
+
+	return(_fileTable.AddEntry(f));
+}
+
+int DerivedDataVarPython::CloseVariable(int fd) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	_fileTable.RemoveEntry(fd);
+	delete f;
+
+	return(0);
+}
+
+int DerivedDataVarPython::ReadRegionBlock(
+	int fd,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	vector <size_t> dims, bs;
+	int rc = GetDimLensAtLevel(f->GetLevel(), dims, bs);
+	if (rc<0) return(-1);
+
+	// Exclude block padding from the region computed
+	//
+	vector <size_t> myMax = max;
+	for (int i=0; i<myMax.size(); i++) {
+		if (myMax[i] >= dims[i]) myMax[i] = dims[i] - 1;
+	}
+
+	// A region within a single block, which includes unblocked
+	// variables, is computed in place, strides skipping the padding
+	//
+	bool oneBlock = true;
+	for (int i=0; i<min.size(); i++) {
+		if (min[i] / bs[i] != max[i] / bs[i]) oneBlock = false;
+	}
+	if (oneBlock) {
+		float *data = region;
+		size_t stride = 1;
+		for (int i=0; i<min.size(); i++) {
+			data += (min[i] % bs[i]) * stride;
+			stride *= bs[i];
+		}
+		return(_read(
+			f->GetTS(), f->GetLevel(), f->GetLOD(), min, myMax, bs, data
+		));
+	}
+
+	vector <size_t> roidims;
+	for (int i=0; i<min.size(); i++) {
+		roidims.push_back(myMax[i] - min[i] + 1);
+	}
+
+	float *buf = new float[numElements(roidims)];
+
+	rc = _read(f->GetTS(), f->GetLevel(), f->GetLOD(), min, myMax, roidims, buf);
+	if (rc<0) {
+		delete [] buf;
+		return(-1);
+	}
+
+	_blockit(buf, roidims, bs, region);
+
+	delete [] buf;
+
+	return(0);
+}
+
+int DerivedDataVarPython::ReadRegion(
+	int fd,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	vector <size_t> roidims;
+	for (int i=0; i<min.size(); i++) {
+		roidims.push_back(max[i] - min[i] + 1);
+	}
+
+	return(_read(
+		f->GetTS(), f->GetLevel(), f->GetLOD(), min, max, roidims, region
+	));
+}
+
+bool DerivedDataVarPython::VariableExists(
+	size_t ts,
+	int reflevel,
+	int lod
+) const {
+
+	for (int i=0; i<_inputs.size(); i++) {
+		if (! _dataMgr->VariableExists(ts, _inputs[i], reflevel, lod)) {
+			return(false);
+		}
+	}
+	return(true);
+}
+
+// The interpreter is not initialized for use from more than one thread,
+// and the DataMgr may be read from worker threads, e.g. to read ahead
+//
+int DerivedDataVarPython::_wrongThread() const {
+	SetErrMsg(
+		"Variable %s is computed by Python, and can only be read from the "
+		"thread that initialized the interpreter", _derivedVarName.c_str()
+	);
+	return(-1);
+}
+
+int DerivedDataVarPython::_read(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max,
+	const vector <size_t> &allocDims, float *region
+) {
+	if (! MyPython::IsInterpreterThread()) return(_wrongThread());
+
+	vector <size_t> dims;
+	for (int i=0; i<min.size(); i++) {
+		dims.push_back(max[i] - min[i] + 1);
+	}
+
+	// Read and lock the inputs. The grids returned by the DataMgr start
+	// on a block boundary.
+	//
+	vector <Grid *> grids;
+	vector <vector <size_t> > offsets;
+	for (int i=0; i<_inputs.size(); i++) {
+		vector <size_t> dims_at_level, bs_at_level;
+		int rc = _dataMgr->GetDimLensAtLevel(
+			_inputs[i], level, dims_at_level, bs_at_level
+		);
+		Grid *g = NULL;
+		vector <size_t> gmin, offset;
+		if (rc >= 0) {
+			for (int j=0; j<min.size(); j++) {
+				gmin.push_back(min[j] / bs_at_level[j] * bs_at_level[j]);
+				offset.push_back(min[j] - gmin[j]);
+			}
+			g = _dataMgr->GetVariable(ts, _inputs[i], level, lod, gmin, max, true);
+		}
+		if (! g) {
+			for (int j=0; j<grids.size(); j++) {
+				_dataMgr->UnlockGrid(grids[j]);
+				delete grids[j];
+			}
+			return(-1);
+		}
+		grids.push_back(g);
+		offsets.push_back(offset);
+	}
+
+	PyObject *numpy = PyImport_ImportModule("numpy");
+	PyObject *asarray = numpy ? PyObject_GetAttrString(numpy, "asarray") : NULL;
+	if (! asarray) {
+		SetErrMsg(
+			"Failed to import numpy : %s", MyPython::Instance()->PyErr().c_str()
+		);
+		Py_XDECREF(numpy);
+		for (int i=0; i<grids.size(); i++) {
+			_dataMgr->UnlockGrid(grids[i]);
+			delete grids[i];
+		}
+		return(-1);
+	}
+
+	// Run the script in a namespace of its own. The buffer objects are
+	// kept so that, once the namespace is gone, the input grids can be
+	// unlocked before returning, rather than whenever Python collects
+	// them.
+	//
+	PyObject *dict = PyDict_New();
+	PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins());
+	PyDict_SetItemString(dict, "numpy", numpy);
+
+	vector <PyObject *> bufs;
+	bool ok = true;
+	for (int i=0; i<grids.size(); i++) {
+		PyObject *array = NULL;
+		if (ok) {
+			PyObject *buf = newGridBuffer(_dataMgr, grids[i], offsets[i], dims);
+			if (buf) array = PyObject_CallFunctionObjArgs(asarray, buf, NULL);
+			if (buf) bufs.push_back(buf);
+		}
+		else {
+			_dataMgr->UnlockGrid(grids[i]);
+			delete grids[i];
+		}
+
+		if (array) {
+			PyDict_SetItemString(dict, _inputs[i].c_str(), array);
+			Py_DECREF(array);
+		}
+		else if (ok) {
+			SetErrMsg(
+				"Failed to pass variable %s to Python : %s",
+				_inputs[i].c_str(), MyPython::Instance()->PyErr().c_str()
+			);
+			ok = false;
+		}
+	}
+
+	PyObject *outArray = NULL;
+	PyObject *outBuf = NULL;
+	if (ok) {
+		outBuf = (PyObject *) newFloatBuffer(region, dims, allocDims, false);
+		if (outBuf) {
+			outArray = PyObject_CallFunctionObjArgs(asarray, outBuf, NULL);
+		}
+
+		if (outArray) {
+			PyDict_SetItemString(dict, _derivedVarName.c_str(), outArray);
+		}
+		else {
+			SetErrMsg(
+				"Failed to pass variable %s to Python : %s",
+				_derivedVarName.c_str(), MyPython::Instance()->PyErr().c_str()
+			);
+			ok = false;
+		}
+	}
+
+	if (ok) {
+		PyObject *result = PyRun_String(
+			_script.c_str(), Py_file_input, dict, dict
+		);
+		if (result) {
+			Py_DECREF(result);
+		}
+		else {
+			SetErrMsg(
+				"Script for variable %s failed : %s",
+				_derivedVarName.c_str(), MyPython::Instance()->PyErr().c_str()
+			);
+			ok = false;
+		}
+	}
+
+	// If the script rebound the output name, rather than writing the
+	// output array in place, copy the result into it
+	//
+	if (ok) {
+		PyObject *value = PyDict_GetItemString(dict, _derivedVarName.c_str());
+		if (! value) {
+			SetErrMsg(
+				"Script for variable %s deleted its output",
+				_derivedVarName.c_str()
+			);
+			ok = false;
+		}
+		else if (
+			value != outArray &&
+			PyObject_SetItem(outArray, Py_Ellipsis, value) < 0
+		) {
+			SetErrMsg(
+				"Invalid result for variable %s : %s",
+				_derivedVarName.c_str(), MyPython::Instance()->PyErr().c_str()
+			);
+			ok = false;
+		}
+	}
+
+	Py_XDECREF(outArray);
+	PyDict_Clear(dict);
+	Py_DECREF(dict);
+	Py_DECREF(asarray);
+	Py_DECREF(numpy);
+
+	// Only our references to the buffers should remain. Objects the
+	// script left in reference cycles are collected first.
+	//
+	bool kept = outBuf && Py_REFCNT(outBuf) > 1;
+	for (int i=0; i<bufs.size(); i++) {
+		if (Py_REFCNT(bufs[i]) > 1) kept = true;
+	}
+	if (kept) {
+		PyGC_Collect();
+		kept = outBuf && Py_REFCNT(outBuf) > 1;
+	}
+
+	// A grid whose array the script kept stays locked, since the array
+	// still views it, but the buffer object no longer refers to the
+	// DataMgr, which may be gone when it is collected
+	//
+	for (int i=0; i<bufs.size(); i++) {
+		if (Py_REFCNT(bufs[i]) > 1) {
+			((floatBuffer_t *) bufs[i])->dataMgr = NULL;
+			kept = true;
+		}
+		Py_DECREF(bufs[i]);
+	}
+	Py_XDECREF(outBuf);
+
+	if (kept && ok) {
+		SetErrMsg(
+			"Script for variable %s kept a reference to an input or "
+			"output array", _derivedVarName.c_str()
+		);
+		ok = false;
+	}
+
+	return(ok ? 0 : -1);
+}
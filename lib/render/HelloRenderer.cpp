@@ -71,8 +71,8 @@ int HelloRenderer::_paintGL(bool){
 	Grid *helloGrid;
 
 	//To obtain the Grid, we need the refinement level, variable, LOD, and extents:
-	int actualRefLevel = rParams->GetRefinementLevel();
-	int lod = rParams->GetCompressionLevel();
+	int actualRefLevel = GetRefinementLevel();
+	int lod = GetCompressionLevel();
 	
 	//Get the variable name
 	string varname = rParams->GetVariableName();
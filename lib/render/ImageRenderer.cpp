@@ -308,8 +308,8 @@ bool ImageRenderer::_gridStateDirty() const
 {
 	ImageParams *myParams = (ImageParams *) GetActiveParams();
 
-	int refLevel = myParams->GetRefinementLevel();
-	int lod = myParams->GetCompressionLevel();
+	int refLevel = GetRefinementLevel();
+	int lod = GetCompressionLevel();
 	string hgtVar = myParams->GetHeightVariableName();
 	int ts  = myParams->GetCurrentTimestep();
   vector<double> minExt, maxExt;
@@ -338,8 +338,8 @@ void ImageRenderer::_gridStateClear()
 void ImageRenderer::_gridStateSet() 
 {
 	ImageParams *myParams = (ImageParams *) GetActiveParams();
-	_cacheRefLevel = myParams->GetRefinementLevel();
-	_cacheLod = myParams->GetCompressionLevel();
+	_cacheRefLevel = GetRefinementLevel();
+	_cacheLod = GetCompressionLevel();
 	_cacheHgtVar = myParams->GetHeightVariableName();
 	_cacheTimestep = myParams->GetCurrentTimestep();
   vector<double> minExt, maxExt;
@@ -544,8 +544,8 @@ int ImageRenderer::_getMeshDisplaced( DataMgr *dataMgr,
 	//
 	ImageParams *myParams = (ImageParams *) GetActiveParams();
 
-	int refLevel = myParams->GetRefinementLevel();
-	int lod = myParams->GetCompressionLevel();
+	int refLevel = GetRefinementLevel();
+	int lod = GetCompressionLevel();
 
 	
 	// Get the height variable if one specified
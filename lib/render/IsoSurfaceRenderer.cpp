@@ -46,8 +46,6 @@ void IsoSurfaceRenderer::_3rdPassSpecialHandling( bool fast )
 {
     IsoSurfaceParams*   params    = dynamic_cast<IsoSurfaceParams*>( GetActiveParams() );
     bool                lighting  = params->GetLighting();
-    std::vector<double> isoValues = params->GetIsoValues();
-    std::vector<bool>   isoFlags  = params->GetEnabledIsoValueFlags();
 
     // Special handling for IsoSurface #1: 
     //   honor GUI lighting selection even in fast rendering mode.
@@ -64,11 +62,7 @@ void IsoSurfaceRenderer::_3rdPassSpecialHandling( bool fast )
 
     // Special handling for IsoSurface #2: 
     //   pass in *normalized* iso values.
-    std::vector<float>  validValues;
-    for( int i = 0; i < isoFlags.size(); i++ )
-        if( isoFlags[i] )
-            validValues.push_back( (float(isoValues[i]) - _userCoordinates.valueRange[0]) /
-                        (_userCoordinates.valueRange[1] - _userCoordinates.valueRange[0]) );
+    std::vector<float>  validValues = _getNormalizedIsoValues();
     int numOfIsoValues  = (int)validValues.size();
 
     glUniform1i( glGetUniformLocation( _3rdPassShaderId, "numOfIsoValues" ),
@@ -79,3 +73,34 @@ void IsoSurfaceRenderer::_3rdPassSpecialHandling( bool fast )
                   validValues.data() );
 }
 
+std::vector<float> IsoSurfaceRenderer::_getNormalizedIsoValues() const
+{
+    IsoSurfaceParams*   params    = dynamic_cast<IsoSurfaceParams*>( GetActiveParams() );
+    std::vector<double> isoValues = params->GetIsoValues();
+    std::vector<bool>   isoFlags  = params->GetEnabledIsoValueFlags();
+
+    std::vector<float>  validValues;
+    for( int i = 0; i < isoFlags.size(); i++ )
+        if( isoFlags[i] )
+            validValues.push_back( (float(isoValues[i]) - _userCoordinates.valueRange[0]) /
+                        (_userCoordinates.valueRange[1] - _userCoordinates.valueRange[0]) );
+    return validValues;
+}
+
+void IsoSurfaceRenderer::_classifyMacroCells( std::vector<unsigned char>& occupancy )
+{
+    // A macro cell can only contain a surface if an iso value lies within
+    //   the range of the samples it interpolates from.
+    std::vector<float>        isoValues = _getNormalizedIsoValues();
+    const std::vector<float>& range     = _userCoordinates.macroCellRange;
+    size_t numOfCells = range.size() / 2;
+    occupancy.assign( numOfCells, 0 );
+
+    for( size_t c = 0; c < numOfCells; c++ )
+        for( size_t i = 0; i < isoValues.size(); i++ )
+            if( range[2*c] <= isoValues[i] && isoValues[i] <= range[2*c+1] )
+            {
+                occupancy[c] = 1;
+                break;
+            }
+}
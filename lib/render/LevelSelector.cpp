@@ -0,0 +1,154 @@
+#include <cmath>
+#include <algorithm>
+
+#include <vapor/DataMgr.h>
+#include <vapor/LevelSelector.h>
+
+using namespace VAPoR;
+using namespace std;
+
+namespace {
+
+// Clamp a possibly negative (counted from the finest) level into the
+// range [0, n-1]
+//
+int clamp_level(int level, int n) {
+	if (level < 0) level = n + level;
+	return(std::max(0, std::min(level, n-1)));
+}
+
+// Return true if a grid with dims samples spanning the domain resolves
+// the fraction of the domain covered by the box, frac, at the screen
+// resolution given by pixels, after reduction by scale
+//
+bool adequate(
+	const vector <size_t> &dims, const vector <double> &frac,
+	const vector <double> &pixels, double scale
+) {
+	for (int i=0; i<frac.size(); i++) {
+		if (frac[i] <= 0.0) continue;
+		double samples = (double) dims[i] * frac[i] / scale;
+		if (samples < pixels[i]) return(false);
+	}
+	return(true);
+}
+
+};
+
+bool LevelSelector::ScreenFootprint(
+	const vector <double> &minExts, const vector <double> &maxExts,
+	const glm::mat4 &mvp, const int viewport[4], vector <double> &pixels
+) {
+	int n = (int) std::min(minExts.size(), maxExts.size());
+	n = std::min(n, 3);
+	pixels.assign(n, 0.0);
+
+	// Project the corners into window coordinates. Corner c takes
+	// the max extent along axis i if bit i of c is set.
+	//
+	int ncorners = 1 << n;
+	glm::vec2 win[8];
+	for (int c=0; c<ncorners; c++) {
+		glm::vec4 p(0.0, 0.0, 0.0, 1.0);
+		for (int i=0; i<n; i++) {
+			p[i] = (c & (1<<i)) ? maxExts[i] : minExts[i];
+		}
+		glm::vec4 clip = mvp * p;
+		if (clip.w <= 0.0) return(false);
+
+		win[c].x = (clip.x / clip.w + 1.0) * 0.5 * viewport[2];
+		win[c].y = (clip.y / clip.w + 1.0) * 0.5 * viewport[3];
+	}
+
+	for (int c=0; c<ncorners; c++) {
+		for (int i=0; i<n; i++) {
+			if (c & (1<<i)) continue;
+			double len = glm::length(win[c | (1<<i)] - win[c]);
+			pixels[i] = std::max(pixels[i], len);
+		}
+	}
+	return(true);
+}
+
+int LevelSelector::SelectLevels(
+	DataMgr *dataMgr, size_t ts, string varname,
+	const vector <double> &minExts, const vector <double> &maxExts,
+	const glm::mat4 &mvp, const int viewport[4],
+	int maxLevel, int maxLod, int &level, int &lod
+) {
+	level = maxLevel;
+	lod = maxLod;
+
+	int nlevels = (int) dataMgr->GetNumRefLevels(varname);
+	vector <size_t> cratios = dataMgr->GetCRatios(varname);
+	if (nlevels < 1 || cratios.empty()) {
+		SetErrMsg("Invalid variable : %s", varname.c_str());
+		return(-1);
+	}
+	maxLevel = clamp_level(maxLevel, nlevels);
+	maxLod = clamp_level(maxLod, (int) cratios.size());
+
+	vector <double> pixels;
+	if (! ScreenFootprint(minExts, maxExts, mvp, viewport, pixels)) {
+
+		// Camera is inside or behind the region
+		//
+		level = maxLevel;
+		lod = maxLod;
+		return(0);
+	}
+
+	// The coarsest level is cheap to obtain extents for and spans the
+	// same domain as the finer ones
+	//
+	vector <double> vmin, vmax;
+	int rc = dataMgr->GetVariableExtents(ts, varname, 0, vmin, vmax);
+	if (rc<0) return(-1);
+
+	// Fraction of the variable's domain covered by the box along each
+	// axis common to both
+	//
+	int n = (int) std::min(pixels.size(), vmin.size());
+	vector <double> frac(n, 0.0);
+	for (int i=0; i<n; i++) {
+		double domain = vmax[i] - vmin[i];
+		if (domain <= 0.0) continue;
+
+		double overlap = std::min(maxExts[i], vmax[i]) -
+			std::max(minExts[i], vmin[i]);
+		frac[i] = std::max(0.0, overlap) / domain;
+	}
+	pixels.resize(n);
+
+	vector <size_t> dims, bs;
+	level = maxLevel;
+	for (int l=0; l<maxLevel; l++) {
+		rc = dataMgr->GetDimLensAtLevel(varname, l, dims, bs);
+		if (rc<0) return(-1);
+		if ((int) dims.size() < n) continue;
+
+		if (adequate(dims, frac, pixels, 1.0)) {
+			level = l;
+			break;
+		}
+	}
+
+	// Compression discards information roughly uniformly along each
+	// axis, so a ratio of c reduces the effective resolution of the
+	// native grid by c^(1/ndims)
+	//
+	rc = dataMgr->GetDimLensAtLevel(varname, -1, dims, bs);
+	if (rc<0) return(-1);
+	if ((int) dims.size() < n) return(0);
+
+	lod = maxLod;
+	for (int l=0; l<maxLod; l++) {
+		double scale = pow((double) cratios[l], 1.0 / (double) dims.size());
+		if (adequate(dims, frac, pixels, scale)) {
+			lod = l;
+			break;
+		}
+	}
+
+	return(0);
+}
@@ -58,6 +58,7 @@ namespace {
 MyPython *MyPython::m_instance = NULL;
 bool MyPython::m_isInitialized = false;
 std::string MyPython::m_pyHome = "";
+std::thread::id MyPython::m_thread;
 
 MyPython *MyPython::Instance() {
 	if (! m_instance) {
@@ -125,6 +126,7 @@ int MyPython::Initialize() {
 #endif
 
 	Py_Initialize();
+	m_thread = std::this_thread::get_id();
 
 #ifdef	VAPOR3_0_0
 	if (pyIntFailed) {
@@ -191,6 +193,10 @@ int MyPython::Initialize() {
 	return(0);
 }
 
+bool MyPython::IsInterpreterThread() {
+	return(! Py_IsInitialized() || m_thread == std::this_thread::get_id());
+}
+
 // Fetch an error message genereated by Python API.
 //
 string MyPython::PyErr() {
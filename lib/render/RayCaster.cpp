@@ -1,8 +1,12 @@
 #include <vapor/glutil.h>
 #include <vapor/RayCaster.h>
+#include <vapor/ThreadPool.h>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 
 //
 // OpenGL debug output
@@ -49,6 +53,9 @@ RayCaster::RayCaster( const ParamsMgr*    pm,
     _volumeTextureId             = 0;
     _missingValueTextureId       = 0;
     _colorMapTextureId           = 0;
+    _macroCellTextureId          = 0;
+    _sceneDepthTextureId         = 0;
+    _hasSceneDepth               = false;
     _frameBufferId               = 0;
     _depthBufferId               = 0;
 
@@ -98,6 +105,16 @@ RayCaster::~RayCaster()
         glDeleteTextures( 1, &_colorMapTextureId );
         _colorMapTextureId = 0;
     }
+    if( _macroCellTextureId )
+    {
+        glDeleteTextures( 1, &_macroCellTextureId );
+        _macroCellTextureId = 0;
+    }
+    if( _sceneDepthTextureId )
+    {
+        glDeleteTextures( 1, &_sceneDepthTextureId );
+        _sceneDepthTextureId = 0;
+    }
 
     // delete buffers
     if( _frameBufferId )
@@ -162,6 +179,7 @@ RayCaster::UserCoordinates::UserCoordinates()
         dims[i]   = 0;
         boxMin[i] = 0;
         boxMax[i] = 0;
+        macroCellDims[i] = 0;
     }
     
     myCurrentTimeStep  = 0;
@@ -237,12 +255,14 @@ RayCaster::UserCoordinates::GetCurrentGrid( const RayCasterParams* params,
 }
 
 bool RayCaster::UserCoordinates::IsUpToDate( const RayCasterParams* params,  
-                                                   DataMgr*         dataMgr ) const
+                                                   DataMgr*         dataMgr,
+                                                   int              refLevel,
+                                                   int              compLevel ) const
 {
     if( ( myCurrentTimeStep  != params->GetCurrentTimestep()  )  ||
         ( myVariableName     != params->GetVariableName()     )  ||
-        ( myRefinementLevel  != params->GetRefinementLevel()  )  ||
-        ( myCompressionLevel != params->GetCompressionLevel() )     )
+        ( myRefinementLevel  != refLevel                      )  ||
+        ( myCompressionLevel != compLevel                     )     )
     {
         return false;
     }
@@ -274,12 +294,14 @@ bool RayCaster::UserCoordinates::IsUpToDate( const RayCasterParams* params,
 }
         
 bool RayCaster::UserCoordinates::UpdateCoordinates( const RayCasterParams* params,
-                                                          DataMgr*         dataMgr )
+                                                          DataMgr*         dataMgr,
+                                                          int              refLevel,
+                                                          int              compLevel )
 {
     myCurrentTimeStep  = params->GetCurrentTimestep();
     myVariableName     = params->GetVariableName();
-    myRefinementLevel  = params->GetRefinementLevel();
-    myCompressionLevel = params->GetCompressionLevel();
+    myRefinementLevel  = refLevel;
+    myCompressionLevel = compLevel;
 
     /* update member variables */
     StructuredGrid*       grid = this->GetCurrentGrid( params, dataMgr );
@@ -435,10 +457,57 @@ bool RayCaster::UserCoordinates::UpdateCoordinates( const RayCasterParams* param
         }
     }
 
+    UpdateMacroCells();
+
     delete grid;
     return true;
 }
 
+void RayCaster::UserCoordinates::UpdateMacroCells()
+{
+    // Trilinear interpolation between samples x and x+1 happens within the
+    //   macro cell containing x, so cell c spans samples [c*size, (c+1)*size]
+    //   and adjacent cells share a layer of samples.
+    const size_t size = MacroCellSize;
+    for( int i = 0; i < 3; i++ )
+        macroCellDims[i] = dims[i] > 1 ? (dims[i] - 2) / size + 1 : 1;
+
+    size_t nx = macroCellDims[0], ny = macroCellDims[1], nz = macroCellDims[2];
+    macroCellRange.resize( 2 * nx * ny * nz );
+
+    // Missing samples hold 0.0 in dataField and are interpolated like any
+    //   other, so they are included.
+    Wasp::ThreadPool::Instance()->ParallelFor( 0, nz, 1, 
+        [this, size, nx, ny]( size_t zBegin, size_t zEnd )
+    {
+        for( size_t cz = zBegin; cz < zEnd; cz++ )
+        for( size_t cy = 0;      cy < ny;   cy++ )
+        for( size_t cx = 0;      cx < nx;   cx++ )
+        {
+            size_t x0 = cx * size, x1 = std::min( x0 + size, dims[0] - 1 );
+            size_t y0 = cy * size, y1 = std::min( y0 + size, dims[1] - 1 );
+            size_t z0 = cz * size, z1 = std::min( z0 + size, dims[2] - 1 );
+
+            float minVal = std::numeric_limits<float>::max();
+            float maxVal = std::numeric_limits<float>::lowest();
+            for( size_t z = z0; z <= z1; z++ )
+                for( size_t y = y0; y <= y1; y++ )
+                {
+                    const float* row = dataField + (z * dims[1] + y) * dims[0];
+                    for( size_t x = x0; x <= x1; x++ )
+                    {
+                        minVal = std::min( minVal, row[x] );
+                        maxVal = std::max( maxVal, row[x] );
+                    }
+                }
+
+            size_t idx = (cz * ny + cy) * nx + cx;
+            macroCellRange[ 2 * idx     ] = minVal;
+            macroCellRange[ 2 * idx + 1 ] = maxVal;
+        }
+    } );
+}
+
 int RayCaster::_initializeGL()
 {
 #ifdef Darwin
@@ -489,6 +558,12 @@ int RayCaster::_paintGL( bool fast )
         glBindRenderbuffer(    GL_RENDERBUFFER, _depthBufferId );
         glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT, 
                                _currentViewport[2], _currentViewport[3] );
+
+        textureUnit = 6;
+        glActiveTexture( GL_TEXTURE0 + textureUnit );
+        glBindTexture(GL_TEXTURE_2D, _sceneDepthTextureId); 
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, _currentViewport[2], 
+                     _currentViewport[3], 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
     }
 
     RayCasterParams* params = dynamic_cast<RayCasterParams*>( GetActiveParams() );
@@ -504,9 +579,13 @@ int RayCaster::_paintGL( bool fast )
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _indexBufferId );
 
     /* Gather user coordinates */
-    if( !_userCoordinates.IsUpToDate( params, _dataMgr ) )
+    int refLevel  = GetRefinementLevel();
+    int compLevel = GetCompressionLevel();
+    bool dataChanged = false;
+    if( !_userCoordinates.IsUpToDate( params, _dataMgr, refLevel, compLevel ) )
     {
-        _userCoordinates.UpdateCoordinates( params, _dataMgr );
+        _userCoordinates.UpdateCoordinates( params, _dataMgr, refLevel, compLevel );
+        dataChanged = true;
 
         /* Also attach the new data to 3D textures */
         glBindTexture( GL_TEXTURE_3D, _volumeTextureId );
@@ -556,6 +635,8 @@ int RayCaster::_paintGL( bool fast )
                    0, GL_RGBA,       GL_FLOAT,       _colorMap.data() );
     glBindTexture( GL_TEXTURE_1D, 0 );
 
+    _updateMacroCellTexture( dataChanged );
+
     glBindFramebuffer( GL_FRAMEBUFFER, _frameBufferId );
     glViewport( 0, 0, _currentViewport[2], _currentViewport[3] );
 
@@ -606,6 +687,8 @@ int RayCaster::_paintGL( bool fast )
     glBindFramebuffer( GL_FRAMEBUFFER, 0 );
     glViewport( 0, 0, _currentViewport[2], _currentViewport[3] );
 
+    _copySceneDepth();
+
     _drawVolumeFaces( 3, insideACell, ModelView, InversedMV, fast );  // 3rd pass, perform ray casting
         
     delete grid;
@@ -711,6 +794,29 @@ void RayCaster::_initializeFramebufferTextures()
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
+    /* Generate and configure 3D texture: _macroCellTextureId */
+    textureUnit =  5;
+    glGenTextures( 1, &_macroCellTextureId );
+    glActiveTexture( GL_TEXTURE0 + textureUnit );
+    glBindTexture( GL_TEXTURE_3D, _macroCellTextureId );
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    /* Generate and configure 2D texture: _sceneDepthTextureId */
+    textureUnit =  6;
+    glGenTextures( 1, &_sceneDepthTextureId );
+    glActiveTexture( GL_TEXTURE0 + textureUnit );
+    glBindTexture( GL_TEXTURE_2D, _sceneDepthTextureId );
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, _currentViewport[2], 
+                 _currentViewport[3], 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
     /* Bind the default textures */
     glBindTexture(GL_TEXTURE_1D, 0);
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -769,6 +875,11 @@ void RayCaster::_drawVolumeFaces( int            whichPass,
     { 
         _load3rdPassUniforms( MVP, ModelView, InversedMV, fast );
 
+        GLfloat InversedMVP[16];
+        _mesa_invert_matrix_general( InversedMVP, MVP );
+        uniformLocation = glGetUniformLocation( _3rdPassShaderId, "inversedMVP" );
+        glUniformMatrix4fv( uniformLocation, 1, GL_FALSE, InversedMVP );
+
         _3rdPassSpecialHandling( fast );
 
         glEnable(    GL_CULL_FACE );
@@ -893,6 +1004,107 @@ void RayCaster::_load3rdPassUniforms( const GLfloat*   MVP,
         uniformLocation = glGetUniformLocation( _3rdPassShaderId, "missingValueMaskTexture" );
         glUniform1i( uniformLocation, textureUnit );
     }
+
+    // Macro cells that can be skipped
+    textureUnit = 5;
+    glActiveTexture( GL_TEXTURE0 + textureUnit );
+    glBindTexture( GL_TEXTURE_3D, _macroCellTextureId );
+    uniformLocation = glGetUniformLocation( _3rdPassShaderId, "macroCellTexture" );
+    glUniform1i( uniformLocation, textureUnit );
+
+    float macroCellDims[3] = { float(_userCoordinates.macroCellDims[0]),
+                               float(_userCoordinates.macroCellDims[1]),
+                               float(_userCoordinates.macroCellDims[2]) };
+    uniformLocation = glGetUniformLocation( _3rdPassShaderId, "macroCellDims" );
+    glUniform3fv( uniformLocation, 1, macroCellDims );
+
+    uniformLocation = glGetUniformLocation( _3rdPassShaderId, "macroCellSize" );
+    glUniform1f( uniformLocation, float(UserCoordinates::MacroCellSize) );
+
+    // Depth of the scene geometry to terminate rays
+    textureUnit = 6;
+    glActiveTexture( GL_TEXTURE0 + textureUnit );
+    glBindTexture( GL_TEXTURE_2D, _sceneDepthTextureId );
+    uniformLocation = glGetUniformLocation( _3rdPassShaderId, "sceneDepthTexture" );
+    glUniform1i( uniformLocation, textureUnit );
+
+    uniformLocation = glGetUniformLocation( _3rdPassShaderId, "hasSceneDepth" );
+    glUniform1i( uniformLocation, int(_hasSceneDepth) );
+}
+    
+void RayCaster::_classifyMacroCells( std::vector<unsigned char>& occupancy )
+{
+    const std::vector<float>& range = _userCoordinates.macroCellRange;
+    size_t numOfCells = range.size() / 2;
+    occupancy.resize( numOfCells );
+
+    // A single color, or a degenerate value range, is opaque everywhere
+    size_t lutSize    = _colorMap.size() / 4;
+    float  valueSpan  = _userCoordinates.valueRange[1] - _userCoordinates.valueRange[0];
+    float  colorSpan  = _colorMapRange[1] - _colorMapRange[0];
+    if( lutSize == 0 || !(valueSpan > 0.0f) || !(colorSpan > 0.0f) )
+    {
+        std::fill( occupancy.begin(), occupancy.end(), 1 );
+        return;
+    }
+
+    // Number of color map entries with non-zero opacity before each entry
+    std::vector<size_t> numVisible( lutSize + 1, 0 );
+    for( size_t i = 0; i < lutSize; i++ )
+        numVisible[i+1] = numVisible[i] + (_colorMap[ i * 4 + 3 ] > 0.0f ? 1 : 0);
+
+    float valueMin = _userCoordinates.valueRange[0];
+    Wasp::ThreadPool::Instance()->ParallelFor( 0, numOfCells, 0, 
+        [&]( size_t begin, size_t end )
+    {
+        for( size_t c = begin; c < end; c++ )
+        {
+            // Same mapping as TranslateValue() in the shader. The entry range
+            //   is widened by one for linear filtering of the color map.
+            float t0 = (range[2*c]   * valueSpan + valueMin - _colorMapRange[0]) / colorSpan;
+            float t1 = (range[2*c+1] * valueSpan + valueMin - _colorMapRange[0]) / colorSpan;
+            long  i0 = (long)std::floor( t0 * lutSize - 0.5f );
+            long  i1 = (long)std::ceil(  t1 * lutSize - 0.5f );
+            i0 = std::max( 0L, std::min( i0, (long)lutSize - 1 ) );
+            i1 = std::max( 0L, std::min( i1, (long)lutSize - 1 ) );
+            occupancy[c] = numVisible[ i1 + 1 ] > numVisible[ i0 ] ? 1 : 0;
+        }
+    } );
+}
+
+void RayCaster::_updateMacroCellTexture( bool force )
+{
+    std::vector<unsigned char> occupancy;
+    _classifyMacroCells( occupancy );
+    if( !force && occupancy == _macroCellOccupancy )
+        return;
+    _macroCellOccupancy.swap( occupancy );
+
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glBindTexture( GL_TEXTURE_3D, _macroCellTextureId );
+    glTexImage3D(  GL_TEXTURE_3D, 0, GL_R8UI,       _userCoordinates.macroCellDims[0],
+                   _userCoordinates.macroCellDims[1], _userCoordinates.macroCellDims[2],
+                   0,                               GL_RED_INTEGER,
+                   GL_UNSIGNED_BYTE,                _macroCellOccupancy.data() );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+    glBindTexture( GL_TEXTURE_3D, 0 );
+}
+
+void RayCaster::_copySceneDepth()
+{
+    // The default framebuffer may not have a depth buffer
+    GLint depthBits = 0;
+    glGetFramebufferAttachmentParameteriv( GL_READ_FRAMEBUFFER, GL_DEPTH, 
+                                           GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits );
+    _hasSceneDepth = depthBits > 0;
+    if( !_hasSceneDepth )
+        return;
+
+    glActiveTexture( GL_TEXTURE0 + 6 );
+    glBindTexture( GL_TEXTURE_2D, _sceneDepthTextureId );
+    glCopyTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, 0, 0, 
+                         _currentViewport[2], _currentViewport[3] );
+    glBindTexture( GL_TEXTURE_2D, 0 );
 }
     
 void RayCaster::_3rdPassSpecialHandling( bool fast )
@@ -28,6 +28,8 @@
 #include <vapor/Renderer.h>
 #include <vapor/DataMgrUtils.h>
 #include <vapor/GetAppPath.h>
+#include <vapor/Trace.h>
+#include <vapor/LevelSelector.h>
 #include "vapor/GLManager.h"
 #include "vapor/LegacyGL.h"
 #include "vapor/TextLabel.h"
@@ -57,6 +59,12 @@ Renderer::Renderer(
 	_colorbarTexture = 0;
 	_timestep = 0;
 
+	_autoLevel = false;
+	_targetLevel = _targetLod = 0;
+	_currentLevel = _currentLod = 0;
+	_lastMVP = glm::mat4(0.0f);
+	_paintBegun = false;
+
     _fontName = "arimo";
 }
 
@@ -123,13 +131,7 @@ double Renderer::_getDefaultZ(
 	return(minExts.size() == 3 ? minExts[2] : 0.0); 
 }
 
-int Renderer::paintGL(bool fast) {
-	const RenderParams *rParams = GetActiveParams();
-
-	if (! rParams->IsEnabled()) return(0);
-
-	_timestep = rParams->GetCurrentTimestep();
-
+void Renderer::_pushTransform(const RenderParams *rParams) {
 	vector <double> translate = rParams->GetTransform()->GetTranslations();
 	vector <double> rotate	= rParams->GetTransform()->GetRotations();
 	vector <double> scale	 = rParams->GetTransform()->GetScales();
@@ -150,8 +152,54 @@ int Renderer::paintGL(bool fast) {
 	_glManager->matrixManager->Translate(-origin[0], -origin[1], -origin[2]);
 
 	_glManager->matrixManager->Translate(translate[0], translate[1], translate[2]);
+}
+
+int Renderer::BeginPaint(bool fast) {
+	const RenderParams *rParams = GetActiveParams();
+
+	_paintBegun = false;
+	if (! rParams->IsEnabled()) return(0);
 
-	int rc = _paintGL(fast);
+	_timestep = rParams->GetCurrentTimestep();
+
+	_pushTransform(rParams);
+	_updateAutoLevel(rParams, fast);
+	_glManager->matrixManager->PopMatrix();
+
+	_paintBegun = true;
+	return(0);
+}
+
+int Renderer::Prepare(bool fast) {
+	if (! _paintBegun) return(0);
+
+	VAPOR_TRACE_SCOPE_DYNAMIC(GetMyType() + "::_prepare");
+	return(_prepare(fast));
+}
+
+int Renderer::paintGL(bool fast) {
+	const RenderParams *rParams = GetActiveParams();
+
+	if (! rParams->IsEnabled()) {
+		_paintBegun = false;
+		return(0);
+	}
+
+	_timestep = rParams->GetCurrentTimestep();
+
+	_pushTransform(rParams);
+
+	// Level selection has already been done if the frame was begun
+	// with BeginPaint()
+	//
+	if (! _paintBegun) _updateAutoLevel(rParams, fast);
+	_paintBegun = false;
+
+	int rc;
+	{
+		VAPOR_TRACE_SCOPE_DYNAMIC(GetMyType() + "::_paintGL");
+		rc = _paintGL(fast);
+	}
 
 	_glManager->matrixManager->PopMatrix();
 
@@ -168,6 +216,85 @@ int Renderer::paintGL(bool fast) {
 	return(0);
 }
 
+void Renderer::_updateAutoLevel(const RenderParams *rParams, bool fast) {
+	_autoLevel = rParams->GetAutoLevel();
+	if (! _autoLevel) return;
+
+	int maxLevel = rParams->GetRefinementLevel();
+	int maxLod = rParams->GetCompressionLevel();
+
+	string varname = rParams->GetFirstVariableName();
+	if (varname.empty()) {
+		_targetLevel = _currentLevel = maxLevel;
+		_targetLod = _currentLod = maxLod;
+		return;
+	}
+
+	// The model view includes this renderer's transform
+	//
+	glm::mat4 mvp = _glManager->matrixManager->GetModelViewProjectionMatrix();
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	vector <double> minExts, maxExts;
+	rParams->GetBox()->GetExtents(minExts, maxExts);
+
+	int rc = LevelSelector::SelectLevels(
+		_dataMgr, _timestep, varname, minExts, maxExts, mvp, viewport,
+		maxLevel, maxLod, _targetLevel, _targetLod
+	);
+	if (rc<0) {
+		_targetLevel = _currentLevel = maxLevel;
+		_targetLod = _currentLod = maxLod;
+		return;
+	}
+
+	// The first frame has no previous view to compare with. It is
+	// drawn at the target level, or one step coarser if the caller
+	// asked for a fast paint. _lastMVP is the zero matrix, which no
+	// projection produces, until then.
+	//
+	bool first = _lastMVP == glm::mat4(0.0f);
+
+	// While the view is changing draw one step coarser than the
+	// target so that interaction stays responsive. Once it is idle
+	// refine one step per paint until the target is reached.
+	//
+	bool moving = fast || (! first && mvp != _lastMVP);
+	_lastMVP = mvp;
+
+	if (first && ! fast) {
+		_currentLevel = _targetLevel;
+		_currentLod = _targetLod;
+	}
+	else if (moving) {
+		_currentLevel = std::max(0, _targetLevel - 1);
+		_currentLod = std::max(0, _targetLod - 1);
+	}
+	else {
+		_currentLevel = std::min(_targetLevel, _currentLevel + 1);
+		_currentLod = std::min(_targetLod, _currentLod + 1);
+	}
+}
+
+bool Renderer::NeedsRefinement() const {
+	if (! _autoLevel) return(false);
+
+	return(_currentLevel < _targetLevel || _currentLod < _targetLod);
+}
+
+int Renderer::GetRefinementLevel() const {
+	if (_autoLevel) return(_currentLevel);
+
+	return(GetActiveParams()->GetRefinementLevel());
+}
+
+int Renderer::GetCompressionLevel() const {
+	if (_autoLevel) return(_currentLod);
+
+	return(GetActiveParams()->GetCompressionLevel());
+}
+
 
 void Renderer::EnableClipToBox(ShaderProgram *shader, float haloFrac) const {
     shader->Bind();
@@ -22,6 +22,8 @@
 #include <iostream>
 #include <fstream>
 #include <numeric>
+#include <mutex>
+#include <atomic>
 
 #include <vapor/Proj4API.h>
 #include <vapor/CFuncs.h>
@@ -29,6 +31,8 @@
 #include <vapor/DataMgrUtils.h>
 #include <vapor/TwoDDataRenderer.h>
 #include <vapor/TwoDDataParams.h>
+#include <vapor/Trace.h>
+#include <vapor/ThreadPool.h>
 #include "vapor/GLManager.h"
 
 using namespace VAPoR;
@@ -113,6 +117,21 @@ namespace {
 		ny = dx*dzy;
 		nz = 1.0;
 	}
+
+	// A single thread, shared by all renderers, reads time steps ahead.
+	// A pool of two has one worker. Renderers wait for their own reads
+	// (see _waitPrefetch()), never on the group, which would run any
+	// other renderer's queued read on the waiting thread. The pool and
+	// group live as long as the process.
+	//
+	Wasp::ThreadPool::TaskGroup *prefetchGroup() {
+		static Wasp::ThreadPool::TaskGroup *group = NULL;
+		static std::once_flag flag;
+		std::call_once(flag, []() {
+			group = new Wasp::ThreadPool::TaskGroup(new Wasp::ThreadPool(2));
+		});
+		return(group);
+	}
 }
 
 
@@ -126,11 +145,11 @@ TwoDDataRenderer::TwoDDataRenderer(
 ) {
 
 	_grid_state.clear();
-	_tex_state.clear();
 
-	_texWidth = 0;
-	_texHeight = 0;
-	_texelSize = 8;
+	_front = 0;
+	_lastTs = -1;
+
+	_prefetch = std::make_shared <_prefetch_c> ();
 	_vertsWidth = 0;
 	_vertsHeight = 0;
 	_nindices = 0;
@@ -155,6 +174,8 @@ TwoDDataRenderer::TwoDDataRenderer(
 
 TwoDDataRenderer::~TwoDDataRenderer()
 {
+	_waitPrefetch();
+
 	if (_cMapTexID) glDeleteTextures(1, &_cMapTexID);
 	if (_colormap) delete [] _colormap;
 
@@ -245,20 +266,27 @@ const GLvoid *TwoDDataRenderer::GetTexture(  DataMgr *dataMgr,
                                               size_t &texelSize,
                                               bool &gridAligned) 
 {
-	internalFormat = GL_RG32F;
-	format = GL_RG;
+	internalFormat = GL_R32F;
+	format = GL_RED;
 	type = GL_FLOAT;
-	texelSize = _texelSize;
+	texelSize = sizeof(GLfloat);
 	gridAligned = GridAligned;
 
 	GLvoid *texture = (GLvoid *) _getTexture(dataMgr);
 	if (! texture) return(NULL);
 
-	width = _texWidth;
-	height = _texHeight;
+	width = _textures[_front]._width;
+	height = _textures[_front]._height;
 	return(texture);
 }
 
+const GLubyte *TwoDDataRenderer::GetMissingMask() const {
+	const _texture_c &tex = _textures[_front];
+	if (! tex._valid || ! tex._hasMask) return(NULL);
+
+	return((const GLubyte *) tex._sb_mask.GetBuf());
+}
+
 	
 	
 int TwoDDataRenderer::GetMesh( DataMgr *dataMgr,
@@ -292,8 +320,8 @@ int TwoDDataRenderer::GetMesh( DataMgr *dataMgr,
 	_gridStateClear();
 
 	TwoDDataParams *rParams = (TwoDDataParams *) GetActiveParams();
-	int refLevel = rParams->GetRefinementLevel();
-	int lod = rParams->GetCompressionLevel();
+	int refLevel = GetRefinementLevel();
+	int lod = GetCompressionLevel();
 
     // Find box extents for ROI
 	//
@@ -308,9 +336,12 @@ int TwoDDataRenderer::GetMesh( DataMgr *dataMgr,
 		return(-1);
 	}
 
-	Grid* g = NULL;
-	int rc = DataMgrUtils::GetGrids(
-		dataMgr, ts, varname, minBoxReq, maxBoxReq, true, &refLevel, &lod,  &g
+	// The grid is shared with _readTexture(), and with other renderers
+	// displaying the same data
+	//
+	std::shared_ptr <const Grid> g;
+	int rc = DataMgrUtils::GetSharedGrid(
+		dataMgr, ts, varname, minBoxReq, maxBoxReq, true, &refLevel, &lod,  g
 	);
 	if(rc<0) return (-1);
 
@@ -318,18 +349,16 @@ int TwoDDataRenderer::GetMesh( DataMgr *dataMgr,
 
 	double defaultZ = _getDefaultZ(dataMgr, ts);
 
-	if (dynamic_cast<StructuredGrid *>(g) && ! ForceUnstructured) {
-		rc = _getMeshStructured(dataMgr, dynamic_cast<StructuredGrid *>(g), defaultZ);
+	const StructuredGrid *sg = dynamic_cast<const StructuredGrid *>(g.get());
+	if (sg && ! ForceUnstructured) {
+		rc = _getMeshStructured(dataMgr, sg, defaultZ);
 		structuredMesh = true;
 	}
 	else {
-		rc = _getMeshUnStructured(dataMgr, g, defaultZ);
+		rc = _getMeshUnStructured(dataMgr, g.get(), defaultZ);
 		structuredMesh = false;
 	}
 
-	dataMgr->UnlockGrid(g);
-	delete g;
-
 	if (rc<0) return(-1);
 
 	_gridStateSet();
@@ -357,8 +386,8 @@ bool TwoDDataRenderer::_gridStateDirty() const {
 	rParams->GetBox()->GetExtents(minExts, maxExts);
 
 	_grid_state_c current_state(
-		rParams->GetRefinementLevel(),
-		rParams->GetCompressionLevel(),
+		GetRefinementLevel(),
+		GetCompressionLevel(),
 		rParams->GetHeightVariableName(),
 		dvar.GetMeshName(),
 		rParams->GetCurrentTimestep(),
@@ -384,8 +413,8 @@ void TwoDDataRenderer::_gridStateSet(
 	string meshName;
 
 	_grid_state = _grid_state_c(
-		rParams->GetRefinementLevel(),
-		rParams->GetCompressionLevel(),
+		GetRefinementLevel(),
+		GetCompressionLevel(),
 		rParams->GetHeightVariableName(),
 		dvar.GetMeshName(),
 		rParams->GetCurrentTimestep(),
@@ -393,42 +422,20 @@ void TwoDDataRenderer::_gridStateSet(
 	);
 }
 
-bool TwoDDataRenderer::_texStateDirty(DataMgr *dataMgr) const {
+TwoDDataRenderer::_tex_state_c TwoDDataRenderer::_texStateCurrent() const {
 
 	TwoDDataParams *rParams = (TwoDDataParams *) GetActiveParams();
 
 	vector <double> minExts, maxExts;
 	rParams->GetBox()->GetExtents(minExts, maxExts);
 
-	_tex_state_c current_state(
-		rParams->GetRefinementLevel(),
-		rParams->GetCompressionLevel(),
+	return(_tex_state_c(
+		GetRefinementLevel(),
+		GetCompressionLevel(),
 		rParams->GetVariableName(),
 		rParams->GetCurrentTimestep(),
 		minExts, maxExts
-	);
-
-	return(_tex_state != current_state);
-}
-
-void TwoDDataRenderer::_texStateSet(DataMgr *dataMgr) {
-
-	TwoDDataParams *rParams = (TwoDDataParams *) GetActiveParams();
-
-	vector <double> minExts, maxExts;
-	rParams->GetBox()->GetExtents(minExts, maxExts);
-
-	_tex_state = _tex_state_c(
-		rParams->GetRefinementLevel(),
-		rParams->GetCompressionLevel(),
-		rParams->GetVariableName(),
-		rParams->GetCurrentTimestep(),
-		minExts, maxExts
-	);
-}
-
-void TwoDDataRenderer::_texStateClear() {
-	_tex_state.clear();
+	));
 }
 
 // Get mesh for a structured grid
@@ -533,8 +540,8 @@ int TwoDDataRenderer::_getMeshUnStructuredHelper(
 	// a map projection, if specified.
 	//
 	size_t ts = rParams->GetCurrentTimestep();
-	int refLevel = rParams->GetRefinementLevel();
-	int lod = rParams->GetCompressionLevel();
+	int refLevel = GetRefinementLevel();
+	int lod = GetCompressionLevel();
 
     // Find box extents for ROI
 	//
@@ -546,12 +553,12 @@ int TwoDDataRenderer::_getMeshUnStructuredHelper(
 	//
 	string hgtvar = rParams->GetHeightVariableName();
 
-	Grid* hgtGrid = NULL;
+	std::shared_ptr <const Grid> hgtGrid;
 
 	if (! hgtvar.empty()) {
-		int rc = DataMgrUtils::GetGrids(
+		int rc = DataMgrUtils::GetSharedGrid(
 			dataMgr, ts, hgtvar, minExts, maxExts, true,
-			&refLevel, &lod,  &hgtGrid
+			&refLevel, &lod,  hgtGrid
 		);
 
 		if(rc<0) return(rc);
@@ -599,7 +606,7 @@ int TwoDDataRenderer::_getMeshUnStructuredHelper(
 		// Compute the surface normal using central differences
 		//
 		computeNormal(
-			hgtGrid, coords[0], coords[1], dx, dy, mv,
+			hgtGrid.get(), coords[0], coords[1], dx, dy, mv,
 			normals[voffset + 0], normals[voffset + 1], normals[voffset + 2]
 		);
 
@@ -631,11 +638,6 @@ int TwoDDataRenderer::_getMeshUnStructuredHelper(
 		}
 	}
 
-	if (hgtGrid) {
-		dataMgr->UnlockGrid(hgtGrid);
-		delete hgtGrid;
-	}
-
 	return(0);
 }
 
@@ -653,8 +655,8 @@ int TwoDDataRenderer::_getMeshStructuredDisplaced(
 	// a map projection, if specified.
 	//
 	size_t ts = rParams->GetCurrentTimestep();
-	int refLevel = rParams->GetRefinementLevel();
-	int lod = rParams->GetCompressionLevel();
+	int refLevel = GetRefinementLevel();
+	int lod = GetCompressionLevel();
 
 
     // Find box extents for ROI
@@ -668,10 +670,10 @@ int TwoDDataRenderer::_getMeshStructuredDisplaced(
 	string hgtvar = rParams->GetHeightVariableName();
 	assert (! hgtvar.empty());
 
-	Grid* hgtGrid = NULL;
-	int rc = DataMgrUtils::GetGrids(
+	std::shared_ptr <const Grid> hgtGrid;
+	int rc = DataMgrUtils::GetSharedGrid(
 		dataMgr, ts, hgtvar, minExtsReq, maxExtsReq, true,
-		&refLevel, &lod,  &hgtGrid
+		&refLevel, &lod,  hgtGrid
 	);
 	if(rc<0) return(rc);
 	assert(hgtGrid);
@@ -708,9 +710,6 @@ int TwoDDataRenderer::_getMeshStructuredDisplaced(
 		}
 	}
 
-	dataMgr->UnlockGrid(hgtGrid);
-	delete hgtGrid;
-
 	return(rc);
 }
 
@@ -774,7 +773,7 @@ int TwoDDataRenderer::_getOrientation(
 	return(0);	// Y-Z
 }
 
-// Sets _texWidth, _texHeight, _sb_texture
+// Returns the values of the front texture, reading them if needed
 //
 const GLvoid *TwoDDataRenderer::_getTexture(
 	DataMgr* dataMgr
@@ -782,16 +781,17 @@ const GLvoid *TwoDDataRenderer::_getTexture(
 
 	// See if already in cache
 	//
-	if (! _texStateDirty(dataMgr) && _sb_texture.GetBuf()) {
-		return ((const GLvoid *) _sb_texture.GetBuf());
+	_tex_state_c state = _texStateCurrent();
+	_texture_c *tex = &_textures[_front];
+	if (tex->_valid && tex->_state == state) {
+		return ((const GLvoid *) tex->_sb_values.GetBuf());
 	}
-	_texStateClear();
 
 	TwoDDataParams *rParams = (TwoDDataParams *) GetActiveParams();
 	size_t ts = rParams->GetCurrentTimestep();
 
-	int refLevel = rParams->GetRefinementLevel();
-	int lod = rParams->GetCompressionLevel();
+	int refLevel = GetRefinementLevel();
+	int lod = GetCompressionLevel();
 
 	string varname = rParams->GetVariableName();
 	if (varname.empty()) {
@@ -799,21 +799,115 @@ const GLvoid *TwoDDataRenderer::_getTexture(
 		return(NULL);
 	}
 
-
     // Find box extents for ROI
 	//
     vector<double> minBoxReq, maxBoxReq;
 	rParams->GetBox()->GetExtents(minBoxReq, maxBoxReq);
 
-	Grid* g = NULL;
-	int rc = DataMgrUtils::GetGrids(
-		dataMgr, ts, varname, minBoxReq, maxBoxReq, true, &refLevel, &lod, &g
+	// The requested texture may have been read ahead of time
+	//
+	_waitPrefetch();
+	_texture_c *back = &_textures[1 - _front];
+	if (back->_valid && back->_state == state) {
+		_front = 1 - _front;
+		tex = back;
+	}
+	else {
+		int rc = _readTexture(
+			dataMgr, ts, varname, refLevel, lod, minBoxReq, maxBoxReq, *tex
+		);
+		if (rc<0) return(NULL);
+		tex->_state = state;
+	}
+
+	// Stepping forward one time step at a time, as during animation: 
+	// read the following time step while this one is displayed
+	//
+	if (_lastTs >= 0 && ts == (size_t) _lastTs + 1) {
+		_prefetchTexture(
+			dataMgr, ts + 1, varname, refLevel, lod, minBoxReq, maxBoxReq
+		);
+	}
+	_lastTs = ts;
+
+	return((const GLvoid *) tex->_sb_values.GetBuf());
+}
+
+void TwoDDataRenderer::_prefetchTexture(
+	DataMgr *dataMgr, size_t ts, string varname, int refLevel, int lod,
+	vector <double> minExts, vector <double> maxExts
+) {
+	if ((long) ts >= dataMgr->GetNumTimeSteps(varname)) return;
+	if (! dataMgr->VariableExists(ts, varname, refLevel, lod)) return;
+
+	_texture_c *tex = &_textures[1 - _front];
+	tex->_valid = false;
+	tex->_state = _tex_state_c(refLevel, lod, varname, ts, minExts, maxExts);
+
+	std::shared_ptr <_prefetch_c> prefetch = _prefetch;
+	{
+		std::lock_guard<std::mutex> guard(prefetch->_mutex);
+		prefetch->_queued = true;
+	}
+
+	// Nothing here may touch the params, which may be changed while 
+	// the read is in progress. The renderer, and tex, are only used
+	// once the read has started, and the renderer waits for it before
+	// it is destroyed. A read that has not started when the renderer
+	// waits is cancelled. Errors are not reported: if the read fails
+	// the time step is read again, and the error reported, when it is
+	// displayed.
+	//
+	prefetchGroup()->Run([=]() {
+		{
+			std::lock_guard<std::mutex> guard(prefetch->_mutex);
+			if (! prefetch->_queued) return;
+			prefetch->_queued = false;
+			prefetch->_running = true;
+		}
+
+		VAPOR_TRACE_SCOPE("TwoDDataRenderer::_prefetchTexture");
+		bool errEnabled = EnableErrMsg(false);
+		(void) _readTexture(
+			dataMgr, ts, varname, refLevel, lod, minExts, maxExts, *tex
+		);
+		EnableErrMsg(errEnabled);
+
+		std::lock_guard<std::mutex> guard(prefetch->_mutex);
+		prefetch->_running = false;
+		prefetch->_cv.notify_all();
+	});
+}
+
+// Cancel the read ahead if it has not started, otherwise wait for it
+// to complete
+//
+void TwoDDataRenderer::_waitPrefetch() {
+	std::unique_lock<std::mutex> lock(_prefetch->_mutex);
+	_prefetch->_queued = false;
+	_prefetch->_cv.wait(lock, [this]() { return(! _prefetch->_running); });
+}
+
+// Read the data values for a time step into tex, setting tex._valid
+// on success
+//
+int TwoDDataRenderer::_readTexture(
+	DataMgr *dataMgr, size_t ts, string varname, int refLevel, int lod,
+	vector <double> minExts, vector <double> maxExts, _texture_c &tex
+) const {
+	VAPOR_TRACE_SCOPE("TwoDDataRenderer::_readTexture");
+
+	tex._valid = false;
+
+	std::shared_ptr <const Grid> g;
+	int rc = DataMgrUtils::GetSharedGrid(
+		dataMgr, ts, varname, minExts, maxExts, true, &refLevel, &lod, g
 	);
-	if(rc<0) return (NULL);
+	if(rc<0) return (-1);
 
 	if (g->GetTopologyDim() != 2) {
 		SetErrMsg("Invalid variable: %s ", varname.c_str());
-		return(NULL);
+		return(-1);
 	}
 	
 
@@ -821,41 +915,98 @@ const GLvoid *TwoDDataRenderer::_getTexture(
 	// For structured grid variable data are stored in a 1D array.
 	//
 	vector <size_t> dims = g->GetDimensions();
-	if (dynamic_cast<StructuredGrid *>(g) && ! ForceUnstructured) {
-		_texWidth = dims[0];
-		_texHeight = dims[1];
+	if (dynamic_cast<const StructuredGrid *>(g.get()) && ! ForceUnstructured) {
+		tex._width = dims[0];
+		tex._height = dims[1];
 	}
 	else {
-		_texWidth = std::accumulate(
+		tex._width = std::accumulate(
 			dims.begin(), dims.end(), 1, std::multiplies<size_t>()
 		);
-		_texHeight = 1;
+		tex._height = 1;
 	}
 
-    size_t texSize = _texWidth * _texHeight;
-    GLfloat *texture = (float *) _sb_texture.Alloc(texSize * _texelSize);
-	GLfloat *texptr = texture;
-	Grid::Iterator itr;
-	Grid::Iterator enditr = g->end();
-//	for (itr = g->begin(minBoxReq, maxBoxReq); itr != enditr; ++itr) {
-	for (itr = g->begin(); itr != enditr; ++itr) {
-		float v = *itr;
-
-		if (v == g->GetMissingValue()) {
-			*texptr++ = 0.0;	// Data value
-			*texptr++ = 1.0;	// Missing value flag
-		}
-		else {
-			*texptr++ = v;
-			*texptr++ = 0;
+	size_t texSize = (size_t) tex._width * tex._height;
+	GLfloat *texture = (GLfloat *) tex._sb_values.Alloc(
+		texSize * sizeof(*texture)
+	);
+
+	const vector <float *> &blks = g->GetBlks();
+	if (blks.empty()) {
+
+		// No block storage (e.g. a constant grid). Fall back to the
+		// iterator.
+		//
+		Grid::ConstIterator itr;
+		Grid::ConstIterator enditr = g->cend();
+		GLfloat *texptr = texture;
+		for (itr = g->cbegin(); itr != enditr; ++itr) {
+			*texptr++ = *itr;
 		}
 	}
+	else {
 
-	_texStateSet(dataMgr);
+		// Copy straight out of the grid's blocks, one run of a row 
+		// per block, rows in parallel
+		//
+		vector <size_t> bs = g->GetBlockSize();
+		vector <size_t> bdims = g->GetDimensionInBlks();
+		bs.resize(3, 1);
+		bdims.resize(3, 1);
+		dims.resize(3, 1);
+		size_t nrows = dims[1] * dims[2];
+
+		Wasp::ThreadPool::Instance()->ParallelFor(
+			0, nrows, 0, [&](size_t begin, size_t end) {
+
+			for (size_t r=begin; r<end; r++) {
+				size_t y = r % dims[1];
+				size_t z = r / dims[1];
+				size_t yb = y / bs[1];
+				size_t zb = z / bs[2];
+				size_t blkOffset = (z % bs[2]) * bs[0] * bs[1] + 
+					(y % bs[1]) * bs[0];
+
+				GLfloat *dst = texture + r * dims[0];
+				for (size_t xb=0; xb<bdims[0]; xb++) {
+					size_t x0 = xb * bs[0];
+					if (x0 >= dims[0]) break;
+					size_t n = std::min(bs[0], dims[0] - x0);
+
+					const float *blk = blks[
+						zb*bdims[0]*bdims[1] + yb*bdims[0] + xb
+					];
+					std::copy(blk + blkOffset, blk + blkOffset + n, dst + x0);
+				}
+			}
+		});
+	}
 
-	//Unlock the Grid
-	//
-	dataMgr->UnlockGrid(g);
+	// Mask the values equal to the missing value. The grid may not
+	// report missing data, e.g. when it is read with ForceUnstructured,
+	// so every texel is checked.
+	//
+	GLubyte *mask = (GLubyte *) tex._sb_mask.Alloc(texSize);
+	float mv = g->GetMissingValue();
+	std::atomic<bool> hasMask(false);
+	Wasp::ThreadPool::Instance()->ParallelFor(
+		0, texSize, 0, [&](size_t begin, size_t end) {
+
+		bool found = false;
+		for (size_t i=begin; i<end; i++) {
+			if (texture[i] == mv) {
+				texture[i] = 0.0;
+				mask[i] = 1;
+				found = true;
+			}
+			else {
+				mask[i] = 0;
+			}
+		}
+		if (found) hasMask = true;
+	});
+	tex._hasMask = hasMask;
 
-	return(texture);
+	tex._valid = true;
+	return(0);
 }
@@ -44,6 +44,7 @@ TwoDRenderer::TwoDRenderer(
     _VAO = NULL;
     _VBO = NULL;
     _dataVBO = NULL;
+    _maskVBO = NULL;
     _EBO = NULL;
 }
 
@@ -56,6 +57,7 @@ TwoDRenderer::~TwoDRenderer()
     if (_VAO) glDeleteVertexArrays(1, &_VAO);
     if (_VBO) glDeleteBuffers(1, &_VBO);
     if (_dataVBO) glDeleteBuffers(1, &_dataVBO);
+    if (_maskVBO) glDeleteBuffers(1, &_maskVBO);
     if (_EBO) glDeleteBuffers(1, &_EBO);
 }
 
@@ -64,6 +66,7 @@ int TwoDRenderer::_initializeGL(){
     glGenVertexArrays(1, &_VAO);
     glGenBuffers(1, &_VBO);
     glGenBuffers(1, &_dataVBO);
+    glGenBuffers(1, &_maskVBO);
     glGenBuffers(1, &_EBO);
     
     glBindVertexArray(_VAO);
@@ -73,14 +76,33 @@ int TwoDRenderer::_initializeGL(){
     glEnableVertexAttribArray(0);
     
     glBindBuffer(GL_ARRAY_BUFFER, _dataVBO);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), NULL);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(float), NULL);
     glEnableVertexAttribArray(1);
     
+    glBindBuffer(GL_ARRAY_BUFFER, _maskVBO);
+    glVertexAttribPointer(2, 1, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GLubyte), NULL);
+    
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 	return(0);
 }
 
+int TwoDRenderer::_prepare(bool) {
+
+	_texture = GetTexture(
+		_dataMgr, _texWidth, _texHeight, _texInternalFormat,
+		_texFormat, _texType, _texelSize, _gridAligned
+	);
+	if (! _texture) {
+		return(-1);
+	}
+
+	return(GetMesh(
+		_dataMgr, &_verts, &_normals, _meshWidth, _meshHeight,
+		&_indices, _nindices, _structuredMesh
+	));
+}
+
 int TwoDRenderer::_paintGL(bool) {
 
 	// Get the 2D texture
@@ -237,20 +259,36 @@ void TwoDRenderer::_renderMeshAligned() {
 	// Ugh. For aligned data the type must be GLfloat.
 	//
 	assert (_texType == GL_FLOAT);
-	assert (_texelSize == 8);
+	assert (_texelSize == sizeof(GLfloat));
 	const GLfloat *data = (GLfloat *) _texture;
 
+	// The mask is only present if some of the data are missing. 
+	// Otherwise a constant "not missing" attribute is used.
+	//
+	const GLubyte *mask = GetMissingMask();
+
 	if (_structuredMesh) {
 		// Draw triangle strips one row at a time
 		//
         glBindVertexArray(_VAO);
+		if (mask) {
+			glEnableVertexAttribArray(2);
+		}
+		else {
+			glDisableVertexAttribArray(2);
+			glVertexAttrib1f(2, 0.0);
+		}
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, 2*_meshWidth*sizeof(float), _indices, GL_DYNAMIC_DRAW);
 		for (int j=0; j<_meshHeight-1; j++) {
             glBindBuffer(GL_ARRAY_BUFFER, _VBO);
             glBufferData(GL_ARRAY_BUFFER, _meshWidth*6*sizeof(float), &_verts[j*_meshWidth*3], GL_STREAM_DRAW);
             glBindBuffer(GL_ARRAY_BUFFER, _dataVBO);
-            glBufferData(GL_ARRAY_BUFFER, _meshWidth*4*sizeof(float), &data[j*_meshWidth*2], GL_STREAM_DRAW);
+            glBufferData(GL_ARRAY_BUFFER, _meshWidth*2*sizeof(float), &data[j*_meshWidth], GL_STREAM_DRAW);
+			if (mask) {
+				glBindBuffer(GL_ARRAY_BUFFER, _maskVBO);
+				glBufferData(GL_ARRAY_BUFFER, _meshWidth*2*sizeof(GLubyte), &mask[j*_meshWidth], GL_STREAM_DRAW);
+			}
             glDrawElements(GL_TRIANGLE_STRIP, 2*_meshWidth, GL_UNSIGNED_INT, 0);
 		}
         glBindVertexArray(0);
@@ -265,7 +303,7 @@ void TwoDRenderer::_renderMeshAligned() {
 
 		glVertexPointer(3, GL_FLOAT, 0, _verts);
 		glVertexAttribPointer(
-			/*attrindx*/ 0,  2,  GL_FLOAT,  false,  0, data
+			/*attrindx*/ 0,  1,  GL_FLOAT,  false,  0, data
 		);
         // TODO GL
 		glNormalPointer(GL_FLOAT, 0, _normals);
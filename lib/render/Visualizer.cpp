@@ -23,11 +23,7 @@
 #include <vector>
 #include <cmath>
 #include <cassert>
-#ifdef WIN32
-#include <tiff/tiffio.h>
-#else
-#include <tiffio.h>
-#endif
+#include <cstring>
 
 
 #ifdef WIN32
@@ -40,19 +36,31 @@
 #include <vapor/Renderer.h>
 #include <vapor/DataStatus.h>
 #include <vapor/Visualizer.h>
+#include <vapor/Trace.h>
+#include <vapor/CaptureQueue.h>
 
 
-#include <vapor/jpegapi.h>
 #include <vapor/common.h>
 #include "vapor/GLManager.h"
 #include "vapor/LegacyGL.h"
 
-#include "imagewriter.hpp"
-
 
 using namespace VAPoR;
 bool Visualizer::_regionShareFlag = true;
 
+namespace {
+
+// Select the buffer frames are captured from. Offscreen contexts such
+// as OSMesa are single buffered and have no back buffer.
+//
+void set_read_buffer() {
+	GLboolean doubleBuffer = GL_TRUE;
+	glGetBooleanv(GL_DOUBLEBUFFER, &doubleBuffer);
+	glReadBuffer(doubleBuffer ? GL_BACK : GL_FRONT);
+}
+
+};
+
 /* note: 
  * GL_ENUMS used by depth peeling for attaching the color buffers, currently 16 named points exist
  */
@@ -75,6 +83,14 @@ Visualizer::Visualizer(
 
 	_imageCaptureEnabled = false;
 	_animationCaptureEnabled = false;
+	_captureQueue = NULL;
+	_captureIndex = 0;
+	for (int i=0; i<2; i++) {
+		_capturePBO[i] = 0;
+		_capturePBOSize[i] = 0;
+		_capturePending[i] = false;
+		_captureWidth[i] = _captureHeight[i] = 0;
+	}
 	
 	
 	_renderOrder.clear();
@@ -90,6 +106,16 @@ Visualizer::Visualizer(
 
 Visualizer::~Visualizer()
 {
+	// The OpenGL context may not be current, so frames still being
+	// read back are discarded rather than read. Frames already read
+	// are written before the queue is deleted.
+	//
+	_capturePending[0] = _capturePending[1] = false;
+	if (_captureQueue) {
+		(void) _captureQueue->Flush();
+		delete _captureQueue;
+	}
+	if (_capturePBO[0]) glDeleteBuffers(2, _capturePBO);
 	
 	for (int i = 0; i< _renderer.size(); i++){
 		delete _renderer[i];
@@ -192,8 +218,16 @@ void Visualizer::applyTransforms(int i) {
 	mm->Translate(translations[0], translations[1], translations[2]);
 }
 
+bool Visualizer::NeedsRefinement() const {
+	for (int i=0; i<_renderer.size(); i++) {
+		if (_renderer[i]->NeedsRefinement()) return(true);
+	}
+	return(false);
+}
+
 int Visualizer::paintEvent(bool fast)
 {
+	VAPOR_TRACE_SCOPE("Visualizer::paintEvent");
 	MyBase::SetDiagMsg("Visualizer::paintGL()");
     GL_ERR_BREAK();
     
@@ -235,6 +269,29 @@ int Visualizer::paintEvent(bool fast)
 	//are sorted back-to-front.  Note: This only works if all the geometry of a renderer is ordered by 
 	//a simple depth test.
 	int rc = 0;
+
+	// Initialize any new renderers and begin the frame for each. This
+	// captures the view dependent state needed to prepare the data.
+	//
+	for (int i = 0; i< _renderer.size(); i++) {
+		if (! _renderer[i]->IsGLInitialized()) {
+			int myrc = _renderer[i]->initializeGL(_glManager);
+            GL_ERR_BREAK();
+            if (myrc < 0)
+                rc = -1;
+		}
+		if (! _renderer[i]->IsGLInitialized()) continue;
+
+        _glManager->matrixManager->MatrixModeModelView();
+		applyTransforms(i);
+		if (_renderer[i]->BeginPaint(fast) < 0) rc = -1;
+        _glManager->matrixManager->PopMatrix();
+	}
+
+	// Read data and build geometry for all renderers
+	//
+	if (prepareRenderers(fast) < 0) rc = -1;
+
 	//Now go through all the active renderers, provided the error has not been set
 	for (int i = 0; i< _renderer.size(); i++) {
 		//If a renderer is not initialized, or if its bypass flag is set, then don't render.
@@ -243,13 +300,6 @@ int Visualizer::paintEvent(bool fast)
         _glManager->matrixManager->MatrixModeModelView();
         _glManager->matrixManager->PushMatrix();
 
-		if (! _renderer[i]->IsGLInitialized()) {
-			int myrc = _renderer[i]->initializeGL(_glManager);
-            GL_ERR_BREAK();
-            if (myrc < 0)
-                rc = -1;
-		}
-        
 		if (_renderer[i]->IsGLInitialized()) {
 			applyTransforms(i);
 			int myrc = _renderer[i]->paintGL(fast);
@@ -298,7 +348,7 @@ int Visualizer::paintEvent(bool fast)
     }
 	else if (_animationCaptureEnabled) 
     {
-		captureImage(_captureImageFile);
+		startCapture(_captureImageFile);
 		incrementPath(_captureImageFile);
 	}
     GL_ERR_BREAK();
@@ -308,6 +358,25 @@ int Visualizer::paintEvent(bool fast)
 }
 
 
+int Visualizer::prepareRenderers(bool fast) {
+	VAPOR_TRACE_SCOPE("Visualizer::prepareRenderers");
+
+	// Renderers are prepared one after the other, in render order.
+	// Preparing them concurrently is not safe: the DC readers call the
+	// NetCDF library, which is not thread safe, without serializing
+	// their calls, and DataMgr queries toggle the process wide error
+	// reporting switch. The data reads themselves are parallelized by
+	// the DataMgr and WASP.
+	//
+	int rc = 0;
+	for (int i = 0; i< _renderer.size(); i++) {
+		if (! _renderer[i]->IsGLInitialized()) continue;
+
+		if (_renderer[i]->Prepare(fast) < 0) rc = -1;
+	}
+	return(rc);
+}
+
 bool Visualizer::fbSetup() {
 
 #ifdef	VAPOR3_0_0_ALPHA
@@ -376,6 +445,13 @@ int Visualizer::initializeGL(GLManager *glManager)
 	// glewExperimental = GL_TRUE;
 	GLenum err = glewInit();
 	assert(GLManager::CheckError());
+
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// Offscreen contexts (e.g. OSMesa) have no X display, but the GL
+	// entry points are resolved regardless
+	//
+	if (err == GLEW_ERROR_NO_GLX_DISPLAY) err = GLEW_OK;
+#endif
 	if (GLEW_OK != err) {
 		MyBase::SetErrMsg("Error: Unable to initialize GLEW");
 		return -1;
@@ -753,6 +829,11 @@ void Visualizer::resetTrackball(){
 }
 #endif
 
+CaptureQueue *Visualizer::getCaptureQueue() {
+	if (! _captureQueue) _captureQueue = new CaptureQueue();
+	return(_captureQueue);
+}
+
 int Visualizer:: captureImage(string filename)
 {
 	ViewpointParams* vpParams = getActiveViewpointParams();
@@ -762,89 +843,128 @@ int Visualizer:: captureImage(string filename)
 
 	//Turn off the single capture flag
 	_imageCaptureEnabled = false;
-	string suffix = filename.substr(filename.length()-4, 4);  // it assumes fixed length of all suffix...   
-	
-	FILE* jpegFile = NULL;
-	TIFF* tiffFile = NULL;
-	if (suffix == ".tif" || suffix == "tiff" )
-    {
-		tiffFile = TIFFOpen((const char*)filename.c_str(), "wb");
-		if (!tiffFile) {
-			SetErrMsg("Image Capture Error: Error opening output Tiff file: %s",(const char*)filename.c_str());
-			return -1;
-		}
-	} 
-    else if (suffix == ".jpg" || suffix == "jpeg" ) 
-    {
-		jpegFile = fopen((const char*)filename.c_str(), "wb");
-		if (!jpegFile) {
-			SetErrMsg("Image Capture Error: Error opening output Jpeg file: %s",(const char*)filename.c_str());
-			return -1;
-		}
-	}
-    else // write png files
-    {
-         // The Write_PNG() function handles fopen et al. by itself.
-         // Here we assume the filename is absolutely valid.
-    }
+
+	// Complete any frames still in flight so that they are written
+	// ahead of this one
+	//
+	int rc = FlushCapture();
+	if (rc<0) return -1;
+
+	CaptureQueue *queue = getCaptureQueue();
+
 	//Get the image buffer 
-	unsigned char* buf = new unsigned char[3*width*height];
+	unsigned char* buf = queue->GetBuffer(3*width*height);
 	//Use openGL to fill the buffer:
 	if(!getPixelData(buf)) {
 		SetErrMsg("Image Capture Error; error obtaining GL data");
-		delete [] buf;
+		queue->Release(buf);
 		return -1;
 	}
-	
-	//Now call the Jpeg or tiff library to compress and write the file
+
+	// A single image is written before returning so that errors 
+	// can be reported to the caller
 	//
-    if( suffix == ".tif" || suffix == "tiff" ) //capture the tiff file, one scanline at a time
-    { 
-		uint32 imagelength = (uint32) width;
-		uint32 imagewidth = (uint32) height;
-		assert(tiffFile);
-		TIFFSetField(tiffFile, TIFFTAG_IMAGELENGTH, imagelength);
-		TIFFSetField(tiffFile, TIFFTAG_IMAGEWIDTH, imagewidth);
-		TIFFSetField(tiffFile, TIFFTAG_PLANARCONFIG, 1);
-		TIFFSetField(tiffFile, TIFFTAG_SAMPLESPERPIXEL, 3);
-		TIFFSetField(tiffFile, TIFFTAG_ROWSPERSTRIP, 8);
-		TIFFSetField(tiffFile, TIFFTAG_BITSPERSAMPLE, 8);
-		TIFFSetField(tiffFile, TIFFTAG_PHOTOMETRIC, 2);
-		for (int row = 0; row < imagelength; row++){
-			int rc = TIFFWriteScanline(tiffFile, buf+row*3*imagewidth, row);
-			if (rc != 1){
-				SetErrMsg("Image Capture Error; Error writing tiff file %s",
-				(const char*)filename.c_str());
-				break;
-			}
-		}
-		TIFFClose(tiffFile);
+	(void) queue->Submit(buf, width, height, filename);
+	return(queue->Flush());
+}
+
+int Visualizer::startCapture(string filename)
+{
+	VAPOR_TRACE_SCOPE("Visualizer::startCapture");
+
+	ViewpointParams* vpParams = getActiveViewpointParams();
+
+	size_t width, height;
+	vpParams->GetWindowSize(width, height);
+
+	// Frames are read back into a pair of pixel buffer objects used in
+	// turn. The read of this frame proceeds asynchronously while the
+	// previous frame, whose read completed during this frame's 
+	// rendering, is copied out and handed to the encoders.
+	//
+	int cur = _captureIndex;
+	int prev = 1 - cur;
+
+	if (! _capturePBO[0]) glGenBuffers(2, _capturePBO);
+
+	size_t nbytes = 3*width*height;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, _capturePBO[cur]);
+	if (_capturePBOSize[cur] != nbytes) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, nbytes, NULL, GL_STREAM_READ);
+		_capturePBOSize[cur] = nbytes;
 	}
-	else if( suffix == ".jpg" || suffix == "jpeg" )
-    {
-		int quality = 95;
-		int rc = write_JPEG_file(jpegFile, width, height, buf, quality);
-        fclose( jpegFile );
-		if (rc){
-			SetErrMsg("Image Capture Error; Error writing jpeg file %s",
-				(const char*)filename.c_str());
-            delete[] buf;
-			return -1;
-		} 
-	} 
-    else  // PNG
-    {
-        int rc = Write_PNG( filename.c_str(), width, height, buf );
-		if (rc) {
-			SetErrMsg("Image Capture Error; Error writing PNG file %s", 
-                      (const char*)filename.c_str());
-            delete[] buf;
-			return -1;
-		}
-    }
 
-	delete [] buf;
-	return 0;
+	 // Must clear previous errors first.
+	while(glGetError() != GL_NO_ERROR);
+
+	set_read_buffer();
+	glDisable(GL_SCISSOR_TEST);
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	int rc = 0;
+	if (glGetError() != GL_NO_ERROR) {
+		SetErrMsg("Image Capture Error; error obtaining GL data");
+		rc = -1;
+	}
+	else {
+		_capturePending[cur] = true;
+		_captureFile[cur] = filename;
+		_captureWidth[cur] = width;
+		_captureHeight[cur] = height;
+	}
+
+	if (finishCapture(prev) < 0) rc = -1;
+	_captureIndex = prev;
+	return(rc);
+}
+
+int Visualizer::finishCapture(int i)
+{
+	if (! _capturePending[i]) return(0);
+	_capturePending[i] = false;
+
+	size_t width = _captureWidth[i];
+	size_t height = _captureHeight[i];
+	size_t rowsz = 3*width;
+
+	CaptureQueue *queue = getCaptureQueue();
+	unsigned char *buf = queue->GetBuffer(rowsz*height);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, _capturePBO[i]);
+	const unsigned char *data = (const unsigned char *) glMapBuffer(
+		GL_PIXEL_PACK_BUFFER, GL_READ_ONLY
+	);
+	if (! data) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		queue->Release(buf);
+		SetErrMsg("Image Capture Error; error obtaining GL data");
+		return -1;
+	}
+
+	// GL returns the rows bottom to top, the encoders expect them
+	// top to bottom
+	//
+	for (size_t j = 0; j<height; j++) {
+		memcpy(buf + j*rowsz, data + (height-j-1)*rowsz, rowsz);
+	}
+
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return(queue->Submit(buf, width, height, _captureFile[i]));
+}
+
+int Visualizer::FlushCapture()
+{
+	// At most one frame is pending, in the buffer not used next
+	//
+	int rc = finishCapture(1 - _captureIndex);
+	if (finishCapture(_captureIndex) < 0) rc = -1;
+
+	if (_captureQueue && _captureQueue->Flush() < 0) rc = -1;
+	return(rc);
 }
 
 //Produce an array based on current contents of the (back) buffer
@@ -858,7 +978,7 @@ bool Visualizer::getPixelData(unsigned char* data) const {
 	 // Must clear previous errors first.
 	while(glGetError() != GL_NO_ERROR);
 
-	glReadBuffer(GL_BACK);
+	set_read_buffer();
 	glDisable(GL_SCISSOR_TEST);
 
 	// Calling pack alignment ensures that we can grab the any size window
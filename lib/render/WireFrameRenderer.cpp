@@ -33,17 +33,59 @@
 #include <vapor/errorcodes.h>
 #include <vapor/GetAppPath.h>
 #include <vapor/ControlExecutive.h>
+#include <vapor/StructuredGrid.h>
+#include <vapor/ThreadPool.h>
+#include <vapor/Trace.h>
 #include "vapor/GLManager.h"
 #include "vapor/debug.h"
 
 using namespace VAPoR;
 
-#pragma pack(push, 4)
-struct WireFrameRenderer::VertexData {
-    float x, y, z;
-    float r, g, b, a;
+namespace {
+
+// Linear index of a grid node
+//
+size_t linear_index(const vector <size_t> &index, const vector <size_t> &dims) {
+	size_t offset = 0;
+	for (int i=(int) index.size()-1; i>=0; i--) {
+		offset = offset * dims[i] + index[i];
+	}
+	return(offset);
+}
+
+// Append the edges of a cell, given by the linear indices of its n 
+// nodes, to edges. Each edge is encoded with its lower node index
+// in the high word so that duplicates can be removed by sorting.
+//
+void cell_edges(
+	const size_t *nodes, int n, bool layered, vector <unsigned long long> &edges
+) {
+	auto add = [&edges](size_t a, size_t b) {
+		if (a > b) std::swap(a,b);
+		edges.push_back(((unsigned long long) a << 32) | b);
+	};
+
+	int count = layered ? n/2 : n;
+	for (int i=0; i<count; i++) {
+		add(nodes[i], nodes[(i+1)%count]);
+	}
+
+	if (! layered) return;
+
+	// if layered the coordinates are ordered bottom face first, then top face
+	//
+	for (int i=0; i<count; i++) {
+		add(nodes[i + count], nodes[((i+1)%count) + count]);
+	}
+
+	// Now the edges between top and bottom face
+	//
+	for (int i=0; i<count; i++) {
+		add(nodes[i], nodes[i + count]);
+	}
+}
+
 };
-#pragma pack(pop)
 
 static RendererRegistrar<WireFrameRenderer> registrar(
 	WireFrameRenderer::GetClassType(), WireFrameParams::GetClassType()
@@ -56,15 +98,22 @@ WireFrameRenderer::WireFrameRenderer(
 ) : Renderer(
 	pm, winName, dataSetName, WireFrameParams::GetClassType(),
 	WireFrameRenderer::GetClassType(), instName, dataMgr),
-    _VAO(0), _VBO(0), _EBO(0)
-{}
+    _VAO(0), _VBO(0), _colorVBO(0), _EBO(0), _nIndices(0),
+	_missingValue(0.0),
+	_coordsPending(false), _colorsPending(false), _indicesPending(false)
+{
+	_cacheParams.ts = 0;
+	_cacheParams.level = _cacheParams.lod = 0;
+	_topoParams.level = 0;
+}
 
 WireFrameRenderer::~WireFrameRenderer()
 {
     if (_VAO) glDeleteVertexArrays(1, &_VAO);
     if (_VBO) glDeleteBuffers(1, &_VBO);
+    if (_colorVBO) glDeleteBuffers(1, &_colorVBO);
     if (_EBO) glDeleteBuffers(1, &_EBO);
-    _VAO = _VBO = _EBO = 0;
+    _VAO = _VBO = _colorVBO = _EBO = 0;
 }
 
 void WireFrameRenderer::_saveCacheParams()
@@ -73,8 +122,8 @@ void WireFrameRenderer::_saveCacheParams()
     _cacheParams.varName = p->GetVariableName();
     _cacheParams.heightVarName = p->GetHeightVariableName();
     _cacheParams.ts = p->GetCurrentTimestep();
-    _cacheParams.level = p->GetRefinementLevel();
-    _cacheParams.lod = p->GetCompressionLevel();
+    _cacheParams.level = GetRefinementLevel();
+    _cacheParams.lod = GetCompressionLevel();
     _cacheParams.useSingleColor = p->UseSingleColor();
     p->GetBox()->GetExtents(_cacheParams.boxMin, _cacheParams.boxMax);
 
@@ -87,14 +136,29 @@ void WireFrameRenderer::_saveCacheParams()
 	_cacheParams.constantOpacity = p->GetConstantOpacity();
 }
 
-bool WireFrameRenderer::_isCacheDirty() const
+bool WireFrameRenderer::_isDataDirty() const
 {
     WireFrameParams *p = (WireFrameParams*)GetActiveParams();
     if (_cacheParams.varName != p->GetVariableName()) return true;
     if (_cacheParams.heightVarName != p->GetHeightVariableName()) return true;
     if (_cacheParams.ts      != p->GetCurrentTimestep()) return true;
-    if (_cacheParams.level   != p->GetRefinementLevel()) return true;
-    if (_cacheParams.lod     != p->GetCompressionLevel()) return true;
+    if (_cacheParams.level   != GetRefinementLevel()) return true;
+    if (_cacheParams.lod     != GetCompressionLevel()) return true;
+
+    vector<double> min, max;
+    p->GetBox()->GetExtents(min, max);
+    
+    if (_cacheParams.boxMin != min) return true;
+    if (_cacheParams.boxMax != max) return true;
+    
+    return false;
+}
+
+bool WireFrameRenderer::_isCacheDirty() const
+{
+    if (_isDataDirty()) return true;
+
+    WireFrameParams *p = (WireFrameParams*)GetActiveParams();
     if (_cacheParams.useSingleColor != p->UseSingleColor()) return true;
     if (_cacheParams.constantColor != p->GetConstantColor()) return true;
     if (_cacheParams.constantOpacity != p->GetConstantOpacity()) return true;
@@ -105,153 +169,231 @@ bool WireFrameRenderer::_isCacheDirty() const
 	if (_cacheParams.tf_lut != tf_lut) return(true);
 	if (_cacheParams.tf_minmax != tf->getMinMaxMapValue()) return(true);
     
-    vector<double> min, max;
-    p->GetBox()->GetExtents(min, max);
-    
-    if (_cacheParams.boxMin != min) return true;
-    if (_cacheParams.boxMax != max) return true;
-    
     return false;
 }
 
-void WireFrameRenderer::_drawCell(
-    vector<VertexData> &vertices,
-    vector<unsigned int> &indices,
-	const float *verts,
-	const float *colors,
-	int n,
-	bool layered
-) {
-    int baseIndex = vertices.size();
-    for (int i = 0; i < n; i++) {
-        vertices.push_back({
-            verts[3*i], verts[3*i+1], verts[3*i+2],
-            colors[4*i], colors[4*i+1], colors[4*i+2], colors[4*i+3]
-        });
-    }
+void WireFrameRenderer::_buildEdges(const Grid *grid)
+{
+	VAPOR_TRACE_SCOPE("WireFrameRenderer::_buildEdges");
 
-	int count = layered ? n/2 : n;
-	for (int i=0; i<count; i++) {
-		// indices[i] = i;
-        indices.push_back(baseIndex + i);
-        indices.push_back(baseIndex + ((i+1)%count));
-	}
+    const vector <size_t> &dims = grid->GetNodeDimensions();
 
-	if (! layered) return;
-    
-	// if layered the coordinates are ordered bottom face first, then top face
-	//
-	for (int i=0; i<count; i++) {
-		// indices[i] = i + count;
-        indices.push_back(baseIndex + i + count);
-        indices.push_back(baseIndex + ((i+1)%count) + count);
+	_indices.clear();
+
+	if (dynamic_cast<const StructuredGrid *> (grid)) {
+
+		// The cell edges of a structured grid are the segments
+		// between neighboring nodes along each axis, so they can be
+		// enumerated directly rather than per cell
+		//
+		size_t nx = dims.size() > 0 ? dims[0] : 1;
+		size_t ny = dims.size() > 1 ? dims[1] : 1;
+		size_t nz = dims.size() > 2 ? dims[2] : 1;
+		size_t nrows = ny * nz;
+
+		size_t nxedges = (nx-1) * ny * nz;
+		size_t nyedges = nx * (ny-1) * nz;
+		size_t nzedges = nx * ny * (nz-1);
+		_indices.resize(2 * (nxedges + nyedges + nzedges));
+
+		unsigned int *xedges = _indices.data();
+		unsigned int *yedges = xedges + 2*nxedges;
+		unsigned int *zedges = yedges + 2*nyedges;
+
+		Wasp::ThreadPool::Instance()->ParallelFor(
+			0, nrows, 0, [&](size_t rbegin, size_t rend) {
+
+			for (size_t r=rbegin; r<rend; r++) {
+				size_t j = r % ny;
+				size_t k = r / ny;
+				size_t base = r * nx;
+
+				unsigned int *e = xedges + 2*r*(nx-1);
+				for (size_t i=0; i<nx-1; i++) {
+					*e++ = base + i;
+					*e++ = base + i + 1;
+				}
+
+				if (j < ny-1) {
+					e = yedges + 2*(k*(ny-1) + j)*nx;
+					for (size_t i=0; i<nx; i++) {
+						*e++ = base + i;
+						*e++ = base + i + nx;
+					}
+				}
+
+				if (k < nz-1) {
+					e = zedges + 2*r*nx;
+					for (size_t i=0; i<nx; i++) {
+						*e++ = base + i;
+						*e++ = base + i + nx*ny;
+					}
+				}
+			}
+		});
 	}
-    
-	// Now draw edges between top and bottom face
-	//
-	for (int i=0; i<count; i++) {
-		// indices[2*i+0] = i;
-		// indices[2*i+1] = i + count;
-        indices.push_back(baseIndex + i);
-        indices.push_back(baseIndex + i + count);
+	else {
+
+		// Collect the edges of every cell, then remove those shared 
+		// by neighboring cells
+		//
+		bool layered = grid->GetTopologyDim() == 3;
+		vector <unsigned long long> edges;
+		vector <size_t> nodeIndices;
+		vector <vector<size_t> > nodes;
+
+		Grid::ConstCellIterator it = grid->ConstCellBegin();
+		Grid::ConstCellIterator end = grid->ConstCellEnd();
+		for (; it != end; ++it) {
+			grid->GetCellNodes(*it, nodes);
+
+			nodeIndices.resize(nodes.size());
+			for (int i=0; i<nodes.size(); i++) {
+				nodeIndices[i] = linear_index(nodes[i], dims);
+			}
+			cell_edges(
+				nodeIndices.data(), nodes.size(), layered, edges
+			);
+		}
+
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		_indices.resize(2*edges.size());
+		for (size_t i=0; i<edges.size(); i++) {
+			_indices[2*i+0] = (unsigned int) (edges[i] >> 32);
+			_indices[2*i+1] = (unsigned int) (edges[i] & 0xffffffff);
+		}
 	}
+
+	_indicesPending = true;
 }
 
-int WireFrameRenderer::_buildCache()
+int WireFrameRenderer::_buildMesh()
 {
-    WireFrameParams* rParams = (WireFrameParams*)GetActiveParams();
-    _saveCacheParams();
-    
-    if (rParams->GetVariableName().empty())
-    {
-        return 0;
-    }
-    
-    Grid *grid = _dataMgr->GetVariable(
+	VAPOR_TRACE_SCOPE("WireFrameRenderer::_buildMesh");
+
+    std::shared_ptr <const Grid> grid = _dataMgr->GetSharedVariable(
                                        _cacheParams.ts, _cacheParams.varName,
                                        _cacheParams.level, _cacheParams.lod,
                                        _cacheParams.boxMin, _cacheParams.boxMax
                                        );
     if (! grid) return(-1);
     
-    Grid *heightGrid = NULL;
+    std::shared_ptr <const Grid> heightGrid;
     if (!_cacheParams.heightVarName.empty()) {
-        heightGrid = _dataMgr->GetVariable(
+        heightGrid = _dataMgr->GetSharedVariable(
                                            _cacheParams.ts, _cacheParams.heightVarName,
                                            _cacheParams.level, _cacheParams.lod,
                                            _cacheParams.boxMin, _cacheParams.boxMax
                                            );
-        if (! heightGrid) {
-            delete grid;
-            return(-1);
-        }
+        if (! heightGrid) return(-1);
     }
     
-    vector<VertexData> vertices;
-    vector<unsigned int> indices;
-    
-    double mv = grid->GetMissingValue();
-    
-#if 0    // VAPOR_3_1_0
-    
-    // Performance of the bounding box version of the Cell iterator
-    // is too slow. So we render the entire grid and use clipping planes
-    // to restrict the displayed region
-    //
-    Grid::ConstCellIterator it = grid->ConstCellBegin(
-                                                      _cacheParams.boxMin, _cacheParams.boxMax
-                                                      );
-#else
-    Grid::ConstCellIterator it = grid->ConstCellBegin();
-#endif
-    
-    
-    size_t nverts = grid->GetMaxVertexPerCell();
-    bool layered = grid->GetTopologyDim() == 3;
-    
-    float *coordsArray = new float[nverts*3];
-    float *colorsArray = new float[nverts*4];
-    Grid::ConstCellIterator end = grid->ConstCellEnd();
-    
+	// The edges depend only on the grid's topology, which is 
+	// unchanged from one time step to the next
+	//
+    const vector <size_t> &dims = grid->GetNodeDimensions();
+	if (
+		_topoParams.varName != _cacheParams.varName ||
+		_topoParams.level != _cacheParams.level ||
+		_topoParams.boxMin != _cacheParams.boxMin ||
+		_topoParams.boxMax != _cacheParams.boxMax ||
+		_topoParams.gridType != grid->GetType() ||
+		_topoParams.nodeDims != dims
+	) {
+		_buildEdges(grid.get());
+
+		_topoParams.varName = _cacheParams.varName;
+		_topoParams.level = _cacheParams.level;
+		_topoParams.boxMin = _cacheParams.boxMin;
+		_topoParams.boxMax = _cacheParams.boxMax;
+		_topoParams.gridType = grid->GetType();
+		_topoParams.nodeDims = dims;
+	}
+
+    _missingValue = grid->GetMissingValue();
+
+	size_t nx = dims.size() > 0 ? dims[0] : 1;
+	size_t nrows = 1;
+	for (int i=1; i<dims.size(); i++) nrows *= dims[i];
+
+	_coords.resize(3 * nx * nrows);
+	_values.resize(nx * nrows);
+
     float defaultZ = _getDefaultZ(_dataMgr, _cacheParams.ts);
-    for (; it != end; ++it)
-    {
-        vector <vector<size_t> > nodes;
-        grid->GetCellNodes(*it, nodes);
-        
-        for (int i = 0; i < nodes.size(); i++)
-        {
-            vector <double> coord;
-            grid->GetUserCoordinates(nodes[i], coord);
-            
-            coordsArray[3*i+0] = coord[0];
-            coordsArray[3*i+1] = coord[1];
-            
-            if (coord.size() == 3) {
-                coordsArray[3*i+2] = coord[2];
-            }
-            else if (heightGrid) {
-                coordsArray[3*i+2] = heightGrid->AccessIndex(nodes[i]);
-            }
-            else {
-                coordsArray[3*i+2] = defaultZ;
-            }
-            
-            float dataValue = grid->AccessIndex(nodes[i]);
+
+	// Gather the node coordinates and values one row of nodes at a 
+	// time, rows in parallel
+	//
+	Wasp::ThreadPool::Instance()->ParallelFor(
+		0, nrows, 0, [&](size_t rbegin, size_t rend) {
+
+		vector <size_t> index(dims.size(), 0);
+		vector <double> coord;
+		for (size_t r=rbegin; r<rend; r++) {
+			size_t rem = r;
+			for (int d=1; d<dims.size(); d++) {
+				index[d] = rem % dims[d];
+				rem /= dims[d];
+			}
+
+			float *coords = _coords.data() + 3*r*nx;
+			float *values = _values.data() + r*nx;
+			for (size_t i=0; i<nx; i++) {
+				index[0] = i;
+				grid->GetUserCoordinates(index, coord);
+
+				coords[3*i+0] = coord[0];
+				coords[3*i+1] = coord[1];
+
+				if (coord.size() == 3) {
+					coords[3*i+2] = coord[2];
+				}
+				else if (heightGrid) {
+					coords[3*i+2] = heightGrid->AccessIndex(index);
+				}
+				else {
+					coords[3*i+2] = defaultZ;
+				}
+
+				values[i] = grid->AccessIndex(index);
+			}
+		}
+	});
+    
+	_coordsPending = true;
+	return(0);
+}
+
+void WireFrameRenderer::_buildColors()
+{
+	size_t nnodes = _values.size();
+	_colors.resize(4 * nnodes);
+
+	const float *values = _values.data();
+	float *colors = _colors.data();
+	float mv = _missingValue;
+
+	Wasp::ThreadPool::Instance()->ParallelFor(
+		0, nnodes, 0, [&](size_t begin, size_t end) {
+
+		size_t n = _cacheParams.tf_lut.size() >> 2;
+		for (size_t i=begin; i<end; i++) {
+			float dataValue = values[i];
             if (dataValue == mv) {
-                colorsArray[4*i+0] = 0.0;
-                colorsArray[4*i+1] = 0.0;
-                colorsArray[4*i+2] = 0.0;
-                colorsArray[4*i+3] = 0.0;
+                colors[4*i+0] = 0.0;
+                colors[4*i+1] = 0.0;
+                colors[4*i+2] = 0.0;
+                colors[4*i+3] = 0.0;
             }
             else if (_cacheParams.useSingleColor) {
-                colorsArray[4*i+0] = _cacheParams.constantColor[0];
-                colorsArray[4*i+1] = _cacheParams.constantColor[1];
-                colorsArray[4*i+2] = _cacheParams.constantColor[2];
-                colorsArray[4*i+3] = _cacheParams.constantOpacity;
+                colors[4*i+0] = _cacheParams.constantColor[0];
+                colors[4*i+1] = _cacheParams.constantColor[1];
+                colors[4*i+2] = _cacheParams.constantColor[2];
+                colors[4*i+3] = _cacheParams.constantOpacity;
             }
             else {
-                size_t n = _cacheParams.tf_lut.size() >> 2;
                 int index = (dataValue - _cacheParams.tf_minmax[0]) /
                 (_cacheParams.tf_minmax[1] - _cacheParams.tf_minmax[0]) *
                 (n - 1);
@@ -261,42 +403,82 @@ int WireFrameRenderer::_buildCache()
                 if (index >= n) {
                     index = n-1;
                 }
-                colorsArray[4*i+0] = _cacheParams.tf_lut[4*index+0];
-                colorsArray[4*i+1] = _cacheParams.tf_lut[4*index+1];
-                colorsArray[4*i+2] = _cacheParams.tf_lut[4*index+2];
-                colorsArray[4*i+3] = _cacheParams.tf_lut[4*index+3];
-                
+                colors[4*i+0] = _cacheParams.tf_lut[4*index+0];
+                colors[4*i+1] = _cacheParams.tf_lut[4*index+1];
+                colors[4*i+2] = _cacheParams.tf_lut[4*index+2];
+                colors[4*i+3] = _cacheParams.tf_lut[4*index+3];
             }
-        }
-        
-        _drawCell(vertices, indices, coordsArray, colorsArray, nodes.size(), layered);
-    }
-    
-    
-    delete [] coordsArray;
-    delete [] colorsArray;
-    
-    if (grid) delete grid;
-    if (heightGrid) delete heightGrid;
+		}
+	});
+
+	_colorsPending = true;
+}
+
+int WireFrameRenderer::_buildCache()
+{
+    WireFrameParams* rParams = (WireFrameParams*)GetActiveParams();
+	bool dataDirty = _isDataDirty();
+    _saveCacheParams();
     
-    _nIndices = indices.size();
-    glBindVertexArray(_VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, _VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(VertexData), vertices.data(), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_DYNAMIC_DRAW);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    if (rParams->GetVariableName().empty())
+    {
+        return 0;
+    }
+
+	// A change of colors alone does not require the variable to be 
+	// read again
+	//
+	if (dataDirty || _values.empty()) {
+		int rc = _buildMesh();
+		if (rc<0) return(-1);
+	}
+
+	_buildColors();
     return 0;
 }
 
+void WireFrameRenderer::_uploadCache()
+{
+	if (_coordsPending) {
+		glBindBuffer(GL_ARRAY_BUFFER, _VBO);
+		glBufferData(GL_ARRAY_BUFFER, _coords.size() * sizeof(float), _coords.data(), GL_DYNAMIC_DRAW);
+		vector <float>().swap(_coords);
+		_coordsPending = false;
+	}
+	if (_colorsPending) {
+		glBindBuffer(GL_ARRAY_BUFFER, _colorVBO);
+		glBufferData(GL_ARRAY_BUFFER, _colors.size() * sizeof(float), _colors.data(), GL_DYNAMIC_DRAW);
+		vector <float>().swap(_colors);
+		_colorsPending = false;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (_indicesPending) {
+		glBindVertexArray(_VAO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(unsigned int), _indices.data(), GL_DYNAMIC_DRAW);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		_nIndices = _indices.size();
+		vector <unsigned int>().swap(_indices);
+		_indicesPending = false;
+	}
+}
+
+int WireFrameRenderer::_prepare(bool)
+{
+    if (_isCacheDirty())
+        return _buildCache();
+	return 0;
+}
+
 int WireFrameRenderer::_paintGL(bool fast)
 {
     
     int rc = 0;
     if (_isCacheDirty())
         rc = _buildCache();
+	_uploadCache();
     
     SmartShaderProgram shader = _glManager->shaderManager->GetSmartShader("Wireframe");
     if (!shader.IsValid())
@@ -321,12 +503,15 @@ int WireFrameRenderer::_initializeGL()
     glGenVertexArrays(1, &_VAO);
     glBindVertexArray(_VAO);
     glGenBuffers(1, &_VBO);
+    glGenBuffers(1, &_colorVBO);
     glGenBuffers(1, &_EBO);
     glBindBuffer(GL_ARRAY_BUFFER, _VBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), NULL);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), NULL);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)offsetof(struct VertexData, r));
+    glBindBuffer(GL_ARRAY_BUFFER, _colorVBO);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 4*sizeof(float), NULL);
     glEnableVertexAttribArray(1);
     glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     return 0;
 }
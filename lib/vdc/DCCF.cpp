@@ -63,6 +63,10 @@ int DCCF::initialize(
 
 	NetCDFCFCollection *ncdfc = new NetCDFCFCollection();
 
+	// Reuse cached metadata for unchanged files, if enabled
+	//
+	ncdfc->SetIndexFile(NetCDFCollection::DefaultIndexFile(paths));
+
 	// Initialize the NetCDFCFCollection class. 
 	//
 	int rc = ncdfc->Initialize(paths);
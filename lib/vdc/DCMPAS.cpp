@@ -289,6 +289,10 @@ int DCMPAS::initialize(
 
 	NetCDFCollection *ncdfc = new NetCDFCollection();
 
+	// Reuse cached metadata for unchanged files, if enabled
+	//
+	ncdfc->SetIndexFile(NetCDFCollection::DefaultIndexFile(files));
+
 	// Initialize NetCDFCollection class
 	//
 	vector <string> time_dimnames(1, timeDimName);
@@ -73,6 +73,10 @@ int DCWRF::initialize(
 
 	NetCDFCollection *ncdfc = new NetCDFCollection();
 
+	// Reuse cached metadata for unchanged files, if enabled
+	//
+	ncdfc->SetIndexFile(NetCDFCollection::DefaultIndexFile(files));
+
 	// Initialize the NetCDFCollection class. Need to specify the name
 	// of the time dimension ("Time" for WRF), and time coordinate variable
 	// names (N/A for WRF)
@@ -281,6 +285,14 @@ bool DCWRF::_getAttTemplate(
 	string varname, string attname, T &values
 ) const {
 
+	// Global attributes
+	//
+	if (varname.empty()) {
+		if (! _ncdfc) return(false);
+		_ncdfc->GetAtt("", attname, values);
+		return(! values.empty());
+	}
+
 	DC::BaseVar var;
 	bool status = getBaseVarInfo(varname, var);
 	if (! status) return(status);
@@ -319,6 +331,11 @@ bool DCWRF::getAtt(
 }
 
 std::vector <string> DCWRF::getAttNames(string varname) const {
+	if (varname.empty()) {
+		if (! _ncdfc) return(vector <string> ());
+		return(_ncdfc->GetAttNames(""));
+	}
+
 	DC::BaseVar var;
 	bool status = getBaseVarInfo(varname, var);
 	if (! status) return(vector <string> ());
@@ -13,7 +13,12 @@
 #include <vapor/DCCF.h>
 #include <vapor/DCMPAS.h>
 #include <vapor/DerivedVar.h>
+#include <vapor/DerivedVarWRF.h>
+#include <vapor/DerivedVarExpr.h>
+#include <vapor/DerivedVarFinDiff.h>
 #include <vapor/DataMgr.h>
+#include <vapor/Trace.h>
+#include <vapor/ThreadPool.h>
 #ifdef WIN32
 #include <float.h>
 #endif
@@ -217,33 +222,25 @@ void decimate(
 	size_t src_block_size = vproduct(src_bs);
 	size_t dst_block_size = vproduct(dst_bs);
 
-	if (src_bs.size() == 1) {
-		for (int i=bmin[0]; i<= bmax[0]; i++) {
-			decimate1d(src_bs, src, dst);
-			src += src_block_size;
-			dst += dst_block_size;
-		}
-	}
-	else if (src_bs.size() == 2) {
-		for (int j=bmin[1]; j<= bmax[1]; j++) {
-		for (int i=bmin[0]; i<= bmax[0]; i++) {
-			decimate2d(src_bs, src, dst);
-			src += src_block_size;
-			dst += dst_block_size;
-		}
-		}
+	size_t nblocks = 1;
+	for (int i=0; i<bmin.size(); i++) {
+		nblocks *= bmax[i] - bmin[i] + 1;
 	}
-	else {
-		for (int k=bmin[2]; k<= bmax[2]; k++) {
-		for (int j=bmin[1]; j<= bmax[1]; j++) {
-		for (int i=bmin[0]; i<= bmax[0]; i++) {
-			decimate3d(src_bs, src, dst);
-			src += src_block_size;
-			dst += dst_block_size;
-		}
-		}
+
+	// Blocks are decimated independently, so process them in parallel
+	//
+	ThreadPool::Instance()->ParallelFor(
+		0, nblocks, 0, [&](size_t b0, size_t b1) {
+
+		for (size_t b=b0; b<b1; b++) {
+			const T *s = src + b * src_block_size;
+			T *d = dst + b * dst_block_size;
+
+			if (src_bs.size() == 1) decimate1d(src_bs, s, d);
+			else if (src_bs.size() == 2) decimate2d(src_bs, s, d);
+			else decimate3d(src_bs, s, d);
 		}
-	}
+	});
 }
 
 
@@ -325,6 +322,21 @@ void coord_setup_helper(
 }
 #endif
 
+// Return the formula of a variable created by AddExpressionVar(), or the
+// empty string for any other variable
+//
+string exprVarFormula(const DerivedVar *var) {
+	const DerivedDataVarExpr *expr =
+		dynamic_cast <const DerivedDataVarExpr *> (var);
+	if (expr) return(expr->GetFormula());
+
+	const DerivedDataVarFinDiff *findiff =
+		dynamic_cast <const DerivedDataVarFinDiff *> (var);
+	if (findiff) return(findiff->GetFormula());
+
+	return("");
+}
+
 };
 
 
@@ -355,6 +367,10 @@ DataMgr::DataMgr(
 
 	_varInfoCache.Clear();
 
+	_sharedGridCacheSize = 8;
+	_self = std::make_shared <DataMgr *> (this);
+	_refineQuit = false;
+
 	_doTransformHorizontal = false;
 	_doTransformVertical = false;
 	_openVarName.clear();
@@ -367,6 +383,13 @@ DataMgr::~DataMgr(
 ) {
 	SetDiagMsg("DataMgr::~DataMgr()");
 
+	// Shared grids still held elsewhere must no longer unlock their
+	// blocks when released
+	//
+	_self.reset();
+
+	_stopRefinement();
+
 	if (_dc) delete _dc;
 	_dc = NULL;
 
@@ -431,6 +454,8 @@ int DataMgr::Initialize(
 	int rc = _parseOptions(deviceOptions);
 	if (rc<0) return(-1);
 
+	_stopRefinement();
+
 	Clear();
 	if (_dc) delete _dc;
 
@@ -491,11 +516,18 @@ int DataMgr::Initialize(
 		SetErrMsg("Failed to get time coordinates");
 		return(-1);
 	}
+
+	rc = _initDerivedDataVars();
+	if (rc<0) {
+		SetErrMsg("Failed to initialize derived data variables");
+		return(-1);
+	}
 	return(0);
 }
 
 bool DataMgr::GetMesh(string meshname, DC::Mesh &m) const {
 	assert(_dc);
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
 
 	bool ok = _dvm.GetMesh(meshname, m);
 	if (! ok) {
@@ -627,6 +659,7 @@ bool DataMgr::GetDataVarInfo(
 	string varname, VAPoR::DC::DataVar &var
 ) const {
 	assert(_dc);
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
 
 	bool ok = _dvm.GetDataVarInfo(varname, var);
 	if (! ok) {
@@ -650,6 +683,7 @@ bool DataMgr::GetCoordVarInfo(
 	string varname, VAPoR::DC::CoordVar &var
 ) const {
 	assert(_dc);
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
 
 	bool ok = _dvm.GetCoordVarInfo(varname, var);
 	if (! ok) {
@@ -662,6 +696,7 @@ bool DataMgr::GetBaseVarInfo(
 	string varname, VAPoR::DC::BaseVar &var
 ) const {
 	assert(_dc);
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
 
 	bool ok = _dvm.GetBaseVarInfo(varname, var);
 	if (! ok) {
@@ -704,6 +739,7 @@ bool DataMgr::IsCompressed(string varname) const {
 
 int DataMgr::GetNumTimeSteps(string varname) const {
 	assert(_dc);
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
 
 	// If data variable get it's time coordinate variable if it exists
 	//
@@ -738,6 +774,7 @@ int DataMgr::GetNumTimeSteps() const
 
 size_t DataMgr::GetNumRefLevels(string varname) const {
 	assert(_dc);
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
 
 	if (varname == "") return 1;
 
@@ -748,6 +785,7 @@ size_t DataMgr::GetNumRefLevels(string varname) const {
 
 vector <size_t> DataMgr::GetCRatios(string varname) const {
 	assert(_dc);
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
 
 	DC::BaseVar var;
 	int rc = GetBaseVarInfo(varname, var);
@@ -759,6 +797,8 @@ vector <size_t> DataMgr::GetCRatios(string varname) const {
 Grid *DataMgr::GetVariable (
 	size_t ts, string varname, int level, int lod, bool lock
 ) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
 	SetDiagMsg(
 		"DataMgr::GetVariable(%d,%s,%d,%d,%d, %d)",
 		ts,varname.c_str(), level, lod, lock
@@ -785,6 +825,8 @@ Grid *DataMgr::GetVariable (
 	size_t ts, string varname, int level, int lod,
     vector <double> min, vector <double> max, bool lock
 ) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
 	assert(min.size() == max.size());
 
 	SetDiagMsg(
@@ -839,6 +881,7 @@ Grid *DataMgr::_getVariable(
 	bool	lock,
 	bool	dataless
 ) {
+	VAPOR_TRACE_SCOPE("DataMgr::_getVariable");
 
 	if (! VariableExists(ts, varname, level, lod)) {
 		SetErrMsg("Invalid variable reference : %s", varname.c_str());
@@ -1187,6 +1230,7 @@ Grid *DataMgr::_getVariable(
 	bool	lock,
 	bool	dataless
 ) {
+	VAPOR_TRACE_SCOPE("DataMgr::_getVariable");
 	Grid *rg = NULL;
 
 	string gridType = _get_grid_type(varname);
@@ -1340,6 +1384,8 @@ Grid *DataMgr::GetVariable(
 	vector <size_t> max,
 	bool	lock
 ) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
 	assert(min.size() == max.size());
 
 	SetDiagMsg(
@@ -1378,10 +1424,153 @@ Grid *DataMgr::GetVariable(
 	return(rg);
 }
 
+Grid *DataMgr::GetVariableProgressive(
+	size_t ts, string varname, int level, int lod,
+	vector <double> min, vector <double> max,
+	ProgressiveCB callback, std::shared_ptr <ProgressiveRead> &request
+) {
+	SetDiagMsg(
+		"DataMgr::GetVariableProgressive(%d, %s, %d, %d, %s, %s)",
+		ts,varname.c_str(), level, lod, vector_to_string(min).c_str(),
+		vector_to_string(max).c_str()
+	);
+
+	request.reset();
+
+	int rc = _level_correction(varname, level);
+	if (rc<0) return(NULL);
+
+	rc = _lod_correction(varname, lod);
+	if (rc<0) return(NULL);
+
+	// Grids handed out are locked so that the refinements read in the
+	// background do not evict them while they are in use
+	//
+	Grid *rg = GetVariable(ts, varname, 0, 0, min, max, true);
+	if (! rg) return(NULL);
+
+	// Refinements, coarse to fine. The finest level-of-detail is
+	// used for all but the coarsest refinement level since, for a 
+	// given level, most of the cost is in inverse transforming the
+	// coefficients, not in their number. All refinements then share
+	// the same coefficients, which the DC is asked to retain so that
+	// only the first refinement fetches them.
+	//
+	vector <pair <int, int> > steps;
+	for (int l=1; l<=level; l++) {
+		steps.push_back(make_pair(l, lod));
+	}
+	if (steps.empty() && lod > 0) steps.push_back(make_pair(0, lod));
+
+	std::shared_ptr <ProgressiveRead> req(new ProgressiveRead());
+	std::shared_ptr <std::promise <int> > done(new std::promise <int>);
+	req->_future = done->get_future().share();
+	request = req;
+
+	if (steps.empty()) {
+		done->set_value(0);
+		return(rg);
+	}
+
+	auto refine = [this, req, done, steps, ts, varname, min, max, callback]() {
+		int status = 0;
+		for (int i=0; i<steps.size(); i++) {
+			if (req->IsCancelled()) {
+				status = -1;
+				break;
+			}
+
+			Grid *g;
+			{
+				std::lock_guard<std::recursive_mutex> guard(_mutex);
+				_dc->RetainCoeffs(ts, varname);
+				g = GetVariable(
+					ts, varname, steps[i].first, steps[i].second, 
+					min, max, true
+				);
+			}
+			if (! g) {
+				status = -1;
+				break;
+			}
+
+			if (req->IsCancelled()) {
+				UnlockGrid(g);
+				delete g;
+				status = -1;
+				break;
+			}
+			callback(steps[i].first, steps[i].second, g);
+		}
+
+		{
+			std::lock_guard<std::recursive_mutex> guard(_mutex);
+			_dc->RetainCoeffs(0, "");
+			_progressiveReads.remove(req);
+		}
+		done->set_value(status);
+	};
+
+	// Refinements are read on a dedicated thread rather than on the
+	// shared ThreadPool. A pool worker waiting on its own nested tasks
+	// could otherwise pick up a refinement and re-enter the DataMgr
+	// while holding _mutex.
+	//
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+	if (! _refineThread.joinable()) {
+		_refineThread = std::thread(&DataMgr::_refineLoop, this);
+	}
+	_progressiveReads.push_back(req);
+	_refineQueue.push_back(refine);
+	_refineCV.notify_one();
+
+	return(rg);
+}
+
+void DataMgr::_refineLoop() {
+	std::unique_lock<std::recursive_mutex> lock(_mutex);
+	while (true) {
+		_refineCV.wait(lock, [this]() -> bool {
+			return(_refineQuit || ! _refineQueue.empty());
+		});
+		if (_refineQueue.empty()) break;
+
+		std::function <void ()> refine = _refineQueue.front();
+		_refineQueue.pop_front();
+
+		lock.unlock();
+		refine();
+		lock.lock();
+	}
+}
+
+void DataMgr::_stopRefinement() {
+
+	// Reads still queued run to completion, delivering nothing, so that
+	// their futures become ready. The thread must be joined without 
+	// holding _mutex, which the reads require.
+	//
+	{
+		std::lock_guard<std::recursive_mutex> guard(_mutex);
+		std::list <std::shared_ptr <ProgressiveRead> >::iterator itr;
+		for (itr = _progressiveReads.begin(); itr!=_progressiveReads.end(); ++itr){
+			(*itr)->Cancel();
+		}
+		_refineQuit = true;
+		_refineCV.notify_one();
+	}
+	if (_refineThread.joinable()) _refineThread.join();
+
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+	_refineQuit = false;
+}
+
 int DataMgr::GetVariableExtents(
     size_t ts, string varname, int level,
     vector <double> &min , vector <double> &max
 ) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
 	min.clear();
 	max.clear();
 
@@ -1427,6 +1616,8 @@ int DataMgr::GetDataRange(
 	int lod,
 	vector <double> &range
 ) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
 	SetDiagMsg("DataMgr::GetDataRange(%d,%s)", ts, varname.c_str());
 	range.clear();
 
@@ -1484,6 +1675,8 @@ int DataMgr::GetDimLensAtLevel(
 ) const {
 	assert(_dc);
 
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
 	DerivedVar *dvar = _getDerivedVar(varname);
 	if (dvar) {
 		return(
@@ -1645,6 +1838,11 @@ bool DataMgr::VariableExists(
 ) const {
 	if (varname.empty()) return (false);
 
+	// The info cache is shared, and error reporting is switched off
+	// below, with other threads using this DataMgr
+	//
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
     // disable error reporting
     //
     bool enabled = EnableErrMsg(false);
@@ -1739,6 +1937,13 @@ bool DataMgr::IsVariableDerived(string name) const {
 }
 
 void	DataMgr::Clear() {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
+	// Shared grids release their locks when destroyed, so must go before
+	// the regions they reference
+	//
+	_sharedGrids.clear();
+	_sharedGridRefs.clear();
 
 	_PipeLines.clear();
 
@@ -1768,6 +1973,8 @@ void	DataMgr::Clear() {
 void	DataMgr::UnlockGrid(
 	const Grid *rg
 ) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
 	SetDiagMsg("DataMgr::UnlockGrid()");
 	const vector <float *> &blks = rg->GetBlks();
 	if (blks.size()) _unlock_blocks(blks[0]);
@@ -1779,6 +1986,109 @@ void	DataMgr::UnlockGrid(
 	}
 }
 
+std::shared_ptr <const Grid> DataMgr::GetSharedVariable(
+	size_t ts, string varname, int level, int lod,
+    vector <double> min, vector <double> max
+) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
+	assert(min.size() == max.size());
+
+	SetDiagMsg(
+		"DataMgr::GetSharedVariable(%d, %s, %d, %d, %s, %s)",
+		ts,varname.c_str(), level, lod, vector_to_string(min).c_str(),
+		vector_to_string(max).c_str()
+	);
+
+	int rc = _level_correction(varname, level);
+	if (rc<0) return(nullptr);
+
+	rc = _lod_correction(varname, lod);
+	if (rc<0) return(nullptr);
+
+	vector <string> coord_vars;
+	bool ok = GetVarCoordVars(varname, true, coord_vars);
+	assert(ok);
+
+	while (min.size() > coord_vars.size()) {
+		min.pop_back();
+		max.pop_back();
+	}
+
+	// Requests for different boxes that select the same voxels share 
+	// a grid, so the key is formed from the voxel coordinates
+	//
+	vector <size_t> min_ui, max_ui;
+	rc = _find_bounding_grid(
+		ts, varname, level, lod, min, max, min_ui, max_ui
+	);
+	if (rc<0) return(nullptr);
+
+	if (! min_ui.size()) {
+		return(std::shared_ptr <const Grid> (new RegularGrid()));
+	}
+
+	ostringstream oss;
+	oss << ts << ":" << varname << ":" << level << ":" << lod << ":" <<
+		vector_to_string(min_ui) << ":" << vector_to_string(max_ui);
+	string key = oss.str();
+
+	list <shared_grid_t>::iterator itr;
+	for (itr = _sharedGrids.begin(); itr != _sharedGrids.end(); ++itr) {
+		if (itr->first == key) {
+			_sharedGrids.splice(_sharedGrids.begin(), _sharedGrids, itr);
+			return(itr->second);
+		}
+	}
+
+	// Evicted from the cache but still in use elsewhere
+	//
+	std::shared_ptr <const Grid> grid;
+	map <string, std::weak_ptr <const Grid> >::iterator ref;
+	ref = _sharedGridRefs.find(key);
+	if (ref != _sharedGridRefs.end()) {
+		grid = ref->second.lock();
+	}
+
+	if (! grid) {
+		Grid *rg = GetVariable(ts, varname, level, lod, min_ui, max_ui, true);
+		if (! rg) return(nullptr);
+
+		std::weak_ptr <DataMgr *> self = _self;
+		grid = std::shared_ptr <const Grid> (rg, [self](const Grid *g) {
+			std::shared_ptr <DataMgr *> dataMgr = self.lock();
+			if (dataMgr) (*dataMgr)->UnlockGrid(g);
+			delete g;
+		});
+		_sharedGridRefs[key] = grid;
+	}
+
+	if (_sharedGridCacheSize) {
+		_sharedGrids.push_front(shared_grid_t(key, grid));
+		while (_sharedGrids.size() > _sharedGridCacheSize) {
+			_sharedGrids.pop_back();
+		}
+	}
+
+	// Forget grids nobody holds any more
+	//
+	for (ref = _sharedGridRefs.begin(); ref != _sharedGridRefs.end(); ) {
+		if (ref->second.expired()) ref = _sharedGridRefs.erase(ref);
+		else ++ref;
+	}
+
+	return(grid);
+}
+
+void DataMgr::SetSharedGridCacheSize(size_t n) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
+	_sharedGridCacheSize = n;
+	while (_sharedGrids.size() > _sharedGridCacheSize) {
+		_sharedGrids.pop_back();
+	}
+}
+
 size_t DataMgr::GetNumDimensions(string varname) const {
 	assert(_dc);
 
@@ -1852,6 +2162,7 @@ T	*DataMgr::_get_region_from_cache(
 				"DataMgr::_get_region_from_cache() - data in cache %xll\n",
 				 tmp_region.blks
 			);
+			VAPOR_TRACE_COUNTER("DataMgr cache hits", 1);
 			return((T *) tmp_region.blks);
 		}
 	}
@@ -1865,9 +2176,14 @@ T *DataMgr::_get_region_from_fs(
     const vector <size_t> &bs, const vector <size_t> &bmin, 
 	const vector <size_t> &bmax, bool lock
 ) {
+	VAPOR_TRACE_SCOPE("DataMgr::_get_region_from_fs");
 
+	// The region is locked while it is filled. A derived variable may
+	// read its inputs through this DataMgr, which could otherwise free
+	// the region to make room for them.
+	//
 	T *blks = (T *) _alloc_region(
-		ts, varname, level, lod, bmin, bmax, bs, sizeof(T), lock, false
+		ts, varname, level, lod, bmin, bmax, bs, sizeof(T), true, false
 	);
 	if (! blks) return(NULL);
 
@@ -1891,19 +2207,42 @@ T *DataMgr::_get_region_from_fs(
 	}
 
 	int fd = _openVariableRead(ts, varname, level, lod);
-    if (fd < 0) return(NULL);
+    if (fd < 0) {
+		_unlock_blocks(blks);
+		_free_region(ts,varname ,level,lod,bmin,bmax);
+		return(NULL);
+	}
 
 	int rc = _readRegionBlock(fd, min, max, blks);
+
+	// A derived variable may have read its inputs through this DataMgr,
+	// opening other variables
+	//
+	_openVarName = varname;
+
     if (rc < 0) {
+		_unlock_blocks(blks);
 		_free_region(ts,varname ,level,lod,bmin,bmax);
 		_closeVariable(fd); 
 		return(NULL);
 	}
 
 	rc = _closeVariable(fd); 
-	if (rc<0) return(NULL);
+	if (rc<0) {
+		_unlock_blocks(blks);
+		_free_region(ts,varname ,level,lod,bmin,bmax);
+		return(NULL);
+	}
+
+	if (! lock) _unlock_blocks(blks);
 
 	SetDiagMsg("DataMgr::GetGrid() - data read from fs\n");
+	VAPOR_TRACE_COUNTER("DataMgr cache misses", 1);
+#ifdef	VAPOR_TRACE
+	size_t nbytes = sizeof(T);
+	for (int i=0; i<min.size(); i++) nbytes *= max[i] - min[i] + 1;
+	VAPOR_TRACE_COUNTER("DataMgr bytes read", nbytes);
+#endif
 	return(blks);
 }
 
@@ -1931,14 +2270,16 @@ T *DataMgr::_get_region(
 	);
 	if (! blks ) {
 
-		// If level not available we recursively decimate
+		// If level not available we recursively decimate. The finer
+		// region stays locked until it has been decimated, since 
+		// allocating the coarser one may free unlocked regions.
 		//
 		if (level < -nlevels) {
 			level++;
 
 			blks = _get_region<T>(
 				ts, varname, level, nlevels, lod, nlods,
-				bs, bmin, bmax, false
+				bs, bmin, bmax, true
 			);
 			if (blks) {
 				vector <size_t> bs_at_level = decimate_dims(bs, -level - 1);
@@ -1946,11 +2287,15 @@ T *DataMgr::_get_region(
 
 				T *newblks = (T *) _alloc_region(
 					ts, varname, level-1, lod, bmin, bmax, bs_at_level_m1, 
-					sizeof(T), false, false
+					sizeof(T), lock, false
 				);
-				if (! newblks) return(NULL);
+				if (! newblks) {
+					_unlock_blocks(blks);
+					return(NULL);
+				}
 
 				decimate(bmin, bmax, bs_at_level, blks, newblks); 
+				_unlock_blocks(blks);
 				return(newblks);
 			}
 		} 
@@ -2150,17 +2495,33 @@ void	DataMgr::_free_var(string varname) {
 bool	DataMgr::_free_lru(
 ) {
 
-	// The least recently used region is at the front of the list
-	//
-	list <region_t>::iterator itr;
-	for(itr = _regionsList.begin(); itr!=_regionsList.end(); itr++) {
-		const region_t &region = *itr;
+	for (;;) {
 
-		if (region.lock_counter == 0) {
-			if (region.blks) _blk_mem_mgr->FreeMem(region.blks);
-			_regionsList.erase(itr);
-			return(true);
+		// The least recently used region is at the front of the list
+		//
+		list <region_t>::iterator itr;
+		for(itr = _regionsList.begin(); itr!=_regionsList.end(); itr++) {
+			const region_t &region = *itr;
+
+			if (region.lock_counter == 0) {
+				if (region.blks) _blk_mem_mgr->FreeMem(region.blks);
+				_regionsList.erase(itr);
+				return(true);
+			}
 		}
+
+		// Release the least recently used shared grid that is held only
+		// by the cache, unlocking its regions, and try again
+		//
+		list <shared_grid_t>::iterator sitr = _sharedGrids.end();
+		while (sitr != _sharedGrids.begin()) {
+			--sitr;
+			if (sitr->second.use_count() == 1) break;
+		}
+		if (sitr == _sharedGrids.end() || sitr->second.use_count() != 1) {
+			break;
+		}
+		_sharedGrids.erase(sitr);
 	}
 
 	// nothing to free
@@ -2415,6 +2776,8 @@ vector <string> DataMgr::_get_native_variables() const {
 #ifdef	VAPOR3_0_0_ALPHA
 
 void DataMgr::PurgeVariable(string varname){
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
 	_free_var(varname);
 	_VarInfoCache.PurgeVariable(varname);
 }
@@ -2608,6 +2971,29 @@ void DataMgr::VarInfoCache::PurgeDouble(
 	_cacheDouble.erase(itr);
 }
 
+void DataMgr::VarInfoCache::PurgeVariable(string varname) {
+
+	// Hashes list the variable names between colons (see _make_hash())
+	//
+	string tag = ":" + varname + ":";
+
+	map <string, vector <size_t> >::iterator itr1 = _cacheSize_t.begin();
+	while (itr1 != _cacheSize_t.end()) {
+		if (itr1->first.find(tag) != string::npos) {
+			itr1 = _cacheSize_t.erase(itr1);
+		}
+		else ++itr1;
+	}
+
+	map <string, vector <double> >::iterator itr2 = _cacheDouble.begin();
+	while (itr2 != _cacheDouble.end()) {
+		if (itr2->first.find(tag) != string::npos) {
+			itr2 = _cacheDouble.erase(itr2);
+		}
+		else ++itr2;
+	}
+}
+
 void DataMgr::VarInfoCache::Set(
 	size_t ts, vector <string> varnames, int level, int lod, string key,
 	const vector <void *> &values
@@ -3427,6 +3813,7 @@ int DataMgr::_readRegionBlock(
 	DerivedVar *derivedVar = _getDerivedVar(_openVarName);
 	if (derivedVar) {
 		assert ((std::is_same<T,float>::value) == true);
+		VAPOR_TRACE_SCOPE("DerivedVar::ReadRegionBlock");
 		return(derivedVar->ReadRegionBlock(fd, min, max, (float *) region));
 	}
 
@@ -3440,6 +3827,7 @@ int DataMgr::_readRegion(
 
 	DerivedVar *derivedVar = _getDerivedVar(_openVarName);
 	if (derivedVar) {
+		VAPOR_TRACE_SCOPE("DerivedVar::ReadRegion");
 		return(derivedVar->ReadRegion(fd, min, max, region));
 	}
 
@@ -3755,6 +4143,321 @@ int DataMgr::_initVerticalCoordVars() {
 	return(0);
 }
 
+// Diagnostics computed from the native variables, e.g. the WRF
+// diagnostics. Each is only added if the data collection provides its
+// inputs.
+//
+int DataMgr::_initDerivedDataVars() {
+
+	vector <DerivedDataVarWRF *> wrfVars = DerivedDataVarWRF::CreateAll(_dc);
+	for (int i=0; i<wrfVars.size(); i++) {
+		_dvm.AddDataVar(wrfVars[i]);
+	}
+
+	return(0);
+}
+
+int DataMgr::AddExpressionVar(string varname, string formula, string units) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
+	DC::BaseVar dummy;
+	DerivedVar *oldVar = _dvm.GetVar(varname);
+	if (
+		_dc->GetBaseVarInfo(varname, dummy) ||
+		(oldVar && exprVarFormula(oldVar).empty())
+	) {
+		SetErrMsg("Variable %s already exists", varname.c_str());
+		return(-1);
+	}
+
+	// Finite difference operators are evaluated with stencils over the
+	// coordinates of their operands, everything else point-wise
+	//
+	DerivedDataVar *var;
+	if (DerivedDataVarFinDiff::IsFinDiffFormula(formula)) {
+		string op;
+		vector <string> inputs, coordVars;
+		int order;
+		int rc = DerivedDataVarFinDiff::ParseFormula(
+			formula, op, inputs, order
+		);
+		if (rc<0) return(-1);
+
+		if (! GetVarCoordVars(inputs[0], true, coordVars)) {
+			SetErrMsg(
+				"Undefined variable \"%s\" in \"%s\"",
+				inputs[0].c_str(), formula.c_str()
+			);
+			return(-1);
+		}
+
+		// Order the coordinate variables by axis
+		//
+		vector <string> axisVars(3);
+		for (int i=0; i<coordVars.size(); i++) {
+			DC::CoordVar cvar;
+			if (! GetCoordVarInfo(coordVars[i], cvar)) continue;
+			if (cvar.GetAxis() < 0 || cvar.GetAxis() > 2) continue;
+			axisVars[cvar.GetAxis()] = coordVars[i];
+		}
+
+		var = new DerivedDataVarFinDiff(
+			varname, _dc, &_dvm, formula, axisVars, units
+		);
+	}
+	else {
+		var = new DerivedDataVarExpr(varname, _dc, &_dvm, formula, units);
+	}
+
+	int rc = var->Initialize();
+	if (rc<0) {
+		delete var;
+		return(-1);
+	}
+
+	vector <string> inputs = var->GetInputs();
+	for (int i=0; i<inputs.size(); i++) {
+		if (_dependsOn(inputs[i], varname)) {
+			SetErrMsg(
+				"Circular definition of variable %s", varname.c_str()
+			);
+			delete var;
+			return(-1);
+		}
+	}
+
+	if (oldVar) {
+		_dvm.RemoveVar(oldVar);
+		delete oldVar;
+	}
+	_dvm.AddDataVar(var);
+
+	_invalidateVar(varname);
+
+	return(0);
+}
+
+int DataMgr::RemoveExpressionVar(string varname) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
+	DerivedVar *var = _dvm.GetVar(varname);
+	if (exprVarFormula(var).empty()) return(0);
+
+	vector <string> dependants = _getDependants(varname);
+	if (! dependants.empty()) {
+		SetErrMsg(
+			"Variable %s is used by variable %s",
+			varname.c_str(), dependants[0].c_str()
+		);
+		return(-1);
+	}
+
+	_invalidateVar(varname);
+
+	_dvm.RemoveVar(var);
+	delete var;
+
+	return(0);
+}
+
+vector <string> DataMgr::GetExpressionVarNames() const {
+
+	vector <string> names;
+	vector <string> dvarnames = _dvm.GetDataVarNames();
+	for (int i=0; i<dvarnames.size(); i++) {
+		if (! exprVarFormula(_dvm.GetVar(dvarnames[i])).empty()) {
+			names.push_back(dvarnames[i]);
+		}
+	}
+	return(names);
+}
+
+string DataMgr::GetExpressionVarFormula(string varname) const {
+	return(exprVarFormula(_dvm.GetVar(varname)));
+}
+
+int DataMgr::AddDerivedVar(DerivedDataVar *var) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
+	assert(var);
+	string varname = var->GetName();
+
+	DC::BaseVar dummy;
+	DerivedVar *oldVar = _dvm.GetVar(varname);
+	bool added = find(
+		_addedVarNames.begin(), _addedVarNames.end(), varname
+	) != _addedVarNames.end();
+	if (_dc->GetBaseVarInfo(varname, dummy) || (oldVar && ! added)) {
+		SetErrMsg("Variable %s already exists", varname.c_str());
+		delete var;
+		return(-1);
+	}
+
+	int rc = var->Initialize();
+	if (rc<0) {
+		delete var;
+		return(-1);
+	}
+
+	vector <string> inputs = var->GetInputs();
+	for (int i=0; i<inputs.size(); i++) {
+		if (_dependsOn(inputs[i], varname)) {
+			SetErrMsg(
+				"Circular definition of variable %s", varname.c_str()
+			);
+			delete var;
+			return(-1);
+		}
+	}
+
+	if (oldVar) {
+		_dvm.RemoveVar(oldVar);
+		delete oldVar;
+	}
+	else {
+		_addedVarNames.push_back(varname);
+	}
+	_dvm.AddDataVar(var);
+
+	_invalidateVar(varname);
+
+	return(0);
+}
+
+int DataMgr::RemoveDerivedVar(string varname) {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
+	vector <string>::iterator itr = find(
+		_addedVarNames.begin(), _addedVarNames.end(), varname
+	);
+	if (itr == _addedVarNames.end()) return(0);
+
+	vector <string> dependants = _getDependants(varname);
+	if (! dependants.empty()) {
+		SetErrMsg(
+			"Variable %s is used by variable %s",
+			varname.c_str(), dependants[0].c_str()
+		);
+		return(-1);
+	}
+
+	_addedVarNames.erase(itr);
+
+	DerivedVar *var = _dvm.GetVar(varname);
+	if (! var) return(0);
+
+	_invalidateVar(varname);
+
+	_dvm.RemoveVar(var);
+	delete var;
+
+	return(0);
+}
+
+vector <string> DataMgr::GetDerivedVarNames() const {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
+	return(_addedVarNames);
+}
+
+const DerivedDataVar *DataMgr::GetDerivedVar(string varname) const {
+	std::lock_guard<std::recursive_mutex> guard(_mutex);
+
+	if (find(
+		_addedVarNames.begin(), _addedVarNames.end(), varname
+	) == _addedVarNames.end()) return(NULL);
+
+	return(dynamic_cast <const DerivedDataVar *> (_dvm.GetVar(varname)));
+}
+
+// Return the derived data variables computed, directly or indirectly,
+// from varname
+//
+vector <string> DataMgr::_getDependants(string varname) const {
+	vector <string> dependants;
+
+	vector <string> names = _dvm.GetDataVarNames();
+	for (int i=0; i<names.size(); i++) {
+		if (names[i] == varname) continue;
+
+		if (_dependsOn(names[i], varname)) dependants.push_back(names[i]);
+	}
+	return(dependants);
+}
+
+// Forget the data and metadata cached for varname and the variables
+// computed from it, after its definition has changed. Unlike Clear()
+// this leaves other variables cached, and regions locked by callers 
+// in place until they are unlocked.
+//
+void DataMgr::_invalidateVar(string varname) {
+	vector <string> names = _getDependants(varname);
+	names.push_back(varname);
+
+	for (int i=0; i<names.size(); i++) {
+		_varInfoCache.PurgeVariable(names[i]);
+	}
+
+	// Shared grid keys begin with the time step and variable name (see
+	// GetSharedVariable()). Grids still referenced elsewhere stay locked 
+	// until released but are not handed out again.
+	//
+	auto affected = [&names](const string &key) -> bool {
+		size_t p = key.find(':');
+		size_t q = key.find(':', p+1);
+		if (p == string::npos || q == string::npos) return(false);
+		string name = key.substr(p+1, q-p-1);
+		return(find(names.begin(), names.end(), name) != names.end());
+	};
+
+	list <shared_grid_t>::iterator sitr = _sharedGrids.begin();
+	while (sitr != _sharedGrids.end()) {
+		if (affected(sitr->first)) sitr = _sharedGrids.erase(sitr);
+		else ++sitr;
+	}
+
+	map <string, std::weak_ptr <const Grid> >::iterator ref;
+	ref = _sharedGridRefs.begin();
+	while (ref != _sharedGridRefs.end()) {
+		if (affected(ref->first)) ref = _sharedGridRefs.erase(ref);
+		else ++ref;
+	}
+
+	// A locked region is renamed rather than freed. An empty name 
+	// matches no request, and _free_lru() reclaims the region once the
+	// last lock is released.
+	//
+	list <region_t>::iterator itr = _regionsList.begin();
+	while (itr != _regionsList.end()) {
+		if (find(names.begin(), names.end(), itr->varname) == names.end()) {
+			++itr;
+		}
+		else if (itr->lock_counter > 0) {
+			itr->varname.clear();
+			++itr;
+		}
+		else {
+			if (itr->blks) _blk_mem_mgr->FreeMem(itr->blks);
+			itr = _regionsList.erase(itr);
+		}
+	}
+}
+
+// Return true if the derived variable varname is computed, directly or
+// indirectly, from target
+//
+bool DataMgr::_dependsOn(string varname, string target) const {
+	if (varname == target) return(true);
+
+	DerivedVar *var = _dvm.GetVar(varname);
+	if (! var) return(false);
+
+	vector <string> inputs = var->GetInputs();
+	for (int i=0; i<inputs.size(); i++) {
+		if (_dependsOn(inputs[i], target)) return(true);
+	}
+	return(false);
+}
 
 namespace VAPoR {
 
@@ -117,29 +117,21 @@ int DataMgrUtils::ConvertLonLatToPCS(
 	return 0;
 }
 
-int DataMgrUtils::GetGrids(
-	DataMgr *dataMgr,
-	size_t ts, const vector<string>& varnames, 
-	const vector <double> &minExtsReq, const vector <double> &maxExtsReq,
-	bool useLowerAccuracy,
-	int* refLevel, int* lod, vector <Grid*> &grids
-) {
-	grids.clear();
-	assert(minExtsReq.size() == maxExtsReq.size());
+namespace {
 
-
-	for (int i=0; i<varnames.size(); i++) grids.push_back(NULL);
-	
-	// First, find an lod and a refinement level that will work with 
-	// all variables.
-	//
+// Find an lod and a refinement level that will work with all variables
+//
+int get_levels(
+	DataMgr *dataMgr, size_t ts, const vector<string>& varnames, 
+	bool useLowerAccuracy, int* refLevel, int* lod
+) {
 	int tempRefLevel = *refLevel;
 	int tempLOD = *lod;
 	for (int i = 0; i< varnames.size(); i++){
 		if (varnames[i].empty()) continue;
 
 		size_t maxRefLevel;
-		bool status = MaxXFormPresent(dataMgr, ts, varnames[i], maxRefLevel);
+		bool status = DataMgrUtils::MaxXFormPresent(dataMgr, ts, varnames[i], maxRefLevel);
 		if (! status) {
 			MyBase::SetErrMsg(
 				"Variable not present at required refinement and LOD"
@@ -150,7 +142,7 @@ int DataMgrUtils::GetGrids(
 		tempRefLevel = std::min((int) maxRefLevel, tempRefLevel);
 
 		size_t maxLOD;
-		status = MaxLODPresent(dataMgr, ts, varnames[i], maxLOD);
+		status = DataMgrUtils::MaxLODPresent(dataMgr, ts, varnames[i], maxLOD);
 		if (! status) {
 			MyBase::SetErrMsg(
 				"Variable not present at required refinement and LOD"
@@ -171,9 +163,31 @@ int DataMgrUtils::GetGrids(
 			);
 			return -1;
 		}
-	}	  
+	}
+
+	return(0);
+}
+
+};
+
+int DataMgrUtils::GetGrids(
+	DataMgr *dataMgr,
+	size_t ts, const vector<string>& varnames, 
+	const vector <double> &minExtsReq, const vector <double> &maxExtsReq,
+	bool useLowerAccuracy,
+	int* refLevel, int* lod, vector <Grid*> &grids
+) {
+	grids.clear();
+	assert(minExtsReq.size() == maxExtsReq.size());
+
 
+	for (int i=0; i<varnames.size(); i++) grids.push_back(NULL);
 	
+	int rc = get_levels(
+		dataMgr, ts, varnames, useLowerAccuracy, refLevel, lod
+	);
+	if (rc<0) return(rc);
+
 	// Now obtain a regular grid for each valid variable
 	//
 	for (int i = 0; i<varnames.size(); i++){
@@ -225,6 +239,36 @@ int DataMgrUtils::GetGrids(
 	return(0);
 }
 
+int DataMgrUtils::GetSharedGrid(
+	DataMgr *dataMgr,
+	size_t ts, string varname, 
+	const vector <double> &minExtsReq, const vector <double> &maxExtsReq,
+	bool useLowerAccuracy,
+	int* refLevel, int* lod, std::shared_ptr <const Grid> &grid
+) {
+	grid.reset();
+
+	if (varname == "") {
+		MyBase::SetErrMsg("Cannot get grid for variable \"\"");
+		return -1;
+	}
+
+	int rc = get_levels(
+		dataMgr, ts, vector <string> (1, varname), useLowerAccuracy,
+		refLevel, lod
+	);
+	if (rc<0) return(rc);
+
+	grid = dataMgr->GetSharedVariable(
+		ts, varname, *refLevel, *lod, minExtsReq, maxExtsReq
+	);
+	if (! grid) {
+		MyBase::SetErrMsg("Error retrieving variable data");
+		return -1;
+	}
+	return 0;
+}
+
 int DataMgrUtils::GetGrids(
 	DataMgr *dataMgr, size_t ts, const vector<string>& varnames, 
 	bool useLowerAccuracy,
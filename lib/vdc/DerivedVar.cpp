@@ -1,9 +1,11 @@
 #include <cassert>
 #include <sstream>
 #include <algorithm>
+#include <set>
 #include <vapor/UDUnitsClass.h>
 #include <vapor/NetCDFCollection.h>
 #include <vapor/utils.h>
+#include <vapor/ThreadPool.h>
 #include <vapor/DerivedVar.h>
 
 using namespace VAPoR;
@@ -69,19 +71,6 @@ size_t blockSize(const vector <size_t> &bs) {
 	return(sz);
 }
 
-vector <size_t> increment(vector <size_t> dims, vector <size_t> coord) {
-	assert(dims.size() == coord.size());
-
-	for (int i=0; i<coord.size(); i++) {
-		coord[i] += 1;
-		if (coord[i] < (dims[i])) {
-			break;
-		}
-		coord[i] = 0;
-	}
-	return(coord);
-}
-
 
 // Product of elements in a vector
 //
@@ -148,19 +137,22 @@ void blockit(
 	size_t nby = bdims.size() > 1 ? bdims[1] : 1;
 	size_t nbx = bdims.size() > 0 ? bdims[0] : 1;
 
-	float *blockptr = blocks;
-	vector <size_t> bcoord(bdims.size(), 0);
+	// Blocks are independent, so extract them in parallel. Block b
+	// has linear block coordinate b, fastest varying dimension first
+	//
+	ThreadPool::Instance()->ParallelFor(
+		0, nbx*nby*nbz, 0, [&](size_t b0, size_t b1) {
 
-	for (size_t zb=0; zb<nbz; zb++) {
-	for (size_t yb=0; yb<nby; yb++) {
-	for (size_t xb=0; xb<nbx; xb++) {
+		vector <size_t> bcoord;
+		for (size_t b=b0; b<b1; b++) {
+			bcoord.clear();
+			if (bdims.size() > 0) bcoord.push_back(b % nbx);
+			if (bdims.size() > 1) bcoord.push_back((b / nbx) % nby);
+			if (bdims.size() > 2) bcoord.push_back(b / (nbx * nby));
 
-		extractBlock(data, dims, bcoord, bs, blockptr); 
-		blockptr += block_size;
-		bcoord = increment(bdims, bcoord);
-	}
-	}
-	}
+			extractBlock(data, dims, bcoord, bs, blocks + b*block_size); 
+		}
+	});
 }
 	
 
@@ -371,15 +363,17 @@ void resampleToStaggered(
 	size_t nxs = outDimsT[0];  // staggered dimension
 	size_t i0 = outMin[stagDim] > inMin[stagDim] ? 0 : 1;
 
-	for (size_t k=0; k<nz; k++) {
-	for (size_t j=0; j<ny; j++) {
-	for (size_t i=0, ii=i0; i<nx-1; i++, ii++) {
-		src[k*nxs*ny + j*nxs + ii] = 0.5 * (
-			buf[k*nx*ny + j*nx + i] + buf[k*nx*ny + j*nx + i+1]
-		);
-	}
-	}
-	}
+	ThreadPool::Instance()->ParallelFor(0, nz*ny, 0, [&](size_t r0, size_t r1) {
+		for (size_t r=r0; r<r1; r++) {
+			size_t k = r / ny;
+			size_t j = r % ny;
+			for (size_t i=0, ii=i0; i<nx-1; i++, ii++) {
+				src[k*nxs*ny + j*nxs + ii] = 0.5 * (
+					buf[k*nx*ny + j*nx + i] + buf[k*nx*ny + j*nx + i+1]
+				);
+			}
+		}
+	});
 
 	// Next extrapolate boundary points if needed
 	//
@@ -584,6 +578,13 @@ int DerivedVar::_getVarBlock(
 	return(dc->CloseVariable(fd));
 }
 
+void DerivedVar::_blockit(
+	const float *data, const vector <size_t> &dims,
+	const vector <size_t> &bs, float *blocks
+) {
+	blockit(data, dims, bs, blocks);
+}
+
 
 
 ////////////////////////////////////////////////////////////////////////////// 
@@ -1111,18 +1112,40 @@ int DerivedCoordVar_WRFTime::Initialize() {
 
 	// Read all of the formatted time strings up front - it's a 1D array
 	// so we can simply store the results in memory - and convert from
-	// a formatted time string to seconds since the EPOCH
+	// a formatted time string to seconds since the EPOCH. Times decoded
+	// from a file are kept in the collection's index, if any, so that 
+	// files need not be opened to decode them again.
 	//
+	map <string, vector <double> > fileTimes;
+	std::set <string> decoded;
 	_times.clear();
 	for (size_t ts = 0; ts < numTS; ts++) {
 
+		string file;
+		size_t local_ts;
+		int rc = _ncdfc->GetFile(ts, _wrfTimeVar, file, local_ts);
+		if (rc<0) {
+			SetErrMsg("Can't read time variable");
+			return(-1);
+		}
+
+		vector <double> &times = fileTimes[file];
+		if (times.empty() && ! decoded.count(file)) {
+			(void) _ncdfc->GetIndexedValues(file, _wrfTimeVar, times);
+		}
+		if (local_ts < times.size() && ! decoded.count(file)) {
+			_times.push_back(times[local_ts] * _p2si);
+			continue;
+		}
+		decoded.insert(file);
+
 		int fd = _ncdfc->OpenRead(ts, _wrfTimeVar);
 		if (fd<0) {
 			SetErrMsg("Can't read time variable");
 			return(-1);
 		}
 
-		int rc = _ncdfc->Read(buf, fd);
+		rc = _ncdfc->Read(buf, fd);
 		if (rc<0) {
 			SetErrMsg("Can't read time variable");
 			_ncdfc->Close(fd);
@@ -1143,13 +1166,23 @@ int DerivedCoordVar_WRFTime::Initialize() {
 			}
 		}
 
-		_times.push_back(
-			udunits.EncodeTime(year, mon, mday, hour, min, sec) * _p2si
-		);
+		double seconds = udunits.EncodeTime(year, mon, mday, hour, min, sec);
+		if (times.size() <= local_ts) times.resize(local_ts+1);
+		times[local_ts] = seconds;
+
+		_times.push_back(seconds * _p2si);
 
 	}
 	delete [] buf;
 
+	std::set <string>::const_iterator itr;
+	for (itr = decoded.begin(); itr != decoded.end(); ++itr) {
+		_ncdfc->SetIndexedValues(*itr, _wrfTimeVar, fileTimes[*itr]);
+	}
+	bool enable = EnableErrMsg(false);
+	if (_ncdfc->FlushIndex() < 0) SetErrCode(0);
+	(void) EnableErrMsg(enable); 
+
 	// The NetCDFCollection class doesn't handle the WRF time
 	// variable. Hence, the time steps aren't sorted. Sort them now and
 	// create a lookup table to map a time index to the correct time step
@@ -0,0 +1,422 @@
+#include <cassert>
+#include <algorithm>
+#include <vapor/ThreadPool.h>
+#include <vapor/DerivedVarExpr.h>
+
+using namespace VAPoR;
+using namespace Wasp;
+
+namespace {
+
+size_t numElements(
+	const vector <size_t> &min, const vector <size_t> &max
+) {
+	assert(min.size() == max.size());
+
+	size_t nElements = 1;
+	for (int i=0; i<min.size(); i++) {
+		nElements *= (max[i] - min[i] + 1);
+	}
+	return(nElements);
+}
+
+// Number of elements in the blocks spanned by a region
+//
+size_t numBlockElements(
+	const vector <size_t> &min, const vector <size_t> &max,
+	const vector <size_t> &bs
+) {
+	size_t nElements = 1;
+	for (int i=0; i<min.size(); i++) {
+		nElements *= (max[i] / bs[i] - min[i] / bs[i] + 1) * bs[i];
+	}
+	return(nElements);
+}
+
+};
+
+DerivedDataVarExpr::DerivedDataVarExpr(
+	string varName, DC *dc, DC *derivedDC, string formula, string units
+) : DerivedDataVar(varName) {
+
+	_dc = dc;
+	_derivedDC = derivedDC;
+	_formula = formula;
+	_units = units;
+	_blockwise = false;
+}
+
+int DerivedDataVarExpr::Initialize() {
+
+	if (_expr.Parse(_formula) < 0) return(-1);
+
+	vector <string> inputs = _expr.GetVarNames();
+	if (inputs.empty()) {
+		SetErrMsg(
+			"Expression \"%s\" for variable %s references no variables",
+			_formula.c_str(), _derivedVarName.c_str()
+		);
+		return(-1);
+	}
+
+	// The input of highest rank defines the grid
+	//
+	vector <DC::DataVar> dvars(inputs.size());
+	vector <vector <size_t> > dims(inputs.size());
+	vector <vector <size_t> > bs(inputs.size());
+	_refVar.clear();
+	int refIndex = -1;
+	for (int i=0; i<inputs.size(); i++) {
+		if (inputs[i] == _derivedVarName) {
+			SetErrMsg(
+				"Expression for variable %s refers to itself",
+				_derivedVarName.c_str()
+			);
+			return(-1);
+		}
+
+		DC *dc = _getDC(inputs[i]);
+		if (! dc) {
+			SetErrMsg(
+				"Undefined variable \"%s\" in expression \"%s\"",
+				inputs[i].c_str(), _formula.c_str()
+			);
+			return(-1);
+		}
+		(void) dc->GetDataVarInfo(inputs[i], dvars[i]);
+
+		int rc = dc->GetDimLensAtLevel(inputs[i], -1, dims[i], bs[i]);
+		if (rc<0) return(-1);
+
+		if (refIndex < 0 || dims[i].size() > dims[refIndex].size()) {
+			refIndex = i;
+		}
+	}
+	_refVar = inputs[refIndex];
+	const vector <size_t> &refDims = dims[refIndex];
+
+	_blockwise = true;
+	_broadcast.clear();
+	_hasMissing.clear();
+	_missingValues.clear();
+	for (int i=0; i<inputs.size(); i++) {
+		vector <size_t> d = dims[i];
+		bool broadcast = d.size() == 2 && refDims.size() == 3;
+		if (broadcast) d.push_back(refDims[2]);
+
+		if (d != refDims) {
+			SetErrMsg(
+				"Variables \"%s\" and \"%s\" in expression \"%s\" have "
+				"different dimensions",
+				_refVar.c_str(), inputs[i].c_str(), _formula.c_str()
+			);
+			return(-1);
+		}
+		_broadcast.push_back(broadcast);
+		if (broadcast || bs[i] != bs[refIndex]) _blockwise = false;
+		_hasMissing.push_back(dvars[i].GetHasMissing());
+		_missingValues.push_back(dvars[i].GetMissingValue());
+	}
+
+	const DC::DataVar &ref = dvars[refIndex];
+
+	// Take the time coordinate from a time varying input, if any
+	//
+	string timeCoordVar = ref.GetTimeCoordVar();
+	for (int i=0; i<dvars.size() && timeCoordVar.empty(); i++) {
+		timeCoordVar = dvars[i].GetTimeCoordVar();
+	}
+
+	vector <bool>::const_iterator itr = find(
+		_hasMissing.begin(), _hasMissing.end(), true
+	);
+	if (itr != _hasMissing.end()) {
+		_dataVarInfo = DC::DataVar(
+			_derivedVarName, _units, DC::FLOAT, ref.GetWName(),
+			ref.GetCRatios(), ref.GetPeriodic(), ref.GetMeshName(),
+			timeCoordVar, ref.GetSamplingLocation(),
+			_missingValues[itr - _hasMissing.begin()]
+		);
+	}
+	else {
+		_dataVarInfo = DC::DataVar(
+			_derivedVarName, _units, DC::FLOAT, ref.GetWName(),
+			ref.GetCRatios(), ref.GetPeriodic(), ref.GetMeshName(),
+			timeCoordVar, ref.GetSamplingLocation()
+		);
+	}
+
+	return(0);
+}
+
+bool DerivedDataVarExpr::GetBaseVarInfo(DC::BaseVar &var) const {
+	var = _dataVarInfo;
+	return(true);
+}
+
+bool DerivedDataVarExpr::GetDataVarInfo(DC::DataVar &var) const {
+	var = _dataVarInfo;
+	return(true);
+}
+
+size_t DerivedDataVarExpr::GetNumRefLevels() const {
+	vector <string> inputs = _expr.GetVarNames();
+
+	size_t nlevels = 0;
+	for (int i=0; i<inputs.size(); i++) {
+		DC *dc = _getDC(inputs[i]);
+		if (! dc) return(1);
+
+		size_t n = dc->GetNumRefLevels(inputs[i]);
+		nlevels = i == 0 ? n : std::min(nlevels, n);
+	}
+	return(std::max(nlevels, (size_t) 1));
+}
+
+int DerivedDataVarExpr::GetDimLensAtLevel(
+	int level, std::vector <size_t> &dims_at_level,
+	std::vector <size_t> &bs_at_level
+) const {
+	dims_at_level.clear();
+	bs_at_level.clear();
+
+	DC *dc = _getDC(_refVar);
+	if (! dc) {
+		SetErrMsg("Undefined variable \"%s\"", _refVar.c_str());
+		return(-1);
+	}
+
+	return(dc->GetDimLensAtLevel(_refVar, level, dims_at_level, bs_at_level));
+}
+
+int DerivedDataVarExpr::OpenVariableRead(
+	size_t ts, int level, int lod
+) {
+
+	DC::FileTable::FileObject *f = new DC::FileTable::FileObject(
+		ts, _derivedVarName, level, lod
+	);
+
+	return(_fileTable.AddEntry(f));
+}
+
+int DerivedDataVarExpr::CloseVariable(int fd) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	_fileTable.RemoveEntry(fd);
+	delete f;
+
+	return(0);
+}
+
+int DerivedDataVarExpr::ReadRegionBlock(
+	int fd,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	vector <size_t> dims, bs;
+	int rc = GetDimLensAtLevel(f->GetLevel(), dims, bs);
+	if (rc<0) return(-1);
+
+	// Inputs stored with the same blocking as the result are evaluated
+	// block for block, padding included
+	//
+	if (dims == bs || _blockwise) {
+		return(_read(
+			f->GetTS(), f->GetLevel(), f->GetLOD(), min, max, dims != bs,
+			region
+		));
+	}
+
+	// Exclude block padding from the region computed
+	//
+	vector <size_t> myMax = max;
+	for (int i=0; i<myMax.size(); i++) {
+		if (myMax[i] >= dims[i]) myMax[i] = dims[i] - 1;
+	}
+
+	vector <size_t> roidims;
+	for (int i=0; i<min.size(); i++) {
+		roidims.push_back(myMax[i] - min[i] + 1);
+	}
+
+	float *buf = new float[numElements(min, myMax)];
+
+	rc = _read(f->GetTS(), f->GetLevel(), f->GetLOD(), min, myMax, false, buf);
+	if (rc<0) {
+		delete [] buf;
+		return(-1);
+	}
+
+	_blockit(buf, roidims, bs, region);
+
+	delete [] buf;
+
+	return(0);
+}
+
+int DerivedDataVarExpr::ReadRegion(
+	int fd,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	return(_read(
+		f->GetTS(), f->GetLevel(), f->GetLOD(), min, max, false, region
+	));
+}
+
+bool DerivedDataVarExpr::VariableExists(
+	size_t ts,
+	int reflevel,
+	int lod
+) const {
+
+	vector <string> inputs = _expr.GetVarNames();
+	for (int i=0; i<inputs.size(); i++) {
+		DC *dc = _getDC(inputs[i]);
+		if (! dc || ! dc->VariableExists(ts, inputs[i], reflevel, lod)) {
+			return(false);
+		}
+	}
+	return(true);
+}
+
+DC *DerivedDataVarExpr::_getDC(string varname) const {
+	DC::DataVar dvar;
+	if (_dc->GetDataVarInfo(varname, dvar)) return(_dc);
+	if (_derivedDC && _derivedDC->GetDataVarInfo(varname, dvar)) {
+		return(_derivedDC);
+	}
+	return(NULL);
+}
+
+int DerivedDataVarExpr::_read(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max,
+	bool blocked, float *region
+) {
+	assert(! blocked || _blockwise);
+
+	vector <size_t> dims, bs;
+	int rc = GetDimLensAtLevel(level, dims, bs);
+	if (rc<0) return(-1);
+
+	size_t n = blocked ?
+		numBlockElements(min, max, bs) : numElements(min, max);
+
+	// Broadcast inputs repeat with a period of one horizontal slice
+	//
+	vector <size_t> min2d(min.begin(), min.begin() + std::min(min.size(), (size_t) 2));
+	vector <size_t> max2d(max.begin(), max.begin() + std::min(max.size(), (size_t) 2));
+	size_t n2d = numElements(min2d, max2d);
+
+	vector <string> inputs = _expr.GetVarNames();
+	vector <size_t> periods(inputs.size(), 0);
+	size_t total = 0;
+	for (int i=0; i<inputs.size(); i++) {
+		if (_broadcast[i]) periods[i] = n2d;
+		total += _broadcast[i] ? n2d : n;
+	}
+
+	float *buf = new float[total];
+	vector <const float *> ptrs;
+
+	float *ptr = buf;
+	for (int i=0; i<inputs.size(); i++) {
+		DC *dc = _getDC(inputs[i]);
+		if (! dc) {
+			SetErrMsg("Undefined variable \"%s\"", inputs[i].c_str());
+			delete [] buf;
+			return(-1);
+		}
+
+		if (blocked) {
+			rc = _getVarBlock(dc, ts, inputs[i], level, lod, min, max, ptr);
+		}
+		else if (_broadcast[i]) {
+			rc = _getVar(dc, ts, inputs[i], level, lod, min2d, max2d, ptr);
+		}
+		else {
+			rc = _getVar(dc, ts, inputs[i], level, lod, min, max, ptr);
+		}
+		if (rc<0) {
+			delete [] buf;
+			return(-1);
+		}
+
+		ptrs.push_back(ptr);
+		ptr += _broadcast[i] ? n2d : n;
+	}
+
+	_evaluate(ptrs, periods, n, region);
+
+	delete [] buf;
+
+	return(0);
+}
+
+// Evaluate the expression over n elements in parallel. An input with a
+// non-zero period p supplies element (i % p) to output element i.
+//
+void DerivedDataVarExpr::_evaluate(
+	const vector <const float *> &inputs, const vector <size_t> &periods,
+	size_t n, float *region
+) const {
+
+	int outMissingIndex = find(
+		_hasMissing.begin(), _hasMissing.end(), true
+	) - _hasMissing.begin();
+	float outMissing = outMissingIndex < _hasMissing.size() ?
+		_missingValues[outMissingIndex] : 0.0;
+
+	ThreadPool::Instance()->ParallelFor(
+		0, n, 16 * Expression::ChunkSize,
+		[&](size_t begin, size_t end) {
+
+		vector <float> scratch(_expr.GetScratchSize());
+		vector <const float *> ptrs(inputs.size());
+
+		size_t start = begin;
+		while (start < end) {
+			size_t len = end - start;
+			for (int i=0; i<inputs.size(); i++) {
+				size_t offset = start;
+				if (periods[i]) {
+					offset = start % periods[i];
+					len = std::min(len, periods[i] - offset);
+				}
+				ptrs[i] = inputs[i] + offset;
+			}
+
+			float *out = region + start;
+			_expr.Evaluate(ptrs.data(), len, out, scratch.data());
+
+			for (int i=0; i<inputs.size(); i++) {
+				if (! _hasMissing[i]) continue;
+
+				const float *in = ptrs[i];
+				float mv = _missingValues[i];
+				for (size_t j=0; j<len; j++) {
+					if (in[j] == mv) out[j] = outMissing;
+				}
+			}
+
+			start += len;
+		}
+	});
+}
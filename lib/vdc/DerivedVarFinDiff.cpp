@@ -0,0 +1,755 @@
+#include <cassert>
+#include <cctype>
+#include <cstdlib>
+#include <algorithm>
+#include <vapor/ThreadPool.h>
+#include <vapor/DerivedVarFinDiff.h>
+
+using namespace VAPoR;
+using namespace Wasp;
+
+namespace {
+
+const char *Operators[] = {
+	"grad_x", "grad_y", "grad_z", "div", "curl_x", "curl_y", "curl_z", NULL
+};
+
+size_t numElements(
+	const vector <size_t> &min, const vector <size_t> &max
+) {
+	assert(min.size() == max.size());
+
+	size_t nElements = 1;
+	for (int i=0; i<min.size(); i++) {
+		nElements *= (max[i] - min[i] + 1);
+	}
+	return(nElements);
+}
+
+string trim(string s) {
+	size_t b = s.find_first_not_of(" \t\n");
+	if (b == string::npos) return("");
+	size_t e = s.find_last_not_of(" \t\n");
+	return(s.substr(b, e - b + 1));
+}
+
+bool isIdentifier(const string &s) {
+	if (s.empty() || ! (isalpha((unsigned char) s[0]) || s[0] == '_')) {
+		return(false);
+	}
+	for (int i=1; i<s.size(); i++) {
+		if (! (isalnum((unsigned char) s[i]) || s[i] == '_')) return(false);
+	}
+	return(true);
+}
+
+// Finite difference stencil: offsets relative to the point of
+// evaluation, in samples, and weights for unit grid spacing
+//
+struct stencil_t {
+	int n;
+	int off[6];
+	float c[6];
+};
+
+const stencil_t Forward2 = {2, {0, 1}, {-1.0f, 1.0f}};
+const stencil_t Center2 = {2, {-1, 1}, {-1.0f/2, 1.0f/2}};
+const stencil_t Backward2 = {2, {-1, 0}, {-1.0f, 1.0f}};
+
+const stencil_t Forward4 = {3, {0, 1, 2}, {-3.0f/2, 4.0f/2, -1.0f/2}};
+const stencil_t Center4 = {
+	4, {-2, -1, 1, 2}, {1.0f/12, -8.0f/12, 8.0f/12, -1.0f/12}
+};
+const stencil_t Backward4 = {3, {-2, -1, 0}, {1.0f/2, -4.0f/2, 3.0f/2}};
+
+const stencil_t Forward6 = {
+	4, {0, 1, 2, 3}, {-11.0f/6, 18.0f/6, -9.0f/6, 2.0f/6}
+};
+const stencil_t Center6 = {
+	6, {-3, -2, -1, 1, 2, 3},
+	{-1.0f/60, 9.0f/60, -45.0f/60, 45.0f/60, -9.0f/60, 1.0f/60}
+};
+const stencil_t Backward6 = {
+	4, {-3, -2, -1, 0}, {-2.0f/6, 9.0f/6, -18.0f/6, 11.0f/6}
+};
+
+// Highest order no greater than order that the number of samples, n,
+// along an axis supports
+//
+int effectiveOrder(int order, size_t n) {
+	if (order >= 6 && n >= 6) return(6);
+	if (order >= 4 && n >= 4) return(4);
+	return(2);
+}
+
+// Stencil for global sample g of n along an axis
+//
+const stencil_t &stencil(int order, size_t g, size_t n) {
+	size_t h = order / 2;
+	if (order == 6) {
+		return(g < h ? Forward6 : g >= n - h ? Backward6 : Center6);
+	}
+	else if (order == 4) {
+		return(g < h ? Forward4 : g >= n - h ? Backward4 : Center4);
+	}
+	return(g < h ? Forward2 : g >= n - h ? Backward2 : Center2);
+}
+
+// out[i] = sum of s.c[k] * f[i + s.off[k] * stride], for i < n. One
+// loop per stencil point so that each vectorizes.
+//
+inline void apply(
+	const stencil_t &s, const float *f, ptrdiff_t stride, size_t n,
+	float *out
+) {
+	const float *f0 = f + s.off[0] * stride;
+	float c0 = s.c[0];
+	for (size_t i=0; i<n; i++) out[i] = c0 * f0[i];
+
+	for (int k=1; k<s.n; k++) {
+		const float *fk = f + s.off[k] * stride;
+		float ck = s.c[k];
+		for (size_t i=0; i<n; i++) out[i] += ck * fk[i];
+	}
+}
+
+// Derivative along axis, in grid index space, of f, whose dimensions are
+// fdims. The derivative is evaluated over the sub-box of f starting at
+// offset with dimensions odims, whose first sample along axis is the
+// global sample gmin of n. f must extend far enough past the sub-box for
+// the stencils used.
+//
+void deriv(
+	const float *f, const size_t fdims[3], const size_t offset[3],
+	const size_t odims[3], int axis, size_t gmin, size_t n, int order,
+	float *out
+) {
+	order = effectiveOrder(order, n);
+	size_t h = order / 2;
+
+	const size_t fstride[3] = {1, fdims[0], fdims[0] * fdims[1]};
+	const stencil_t &center = order == 6 ? Center6 :
+		order == 4 ? Center4 : Center2;
+
+	// Range of the sub-box along X where centered differences apply
+	//
+	size_t ib = 0, ie = 0;
+	if (axis == 0) {
+		ib = gmin < h ? std::min(h - gmin, odims[0]) : 0;
+		ie = n - h > gmin ? std::min(n - h - gmin, odims[0]) : 0;
+		ie = std::max(ib, ie);
+	}
+
+	ThreadPool::Instance()->ParallelFor(
+		0, odims[1] * odims[2], 0,
+		[&](size_t begin, size_t end) {
+
+		for (size_t r=begin; r<end; r++) {
+			size_t j = r % odims[1];
+			size_t k = r / odims[1];
+
+			const float *frow = f + (k + offset[2]) * fstride[2] +
+				(j + offset[1]) * fstride[1] + offset[0];
+			float *orow = out + r * odims[0];
+
+			if (axis == 0) {
+				for (size_t i=0; i<ib; i++) {
+					apply(
+						stencil(order, gmin + i, n), frow + i, 1, 1, orow + i
+					);
+				}
+				apply(center, frow + ib, 1, ie - ib, orow + ib);
+				for (size_t i=ie; i<odims[0]; i++) {
+					apply(
+						stencil(order, gmin + i, n), frow + i, 1, 1, orow + i
+					);
+				}
+			}
+			else {
+				size_t g = gmin + (axis == 1 ? j : k);
+				apply(
+					stencil(order, g, n), frow, fstride[axis], odims[0], orow
+				);
+			}
+		}
+	});
+}
+
+};
+
+DerivedDataVarFinDiff::DerivedDataVarFinDiff(
+	string varName, DC *dc, DC *derivedDC, string formula,
+	const vector <string> &coordVars, string units
+) : DerivedDataVar(varName) {
+
+	_dc = dc;
+	_derivedDC = derivedDC;
+	_formula = formula;
+	_coordVars = coordVars;
+	_units = units;
+	_order = 6;
+	_terrainFollowing = false;
+}
+
+bool DerivedDataVarFinDiff::IsFinDiffFormula(string formula) {
+	formula = trim(formula);
+	size_t p = formula.find('(');
+	if (p == string::npos) return(false);
+
+	// The operator's argument list must extend to the end of the
+	// formula. Anything else, e.g. "div(U, V) * 2", is an expression.
+	//
+	int depth = 0;
+	for (size_t i=p; i<formula.size(); i++) {
+		if (formula[i] == '(') depth++;
+		else if (formula[i] == ')') depth--;
+		if (depth == 0 && i != formula.size()-1) return(false);
+	}
+	if (depth != 0) return(false);
+
+	string name = trim(formula.substr(0, p));
+	for (int i=0; Operators[i]; i++) {
+		if (name == Operators[i]) return(true);
+	}
+	return(false);
+}
+
+int DerivedDataVarFinDiff::ParseFormula(
+	string formula, string &op, vector <string> &inputs, int &order
+) {
+	op.clear();
+	inputs.clear();
+	order = 6;
+
+	string s = trim(formula);
+	size_t p = s.find('(');
+	if (! IsFinDiffFormula(s) || s[s.size()-1] != ')') {
+		SetErrMsg("Invalid finite difference formula \"%s\"", formula.c_str());
+		return(-1);
+	}
+	op = trim(s.substr(0, p));
+
+	string args = s.substr(p + 1, s.size() - p - 2);
+	size_t start = 0;
+	while (true) {
+		size_t comma = args.find(',', start);
+		inputs.push_back(trim(args.substr(start, comma - start)));
+		if (comma == string::npos) break;
+		start = comma + 1;
+	}
+
+	// An optional trailing integer is the order of accuracy
+	//
+	const string &last = inputs.back();
+	if (! last.empty() && isdigit((unsigned char) last[0])) {
+		order = atoi(last.c_str());
+		inputs.pop_back();
+		if (order != 2 && order != 4 && order != 6) {
+			SetErrMsg(
+				"Invalid order of accuracy in \"%s\", must be 2, 4, or 6",
+				formula.c_str()
+			);
+			return(-1);
+		}
+	}
+
+	for (int i=0; i<inputs.size(); i++) {
+		if (! isIdentifier(inputs[i])) {
+			SetErrMsg(
+				"Invalid variable name \"%s\" in \"%s\"",
+				inputs[i].c_str(), formula.c_str()
+			);
+			return(-1);
+		}
+	}
+
+	size_t n = inputs.size();
+	bool ok;
+	if (op.compare(0, 5, "grad_") == 0) ok = n == 1;
+	else if (op == "div" || op == "curl_z") ok = n == 2 || n == 3;
+	else ok = n == 3;
+
+	if (! ok) {
+		SetErrMsg(
+			"Wrong number of variables for %s in \"%s\"",
+			op.c_str(), formula.c_str()
+		);
+		return(-1);
+	}
+
+	return(0);
+}
+
+int DerivedDataVarFinDiff::Initialize() {
+
+	string op;
+	int rc = ParseFormula(_formula, op, _inputs, _order);
+	if (rc<0) return(-1);
+
+	// All inputs must be data variables sampled on the same grid
+	//
+	vector <size_t> dims;
+	DC::DataVar ref;
+	for (int i=0; i<_inputs.size(); i++) {
+		if (_inputs[i] == _derivedVarName) {
+			SetErrMsg(
+				"Formula for variable %s refers to itself",
+				_derivedVarName.c_str()
+			);
+			return(-1);
+		}
+
+		DC::DataVar dvar;
+		DC *dc = _getDC(_inputs[i]);
+		if (! dc || ! dc->GetDataVarInfo(_inputs[i], dvar)) {
+			SetErrMsg(
+				"Undefined variable \"%s\" in \"%s\"",
+				_inputs[i].c_str(), _formula.c_str()
+			);
+			return(-1);
+		}
+
+		vector <size_t> d, bs;
+		rc = dc->GetDimLensAtLevel(_inputs[i], -1, d, bs);
+		if (rc<0) return(-1);
+
+		if (i == 0) {
+			dims = d;
+			ref = dvar;
+		}
+		else if (d != dims) {
+			SetErrMsg(
+				"Variables \"%s\" and \"%s\" in \"%s\" have different "
+				"dimensions",
+				_inputs[0].c_str(), _inputs[i].c_str(), _formula.c_str()
+			);
+			return(-1);
+		}
+	}
+	if (dims.size() != 2 && dims.size() != 3) {
+		SetErrMsg(
+			"Variables in \"%s\" must be 2D or 3D", _formula.c_str()
+		);
+		return(-1);
+	}
+
+	// Express the operator as a sum of derivatives
+	//
+	_terms.clear();
+	term_t t;
+	if (op.compare(0, 5, "grad_") == 0) {
+		t.input = 0; t.axis = op[5] - 'x'; t.sign = 1.0; _terms.push_back(t);
+	}
+	else if (op == "div") {
+		for (int i=0; i<_inputs.size(); i++) {
+			t.input = i; t.axis = i; t.sign = 1.0; _terms.push_back(t);
+		}
+	}
+	else if (op == "curl_x") {
+		t.input = 2; t.axis = 1; t.sign = 1.0; _terms.push_back(t);
+		t.input = 1; t.axis = 2; t.sign = -1.0; _terms.push_back(t);
+	}
+	else if (op == "curl_y") {
+		t.input = 0; t.axis = 2; t.sign = 1.0; _terms.push_back(t);
+		t.input = 2; t.axis = 0; t.sign = -1.0; _terms.push_back(t);
+	}
+	else {
+		t.input = 1; t.axis = 0; t.sign = 1.0; _terms.push_back(t);
+		t.input = 0; t.axis = 1; t.sign = -1.0; _terms.push_back(t);
+	}
+
+	for (int i=0; i<_terms.size(); i++) {
+		if (_terms[i].axis >= dims.size()) {
+			SetErrMsg(
+				"\"%s\" requires 3D variables", _formula.c_str()
+			);
+			return(-1);
+		}
+	}
+
+	// Coordinate variables must match the grid of the inputs. Those
+	// that don't exist imply unit spacing
+	//
+	_coordVars.resize(dims.size());
+	_terrainFollowing = false;
+	for (int axis=0; axis<_coordVars.size(); axis++) {
+		DC *dc = _getDC(_coordVars[axis]);
+		if (! dc) {
+			_coordVars[axis].clear();
+			continue;
+		}
+
+		vector <size_t> cdims, bs;
+		rc = dc->GetDimLensAtLevel(_coordVars[axis], -1, cdims, bs);
+		if (rc<0) return(-1);
+
+		bool ok;
+		if (cdims.size() > dims.size()) ok = false;
+		else if (cdims.size() == 1) ok = cdims[0] == dims[axis];
+		else ok = equal(cdims.begin(), cdims.end(), dims.begin());
+
+		if (! ok) {
+			SetErrMsg(
+				"Coordinate variable \"%s\" does not match the grid of \"%s\"",
+				_coordVars[axis].c_str(), _inputs[0].c_str()
+			);
+			return(-1);
+		}
+
+		if (axis == 2 && cdims.size() == 3) _terrainFollowing = true;
+	}
+
+	_dataVarInfo = DC::DataVar(
+		_derivedVarName, _units, DC::FLOAT, ref.GetWName(), ref.GetCRatios(),
+		ref.GetPeriodic(), ref.GetMeshName(), ref.GetTimeCoordVar(),
+		ref.GetSamplingLocation()
+	);
+
+	return(0);
+}
+
+bool DerivedDataVarFinDiff::GetBaseVarInfo(DC::BaseVar &var) const {
+	var = _dataVarInfo;
+	return(true);
+}
+
+bool DerivedDataVarFinDiff::GetDataVarInfo(DC::DataVar &var) const {
+	var = _dataVarInfo;
+	return(true);
+}
+
+vector <string> DerivedDataVarFinDiff::GetInputs() const {
+	vector <string> inputs = _inputs;
+	for (int i=0; i<_coordVars.size(); i++) {
+		if (! _coordVars[i].empty()) inputs.push_back(_coordVars[i]);
+	}
+	return(inputs);
+}
+
+size_t DerivedDataVarFinDiff::GetNumRefLevels() const {
+	vector <string> inputs = GetInputs();
+
+	size_t nlevels = 0;
+	for (int i=0; i<inputs.size(); i++) {
+		DC *dc = _getDC(inputs[i]);
+		if (! dc) return(1);
+
+		size_t n = dc->GetNumRefLevels(inputs[i]);
+		nlevels = i == 0 ? n : std::min(nlevels, n);
+	}
+	return(std::max(nlevels, (size_t) 1));
+}
+
+int DerivedDataVarFinDiff::GetDimLensAtLevel(
+	int level, std::vector <size_t> &dims_at_level,
+	std::vector <size_t> &bs_at_level
+) const {
+	dims_at_level.clear();
+	bs_at_level.clear();
+
+	DC *dc = _inputs.empty() ? NULL : _getDC(_inputs[0]);
+	if (! dc) {
+		SetErrMsg("Variable %s is not initialized", _derivedVarName.c_str());
+		return(-1);
+	}
+
+	return(dc->GetDimLensAtLevel(
+		_inputs[0], level, dims_at_level, bs_at_level
+	));
+}
+
+int DerivedDataVarFinDiff::OpenVariableRead(
+	size_t ts, int level, int lod
+) {
+
+	DC::FileTable::FileObject *f = new DC::FileTable::FileObject(
+		ts, _derivedVarName, level, lod
+	);
+
+	return(_fileTable.AddEntry(f));
+}
+
+int DerivedDataVarFinDiff::CloseVariable(int fd) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	_fileTable.RemoveEntry(fd);
+	delete f;
+
+	return(0);
+}
+
+int DerivedDataVarFinDiff::ReadRegionBlock(
+	int fd,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	vector <size_t> dims, bs;
+	int rc = GetDimLensAtLevel(f->GetLevel(), dims, bs);
+	if (rc<0) return(-1);
+
+	// Exclude block padding from the region computed
+	//
+	vector <size_t> myMax = max;
+	for (int i=0; i<myMax.size(); i++) {
+		if (myMax[i] >= dims[i]) myMax[i] = dims[i] - 1;
+	}
+
+	if (dims == bs) {
+		return(ReadRegion(fd, min, myMax, region));
+	}
+
+	vector <size_t> roidims;
+	for (int i=0; i<min.size(); i++) {
+		roidims.push_back(myMax[i] - min[i] + 1);
+	}
+
+	float *buf = new float[numElements(min, myMax)];
+
+	rc = ReadRegion(fd, min, myMax, buf);
+	if (rc<0) {
+		delete [] buf;
+		return(-1);
+	}
+
+	_blockit(buf, roidims, bs, region);
+
+	delete [] buf;
+
+	return(0);
+}
+
+int DerivedDataVarFinDiff::ReadRegion(
+	int fd,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	return(_compute(
+		f->GetTS(), f->GetLevel(), f->GetLOD(), min, max, region
+	));
+}
+
+bool DerivedDataVarFinDiff::VariableExists(
+	size_t ts,
+	int reflevel,
+	int lod
+) const {
+
+	vector <string> inputs = GetInputs();
+	for (int i=0; i<inputs.size(); i++) {
+		DC *dc = _getDC(inputs[i]);
+		if (! dc || ! dc->VariableExists(ts, inputs[i], reflevel, lod)) {
+			return(false);
+		}
+	}
+	return(true);
+}
+
+DC *DerivedDataVarFinDiff::_getDC(string varname) const {
+	if (varname.empty()) return(NULL);
+
+	DC::BaseVar var;
+	if (_dc->GetBaseVarInfo(varname, var)) return(_dc);
+	if (_derivedDC && _derivedDC->GetBaseVarInfo(varname, var)) {
+		return(_derivedDC);
+	}
+	return(NULL);
+}
+
+int DerivedDataVarFinDiff::_readField(
+	size_t ts, int level, int lod, string varname, int axis,
+	const vector <size_t> &min, const vector <size_t> &max,
+	vector <float> &buf
+) const {
+	DC *dc = _getDC(varname);
+	assert(dc);
+
+	// Time invariant variables are stored at the first time step
+	//
+	DC::DataVar dvar;
+	DC::CoordVar cvar;
+	if (dc->GetDataVarInfo(varname, dvar)) {
+		if (dvar.GetTimeCoordVar().empty()) ts = 0;
+	}
+	else if (dc->GetCoordVarInfo(varname, cvar)) {
+		if (cvar.GetTimeDimName().empty()) ts = 0;
+	}
+
+	vector <size_t> dims, bs;
+	int rc = dc->GetDimLensAtLevel(varname, level, dims, bs);
+	if (rc<0) return(-1);
+
+	buf.resize(numElements(min, max));
+
+	if (dims.size() == min.size()) {
+		return(_getVar(dc, ts, varname, level, lod, min, max, buf.data()));
+	}
+
+	// Broadcast a 1D coordinate along its axis, or a 2D coordinate over
+	// the vertical axis
+	//
+	vector <size_t> cmin, cmax;
+	if (dims.size() == 1) {
+		cmin.push_back(min[axis]);
+		cmax.push_back(max[axis]);
+	}
+	else {
+		cmin.assign(min.begin(), min.begin() + dims.size());
+		cmax.assign(max.begin(), max.begin() + dims.size());
+	}
+
+	vector <float> cbuf(numElements(cmin, cmax));
+	rc = _getVar(dc, ts, varname, level, lod, cmin, cmax, cbuf.data());
+	if (rc<0) return(-1);
+
+	size_t nx = max[0] - min[0] + 1;
+	size_t ny = max[1] - min[1] + 1;
+	size_t nz = min.size() > 2 ? max[2] - min[2] + 1 : 1;
+	float *dst = buf.data();
+	for (size_t k=0; k<nz; k++) {
+	for (size_t j=0; j<ny; j++) {
+	for (size_t i=0; i<nx; i++) {
+		if (dims.size() == 1) {
+			*dst++ = cbuf[axis == 0 ? i : axis == 1 ? j : k];
+		}
+		else {
+			*dst++ = cbuf[j * nx + i];
+		}
+	}
+	}
+	}
+
+	return(0);
+}
+
+int DerivedDataVarFinDiff::_compute(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	vector <size_t> dims, bs;
+	int rc = GetDimLensAtLevel(level, dims, bs);
+	if (rc<0) return(-1);
+
+	int ndims = dims.size();
+	assert(min.size() == ndims && max.size() == ndims);
+
+	// Extend the region by a halo wide enough for the centered stencils
+	//
+	size_t h = _order / 2;
+	vector <size_t> hmin(ndims), hmax(ndims);
+	size_t fdims[3] = {1, 1, 1};
+	size_t offset[3] = {0, 0, 0};
+	size_t odims[3] = {1, 1, 1};
+	for (int i=0; i<ndims; i++) {
+		hmin[i] = min[i] > h ? min[i] - h : 0;
+		hmax[i] = std::min(max[i] + h, dims[i] - 1);
+		fdims[i] = hmax[i] - hmin[i] + 1;
+		offset[i] = min[i] - hmin[i];
+		odims[i] = max[i] - min[i] + 1;
+	}
+	size_t n = odims[0] * odims[1] * odims[2];
+
+	// Derivatives of the coordinates along their own axes, and for
+	// terrain following grids of the vertical coordinate along each axis
+	//
+	vector <vector <float> > dcoord(ndims);
+	vector <vector <float> > dzcoord(ndims);
+	for (int axis=0; axis<ndims; axis++) {
+		if (_coordVars[axis].empty() || dims[axis] < 2) continue;
+
+		vector <float> coord;
+		rc = _readField(
+			ts, level, lod, _coordVars[axis], axis, hmin, hmax, coord
+		);
+		if (rc<0) return(-1);
+
+		dcoord[axis].resize(n);
+		deriv(
+			coord.data(), fdims, offset, odims, axis, min[axis], dims[axis],
+			_order, dcoord[axis].data()
+		);
+
+		if (_terrainFollowing && axis == 2) {
+			for (int a=0; a<2; a++) {
+				if (dims[a] < 2) continue;
+				dzcoord[a].resize(n);
+				deriv(
+					coord.data(), fdims, offset, odims, a, min[a], dims[a],
+					_order, dzcoord[a].data()
+				);
+			}
+		}
+	}
+
+	for (size_t i=0; i<n; i++) region[i] = 0.0;
+
+	vector <float> df(n);
+	vector <float> dfdz;
+	vector <vector <float> > fields(_inputs.size());
+	for (int t=0; t<_terms.size(); t++) {
+		const term_t &term = _terms[t];
+		int axis = term.axis;
+
+		// Derivative is zero along an axis with a single sample
+		//
+		if (dims[axis] < 2) continue;
+
+		vector <float> &f = fields[term.input];
+		if (f.empty()) {
+			rc = _readField(
+				ts, level, lod, _inputs[term.input], 0, hmin, hmax, f
+			);
+			if (rc<0) return(-1);
+		}
+
+		deriv(
+			f.data(), fdims, offset, odims, axis, min[axis], dims[axis],
+			_order, df.data()
+		);
+
+		// On a terrain following grid correct horizontal derivatives,
+		// taken along surfaces of constant grid index, to constant height:
+		// df/dx = (df/dx)_k - df/dz * (dz/dx)_k
+		//
+		if (
+			_terrainFollowing && axis < 2 && dims[2] > 1 &&
+			! dzcoord[axis].empty()
+		) {
+			dfdz.resize(n);
+			deriv(
+				f.data(), fdims, offset, odims, 2, min[2], dims[2],
+				_order, dfdz.data()
+			);
+			const float *dz = dcoord[2].data();
+			const float *dza = dzcoord[axis].data();
+			for (size_t i=0; i<n; i++) {
+				df[i] -= dfdz[i] / dz[i] * dza[i];
+			}
+		}
+
+		float sign = term.sign;
+		if (! dcoord[axis].empty()) {
+			const float *dc = dcoord[axis].data();
+			for (size_t i=0; i<n; i++) region[i] += sign * df[i] / dc[i];
+		}
+		else {
+			for (size_t i=0; i<n; i++) region[i] += sign * df[i];
+		}
+	}
+
+	return(0);
+}
@@ -0,0 +1,1061 @@
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <vapor/ThreadPool.h>
+#include <vapor/DerivedVarWRF.h>
+
+using namespace VAPoR;
+using namespace Wasp;
+
+namespace {
+
+const float Grav = 9.81;
+const float CelKel = 273.15;
+const float Kappa = 2.0 / 7.0;		// R / cp
+const float Rd = 287.04;
+const float Eps = 0.622;
+
+size_t numElements(
+	const vector <size_t> &min, const vector <size_t> &max
+) {
+	assert(min.size() == max.size());
+
+	size_t nElements = 1;
+	for (int i=0; i<min.size(); i++) {
+		nElements *= (max[i] - min[i] + 1);
+	}
+	return(nElements);
+}
+
+// Average adjacent samples along axis of src, with dimensions sdims,
+// into dst, whose dimension along axis is one less
+//
+void unstagger(
+	const float *src, const vector <size_t> &sdims, int axis, float *dst
+) {
+	size_t stride = 1;
+	for (int i=0; i<axis; i++) stride *= sdims[i];
+
+	size_t outer = 1;
+	for (int i=axis+1; i<sdims.size(); i++) outer *= sdims[i];
+
+	size_t n = sdims[axis];
+	for (size_t o=0; o<outer; o++) {
+		for (size_t j=0; j<n-1; j++) {
+			const float *s0 = src + (o*n + j) * stride;
+			const float *s1 = s0 + stride;
+			float *d = dst + (o*(n-1) + j) * stride;
+			for (size_t s=0; s<stride; s++) {
+				d[s] = 0.5 * (s0[s] + s1[s]);
+			}
+		}
+	}
+}
+
+// Temperature (K) from potential temperature perturbation and pressure (Pa)
+//
+inline float temperature(float t, float p) {
+	return((t + 300.0f) * std::pow(p * 1.0e-5f, Kappa));
+}
+
+// Linearly interpolate the column a to the pressure val. Pressure, pr,
+// decreases with the vertical index. Values above the top of the
+// column take the value at the top, those below the surface the value
+// at the surface.
+//
+inline float interp_pressure(
+	const float *a, const float *pr, size_t nz, size_t stride, float val
+) {
+	for (size_t k=0; k<nz; k++) {
+		if (pr[k*stride] < val) {
+			if (k == 0) return(a[0]);
+
+			float p0 = pr[(k-1)*stride];
+			float p1 = pr[k*stride];
+			float w = (val - p1) / (p0 - p1);
+			return(a[k*stride] + w * (a[(k-1)*stride] - a[k*stride]));
+		}
+	}
+	return(a[(nz-1)*stride]);
+}
+
+// Apply f to every element index in [0, n) in parallel
+//
+template <typename F>
+void parallel_map(size_t n, const F &f) {
+	ThreadPool::Instance()->ParallelFor(0, n, 0, [&](size_t b, size_t e) {
+		for (size_t i=b; i<e; i++) f(i);
+	});
+}
+
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//	DerivedDataVarWRF
+//
+//////////////////////////////////////////////////////////////////////////////
+
+DerivedDataVarWRF::DerivedDataVarWRF(
+	string varName, DC *dc, string units, bool columnFlag,
+	const vector <string> &required, const vector <string> &optional
+) : DerivedDataVar(varName) {
+	assert(required.size());
+
+	_dc = dc;
+	_units = units;
+	_columnFlag = columnFlag;
+	_required = required;
+	_optional = optional;
+}
+
+int DerivedDataVarWRF::Initialize() {
+
+	if (! _inputsExist()) {
+		SetErrMsg(
+			"Missing inputs for derived variable %s", _derivedVarName.c_str()
+		);
+		return(-1);
+	}
+
+	_inNames = _required;
+	for (int i=0; i<_optional.size(); i++) {
+		DC::DataVar dvar;
+		if (_dc->GetDataVarInfo(_optional[i], dvar)) {
+			_inNames.push_back(_optional[i]);
+		}
+	}
+
+	// The first required input defines the grid
+	//
+	DC::DataVar ref;
+	(void) _dc->GetDataVarInfo(_required[0], ref);
+
+	DC::Mesh m;
+	if (! _dc->GetMesh(ref.GetMeshName(), m) || m.GetDimNames().size() != 3) {
+		SetErrMsg("Invalid variable \"%s\"", _required[0].c_str());
+		return(-1);
+	}
+
+	string meshName = ref.GetMeshName();
+	vector <bool> periodic = ref.GetPeriodic();
+
+	if (_columnFlag) {
+
+		// Find the horizontal mesh
+		//
+		vector <string> dimnames = m.GetDimNames();
+		dimnames.pop_back();
+
+		meshName.clear();
+		vector <string> meshnames = _dc->GetMeshNames();
+		for (int i=0; i<meshnames.size(); i++) {
+			DC::Mesh m2d;
+			if (! _dc->GetMesh(meshnames[i], m2d)) continue;
+
+			if (m2d.GetDimNames() == dimnames) {
+				meshName = meshnames[i];
+				break;
+			}
+		}
+		if (meshName.empty()) {
+			SetErrMsg(
+				"No horizontal mesh for derived variable %s",
+				_derivedVarName.c_str()
+			);
+			return(-1);
+		}
+		periodic.resize(2, false);
+	}
+
+	_dataVarInfo = DC::DataVar(
+		_derivedVarName, _units, DC::FLOAT, ref.GetWName(), ref.GetCRatios(),
+		periodic, meshName, ref.GetTimeCoordVar(), DC::Mesh::NODE
+	);
+
+	return(0);
+}
+
+bool DerivedDataVarWRF::GetBaseVarInfo(DC::BaseVar &var) const {
+	var = _dataVarInfo;
+	return(true);
+}
+
+bool DerivedDataVarWRF::GetDataVarInfo(DC::DataVar &var) const {
+	var = _dataVarInfo;
+	return(true);
+}
+
+size_t DerivedDataVarWRF::GetNumRefLevels() const {
+	size_t nlevels = _dc->GetNumRefLevels(_required[0]);
+	for (int i=1; i<_inNames.size(); i++) {
+		nlevels = std::min(nlevels, _dc->GetNumRefLevels(_inNames[i]));
+	}
+	return(std::max(nlevels, (size_t) 1));
+}
+
+int DerivedDataVarWRF::GetDimLensAtLevel(
+	int level, std::vector <size_t> &dims_at_level,
+	std::vector <size_t> &bs_at_level
+) const {
+	dims_at_level.clear();
+	bs_at_level.clear();
+
+	int rc = _dc->GetDimLensAtLevel(
+		_required[0], level, dims_at_level, bs_at_level
+	);
+	if (rc<0) return(-1);
+
+	bool blocked = dims_at_level != bs_at_level;
+
+	if (_columnFlag) {
+		dims_at_level.pop_back();
+		bs_at_level.pop_back();
+	}
+
+	if (! blocked) {
+		bs_at_level = dims_at_level;
+	}
+	return(0);
+}
+
+int DerivedDataVarWRF::OpenVariableRead(
+	size_t ts, int level, int lod
+) {
+
+	DC::FileTable::FileObject *f = new DC::FileTable::FileObject(
+		ts, _derivedVarName, level, lod
+	);
+
+	return(_fileTable.AddEntry(f));
+}
+
+int DerivedDataVarWRF::CloseVariable(int fd) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	_fileTable.RemoveEntry(fd);
+	delete f;
+
+	return(0);
+}
+
+int DerivedDataVarWRF::ReadRegionBlock(
+	int fd,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	vector <size_t> dims, bs;
+	int rc = GetDimLensAtLevel(f->GetLevel(), dims, bs);
+	if (rc<0) return(-1);
+
+	// Exclude block padding from the region computed
+	//
+	vector <size_t> myMax = max;
+	for (int i=0; i<myMax.size(); i++) {
+		if (myMax[i] >= dims[i]) myMax[i] = dims[i] - 1;
+	}
+
+	if (dims == bs) {
+		return(ReadRegion(fd, min, myMax, region));
+	}
+
+	vector <size_t> roidims;
+	for (int i=0; i<min.size(); i++) {
+		roidims.push_back(myMax[i] - min[i] + 1);
+	}
+
+	float *buf = new float[numElements(min, myMax)];
+
+	rc = ReadRegion(fd, min, myMax, buf);
+	if (rc<0) {
+		delete [] buf;
+		return(-1);
+	}
+
+	_blockit(buf, roidims, bs, region);
+
+	delete [] buf;
+
+	return(0);
+}
+
+int DerivedDataVarWRF::ReadRegion(
+	int fd,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	DC::FileTable::FileObject *f = _fileTable.GetEntry(fd);
+	if (! f) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+
+	vector <size_t> myMin = min;
+	vector <size_t> myMax = max;
+
+	if (_columnFlag) {
+		assert(min.size() == 2);
+
+		vector <size_t> dims;
+		int rc = _getMassDims(f->GetLevel(), dims);
+		if (rc<0) return(-1);
+
+		myMin.push_back(0);
+		myMax.push_back(dims[2] - 1);
+	}
+	assert(myMin.size() == 3);
+
+	return(_compute(
+		f->GetTS(), f->GetLevel(), f->GetLOD(), myMin, myMax, region
+	));
+}
+
+bool DerivedDataVarWRF::VariableExists(
+	size_t ts,
+	int reflevel,
+	int lod
+) const {
+
+	for (int i=0; i<_inNames.size(); i++) {
+		if (! _dc->VariableExists(ts, _inNames[i], reflevel, lod)) {
+			return(false);
+		}
+	}
+	return(true);
+}
+
+vector <DerivedDataVarWRF *> DerivedDataVarWRF::CreateAll(DC *dc) {
+
+	vector <DerivedDataVarWRF *> candidates;
+	candidates.push_back(new DerivedDataVarWRF_TK(dc));
+	candidates.push_back(new DerivedDataVarWRF_TD(dc));
+	candidates.push_back(new DerivedDataVarWRF_RH(dc));
+	candidates.push_back(new DerivedDataVarWRF_ETH(dc));
+	candidates.push_back(new DerivedDataVarWRF_DBZ(dc, false));
+	candidates.push_back(new DerivedDataVarWRF_DBZ(dc, true));
+	candidates.push_back(new DerivedDataVarWRF_CTT(dc));
+	candidates.push_back(new DerivedDataVarWRF_SLP(dc));
+	candidates.push_back(new DerivedDataVarWRF_SHEAR(dc));
+	candidates.push_back(new DerivedDataVarWRF_PV(dc));
+
+	vector <DerivedDataVarWRF *> vars;
+	for (int i=0; i<candidates.size(); i++) {
+		DerivedDataVarWRF *var = candidates[i];
+
+		DC::BaseVar dummy;
+		if (
+			dc->GetBaseVarInfo(var->GetName(), dummy) ||
+			! var->_inputsExist() || var->Initialize() < 0
+		) {
+			delete var;
+			continue;
+		}
+		vars.push_back(var);
+	}
+	return(vars);
+}
+
+bool DerivedDataVarWRF::_inputsExist() const {
+	for (int i=0; i<_required.size(); i++) {
+		DC::DataVar dvar;
+		if (! _dc->GetDataVarInfo(_required[i], dvar)) return(false);
+	}
+	return(true);
+}
+
+bool DerivedDataVarWRF::_hasInput(string name) const {
+	return(find(_inNames.begin(), _inNames.end(), name) != _inNames.end());
+}
+
+int DerivedDataVarWRF::_getMassDims(int level, vector <size_t> &dims) const {
+	vector <size_t> bs;
+	return(_dc->GetDimLensAtLevel(_required[0], level, dims, bs));
+}
+
+int DerivedDataVarWRF::_getInput(
+	size_t ts, int level, int lod, string name,
+	const vector <size_t> &min, const vector <size_t> &max,
+	vector <float> &buf
+) const {
+
+	if (! _hasInput(name)) {
+		buf.assign(numElements(min, max), 0.0);
+		return(0);
+	}
+
+	vector <size_t> mdims, dims, bs;
+	int rc = _getMassDims(level, mdims);
+	if (rc<0) return(-1);
+
+	rc = _dc->GetDimLensAtLevel(name, level, dims, bs);
+	if (rc<0) return(-1);
+
+	if (dims.size() > min.size()) {
+		SetErrMsg("Invalid variable \"%s\"", name.c_str());
+		return(-1);
+	}
+
+	// Extend the region by one sample along staggered axes
+	//
+	vector <size_t> imin, imax;
+	vector <bool> stag;
+	for (int i=0; i<dims.size(); i++) {
+		imin.push_back(min[i]);
+		imax.push_back(max[i]);
+		if (dims[i] == mdims[i] + 1) {
+			imax[i]++;
+			stag.push_back(true);
+		}
+		else if (dims[i] == mdims[i]) {
+			stag.push_back(false);
+		}
+		else {
+			SetErrMsg("Invalid variable \"%s\"", name.c_str());
+			return(-1);
+		}
+	}
+
+	buf.resize(numElements(imin, imax));
+	rc = _getVar(_dc, ts, name, level, lod, imin, imax, buf.data());
+	if (rc<0) return(-1);
+
+	for (int i=0; i<stag.size(); i++) {
+		if (! stag[i]) continue;
+
+		vector <size_t> sdims;
+		for (int j=0; j<imin.size(); j++) {
+			sdims.push_back(imax[j] - imin[j] + 1);
+		}
+
+		vector <float> tmp(buf.size() / sdims[i] * (sdims[i] - 1));
+		unstagger(buf.data(), sdims, i, tmp.data());
+		buf.swap(tmp);
+		imax[i]--;
+	}
+
+	return(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//	DerivedDataVarWRF_TK
+//
+//////////////////////////////////////////////////////////////////////////////
+
+DerivedDataVarWRF_TK::DerivedDataVarWRF_TK(
+	DC *dc
+) : DerivedDataVarWRF("TK", dc, "K", false, {"P", "PB", "T"}) {
+}
+
+int DerivedDataVarWRF_TK::_compute(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	vector <float> p, pb, t;
+	if (_getInput(ts, level, lod, "P", min, max, p) < 0) return(-1);
+	if (_getInput(ts, level, lod, "PB", min, max, pb) < 0) return(-1);
+	if (_getInput(ts, level, lod, "T", min, max, t) < 0) return(-1);
+
+	parallel_map(p.size(), [&](size_t i) {
+		region[i] = temperature(t[i], p[i] + pb[i]);
+	});
+
+	return(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//	DerivedDataVarWRF_TD
+//
+//////////////////////////////////////////////////////////////////////////////
+
+DerivedDataVarWRF_TD::DerivedDataVarWRF_TD(
+	DC *dc
+) : DerivedDataVarWRF("TD", dc, "degC", false, {"P", "PB", "QVAPOR"}) {
+}
+
+int DerivedDataVarWRF_TD::_compute(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	vector <float> p, pb, qv;
+	if (_getInput(ts, level, lod, "P", min, max, p) < 0) return(-1);
+	if (_getInput(ts, level, lod, "PB", min, max, pb) < 0) return(-1);
+	if (_getInput(ts, level, lod, "QVAPOR", min, max, qv) < 0) return(-1);
+
+	// Vapor pressure in hPa
+	//
+	parallel_map(p.size(), [&](size_t i) {
+		float q = std::max(qv[i], 0.0f);
+		float e = 0.01f * q * (p[i] + pb[i]) / (Eps + q);
+		float loge = std::log(std::max(e, 0.001f));
+		region[i] = (243.5f * loge - 440.8f) / (19.48f - loge);
+	});
+
+	return(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//	DerivedDataVarWRF_RH
+//
+//////////////////////////////////////////////////////////////////////////////
+
+DerivedDataVarWRF_RH::DerivedDataVarWRF_RH(
+	DC *dc
+) : DerivedDataVarWRF("RH", dc, "%", false, {"P", "PB", "T", "QVAPOR"}) {
+}
+
+int DerivedDataVarWRF_RH::_compute(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	vector <float> p, pb, t, qv;
+	if (_getInput(ts, level, lod, "P", min, max, p) < 0) return(-1);
+	if (_getInput(ts, level, lod, "PB", min, max, pb) < 0) return(-1);
+	if (_getInput(ts, level, lod, "T", min, max, t) < 0) return(-1);
+	if (_getInput(ts, level, lod, "QVAPOR", min, max, qv) < 0) return(-1);
+
+	const float svp1 = 0.6112;
+	const float svp2 = 17.67;
+	const float svp3 = 29.65;
+
+	parallel_map(p.size(), [&](size_t i) {
+		float press = p[i] + pb[i];
+		float tk = temperature(t[i], press);
+
+		// Saturation vapor pressure (hPa) and mixing ratio
+		//
+		float es = 10.0f * svp1 * std::exp(svp2 * (tk - CelKel) / (tk - svp3));
+		float qvs = Eps * es / (0.01f * press - (1.0f - Eps) * es);
+		region[i] = 100.0f * std::max(std::min(qv[i] / qvs, 1.0f), 0.0f);
+	});
+
+	return(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//	DerivedDataVarWRF_ETH
+//
+//////////////////////////////////////////////////////////////////////////////
+
+DerivedDataVarWRF_ETH::DerivedDataVarWRF_ETH(
+	DC *dc
+) : DerivedDataVarWRF("ETH", dc, "K", false, {"P", "PB", "T", "QVAPOR"}) {
+}
+
+int DerivedDataVarWRF_ETH::_compute(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	vector <float> p, pb, t, qv;
+	if (_getInput(ts, level, lod, "P", min, max, p) < 0) return(-1);
+	if (_getInput(ts, level, lod, "PB", min, max, pb) < 0) return(-1);
+	if (_getInput(ts, level, lod, "T", min, max, t) < 0) return(-1);
+	if (_getInput(ts, level, lod, "QVAPOR", min, max, qv) < 0) return(-1);
+
+	const float gamma = 287.04 / 1004.0;
+	const float gammamd = 0.608 - 0.887;
+	const float tlclc1 = 2840.0;
+	const float tlclc2 = 3.5;
+	const float tlclc3 = 4.805;
+	const float tlclc4 = 55.0;
+	const float thtecon1 = 3376.0;
+	const float thtecon2 = 2.54;
+	const float thtecon3 = 0.81;
+
+	parallel_map(p.size(), [&](size_t i) {
+		float press = 0.01f * (p[i] + pb[i]);	// hPa
+		float tk = temperature(t[i], 100.0f * press);
+		float q = std::max(qv[i], 1.0e-15f);
+		float e = q * press / (Eps + q);
+
+		// Temperature at the lifting condensation level
+		//
+		float tlcl = tlclc4 + tlclc1 /
+			(tlclc2 * std::log(tk) - std::log(e) - tlclc3);
+
+		float expnt = (thtecon1 / tlcl - thtecon2) * q * (1.0f + thtecon3 * q);
+		region[i] = tk * std::pow(1000.0f / press, gamma * (1.0f + gammamd * q)) *
+			std::exp(expnt);
+	});
+
+	return(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//	DerivedDataVarWRF_DBZ
+//
+//////////////////////////////////////////////////////////////////////////////
+
+DerivedDataVarWRF_DBZ::DerivedDataVarWRF_DBZ(
+	DC *dc, bool maxFlag
+) : DerivedDataVarWRF(
+	maxFlag ? "DBZ_MAX" : "DBZ", dc, "dBZ", maxFlag,
+	{"P", "PB", "T", "QVAPOR", "QRAIN"}, {"QSNOW", "QGRAUP"}
+) {
+	_maxFlag = maxFlag;
+}
+
+int DerivedDataVarWRF_DBZ::_compute(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	vector <float> p, pb, t, qv, qr, qs, qg;
+	if (_getInput(ts, level, lod, "P", min, max, p) < 0) return(-1);
+	if (_getInput(ts, level, lod, "PB", min, max, pb) < 0) return(-1);
+	if (_getInput(ts, level, lod, "T", min, max, t) < 0) return(-1);
+	if (_getInput(ts, level, lod, "QVAPOR", min, max, qv) < 0) return(-1);
+	if (_getInput(ts, level, lod, "QRAIN", min, max, qr) < 0) return(-1);
+	if (_getInput(ts, level, lod, "QSNOW", min, max, qs) < 0) return(-1);
+	if (_getInput(ts, level, lod, "QGRAUP", min, max, qg) < 0) return(-1);
+
+	// Without a snow mixing ratio, rain below freezing is taken to be snow
+	//
+	bool snowFlag = _hasInput("QSNOW");
+
+	const double pi = 3.141592653589793;
+	const double gamma_seven = 720.0;
+	const double rho_w = 1000.0;
+	const double rho_r = rho_w;
+	const double rho_s = 100.0;
+	const double rho_g = 400.0;
+	const double alpha = 0.224;
+	const double rn0_r = 8.0e6;
+	const double rn0_s = 2.0e7;
+	const double rn0_g = 4.0e6;
+
+	const double factor_r = gamma_seven * 1.0e18 * pow(1.0 / (pi*rho_r), 1.75);
+	const double factor_s = gamma_seven * 1.0e18 * pow(1.0 / (pi*rho_s), 1.75) *
+		pow(rho_s / rho_w, 2.0 * alpha);
+	const double factor_g = gamma_seven * 1.0e18 * pow(1.0 / (pi*rho_g), 1.75) *
+		pow(rho_g / rho_w, 2.0 * alpha);
+
+	// Constant intercept parameters fold into the coefficients
+	//
+	const float cr = factor_r / pow(rn0_r, 0.75);
+	const float cs = factor_s / pow(rn0_s, 0.75);
+	const float cg = factor_g / pow(rn0_g, 0.75);
+
+	float *dbz = region;
+	vector <float> buf;
+	if (_maxFlag) {
+		buf.resize(p.size());
+		dbz = buf.data();
+	}
+
+	parallel_map(p.size(), [&](size_t i) {
+		float press = p[i] + pb[i];
+		float tk = temperature(t[i], press);
+		float q = std::max(qv[i], 0.0f);
+		float rain = std::max(qr[i], 0.0f);
+		float snow = std::max(qs[i], 0.0f);
+		float graup = std::max(qg[i], 0.0f);
+
+		if (! snowFlag && tk < CelKel) {
+			snow = rain;
+			rain = 0.0f;
+		}
+
+		float virtual_t = tk * (Eps + q) / (Eps * (1.0f + q));
+		float rhoair = press / (Rd * virtual_t);
+
+		float z_e = cr * std::pow(rhoair * rain, 1.75f) +
+			cs * std::pow(rhoair * snow, 1.75f) +
+			cg * std::pow(rhoair * graup, 1.75f);
+
+		dbz[i] = 10.0f * std::log10(std::max(z_e, 0.001f));
+	});
+
+	if (! _maxFlag) return(0);
+
+	size_t nxy = (max[0]-min[0]+1) * (max[1]-min[1]+1);
+	size_t nz = max[2]-min[2]+1;
+
+	ThreadPool::Instance()->ParallelFor(0, nxy, 0, [&](size_t b, size_t e) {
+		for (size_t h=b; h<e; h++) region[h] = dbz[h];
+
+		for (size_t k=1; k<nz; k++) {
+			const float *slice = dbz + k*nxy;
+			for (size_t h=b; h<e; h++) {
+				region[h] = std::max(region[h], slice[h]);
+			}
+		}
+	});
+
+	return(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//	DerivedDataVarWRF_CTT
+//
+//////////////////////////////////////////////////////////////////////////////
+
+DerivedDataVarWRF_CTT::DerivedDataVarWRF_CTT(
+	DC *dc
+) : DerivedDataVarWRF(
+	"CTT", dc, "degC", true,
+	{"P", "PB", "T", "QCLOUD"}, {"QICE", "QSNOW"}
+) {
+}
+
+int DerivedDataVarWRF_CTT::_compute(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	vector <float> p, pb, t, qc, qi;
+	if (_getInput(ts, level, lod, "P", min, max, p) < 0) return(-1);
+	if (_getInput(ts, level, lod, "PB", min, max, pb) < 0) return(-1);
+	if (_getInput(ts, level, lod, "T", min, max, t) < 0) return(-1);
+	if (_getInput(ts, level, lod, "QCLOUD", min, max, qc) < 0) return(-1);
+	if (_getInput(ts, level, lod, "QICE", min, max, qi) < 0) return(-1);
+
+	// With ice microphysics cloud water and ice are given separately,
+	// otherwise cloud below freezing is treated as ice
+	//
+	bool iceFlag = _hasInput("QICE") && _hasInput("QSNOW");
+
+	const float abscoefi = 0.272;
+	const float abscoef = 0.145;
+
+	size_t nxy = (max[0]-min[0]+1) * (max[1]-min[1]+1);
+	size_t nz = max[2]-min[2]+1;
+
+	// Columns are processed in chunks, sweeping from the top of the
+	// model down one level at a time for the whole chunk so that the
+	// inner loop runs over contiguous memory
+	//
+	ThreadPool::Instance()->ParallelFor(0, nxy, 0, [&](size_t b, size_t e) {
+		vector <float> opdepthu(e-b, 0.0);
+
+		for (size_t h=b; h<e; h++) {
+			region[h] = temperature(t[h], p[h] + pb[h]) - CelKel;
+		}
+
+		for (long k=(long) nz-2; k>=0; k--) {
+			size_t o = k*nxy;
+			for (size_t h=b; h<e; h++) {
+				float pf = p[o+h] + pb[o+h];
+				float dp = pf - (p[o+nxy+h] + pb[o+nxy+h]);	// Pa
+				float tmk = temperature(t[o+h], pf);
+
+				float opacity;
+				if (iceFlag) {
+					opacity = abscoef * qc[o+h] + abscoefi * qi[o+h];
+				}
+				else {
+					opacity = (tmk < CelKel ? abscoefi : abscoef) * qc[o+h];
+				}
+
+				float opdepthd = opdepthu[h-b] + opacity * dp / Grav;
+				if (opdepthd > 1.0f && opdepthu[h-b] <= 1.0f) {
+					region[h] = tmk - CelKel;
+				}
+				opdepthu[h-b] = opdepthd;
+			}
+		}
+	});
+
+	return(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//	DerivedDataVarWRF_SLP
+//
+//////////////////////////////////////////////////////////////////////////////
+
+DerivedDataVarWRF_SLP::DerivedDataVarWRF_SLP(
+	DC *dc
+) : DerivedDataVarWRF(
+	"SLP", dc, "hPa", true, {"P", "PB", "T", "QVAPOR", "PH", "PHB"}
+) {
+}
+
+int DerivedDataVarWRF_SLP::_compute(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	vector <float> p, pb, t, qv, ph, phb;
+	if (_getInput(ts, level, lod, "P", min, max, p) < 0) return(-1);
+	if (_getInput(ts, level, lod, "PB", min, max, pb) < 0) return(-1);
+	if (_getInput(ts, level, lod, "T", min, max, t) < 0) return(-1);
+	if (_getInput(ts, level, lod, "QVAPOR", min, max, qv) < 0) return(-1);
+	if (_getInput(ts, level, lod, "PH", min, max, ph) < 0) return(-1);
+	if (_getInput(ts, level, lod, "PHB", min, max, phb) < 0) return(-1);
+
+	size_t nxy = (max[0]-min[0]+1) * (max[1]-min[1]+1);
+	size_t nz = max[2]-min[2]+1;
+	if (nz < 2) {
+		SetErrMsg("Too few vertical levels to compute SLP");
+		return(-1);
+	}
+
+	const float pconst = 10000.0;	// Pa
+	const float gamma = 0.0065;		// standard lapse rate
+	const float tc = 273.16 + 17.5;
+
+	ThreadPool::Instance()->ParallelFor(0, nxy, 0, [&](size_t b, size_t e) {
+		for (size_t h=b; h<e; h++) {
+			float p0 = p[h] + pb[h];
+			float p_at_pconst = p0 - pconst;
+
+			// Lowest level more than pconst above the surface
+			//
+			size_t khi = nz-1;
+			for (size_t k=1; k<nz; k++) {
+				if (p[k*nxy+h] + pb[k*nxy+h] < p_at_pconst) {
+					khi = k;
+					break;
+				}
+			}
+			size_t lo = (khi-1)*nxy + h;
+			size_t hi = khi*nxy + h;
+
+			float plo = p[lo] + pb[lo];
+			float phi = p[hi] + pb[hi];
+			float tlo = temperature(t[lo], plo) * (1.0f + 0.608f * qv[lo]);
+			float thi = temperature(t[hi], phi) * (1.0f + 0.608f * qv[hi]);
+			float zlo = (ph[lo] + phb[lo]) / Grav;
+			float zhi = (ph[hi] + phb[hi]) / Grav;
+
+			float w = std::log(p_at_pconst / phi) * std::log(plo / phi);
+			float t_at_pconst = thi - (thi - tlo) * w;
+			float z_at_pconst = zhi - (zhi - zlo) * w;
+
+			float t_surf = t_at_pconst *
+				std::pow(p0 / p_at_pconst, gamma * Rd / Grav);
+			float t_sea_level = t_at_pconst + gamma * z_at_pconst;
+
+			// Correction for unrealistically warm sea level temperatures
+			// carried over from MM5
+			//
+			if (t_surf <= tc && t_sea_level >= tc) {
+				t_sea_level = tc;
+			}
+			else {
+				t_sea_level = tc - 0.005f * (t_surf - tc) * (t_surf - tc);
+			}
+
+			float z_half_lowest = (ph[h] + phb[h]) / Grav;
+			region[h] = 0.01f * p0 * std::exp(
+				2.0f * Grav * z_half_lowest / (Rd * (t_sea_level + t_surf))
+			);
+		}
+	});
+
+	return(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//	DerivedDataVarWRF_SHEAR
+//
+//////////////////////////////////////////////////////////////////////////////
+
+DerivedDataVarWRF_SHEAR::DerivedDataVarWRF_SHEAR(
+	DC *dc, float level1, float level2
+) : DerivedDataVarWRF(
+	"SHEAR", dc, "m/s", true, {"P", "PB", "U", "V"}
+) {
+	_level1 = level1;
+	_level2 = level2;
+}
+
+int DerivedDataVarWRF_SHEAR::_compute(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	vector <float> p, pb, u, v;
+	if (_getInput(ts, level, lod, "P", min, max, p) < 0) return(-1);
+	if (_getInput(ts, level, lod, "PB", min, max, pb) < 0) return(-1);
+	if (_getInput(ts, level, lod, "U", min, max, u) < 0) return(-1);
+	if (_getInput(ts, level, lod, "V", min, max, v) < 0) return(-1);
+
+	// Pressure in hPa, in place
+	//
+	parallel_map(p.size(), [&](size_t i) {
+		p[i] = 0.01f * (p[i] + pb[i]);
+	});
+
+	size_t nxy = (max[0]-min[0]+1) * (max[1]-min[1]+1);
+	size_t nz = max[2]-min[2]+1;
+
+	parallel_map(nxy, [&](size_t h) {
+		float u1 = interp_pressure(&u[h], &p[h], nz, nxy, _level1);
+		float u2 = interp_pressure(&u[h], &p[h], nz, nxy, _level2);
+		float v1 = interp_pressure(&v[h], &p[h], nz, nxy, _level1);
+		float v2 = interp_pressure(&v[h], &p[h], nz, nxy, _level2);
+
+		region[h] = std::sqrt((u1-u2)*(u1-u2) + (v1-v2)*(v1-v2));
+	});
+
+	return(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//	DerivedDataVarWRF_PV
+//
+//////////////////////////////////////////////////////////////////////////////
+
+DerivedDataVarWRF_PV::DerivedDataVarWRF_PV(
+	DC *dc
+) : DerivedDataVarWRF(
+	"PV", dc, "PVU", false, {"T", "P", "PB", "U", "V", "F"}, {"MAPFAC_M"}
+) {
+	_dx = 0.0;
+	_dy = 0.0;
+}
+
+int DerivedDataVarWRF_PV::Initialize() {
+	int rc = DerivedDataVarWRF::Initialize();
+	if (rc<0) return(-1);
+
+	vector <double> values;
+	_dc->GetAtt("", "DX", values);
+	if (values.size() != 1) {
+		SetErrMsg("Error reading required attribute : DX");
+		return(-1);
+	}
+	_dx = values[0];
+
+	_dc->GetAtt("", "DY", values);
+	if (values.size() != 1) {
+		SetErrMsg("Error reading required attribute : DY");
+		return(-1);
+	}
+	_dy = values[0];
+
+	return(0);
+}
+
+bool DerivedDataVarWRF_PV::_inputsExist() const {
+	if (! DerivedDataVarWRF::_inputsExist()) return(false);
+
+	vector <double> dx, dy;
+	return(_dc->GetAtt("", "DX", dx) && _dc->GetAtt("", "DY", dy));
+}
+
+int DerivedDataVarWRF_PV::_compute(
+	size_t ts, int level, int lod,
+	const vector <size_t> &min, const vector <size_t> &max, float *region
+) {
+	vector <size_t> dims, fineDims;
+	int rc = _getMassDims(level, dims);
+	if (rc<0) return(-1);
+
+	rc = _getMassDims(-1, fineDims);
+	if (rc<0) return(-1);
+
+	// Grid spacing grows at coarser refinement levels
+	//
+	double dx = _dx;
+	double dy = _dy;
+	if (dims[0] > 1) dx *= (double) (fineDims[0]-1) / (double) (dims[0]-1);
+	if (dims[1] > 1) dy *= (double) (fineDims[1]-1) / (double) (dims[1]-1);
+
+	// Inputs are read with a one point halo, clamped to the domain
+	//
+	vector <size_t> emin, emax;
+	for (int i=0; i<3; i++) {
+		emin.push_back(min[i] > 0 ? min[i] - 1 : 0);
+		emax.push_back(std::min(max[i] + 1, dims[i] - 1));
+	}
+
+	vector <float> t, p, pb, u, v, f, msf;
+	if (_getInput(ts, level, lod, "T", emin, emax, t) < 0) return(-1);
+	if (_getInput(ts, level, lod, "P", emin, emax, p) < 0) return(-1);
+	if (_getInput(ts, level, lod, "PB", emin, emax, pb) < 0) return(-1);
+	if (_getInput(ts, level, lod, "U", emin, emax, u) < 0) return(-1);
+	if (_getInput(ts, level, lod, "V", emin, emax, v) < 0) return(-1);
+	if (_getInput(ts, level, lod, "F", emin, emax, f) < 0) return(-1);
+
+	size_t ex = emax[0]-emin[0]+1;
+	size_t ey = emax[1]-emin[1]+1;
+
+	if (_hasInput("MAPFAC_M")) {
+		if (_getInput(ts, level, lod, "MAPFAC_M", emin, emax, msf) < 0) {
+			return(-1);
+		}
+	}
+	else {
+		msf.assign(ex*ey, 1.0);
+	}
+
+	// Pressure in hPa, in place
+	//
+	parallel_map(p.size(), [&](size_t i) {
+		p[i] = 0.01f * (p[i] + pb[i]);
+	});
+
+	size_t nx = max[0]-min[0]+1;
+	size_t ny = max[1]-min[1]+1;
+	size_t nz = max[2]-min[2]+1;
+
+	// Offset into the haloed input arrays
+	//
+	auto idx3 = [&](size_t i, size_t j, size_t k) {
+		return(((k-emin[2])*ey + (j-emin[1]))*ex + (i-emin[0]));
+	};
+	auto idx2 = [&](size_t i, size_t j) {
+		return((j-emin[1])*ex + (i-emin[0]));
+	};
+
+	ThreadPool::Instance()->ParallelFor(0, ny*nz, 0, [&](size_t r0, size_t r1) {
+		for (size_t r=r0; r<r1; r++) {
+			size_t j = min[1] + r % ny;
+			size_t k = min[2] + r / ny;
+
+			size_t jp1 = std::min(j+1, dims[1]-1);
+			size_t jm1 = j > 0 ? j-1 : 0;
+			size_t kp1 = std::min(k+1, dims[2]-1);
+			size_t km1 = k > 0 ? k-1 : 0;
+
+			float dsy = (jp1 - jm1) * dy;
+			float rdsy = dsy > 0.0 ? 1.0 / dsy : 0.0;
+
+			float *out = region + r*nx;
+			for (size_t i=min[0]; i<=max[0]; i++) {
+				size_t ip1 = std::min(i+1, dims[0]-1);
+				size_t im1 = i > 0 ? i-1 : 0;
+
+				float dsx = (ip1 - im1) * dx;
+				float rdsx = dsx > 0.0 ? 1.0 / dsx : 0.0;
+
+				float m = msf[idx2(i,j)];
+				float mm = m * m;
+
+				float dudy = (u[idx3(i,jp1,k)] - u[idx3(i,jm1,k)]) * rdsy * mm;
+				float dvdx = (v[idx3(ip1,j,k)] - v[idx3(im1,j,k)]) * rdsx * mm;
+				float avort = dvdx - dudy + f[idx2(i,j)];
+
+				float dp = p[idx3(i,j,kp1)] - p[idx3(i,j,km1)];
+				float rdp = dp != 0.0 ? 1.0 / dp : 0.0;
+
+				float dudp = (u[idx3(i,j,kp1)] - u[idx3(i,j,km1)]) * rdp;
+				float dvdp = (v[idx3(i,j,kp1)] - v[idx3(i,j,km1)]) * rdp;
+				float dthdp = (t[idx3(i,j,kp1)] - t[idx3(i,j,km1)]) * rdp;
+				float dthdx = (t[idx3(ip1,j,k)] - t[idx3(im1,j,k)]) * rdsx * m;
+				float dthdy = (t[idx3(i,jp1,k)] - t[idx3(i,jm1,k)]) * rdsy * m;
+
+				out[i-min[0]] = -Grav *
+					(dthdp * avort - dvdp * dthdx + dudp * dthdy) * 10000.0f;
+			}
+		}
+	});
+
+	return(0);
+}
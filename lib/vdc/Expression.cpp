@@ -0,0 +1,484 @@
+#include <cassert>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vapor/Expression.h>
+
+using namespace VAPoR;
+using namespace std;
+
+namespace {
+
+struct func_t {
+	const char *name;
+	int nargs;
+	int op;
+};
+
+};
+
+const size_t Expression::ChunkSize;
+
+Expression::Expression() {
+	_nregs = 0;
+	_pos = 0;
+}
+
+int Expression::Parse(string formula) {
+	_text = formula;
+	_pos = 0;
+	_nodes.clear();
+
+	vector <string> oldVarNames = _varNames;
+	_varNames.clear();
+
+	int root = _parseExpr();
+	_skipSpace();
+	if (root >= 0 && _pos < _text.size()) {
+		SetErrMsg(
+			"Syntax error at position %d in expression \"%s\"",
+			(int) _pos + 1, formula.c_str()
+		);
+		root = -1;
+	}
+	if (root < 0) {
+		_varNames = oldVarNames;
+		_nodes.clear();
+		return(-1);
+	}
+
+	// Compile the tree
+	//
+	_program.clear();
+	_freeRegs.clear();
+	_nregs = 0;
+
+	operand_t result = _compile(root);
+
+	// Write the final result straight to the output if it was
+	// produced by the last instruction, otherwise copy it
+	//
+	if (
+		result.kind == operand_t::REG && ! _program.empty() &&
+		_program.back().dst == result.index
+	) {
+		_program.back().dst = -1;
+	}
+	else {
+		instr_t instr;
+		instr.op = COPY;
+		instr.dst = -1;
+		instr.a = result;
+		instr.b = result;
+		_program.push_back(instr);
+	}
+
+	_nodes.clear();
+	_formula = formula;
+	return(0);
+}
+
+void Expression::Evaluate(
+	const float *const *inputs, size_t n, float *out, float *scratch
+) const {
+
+	for (size_t c0=0; c0<n; c0+=ChunkSize) {
+		size_t m = std::min(ChunkSize, n - c0);
+
+		for (size_t i=0; i<_program.size(); i++) {
+			const instr_t &instr = _program[i];
+
+			const float *a = NULL;
+			const float *b = NULL;
+			if (instr.a.kind == operand_t::REG) {
+				a = scratch + instr.a.index * ChunkSize;
+			}
+			else if (instr.a.kind == operand_t::INPUT) {
+				a = inputs[instr.a.index] + c0;
+			}
+			if (instr.b.kind == operand_t::REG) {
+				b = scratch + instr.b.index * ChunkSize;
+			}
+			else if (instr.b.kind == operand_t::INPUT) {
+				b = inputs[instr.b.index] + c0;
+			}
+
+			float *dst = instr.dst < 0 ?
+				out + c0 : scratch + instr.dst * ChunkSize;
+
+			_apply(instr.op, m, a, instr.a.value, b, instr.b.value, dst);
+		}
+	}
+}
+
+//
+// Recursive descent parser. Each method returns the index of a node in
+// _nodes, or -1 on a syntax error.
+//
+
+void Expression::_skipSpace() {
+	while (_pos < _text.size() && isspace((unsigned char) _text[_pos])) {
+		_pos++;
+	}
+}
+
+bool Expression::_accept(const char *token) {
+	_skipSpace();
+	size_t len = strlen(token);
+	if (_text.compare(_pos, len, token) != 0) return(false);
+
+	_pos += len;
+	return(true);
+}
+
+int Expression::_parseExpr() {
+	int left = _parseTerm();
+	while (left >= 0) {
+		if (_accept("+")) {
+			int right = _parseTerm();
+			if (right < 0) return(-1);
+			left = _newNode(ADD, left, right);
+		}
+		else if (_accept("-")) {
+			int right = _parseTerm();
+			if (right < 0) return(-1);
+			left = _newNode(SUB, left, right);
+		}
+		else break;
+	}
+	return(left);
+}
+
+int Expression::_parseTerm() {
+	int left = _parseUnary();
+	while (left >= 0) {
+
+		// "**" is exponentiation
+		//
+		_skipSpace();
+		if (_text.compare(_pos, 2, "**") == 0) break;
+
+		if (_accept("*")) {
+			int right = _parseUnary();
+			if (right < 0) return(-1);
+			left = _newNode(MUL, left, right);
+		}
+		else if (_accept("/")) {
+			int right = _parseUnary();
+			if (right < 0) return(-1);
+			left = _newNode(DIV, left, right);
+		}
+		else break;
+	}
+	return(left);
+}
+
+int Expression::_parseUnary() {
+	if (_accept("-")) {
+		int operand = _parseUnary();
+		if (operand < 0) return(-1);
+		return(_newNode(NEG, operand, -1));
+	}
+	if (_accept("+")) {
+		return(_parseUnary());
+	}
+	return(_parsePower());
+}
+
+// Exponentiation binds tighter than unary minus on its left and is
+// right associative, so -a^b^c is -(a^(b^c))
+//
+int Expression::_parsePower() {
+	int base = _parsePrimary();
+	if (base < 0) return(-1);
+
+	if (_accept("^") || _accept("**")) {
+		int exponent = _parseUnary();
+		if (exponent < 0) return(-1);
+		return(_newNode(POW, base, exponent));
+	}
+	return(base);
+}
+
+int Expression::_parsePrimary() {
+	static const func_t funcs[] = {
+		{"sqrt", 1, SQRT}, {"abs", 1, ABS}, {"exp", 1, EXP},
+		{"log", 1, LOG}, {"log10", 1, LOG10}, {"sin", 1, SIN},
+		{"cos", 1, COS}, {"tan", 1, TAN}, {"asin", 1, ASIN},
+		{"acos", 1, ACOS}, {"atan", 1, ATAN}, {"floor", 1, FLOOR},
+		{"ceil", 1, CEIL}, {"pow", 2, POW}, {"atan2", 2, ATAN2},
+		{"min", 2, MIN}, {"max", 2, MAX}, {NULL, 0, 0}
+	};
+
+	_skipSpace();
+	if (_pos >= _text.size()) {
+		SetErrMsg(
+			"Unexpected end of expression \"%s\"", _text.c_str()
+		);
+		return(-1);
+	}
+
+	if (_accept("(")) {
+		int node = _parseExpr();
+		if (node < 0) return(-1);
+		if (! _accept(")")) {
+			SetErrMsg(
+				"Missing \")\" at position %d in expression \"%s\"",
+				(int) _pos + 1, _text.c_str()
+			);
+			return(-1);
+		}
+		return(node);
+	}
+
+	char c = _text[_pos];
+
+	// Number
+	//
+	if (isdigit((unsigned char) c) || c == '.') {
+		const char *start = _text.c_str() + _pos;
+		char *end;
+		double value = strtod(start, &end);
+		if (end == start) {
+			SetErrMsg(
+				"Invalid number at position %d in expression \"%s\"",
+				(int) _pos + 1, _text.c_str()
+			);
+			return(-1);
+		}
+		_pos += end - start;
+		return(_newConst(value));
+	}
+
+	if (! (isalpha((unsigned char) c) || c == '_')) {
+		SetErrMsg(
+			"Syntax error at position %d in expression \"%s\"",
+			(int) _pos + 1, _text.c_str()
+		);
+		return(-1);
+	}
+
+	size_t start = _pos;
+	while (
+		_pos < _text.size() &&
+		(isalnum((unsigned char) _text[_pos]) || _text[_pos] == '_')
+	) {
+		_pos++;
+	}
+	string name = _text.substr(start, _pos - start);
+
+	if (! _accept("(")) {
+		if (name == "pi") return(_newConst(M_PI));
+		return(_newVar(name));
+	}
+
+	// Function call
+	//
+	const func_t *f = funcs;
+	while (f->name && name != f->name) f++;
+	if (! f->name) {
+		SetErrMsg(
+			"Unknown function \"%s\" in expression \"%s\"",
+			name.c_str(), _text.c_str()
+		);
+		return(-1);
+	}
+
+	int args[2] = {-1, -1};
+	for (int i=0; i<f->nargs; i++) {
+		if (i > 0 && ! _accept(",")) {
+			SetErrMsg(
+				"Function \"%s\" takes %d arguments in expression \"%s\"",
+				name.c_str(), f->nargs, _text.c_str()
+			);
+			return(-1);
+		}
+		args[i] = _parseExpr();
+		if (args[i] < 0) return(-1);
+	}
+	if (! _accept(")")) {
+		SetErrMsg(
+			"Function \"%s\" takes %d arguments in expression \"%s\"",
+			name.c_str(), f->nargs, _text.c_str()
+		);
+		return(-1);
+	}
+
+	return(_newNode((op_t) f->op, args[0], args[1]));
+}
+
+int Expression::_newNode(op_t op, int left, int right) {
+	node_t node;
+	node.kind = operand_t::REG;
+	node.op = op;
+	node.left = left;
+	node.right = right;
+	node.index = -1;
+	node.value = 0.0;
+	_nodes.push_back(node);
+	return(_nodes.size() - 1);
+}
+
+int Expression::_newConst(float value) {
+	int n = _newNode(COPY, -1, -1);
+	_nodes[n].kind = operand_t::CONST;
+	_nodes[n].value = value;
+	return(n);
+}
+
+int Expression::_newVar(string name) {
+	int index = find(_varNames.begin(), _varNames.end(), name) -
+		_varNames.begin();
+	if (index == _varNames.size()) _varNames.push_back(name);
+
+	int n = _newNode(COPY, -1, -1);
+	_nodes[n].kind = operand_t::INPUT;
+	_nodes[n].index = index;
+	return(n);
+}
+
+//
+// Code generation. Registers are released as soon as their value has
+// been consumed, so an instruction may overwrite one of its own
+// operands, which is safe for element-wise operations.
+//
+
+Expression::operand_t Expression::_compile(int n) {
+	const node_t node = _nodes[n];
+
+	operand_t result;
+	result.kind = node.kind;
+	result.index = node.index;
+	result.value = node.value;
+	if (node.kind != operand_t::REG) return(result);
+
+	operand_t a = _compile(node.left);
+	operand_t b = node.right >= 0 ? _compile(node.right) : a;
+
+	if (a.kind == operand_t::CONST && b.kind == operand_t::CONST) {
+		result.kind = operand_t::CONST;
+		result.index = -1;
+		result.value = _evalScalar(node.op, a.value, b.value);
+		return(result);
+	}
+
+	_releaseReg(a);
+	if (node.right >= 0) _releaseReg(b);
+
+	instr_t instr;
+	instr.op = node.op;
+	instr.dst = _allocReg();
+	instr.a = a;
+	instr.b = b;
+	_program.push_back(instr);
+
+	result.kind = operand_t::REG;
+	result.index = instr.dst;
+	return(result);
+}
+
+int Expression::_allocReg() {
+	if (! _freeRegs.empty()) {
+		int r = _freeRegs.back();
+		_freeRegs.pop_back();
+		return(r);
+	}
+	return(_nregs++);
+}
+
+void Expression::_releaseReg(const operand_t &o) {
+	if (o.kind != operand_t::REG) return;
+	if (find(_freeRegs.begin(), _freeRegs.end(), o.index) != _freeRegs.end()) {
+		return;
+	}
+	_freeRegs.push_back(o.index);
+}
+
+bool Expression::_isBinary(op_t op) {
+	return(op >= ADD);
+}
+
+//
+// Evaluation
+//
+
+namespace {
+
+// Apply f element-wise where either operand may be a scalar (NULL
+// array). Each case is a separate loop so that it vectorizes.
+//
+template <typename F>
+inline void binary(
+	size_t n, const float *a, float av, const float *b, float bv, float *dst,
+	F f
+) {
+	if (a && b) {
+		for (size_t i=0; i<n; i++) dst[i] = f(a[i], b[i]);
+	}
+	else if (a) {
+		for (size_t i=0; i<n; i++) dst[i] = f(a[i], bv);
+	}
+	else {
+		for (size_t i=0; i<n; i++) dst[i] = f(av, b[i]);
+	}
+}
+
+template <typename F>
+inline void unary(size_t n, const float *a, float av, float *dst, F f) {
+	if (a) {
+		for (size_t i=0; i<n; i++) dst[i] = f(a[i]);
+	}
+	else {
+		std::fill(dst, dst + n, f(av));
+	}
+}
+
+};
+
+#define	UNARY(F)	unary(n, a, av, dst, [](float x) {return(F);})
+#define	BINARY(F)	binary(n, a, av, b, bv, dst, [](float x, float y) {return(F);})
+
+void Expression::_apply(
+	op_t op, size_t n, const float *a, float av, const float *b, float bv,
+	float *dst
+) {
+	switch (op) {
+	case COPY: UNARY(x); break;
+	case NEG: UNARY(-x); break;
+	case SQRT: UNARY(std::sqrt(x)); break;
+	case ABS: UNARY(std::fabs(x)); break;
+	case EXP: UNARY(std::exp(x)); break;
+	case LOG: UNARY(std::log(x)); break;
+	case LOG10: UNARY(std::log10(x)); break;
+	case SIN: UNARY(std::sin(x)); break;
+	case COS: UNARY(std::cos(x)); break;
+	case TAN: UNARY(std::tan(x)); break;
+	case ASIN: UNARY(std::asin(x)); break;
+	case ACOS: UNARY(std::acos(x)); break;
+	case ATAN: UNARY(std::atan(x)); break;
+	case FLOOR: UNARY(std::floor(x)); break;
+	case CEIL: UNARY(std::ceil(x)); break;
+	case ADD: BINARY(x + y); break;
+	case SUB: BINARY(x - y); break;
+	case MUL: BINARY(x * y); break;
+	case DIV: BINARY(x / y); break;
+	case POW: BINARY(std::pow(x, y)); break;
+	case ATAN2: BINARY(std::atan2(x, y)); break;
+	case MIN: BINARY(x < y ? x : y); break;
+	case MAX: BINARY(x > y ? x : y); break;
+	default: assert(0);
+	}
+}
+
+float Expression::_evalScalar(op_t op, float a, float b) {
+	float result;
+	if (_isBinary(op)) {
+		_apply(op, 1, &a, a, &b, b, &result);
+	}
+	else {
+		_apply(op, 1, &a, a, NULL, 0.0, &result);
+	}
+	return(result);
+}
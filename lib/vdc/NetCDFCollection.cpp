@@ -1,8 +1,16 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <algorithm>
 #include <utility>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
 #include <netcdf.h>
+#include <vapor/FileUtils.h>
+#include <vapor/ThreadPool.h>
+#include <vapor/Trace.h>
 #include <vapor/NetCDFCollection.h>
 
 using namespace VAPoR;
@@ -40,6 +48,69 @@ bool readOK(vector <size_t> dims, size_t start[], size_t count[]) {
 	return(true);
 }
 
+// Index file encoding. The index is a cache local to the machine that
+// wrote it, so native byte order is used.
+//
+const string IndexMagic = "VAPOR NetCDFCollection index";
+const int IndexVersion = 2;
+
+template <class T>
+void write_pod(ostream &o, const T &v) {
+	o.write((const char *) &v, sizeof(v));
+}
+
+template <class T>
+bool read_pod(istream &i, T &v) {
+	return((bool) i.read((char *) &v, sizeof(v)));
+}
+
+void write_string(ostream &o, const string &s) {
+	write_pod(o, (uint64_t) s.size());
+	o.write(s.data(), s.size());
+}
+
+bool read_string(istream &i, string &s) {
+	uint64_t n;
+	if (! read_pod(i, n) || n > (1 << 30)) return(false);
+	s.resize(n);
+	return(n == 0 || (bool) i.read(&s[0], n));
+}
+
+// Vectors of values keyed by variable name
+//
+void write_values(ostream &o, const map <string, vector <double> > &m) {
+	write_pod(o, (uint64_t) m.size());
+	map <string, vector <double> >::const_iterator itr;
+	for (itr = m.begin(); itr != m.end(); ++itr) {
+		write_string(o, itr->first);
+		write_pod(o, (uint64_t) itr->second.size());
+		o.write(
+			(const char *) itr->second.data(), 
+			itr->second.size() * sizeof(double)
+		);
+	}
+}
+
+bool read_values(istream &i, map <string, vector <double> > &m) {
+	uint64_t n;
+	if (! read_pod(i, n)) return(false);
+
+	for (uint64_t j=0; j<n; j++) {
+		string name;
+		uint64_t len;
+		if (! (read_string(i, name) && read_pod(i, len) && len < (1<<30))) {
+			return(false);
+		}
+
+		vector <double> &values = m[name];
+		values.resize(len);
+		if (len && ! i.read((char *) values.data(), len * sizeof(double))) {
+			return(false);
+		}
+	}
+	return(true);
+}
+
 };
 
 NetCDFCollection::NetCDFCollection() {
@@ -53,6 +124,9 @@ NetCDFCollection::NetCDFCollection() {
 	_ovr_table.clear();
 	_ncdfmap.clear();
 	_failedVars.clear();
+	_indexFile.clear();
+	_index.clear();
+	_indexDirty = false;
 }
 
 NetCDFCollection::~NetCDFCollection() {
@@ -92,6 +166,23 @@ int NetCDFCollection::Initialize(
 	
 	ReInitialize();
 
+	if (! _indexFile.empty() && _index.empty()) {
+		(void) _readIndex();
+	}
+
+	//
+	// Gather the metadata for each file exactly once, from the index
+	// if possible. 
+	//
+	for (int i=0; i<files.size(); i++) {
+		if (_ncdfmap.find(files[i]) != _ncdfmap.end()) continue;
+
+		NetCDFSimple *netcdf = _scanFile(files[i]);
+		if (! netcdf) return(-1);
+
+		_ncdfmap[files[i]] = netcdf;
+	}
+
 	//
 	// Build a hash table to map a variable's time dimension
 	// to its time coordinates
@@ -103,14 +194,7 @@ int NetCDFCollection::Initialize(
 	if (rc<0) return(-1);
 		
 	for (int i=0; i<files.size(); i++) {
-		NetCDFSimple *netcdf = new NetCDFSimple();
-		_ncdfmap[files[i]] = netcdf;
-
-		rc = netcdf->Initialize(files[i]);
-		if (rc<0) {
-			SetErrMsg("NetCDFSimple::Initialize(%s)", files[i].c_str());
-			return(-1);
-		}
+		NetCDFSimple *netcdf = _ncdfmap[files[i]];
 
 		//
 		// Get dimension names and lengths 
@@ -183,10 +267,245 @@ int NetCDFCollection::Initialize(
 			}
 		}
 	}
+
+	if (_indexDirty) {
+		bool enable = EnableErrMsg(false);
+		if (_writeIndex() < 0) SetErrCode(0);
+		(void) EnableErrMsg(enable); 
+	}
 	
 	return(0);
 }
 
+void NetCDFCollection::SetIndexFile(string path) {
+	if (path == _indexFile) return;
+
+	_indexFile = path;
+	_index.clear();
+	_indexDirty = false;
+}
+
+string NetCDFCollection::DefaultIndexFile(const vector <string> &files) {
+	const char *dir = getenv("VAPOR_NETCDF_INDEX_DIR");
+	if (! dir || ! *dir || files.empty()) return("");
+
+	// FNV-1a hash of the file list, so that each collection gets its
+	// own index
+	//
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i=0; i<files.size(); i++) {
+		string s = files[i] + '\n';
+		for (int j=0; j<s.size(); j++) {
+			hash ^= (unsigned char) s[j];
+			hash *= 1099511628211ULL;
+		}
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx.ncindex", (unsigned long long) hash);
+	return(string(dir) + "/" + name);
+}
+
+NetCDFSimple *NetCDFCollection::_scanFile(string file) {
+
+	long mtime = FileUtils::GetFileModifiedTime(file);
+	long long size = FileUtils::GetFileSize(file);
+
+	map <string, indexEntry>::const_iterator itr = _index.find(file);
+	if (
+		itr != _index.end() && itr->second._mtime == mtime && 
+		itr->second._size == size && size >= 0
+	) {
+		NetCDFSimple *netcdf = new NetCDFSimple();
+		istringstream in(itr->second._metadata);
+		bool enable = EnableErrMsg(false);
+		int rc = netcdf->Deserialize(in);
+		(void) EnableErrMsg(enable); 
+		if (rc == 0) return(netcdf);
+
+		// Corrupt entry. Fall through and rescan.
+		//
+		SetErrCode(0);
+		delete netcdf;
+	}
+
+	NetCDFSimple *netcdf = new NetCDFSimple();
+	int rc = netcdf->Initialize(file);
+	if (rc<0) {
+		SetErrMsg("NetCDFSimple::Initialize(%s)", file.c_str());
+		delete netcdf;
+		return(NULL);
+	}
+
+	if (! _indexFile.empty()) {
+		ostringstream out;
+		netcdf->Serialize(out);
+
+		indexEntry &entry = _index[file];
+		entry._mtime = mtime;
+		entry._size = size;
+		entry._metadata = out.str();
+		entry._timeCoords.clear();
+		entry._derivedValues.clear();
+		_indexDirty = true;
+	}
+	return(netcdf);
+}
+
+bool NetCDFCollection::GetIndexedValues(
+	string file, string name, vector <double> &values
+) const {
+	values.clear();
+
+	map <string, indexEntry>::const_iterator itr = _index.find(file);
+	if (itr == _index.end()) return(false);
+
+	const map <string, vector <double> > &m = itr->second._derivedValues;
+	map <string, vector <double> >::const_iterator itr1 = m.find(name);
+	if (itr1 == m.end()) return(false);
+
+	values = itr1->second;
+	return(true);
+}
+
+void NetCDFCollection::SetIndexedValues(
+	string file, string name, const vector <double> &values
+) {
+	map <string, indexEntry>::iterator itr = _index.find(file);
+	if (itr == _index.end()) return;
+
+	itr->second._derivedValues[name] = values;
+	_indexDirty = true;
+}
+
+int NetCDFCollection::FlushIndex() {
+	if (! _indexDirty) return(0);
+	return(_writeIndex());
+}
+
+int NetCDFCollection::_getTimeCoordVar(
+	string file, const NetCDFSimple::Variable &variable, vector <double> &times
+) {
+	times.clear();
+
+	map <string, indexEntry>::iterator itr = _index.find(file);
+	if (itr != _index.end()) {
+		const map <string, vector <double> > &tcs = itr->second._timeCoords;
+		if (tcs.find(variable.GetName()) != tcs.end()) {
+			times = tcs.find(variable.GetName())->second;
+			return(0);
+		}
+	}
+
+	// Read through a copy of the file's metadata so that the file is
+	// closed again when the copy is destroyed. Files in _ncdfmap are 
+	// not opened until variables are read after initialization.
+	//
+	NetCDFSimple netcdf = *_ncdfmap[file];
+
+	float *buf= _Get1DVar(&netcdf, variable);
+	if (! buf) return(-1);
+
+	string timedim = variable.GetDimNames()[0];
+	size_t timedimlen = netcdf.DimLen(timedim);
+	for (int t=0; t<timedimlen; t++) {
+		times.push_back(buf[t]);
+	}
+	delete [] buf;
+
+	if (itr != _index.end()) {
+		itr->second._timeCoords[variable.GetName()] = times;
+		_indexDirty = true;
+	}
+	return(0);
+}
+
+int NetCDFCollection::_readIndex() {
+	_index.clear();
+	_indexDirty = false;
+
+	ifstream in(_indexFile.c_str(), ios::in | ios::binary);
+	if (! in) return(-1);
+
+	string magic;
+	int version;
+	uint64_t n;
+	if (
+		! read_string(in, magic) || magic != IndexMagic ||
+		! read_pod(in, version) || version != IndexVersion ||
+		! read_pod(in, n)
+	) {
+		return(-1);
+	}
+
+	for (uint64_t i=0; i<n; i++) {
+		string file;
+		indexEntry entry;
+		int64_t mtime, size;
+
+		bool ok = read_string(in, file) && read_pod(in, mtime) &&
+			read_pod(in, size) && read_string(in, entry._metadata) &&
+			read_values(in, entry._timeCoords) && 
+			read_values(in, entry._derivedValues);
+
+		if (! ok) {
+			_index.clear();
+			return(-1);
+		}
+
+		entry._mtime = (long) mtime;
+		entry._size = (long long) size;
+		_index[file] = entry;
+	}
+
+	return(0);
+}
+
+int NetCDFCollection::_writeIndex() {
+
+	// Write to a temporary and rename so that readers never see
+	// a partially written index
+	//
+	string tmpfile = _indexFile + ".tmp";
+	ofstream out(tmpfile.c_str(), ios::out | ios::binary | ios::trunc);
+	if (! out) {
+		SetErrMsg("Failed to open index file %s", tmpfile.c_str());
+		return(-1);
+	}
+
+	write_string(out, IndexMagic);
+	write_pod(out, IndexVersion);
+	write_pod(out, (uint64_t) _index.size());
+
+	map <string, indexEntry>::const_iterator itr;
+	for (itr = _index.begin(); itr != _index.end(); ++itr) {
+		const indexEntry &entry = itr->second;
+
+		write_string(out, itr->first);
+		write_pod(out, (int64_t) entry._mtime);
+		write_pod(out, (int64_t) entry._size);
+		write_string(out, entry._metadata);
+		write_values(out, entry._timeCoords);
+		write_values(out, entry._derivedValues);
+	}
+
+	out.close();
+	if (! out) {
+		SetErrMsg("Failed to write index file %s", tmpfile.c_str());
+		remove(tmpfile.c_str());
+		return(-1);
+	}
+
+	if (rename(tmpfile.c_str(), _indexFile.c_str()) != 0) {
+		SetErrMsg("rename(%s, %s) : %M", tmpfile.c_str(), _indexFile.c_str());
+		remove(tmpfile.c_str());
+		return(-1);
+	}
+
+	_indexDirty = false;
+	return(0);
+}
+
 bool NetCDFCollection::VariableExists(string varname) const {
 
     //
@@ -956,7 +1275,7 @@ int NetCDFCollection::_InitializeTimesMap(
 	const vector <string> &time_coordvars, 
 	map <string, vector <double> > &timesMap, 
 	vector <double> &times, int &file_org
-) const {
+) {
 	timesMap.clear();
 	if (time_coordvars.size() && (time_coordvars.size()!=time_dimnames.size())){
 		SetErrMsg("NetCDFCollection::Initialize() : number of time coordinate variables and time dimensions must match when time coordinate variables specified");
@@ -1029,13 +1348,7 @@ int NetCDFCollection::_InitializeTimesMapCase1(
 	//
 
 	for (int i=0; i<files.size(); i++) {
-		NetCDFSimple *netcdf = new NetCDFSimple();
-
-		int rc = netcdf->Initialize(files[i]);
-		if (rc<0) {
-			SetErrMsg("NetCDFSimple::Initialize(%s)", files[i].c_str());
-			return(-1);
-		}
+		const NetCDFSimple *netcdf = _ncdfmap.find(files[i])->second;
 
 		const vector <NetCDFSimple::Variable> &variables = netcdf->GetVariables();
 
@@ -1060,7 +1373,6 @@ int NetCDFCollection::_InitializeTimesMapCase1(
 
 			currentTime[varname] += 1.0;
 		}
-		delete netcdf;
 	}
 	return(0);
 }
@@ -1082,13 +1394,7 @@ int NetCDFCollection::_InitializeTimesMapCase2(
 	//
 
 	for (int i=0; i<files.size(); i++) {
-		NetCDFSimple *netcdf = new NetCDFSimple();
-
-		int rc = netcdf->Initialize(files[i]);
-		if (rc<0) {
-			SetErrMsg("NetCDFSimple::Initialize(%s)", files[i].c_str());
-			return(-1);
-		}
+		const NetCDFSimple *netcdf = _ncdfmap.find(files[i])->second;
 
 		const vector <NetCDFSimple::Variable> &variables = netcdf->GetVariables();
 
@@ -1125,7 +1431,6 @@ int NetCDFCollection::_InitializeTimesMapCase2(
 
 			timesMap[key] = times;
 		}
-		delete netcdf;
 	}
 	return(0);
 }
@@ -1134,7 +1439,7 @@ int NetCDFCollection::_InitializeTimesMapCase3(
 	const vector <string> &files, const vector <string> &time_dimnames, 
 	const vector <string> &time_coordvars,
 	map <string, vector <double> > &timesMap
-) const {
+) {
 	timesMap.clear();
 
 	//
@@ -1149,10 +1454,7 @@ int NetCDFCollection::_InitializeTimesMapCase3(
 	}
 
 	for (int i=0; i<files.size(); i++) {
-		NetCDFSimple *netcdf = new NetCDFSimple();
-
-		int rc = netcdf->Initialize(files[i]);
-		if (rc<0) return(-1);
+		const NetCDFSimple *netcdf = _ncdfmap.find(files[i])->second;
 
 		const vector <NetCDFSimple::Variable> &variables = netcdf->GetVariables();
 
@@ -1170,8 +1472,9 @@ int NetCDFCollection::_InitializeTimesMapCase3(
 			tcvcount[time_coordvars[j]] += 1; 
 
 			// Read TCV
-			float *buf= _Get1DVar(netcdf, variables[index]);
-			if (! buf) {
+			vector <double> times;
+			int rc = _getTimeCoordVar(files[i], variables[index], times);
+			if (rc<0) {
 				SetErrMsg(	
 					"Failed to read time coordinate variable \"%s\"",
 					time_coordvars[j].c_str()
@@ -1180,13 +1483,6 @@ int NetCDFCollection::_InitializeTimesMapCase3(
 			}
 
 			string timedim = variables[index].GetDimNames()[0];
-			size_t timedimlen = netcdf->DimLen(timedim);
-
-			vector <double> times;
-			for (int t=0; t<timedimlen; t++) {
-				times.push_back(buf[t]);
-			}
-			delete [] buf;
 
 			//
 			// The hash key for timesMap is the file plus the
@@ -1210,7 +1506,6 @@ int NetCDFCollection::_InitializeTimesMapCase3(
 			}
 		}
 
-		delete netcdf;
 	}
 
 	//
@@ -1285,6 +1580,72 @@ void NetCDFCollection::_InterpolateSlice(
 	}
 }
 
+// Resample a hyperslab of staggered data onto the unstaggered grid in
+// a single pass. Each output sample is the mean of the 2, 4, or 8 input
+// samples that bracket it along the staggered dimensions, which is
+// what successive application of _InterpolateLine() along each
+// staggered dimension computes. Slabs (z slices of the output) are
+// processed in parallel.
+//
+// count gives the output dimensions, slowest varying first. The input
+// has count[i] + 1 samples along each dimension i for which stag[i]
+// is true.
+//
+void NetCDFCollection::_InterpolateRegion(
+	const float *src, const size_t count[3], const bool stag[3],
+	bool has_missing, float mv, float *dst
+) const {
+
+	size_t nx = count[2];
+	size_t ny = count[1];
+	size_t nz = count[0];
+
+	size_t snx = stag[2] ? nx+1 : nx;
+	size_t sny = stag[1] ? ny+1 : ny;
+
+	// Offsets into src of the corners surrounding an output sample
+	//
+	size_t offsets[8];
+	int ncorners = 0;
+	for (int dk=0; dk <= (int) stag[0]; dk++) {
+	for (int dj=0; dj <= (int) stag[1]; dj++) {
+	for (int di=0; di <= (int) stag[2]; di++) {
+		offsets[ncorners++] = (dk*sny + dj)*snx + di;
+	}
+	}
+	}
+	float scale = 1.0 / (float) ncorners;
+
+	Wasp::ThreadPool::Instance()->ParallelFor(
+		0, nz, 1, [&](size_t kbegin, size_t kend) {
+
+		for (size_t k=kbegin; k<kend; k++) {
+		for (size_t j=0; j<ny; j++) {
+			const float *srow = src + (k*sny + j)*snx;
+			float *drow = dst + (k*ny + j)*nx;
+
+			// Accumulate whole rows so the inner loops vectorize
+			//
+			for (size_t i=0; i<nx; i++) drow[i] = srow[offsets[0] + i];
+			for (int c=1; c<ncorners; c++) {
+				const float *s = srow + offsets[c];
+				for (size_t i=0; i<nx; i++) drow[i] += s[i];
+			}
+			for (size_t i=0; i<nx; i++) drow[i] *= scale;
+
+			if (! has_missing) continue;
+
+			for (int c=0; c<ncorners; c++) {
+				const float *s = srow + offsets[c];
+				for (size_t i=0; i<nx; i++) {
+					if (s[i] == mv) drow[i] = mv;
+				}
+			}
+		}
+		}
+	});
+}
+
 float *NetCDFCollection::_Get1DVar(
 	NetCDFSimple *netcdf, 
 	const NetCDFSimple::Variable &variable
@@ -1563,8 +1924,63 @@ int NetCDFCollection::Read(size_t start[], size_t count[], float *data, int fd)
 		return(NetCDFCollection::ReadNative(start, count, data, fd));
 	}
 
-	SetErrMsg("Not implemented");
-	return(-1);
+	return(_readStaggered(start, count, data, fd));
+}
+
+int NetCDFCollection::_readStaggered(
+	size_t start[], size_t count[], float *data, int fd
+) {
+	VAPOR_TRACE_SCOPE("NetCDFCollection::ReadStaggered");
+
+	fileHandle &fh = _ovr_table.find(fd)->second;
+
+	vector <size_t> dims = fh._tvvars.GetSpatialDims();
+	vector <string> dimnames = fh._tvvars.GetSpatialDimNames();
+	int ndims = (int) dims.size();
+
+	if (ndims < 1 || ndims > 3) {
+		SetErrMsg("Only 1D, 2D and 3D variables supported");
+		return(-1);
+	}
+
+	// Expand the region by one sample along each staggered dimension
+	// and read just that hyperslab. Dimensions are padded to 3D, 
+	// slowest varying first.
+	//
+	size_t nstart[NC_MAX_VAR_DIMS];
+	size_t ncount[NC_MAX_VAR_DIMS];
+	size_t ucount[3] = {1,1,1};
+	bool stag[3] = {false, false, false};
+	size_t nelements = 1;
+	for (int i=0; i<ndims; i++) {
+		int i3 = i + 3 - ndims;
+		stag[i3] = IsStaggeredDim(dimnames[i]);
+		ucount[i3] = count[i];
+
+		nstart[i] = start[i];
+		ncount[i] = stag[i3] ? count[i] + 1 : count[i];
+		if (nstart[i] + ncount[i] > dims[i]) {
+			SetErrMsg("Invalid region");
+			return(-1);
+		}
+		nelements *= ncount[i];
+	}
+	if (ucount[0]*ucount[1]*ucount[2] == 0) return(0);
+
+	if (fh._regionbufsz < (nelements*sizeof(*data))) {
+		if (fh._regionbuf) delete [] fh._regionbuf;
+		fh._regionbuf = (unsigned char *) new float [nelements];
+		fh._regionbufsz = nelements*sizeof(*data);
+	}
+	float *buffer = (float *) fh._regionbuf;
+
+	int rc = NetCDFCollection::ReadNative(nstart, ncount, buffer, fd);
+	if (rc<0) return(rc);
+
+	_InterpolateRegion(
+		buffer, ucount, stag, fh._has_missing, fh._missing_value, data
+	);
+	return(0);
 }
 
 int NetCDFCollection::Read(
@@ -1791,6 +2207,11 @@ int NetCDFCollection::Close(int fd) {
 	int rc = fh._ncdfptr->Close(fh._fd);
 	if (fh._slicebuf) delete [] fh._slicebuf;
 	if (fh._linebuf) delete [] fh._linebuf;
+	if (fh._regionbuf) delete [] fh._regionbuf;
+	fh._slicebuf = NULL;
+	fh._linebuf = NULL;
+	fh._regionbuf = NULL;
+	fh._slicebufsz = fh._linebufsz = fh._regionbufsz = 0;
 
 	_ovr_table.erase(itr);
 	return(rc);
@@ -2044,6 +2465,8 @@ NetCDFCollection::fileHandle::fileHandle() {
 	_slicebufsz = 0;
 	_linebuf = NULL;
 	_linebufsz = 0;
+	_regionbuf = NULL;
+	_regionbufsz = 0;
 	_has_missing = false;
 	_missing_value = 0.0;
 }
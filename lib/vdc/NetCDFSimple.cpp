@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cassert>
+#include <cstdint>
 #include <netcdf.h>
 #include <vapor/NetCDFSimple.h>
 
@@ -7,6 +8,114 @@ using namespace VAPoR;
 using namespace Wasp;
 using namespace std;
 
+namespace {
+
+// Helpers for the native binary encoding used by Serialize() and
+// Deserialize(). Serialized metadata is a cache local to the machine
+// that wrote it, so no attempt is made at portability.
+//
+
+template <class T>
+void write_pod(ostream &o, const T &v) {
+	o.write((const char *) &v, sizeof(v));
+}
+
+template <class T>
+bool read_pod(istream &i, T &v) {
+	return((bool) i.read((char *) &v, sizeof(v)));
+}
+
+// Guard against allocating absurd amounts of memory from a corrupt
+// stream
+//
+const uint64_t MaxLen = 1 << 30;
+
+void write_string(ostream &o, const string &s) {
+	write_pod(o, (uint64_t) s.size());
+	o.write(s.data(), s.size());
+}
+
+bool read_string(istream &i, string &s) {
+	uint64_t n;
+	if (! read_pod(i, n) || n > MaxLen) return(false);
+	s.resize(n);
+	return(n == 0 || (bool) i.read(&s[0], n));
+}
+
+template <class T>
+void write_vector(ostream &o, const vector <T> &v) {
+	write_pod(o, (uint64_t) v.size());
+	for (int j=0; j<v.size(); j++) write_pod(o, v[j]);
+}
+
+template <class T>
+bool read_vector(istream &i, vector <T> &v) {
+	uint64_t n;
+	if (! read_pod(i, n) || n > MaxLen) return(false);
+	v.resize(n);
+	for (int j=0; j<n; j++) {
+		if (! read_pod(i, v[j])) return(false);
+	}
+	return(true);
+}
+
+void write_strings(ostream &o, const vector <string> &v) {
+	write_pod(o, (uint64_t) v.size());
+	for (int j=0; j<v.size(); j++) write_string(o, v[j]);
+}
+
+bool read_strings(istream &i, vector <string> &v) {
+	uint64_t n;
+	if (! read_pod(i, n) || n > MaxLen) return(false);
+	v.resize(n);
+	for (int j=0; j<n; j++) {
+		if (! read_string(i, v[j])) return(false);
+	}
+	return(true);
+}
+
+template <class T>
+void write_atts(ostream &o, const vector <pair <string, vector <T> > > &atts) {
+	write_pod(o, (uint64_t) atts.size());
+	for (int j=0; j<atts.size(); j++) {
+		write_string(o, atts[j].first);
+		write_vector(o, atts[j].second);
+	}
+}
+
+template <class T>
+bool read_atts(istream &i, vector <pair <string, vector <T> > > &atts) {
+	uint64_t n;
+	if (! read_pod(i, n) || n > MaxLen) return(false);
+	atts.resize(n);
+	for (int j=0; j<n; j++) {
+		if (! read_string(i, atts[j].first)) return(false);
+		if (! read_vector(i, atts[j].second)) return(false);
+	}
+	return(true);
+}
+
+void write_atts(ostream &o, const vector <pair <string, string> > &atts) {
+	write_pod(o, (uint64_t) atts.size());
+	for (int j=0; j<atts.size(); j++) {
+		write_string(o, atts[j].first);
+		write_string(o, atts[j].second);
+	}
+}
+
+bool read_atts(istream &i, vector <pair <string, string> > &atts) {
+	uint64_t n;
+	if (! read_pod(i, n) || n > MaxLen) return(false);
+	atts.resize(n);
+	for (int j=0; j<n; j++) {
+		if (! read_string(i, atts[j].first)) return(false);
+		if (! read_string(i, atts[j].second)) return(false);
+	}
+	return(true);
+}
+
+};
+
 NetCDFSimple::NetCDFSimple() {
 	_ncid = -1;
 	_ovr_table.clear();
@@ -152,6 +261,53 @@ int NetCDFSimple::Initialize(string path)
 	return(0);
 }
 
+void NetCDFSimple::Serialize(ostream &o) const {
+	write_string(o, _path);
+	write_strings(o, _dimnames);
+	write_vector(o, _dims);
+	write_strings(o, _unlimited_dimnames);
+	write_atts(o, _flt_atts);
+	write_atts(o, _int_atts);
+	write_atts(o, _str_atts);
+
+	write_pod(o, (uint64_t) _variables.size());
+	for (int i=0; i<_variables.size(); i++) {
+		_variables[i].Serialize(o);
+	}
+}
+
+int NetCDFSimple::Deserialize(istream &in) {
+	_dimnames.clear();
+	_dims.clear();
+	_unlimited_dimnames.clear();
+	_flt_atts.clear();
+	_int_atts.clear();
+	_str_atts.clear();
+	_variables.clear();
+
+	bool ok = read_string(in, _path) &&
+		read_strings(in, _dimnames) &&
+		read_vector(in, _dims) &&
+		read_strings(in, _unlimited_dimnames) &&
+		read_atts(in, _flt_atts) &&
+		read_atts(in, _int_atts) &&
+		read_atts(in, _str_atts);
+
+	uint64_t nvars = 0;
+	ok = ok && read_pod(in, nvars) && nvars <= MaxLen;
+	for (uint64_t i=0; ok && i<nvars; i++) {
+		Variable var;
+		ok = var.Deserialize(in);
+		if (ok) _variables.push_back(var);
+	}
+
+	if (! ok || _dimnames.size() != _dims.size()) {
+		SetErrMsg("Corrupt netCDF metadata for file %s", _path.c_str());
+		return(-1);
+	}
+	return(0);
+}
+
 int NetCDFSimple::OpenRead(
 	const NetCDFSimple::Variable &variable
 ) {
@@ -618,6 +774,28 @@ NetCDFSimple::Variable::Variable(
 	_str_atts.clear();
 }
 
+void NetCDFSimple::Variable::Serialize(ostream &o) const {
+	write_string(o, _name);
+	write_strings(o, _dimnames);
+	write_atts(o, _flt_atts);
+	write_atts(o, _int_atts);
+	write_atts(o, _str_atts);
+	write_pod(o, _type);
+	write_pod(o, _varid);
+}
+
+bool NetCDFSimple::Variable::Deserialize(istream &i) {
+	return(
+		read_string(i, _name) &&
+		read_strings(i, _dimnames) &&
+		read_atts(i, _flt_atts) &&
+		read_atts(i, _int_atts) &&
+		read_atts(i, _str_atts) &&
+		read_pod(i, _type) &&
+		read_pod(i, _varid)
+	);
+}
+
 vector <string> NetCDFSimple::Variable::GetAttNames() const {
 	vector <string> names;
 
@@ -0,0 +1,339 @@
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+#include <vapor/EasyThreads.h>
+#include <vapor/WASP.h>
+#include <vapor/VDCNetCDF.h>
+#include <vapor/VDCInSitu.h>
+
+using namespace VAPoR;
+using namespace Wasp;
+using namespace std;
+
+namespace {
+
+// Identifies a field by the variable, file, and time step within the
+// file written
+//
+string field_key(string varname, string path, size_t file_ts) {
+	return(varname + "\n" + path + "\n" + std::to_string(file_ts));
+}
+
+};
+
+VDCInSitu::VDCInSitu(int nwriters, size_t maxMemory) {
+	if (nwriters < 1) {
+		nwriters = std::max(1, std::min(EasyThreads::NProc() / 4, 4));
+	}
+
+	// Writers hand compression off to the shared pool, so they need
+	// little more than a thread each to wait on it
+	//
+	_nwriters = nwriters;
+	_maxMemory = maxMemory > 0 ? maxMemory : (size_t) 1024*1024*1024;
+	_pool = new ThreadPool(nwriters + 1);
+	_group = new ThreadPool::TaskGroup(_pool);
+	_meta = NULL;
+	_bytesQueued = 0;
+	_bytesFree = 0;
+	_bytesWritten = 0;
+	_waitTime = 0.0;
+	_nRunning = 0;
+}
+
+VDCInSitu::~VDCInSitu() {
+	_close();
+	delete _group;
+	delete _pool;
+
+	for (int i=0; i<_free.size(); i++) delete _free[i];
+}
+
+int VDCInSitu::Initialize(string path) {
+	_close();
+
+	// Opening a netCDF file is not thread safe, and writers of other
+	// VDCs may be running
+	//
+	std::lock_guard<std::mutex> guard(WASP::GetNetCDFMutex());
+
+	// One VDC for each writer, and one for the caller's queries
+	//
+	vector <VDCNetCDF *> vdcs;
+	for (int i=0; i<_nwriters+1; i++) {
+		VDCNetCDF *vdc = new VDCNetCDF();
+		vdcs.push_back(vdc);
+
+		vector <size_t> bs;
+		int rc = vdc->Initialize(path, vector <string> (), VDC::A, bs);
+		if (rc<0) {
+			for (int j=0; j<vdcs.size(); j++) delete vdcs[j];
+			SetErrMsg("Failed to open VDC %s for writing", path.c_str());
+			return(-1);
+		}
+	}
+	_meta = vdcs[0];
+	_idle.assign(vdcs.begin() + 1, vdcs.end());
+	_path = path;
+
+	return(0);
+}
+
+int VDCInSitu::Put(size_t ts, string varname, const float *data) {
+	if (! _meta) {
+		SetErrMsg("VDC not initialized");
+		return(-1);
+	}
+
+	vector <size_t> dims;
+	if (! _meta->GetVarDimLens(varname, true, dims)) {
+		SetErrMsg("Undefined variable name : %s", varname.c_str());
+		return(-1);
+	}
+	size_t nelements = 1;
+	for (int i=0; i<dims.size(); i++) nelements *= dims[i];
+
+	item_t item;
+	item.ts = ts;
+	item.varname = varname;
+	item.nbytes = nelements * sizeof(float);
+
+	size_t file_ts, max_ts;
+	int rc = _meta->GetPath(varname, ts, item.path, file_ts, max_ts);
+	if (rc<0) return(-1);
+	item.key = field_key(varname, item.path, file_ts);
+
+	// A masked variable is written after its mask, which is read when
+	// the variable is opened for writing
+	//
+	VDC::DataVar dvar;
+	if (_meta->GetDataVarInfo(varname, dvar) && ! dvar.GetMaskvar().empty()) {
+		string maskvar = dvar.GetMaskvar();
+		string maskpath;
+		rc = _meta->GetPath(maskvar, ts, maskpath, file_ts, max_ts);
+		if (rc<0) return(-1);
+		item.maskkey = field_key(maskvar, maskpath, file_ts);
+	}
+
+	// Variables stored in the master file, typically small coordinate
+	// variables, are written at once. Every VDC has the master open, but
+	// only _meta writes to it, so that no other handle has changes to
+	// it that could overwrite those of another when flushed. The path
+	// of the master is the one the VDC was opened with.
+	//
+	if (item.path == _path) {
+		rc = _write(_meta, ts, varname, data);
+		if (rc<0) {
+			SetErrMsg(
+				"Failed to write variable %s at time step %d",
+				varname.c_str(), (int) ts
+			);
+			return(-1);
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			_bytesWritten += item.nbytes;
+		}
+		return(_reportErrors());
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		// Only wait for memory if something is queued, otherwise a field
+		// larger than the limit could never be written
+		//
+		auto fits = [this, &item]() {
+			return(
+				_bytesQueued == 0 ||
+				_bytesQueued + item.nbytes <= _maxMemory
+			);
+		};
+		if (! fits()) {
+			auto t0 = std::chrono::steady_clock::now();
+			_cv.wait(lock, fits);
+			std::chrono::duration<double> dt =
+				std::chrono::steady_clock::now() - t0;
+			_waitTime += dt.count();
+		}
+
+		item.buf = _getBuffer(nelements);
+		_bytesQueued += item.nbytes;
+	}
+
+	std::copy(data, data + nelements, item.buf->begin());
+
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+
+		_queue.push_back(item);
+		_pending.insert(item.key);
+
+		// A running writer keeps taking fields until none it may write
+		// remain, so a new one is only needed when one is idle
+		//
+		if (_nRunning < _nwriters) {
+			_nRunning++;
+			_group->Run([this]() { _writer(); });
+		}
+	}
+
+	return(_reportErrors());
+}
+
+int VDCInSitu::Flush() {
+	_group->Wait();
+	return(_reportErrors());
+}
+
+size_t VDCInSitu::GetBytesWritten() const {
+	std::lock_guard<std::mutex> guard(_mutex);
+	return(_bytesWritten);
+}
+
+double VDCInSitu::GetWaitTime() const {
+	std::lock_guard<std::mutex> guard(_mutex);
+	return(_waitTime);
+}
+
+void VDCInSitu::_writer() {
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	assert(! _idle.empty());
+	VDCNetCDF *vdc = _idle.back();
+	_idle.pop_back();
+
+	for (;;) {
+
+		// Take the oldest field whose file is not being written by
+		// another writer, and whose mask, if any, has been written
+		//
+		list <item_t>::iterator itr = _queue.begin();
+		while (
+			itr != _queue.end() && (
+				_busy.count(itr->path) || 
+				(! itr->maskkey.empty() && _pending.count(itr->maskkey))
+			)
+		) ++itr;
+		if (itr == _queue.end()) break;
+
+		item_t item = *itr;
+		_queue.erase(itr);
+		_busy.insert(item.path);
+
+		lock.unlock();
+		int rc = _write(vdc, item.ts, item.varname, item.buf->data());
+		lock.lock();
+
+		_busy.erase(item.path);
+		_pending.erase(_pending.find(item.key));
+		if (rc<0) {
+			_errors.push_back(
+				"Failed to write variable " + item.varname +
+				" at time step " + std::to_string(item.ts)
+			);
+		}
+		else {
+			_bytesWritten += item.nbytes;
+		}
+		_bytesQueued -= item.nbytes;
+
+		size_t cap = item.buf->capacity() * sizeof(float);
+		if (
+			_free.size() <= _nwriters &&
+			_bytesQueued + _bytesFree + cap <= _maxMemory
+		) {
+			_free.push_back(item.buf);
+			_bytesFree += cap;
+		}
+		else {
+			delete item.buf;
+		}
+		_cv.notify_all();
+	}
+
+	// Checked for work and retired under the same lock as Put() queues
+	// work, so no field is left without a writer
+	//
+	_idle.push_back(vdc);
+	_nRunning--;
+}
+
+// Open, write, and close a variable. WASP holds the NetCDF mutex while
+// writing the data, so it is only taken here for the open and close.
+//
+int VDCInSitu::_write(
+	VDCNetCDF *vdc, size_t ts, string varname, const float *data
+) {
+	std::mutex &ncmutex = WASP::GetNetCDFMutex();
+
+	ncmutex.lock();
+	int fd = vdc->OpenVariableWrite(ts, varname, -1);
+	ncmutex.unlock();
+	if (fd<0) return(-1);
+
+	int rc = vdc->Write(fd, data);
+
+	ncmutex.lock();
+	int rc1 = vdc->CloseVariableWrite(fd);
+	ncmutex.unlock();
+
+	return(rc<0 ? rc : rc1);
+}
+
+// Called with _mutex held
+//
+vector <float> *VDCInSitu::_getBuffer(size_t nelements) {
+	for (int i=0; i<_free.size(); i++) {
+		if (_free[i]->capacity() >= nelements) {
+			vector <float> *buf = _free[i];
+			_free.erase(_free.begin() + i);
+			_bytesFree -= buf->capacity() * sizeof(float);
+			buf->resize(nelements);
+			return(buf);
+		}
+	}
+
+	// Give back recycled buffers that are too small rather than exceed
+	// the memory limit
+	//
+	size_t nbytes = nelements * sizeof(float);
+	while (! _free.empty() && _bytesQueued + _bytesFree + nbytes > _maxMemory) {
+		_bytesFree -= _free.back()->capacity() * sizeof(float);
+		delete _free.back();
+		_free.pop_back();
+	}
+	return(new vector <float> (nelements));
+}
+
+int VDCInSitu::_reportErrors() {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	if (_errors.empty()) return(0);
+
+	if (_errors.size() == 1) {
+		SetErrMsg("%s", _errors[0].c_str());
+	}
+	else {
+		SetErrMsg(
+			"%s (and %d more)", _errors[0].c_str(), (int) _errors.size() - 1
+		);
+	}
+	_errors.clear();
+	return(-1);
+}
+
+void VDCInSitu::_close() {
+	if (! _meta) return;
+
+	_group->Wait();
+
+	std::lock_guard<std::mutex> guard(WASP::GetNetCDFMutex());
+
+	assert(_idle.size() == _nwriters);
+	for (int i=0; i<_idle.size(); i++) delete _idle[i];
+	_idle.clear();
+	delete _meta;
+	_meta = NULL;
+}
@@ -1,5 +1,6 @@
 #include <cassert>
 #include <sstream>
+#include <cstring>
 #include <map>
 #include <vector>
 #include <sys/stat.h>
@@ -157,6 +158,8 @@ VDCNetCDF::VDCNetCDF(
 	_chunksizehint =  0;
 	_master = new WASP(nthreads);
 	_version = 1;
+	_waspCacheSize = 32;
+	_retain_ts = 0;
 }
 
 
@@ -166,6 +169,7 @@ VDCNetCDF::~VDCNetCDF() {
 	for (int i=0; i<fds.size(); i++) {
 		(void) closeVariable(i);
 	}
+	_purgeCachedWASP("");
 		
 	if (_master) {
 		_master->Close();
@@ -425,17 +429,120 @@ WASP *VDCNetCDF::_OpenVariableRead(
 		wasp = _master;
 	}
 	else {
-		wasp = new WASP(_nthreads);
-		rc = wasp->Open(path, NC_NOWRITE);
-		if (rc<0) return(NULL);
+		wasp = _getCachedWASP(path);
+		if (! wasp) {
+			wasp = new WASP(_nthreads);
+			rc = wasp->Open(path, NC_NOWRITE);
+			if (rc<0) {
+				delete wasp;
+				return(NULL);
+			}
+		}
+		_waspPaths[wasp] = path;
+	}
+
+	if (ts == _retain_ts && varname == _retain_varname) {
+		wasp->RetainCoeffs(varname);
 	}
 
 	rc = wasp->OpenVarRead(varname, clevel, lod);
-	if (rc<0) return(NULL);
+	if (rc<0) {
+		_releaseWASP(wasp);
+		return(NULL);
+	}
 
 	return(wasp);
 }
 
+WASP *VDCNetCDF::_getCachedWASP(string path) {
+	std::list <std::pair <string, WASP *> >::iterator itr;
+	for (itr = _waspCache.begin(); itr != _waspCache.end(); ++itr) {
+		if (itr->first == path) {
+			WASP *wasp = itr->second;
+			_waspCache.erase(itr);
+			return(wasp);
+		}
+	}
+	return(NULL);
+}
+
+void VDCNetCDF::_releaseWASP(WASP *wasp) {
+	if (wasp == _master) return;
+
+	// Files opened for writing, and files purged while in use, are
+	// always closed
+	//
+	std::map <WASP *, string>::iterator itr = _waspPaths.find(wasp);
+	if (itr == _waspPaths.end()) {
+		wasp->Close();
+		delete wasp;
+		return;
+	}
+
+	_waspCache.push_front(std::make_pair(itr->second, wasp));
+	_waspPaths.erase(itr);
+
+	while (_waspCache.size() > _waspCacheSize) {
+		_waspCache.back().second->Close();
+		delete _waspCache.back().second;
+		_waspCache.pop_back();
+	}
+}
+
+void VDCNetCDF::_purgeCachedWASP(string path) {
+	std::list <std::pair <string, WASP *> >::iterator itr = _waspCache.begin();
+	while (itr != _waspCache.end()) {
+		if (path.empty() || itr->first == path) {
+			itr->second->Close();
+			delete itr->second;
+			itr = _waspCache.erase(itr);
+		}
+		else {
+			++itr;
+		}
+	}
+
+	// Files still in use are forgotten, so that _releaseWASP() closes
+	// them rather than returning them to the cache
+	//
+	std::map <WASP *, string>::iterator pitr = _waspPaths.begin();
+	while (pitr != _waspPaths.end()) {
+		if (path.empty() || pitr->second == path) {
+			pitr = _waspPaths.erase(pitr);
+		}
+		else {
+			++pitr;
+		}
+	}
+}
+
+void VDCNetCDF::SetOpenFileCacheSize(size_t n) {
+	_waspCacheSize = n;
+	while (_waspCache.size() > _waspCacheSize) {
+		_waspCache.back().second->Close();
+		delete _waspCache.back().second;
+		_waspCache.pop_back();
+	}
+}
+
+void VDCNetCDF::RetainCoeffs(size_t ts, string varname) {
+	if (ts == _retain_ts && varname == _retain_varname) return;
+
+	_master->RetainCoeffs("");
+
+	std::list <std::pair <string, WASP *> >::iterator itr;
+	for (itr = _waspCache.begin(); itr != _waspCache.end(); ++itr) {
+		itr->second->RetainCoeffs("");
+	}
+	std::map <WASP *, string>::iterator pitr;
+	for (pitr = _waspPaths.begin(); pitr != _waspPaths.end(); ++pitr) {
+		pitr->first->RetainCoeffs("");
+	}
+
+	_retain_ts = ts;
+	_retain_varname = varname;
+}
+
 string VDCNetCDF::_get_mask_varname(string varname, double &mv) const {
 	VDC::DataVar dvar;
 	mv = 0.0;
@@ -529,6 +636,10 @@ int VDCNetCDF::OpenVariableWrite(size_t ts, string varname, int lod) {
 	int rc = GetPath(varname, ts, path, file_ts, max_ts);
 	if (rc<0) return(-1);
 
+	// Read handles, idle or in use, would not see what is written
+	//
+	_purgeCachedWASP(path);
+
 	WASP *wasp = NULL;
 
 	if (path.compare(_master_path) == 0) {
@@ -612,24 +723,27 @@ int VDCNetCDF::closeVariable(int fd) {
 
 	if (wasp) {
 		wasp->CloseVar();
-	}
-	if (wasp && wasp != _master) {
-		wasp->Close();
-		delete wasp;
+		_releaseWASP(wasp);
 	}
 
 	WASP *wasp_mask = o->GetWaspMask();
 	if (wasp_mask) {
 		wasp_mask->CloseVar();
+		_releaseWASP(wasp_mask);
 	}
-	if (wasp_mask && wasp_mask != _master) {
-		wasp_mask->Close();
-		delete wasp_mask;
-	}
+
+	// Slices buffered by WriteSlab() are lost
+	//
+	size_t slab_count = o->GetSlabCount();
 
     _fileTable.RemoveEntry(fd);
 	delete o;
 
+	if (slab_count) {
+		SetErrMsg("Variable closed with %d slices unwritten", (int) slab_count);
+		return(-1);
+	}
+
 	return(0);
 }
 
@@ -713,6 +827,105 @@ int VDCNetCDF::_writeSliceTemplate(int fd, const T *slice) {
 		SetErrMsg("Invalid file descriptor : %d", fd);
 		return(-1);
 	}
+
+	if (o->GetSlabCount()) {
+		SetErrMsg("Hyperslice partially written with WriteSlab()");
+		return(-1);
+	}
+
+	return(_writeHyperSlice(o, slice));
+}
+
+template <class T> 
+int VDCNetCDF::_writeSlabTemplate(int fd, const T *slab, size_t nslices) {
+
+	VDCFileObject *o = (VDCFileObject *) _fileTable.GetEntry(fd);
+		
+	if (! o) {
+		SetErrMsg("Invalid file descriptor : %d", fd);
+		return(-1);
+	}
+	string varname = o->GetVarname();
+	int level = o->GetLevel();
+
+	vector <size_t> dims_at_level;
+	vector <size_t> bs_at_level;
+	int rc = GetDimLensAtLevel(
+		varname, level,  dims_at_level, bs_at_level
+	);
+	if (rc<0) return(rc);
+
+	vector <size_t> hslice_dims;
+	size_t nslice;
+	rc = GetHyperSliceInfo(varname, level, hslice_dims, nslice);
+	if (rc<0) return(rc);
+	if (hslice_dims.empty()) return(0);
+
+	// Slices are taken along the slowest varying dimension
+	//
+	int dim = hslice_dims.size() - 1;
+	size_t slice_size = 1;
+	for (int i=0; i<dim; i++) slice_size *= hslice_dims[i];
+
+	while (nslices) {
+		int slice_num = o->GetSlice();
+		if (slice_num >= nslice) {
+			SetErrMsg("Too many slices written to variable %s", varname.c_str());
+			return(-1);
+		}
+
+		// Number of slices in this hyperslice. The last may be short.
+		//
+		size_t first = slice_num * hslice_dims[dim];
+		size_t want = std::min(hslice_dims[dim], dims_at_level[dim] - first);
+
+		size_t count = o->GetSlabCount();
+
+		// Complete hyperslices are compressed straight from the slab
+		//
+		if (count == 0 && nslices >= want) {
+			rc = _writeHyperSlice(o, slab);
+			if (rc<0) return(rc);
+
+			slab += want * slice_size;
+			nslices -= want;
+			continue;
+		}
+
+		T *buf = (T *) o->GetSlabBuffer(want * slice_size * sizeof(T));
+		size_t n = std::min(want - count, nslices);
+		memcpy(buf + count * slice_size, slab, n * slice_size * sizeof(T));
+
+		slab += n * slice_size;
+		nslices -= n;
+		count += n;
+
+		if (count < want) {
+			o->SetSlabCount(count);
+			continue;
+		}
+
+		o->SetSlabCount(0);
+		rc = _writeHyperSlice(o, buf);
+		if (rc<0) return(rc);
+	}
+
+	return(0);
+}
+
+template int VDCNetCDF::_writeSlabTemplate<float>(
+	int fd, const float *slab, size_t nslices
+);
+template int VDCNetCDF::_writeSlabTemplate<int>(
+	int fd, const int *slab, size_t nslices
+);
+template int VDCNetCDF::_writeSlabTemplate<unsigned char>(
+	int fd, const unsigned char *slab, size_t nslices
+);
+
+template <class T> 
+int VDCNetCDF::_writeHyperSlice(VDCFileObject *o, const T *slice) {
+
 	WASP *wasp = o->GetWaspData();
 	string varname = o->GetVarname();
 	int level = o->GetLevel();
@@ -1305,6 +1518,10 @@ int VDCNetCDF::_WriteMasterMeta() {
 
 int VDCNetCDF::_ReadMasterMeta() {
 
+	// Files cached from a previous data collection may have changed
+	//
+	_purgeCachedWASP("");
+
     int rc = _master->Open(_master_path, 0);
 	if (rc<0) return(-1);
 
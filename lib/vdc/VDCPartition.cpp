@@ -0,0 +1,333 @@
+#include <cstdio>
+#include <cerrno>
+#include <map>
+#include <sstream>
+#include <algorithm>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+#include <vapor/CFuncs.h>
+#include <vapor/VDCNetCDF.h>
+#include <vapor/VDCPartition.h>
+
+using namespace VAPoR;
+using namespace Wasp;
+using namespace std;
+
+namespace {
+
+// The units stored in a group of files that must be written by the same
+// process
+//
+class file_t {
+public:
+	file_t() : cost(0) {}
+
+	string path;
+	vector <size_t> units;	// indices into the unit list
+	size_t cost;
+};
+
+bool costlier(const file_t *a, const file_t *b) {
+	if (a->cost != b->cost) return(a->cost > b->cost);
+	return(a->path < b->path);
+}
+
+string unit_key(string varname, string path, size_t file_ts) {
+	ostringstream oss;
+	oss << varname << ":" << path << ":" << file_ts;
+	return(oss.str());
+}
+
+// FNV-1a hash, continuing from 'hash'
+//
+unsigned long long fnv1a(const string &s, unsigned long long hash) {
+	for (int i=0; i<s.size(); i++) {
+		hash ^= (unsigned char) s[i];
+		hash *= 1099511628211ULL;
+	}
+	return(hash);
+}
+
+string marker_path(const VDCNetCDF &vdc, int rank) {
+	ostringstream oss;
+	oss << VDCNetCDF::GetDataDir(vdc.GetMasterPath()) << "/.partition." << rank;
+	return(oss.str());
+}
+
+};
+
+VDCPartition::VDCPartition() {
+	_runID = 0;
+}
+
+int VDCPartition::Initialize(
+	const VDCNetCDF &vdc, const vector <Unit> &units, int nranks
+) {
+	_rankUnits.clear();
+	_masterUnits.clear();
+	_runID = 0;
+
+	if (nranks < 1) {
+		SetErrMsg("Invalid number of processes : %d", nranks);
+		return(-1);
+	}
+
+	string master = vdc.GetMasterPath();
+
+	// Markers record the work they vouch for: the unit list and process
+	// count, and the master file, which is recreated for each new VDC.
+	// A marker left by a run over other units, or an earlier VDC, then
+	// fails CheckDone().
+	//
+	struct stat statbuf;
+	if (stat(master.c_str(), &statbuf) < 0) {
+		SetErrMsg("stat(%s) : %M", master.c_str());
+		return(-1);
+	}
+	ostringstream run;
+	run << nranks << "\n" << (long long) statbuf.st_mtime << "\n";
+	unsigned long long hash = fnv1a(run.str(), 14695981039346656037ULL);
+	for (size_t i=0; i<units.size(); i++) {
+		ostringstream oss;
+		oss << units[i].varname << "\n" << units[i].ts << "\n";
+		hash = fnv1a(oss.str(), hash);
+	}
+	_runID = hash;
+
+	vector <string> paths(units.size());
+	vector <size_t> costs(units.size(), 0);
+	map <string, size_t> unitAt;
+
+	for (size_t i=0; i<units.size(); i++) {
+		const Unit &unit = units[i];
+
+		vector <size_t> dims;
+		if (! vdc.GetVarDimLens(unit.varname, true, dims)) {
+			SetErrMsg("Undefined variable name : %s", unit.varname.c_str());
+			return(-1);
+		}
+
+		size_t file_ts, max_ts;
+		int rc = vdc.GetPath(unit.varname, unit.ts, paths[i], file_ts, max_ts);
+		if (rc<0) return(-1);
+
+		size_t nelements = 1;
+		for (int j=0; j<dims.size(); j++) nelements *= dims[j];
+		costs[i] = nelements;
+
+		unitAt[unit_key(unit.varname, paths[i], file_ts)] = i;
+	}
+
+	// A masked data variable is written by the same process as its mask,
+	// and after it: the mask is read when the variable is opened for
+	// writing. A variable whose mask is in the master file is left to the
+	// finalize step along with the mask.
+	//
+	vector <long> maskOf(units.size(), -1);
+	vector <bool> inMaster(units.size(), false);
+	for (size_t i=0; i<units.size(); i++) {
+		VDC::DataVar dvar;
+		if (vdc.GetDataVarInfo(units[i].varname, dvar)) {
+			string maskvar = dvar.GetMaskvar();
+			string path;
+			size_t file_ts, max_ts;
+			if (
+				! maskvar.empty() &&
+				vdc.GetPath(maskvar, units[i].ts, path, file_ts, max_ts) >= 0
+			) {
+				map <string, size_t>::const_iterator itr;
+				itr = unitAt.find(unit_key(maskvar, path, file_ts));
+				if (itr != unitAt.end()) maskOf[i] = itr->second;
+			}
+		}
+
+		inMaster[i] = paths[i] == master ||
+			(maskOf[i] >= 0 && paths[maskOf[i]] == master);
+	}
+
+	// Join the file of each masked variable with that of its mask
+	//
+	map <string, string> parent;
+	auto root = [&parent](string path) -> string {
+		if (! parent.count(path)) parent[path] = path;
+		while (parent[path] != path) path = parent[path];
+		return(path);
+	};
+	for (size_t i=0; i<units.size(); i++) {
+		if (inMaster[i]) continue;
+
+		string r = root(paths[i]);
+		if (maskOf[i] >= 0) {
+			string m = root(paths[maskOf[i]]);
+			if (m != r) parent[r] = m;
+		}
+	}
+
+	map <string, file_t> files;
+	for (size_t i=0; i<units.size(); i++) {
+		if (inMaster[i]) continue;
+
+		file_t &file = files[root(paths[i])];
+		file.path = root(paths[i]);
+		file.units.push_back(i);
+		file.cost += costs[i];
+	}
+
+	// Largest files first, each to the least loaded process. Ties are
+	// broken by path so that every process computes the same partition
+	//
+	vector <const file_t *> sorted;
+	map <string, file_t>::const_iterator itr;
+	for (itr = files.begin(); itr != files.end(); ++itr) {
+		sorted.push_back(&itr->second);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), costlier);
+
+	vector <size_t> load(nranks, 0);
+	vector <int> rankOf(units.size(), -1);
+	for (int i=0; i<sorted.size(); i++) {
+		int rank = std::min_element(load.begin(), load.end()) - load.begin();
+		load[rank] += sorted[i]->cost;
+
+		for (int j=0; j<sorted[i]->units.size(); j++) {
+			rankOf[sorted[i]->units[j]] = rank;
+		}
+	}
+
+	// Preserve the order of the units, except that a mask goes ahead
+	// of the first variable that uses it
+	//
+	_rankUnits.resize(nranks);
+	vector <bool> placed(units.size(), false);
+	auto place = [&](size_t i) {
+		if (placed[i]) return;
+		placed[i] = true;
+		if (inMaster[i]) _masterUnits.push_back(units[i]);
+		else _rankUnits[rankOf[i]].push_back(units[i]);
+	};
+	for (size_t i=0; i<units.size(); i++) {
+		if (maskOf[i] >= 0) place(maskOf[i]);
+		place(i);
+	}
+
+	return(0);
+}
+
+vector <VDCPartition::Unit> VDCPartition::GetUnits(int rank) const {
+	if (rank < 0 || rank >= _rankUnits.size()) return(vector <Unit> ());
+	return(_rankUnits[rank]);
+}
+
+int VDCPartition::MarkDone(const VDCNetCDF &vdc, int rank) const {
+	if (rank < 0 || rank >= _rankUnits.size()) {
+		SetErrMsg("Invalid process rank : %d", rank);
+		return(-1);
+	}
+
+	string path = marker_path(vdc, rank);
+	if (MkDirHier(Dirname(path)) < 0) return(-1);
+
+	FILE *fp = fopen(path.c_str(), "w");
+	if (! fp) {
+		SetErrMsg("fopen(%s) : %M", path.c_str());
+		return(-1);
+	}
+	fprintf(
+		fp, "%d %d %016llx\n", GetNumRanks(), (int) _rankUnits[rank].size(),
+		_runID
+	);
+	if (fclose(fp) != 0) {
+		SetErrMsg("fclose(%s) : %M", path.c_str());
+		return(-1);
+	}
+	return(0);
+}
+
+int VDCPartition::ClearDone(const VDCNetCDF &vdc, int rank) const {
+	for (int r=0; r<GetNumRanks(); r++) {
+		if (rank >= 0 && r != rank) continue;
+
+		string path = marker_path(vdc, r);
+		if (remove(path.c_str()) != 0 && errno != ENOENT) {
+			SetErrMsg("remove(%s) : %M", path.c_str());
+			return(-1);
+		}
+	}
+	return(0);
+}
+
+int VDCPartition::CheckDone(const VDCNetCDF &vdc) const {
+	for (int rank=0; rank<GetNumRanks(); rank++) {
+		string path = marker_path(vdc, rank);
+
+		int nranks = -1;
+		int nunits = -1;
+		unsigned long long runID = 0;
+		FILE *fp = fopen(path.c_str(), "r");
+		if (fp) {
+			if (fscanf(fp, "%d %d %llx", &nranks, &nunits, &runID) != 3) {
+				nranks = -1;
+			}
+			fclose(fp);
+		}
+
+		if (
+			nranks != GetNumRanks() || nunits != _rankUnits[rank].size() ||
+			runID != _runID
+		) {
+			SetErrMsg("Process %d did not complete", rank);
+			return(-1);
+		}
+	}
+	return(0);
+}
+
+int VDCPartition::RunLocal(int nprocs, std::function <int(int rank)> worker) {
+
+#ifdef WIN32
+	int status = 0;
+	for (int rank=0; rank<nprocs; rank++) {
+		if (worker(rank) < 0) status = -1;
+	}
+	return(status);
+#else
+
+	// Output still buffered when forking would be written by every child
+	//
+	fflush(NULL);
+
+	vector <pid_t> pids;
+	for (int rank=0; rank<nprocs; rank++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			SetErrMsg("fork() : %M");
+			break;
+		}
+		if (pid == 0) {
+			int rc = worker(rank);
+			fflush(NULL);
+			_exit(rc < 0 ? 1 : 0);
+		}
+		pids.push_back(pid);
+	}
+
+	int status = pids.size() == nprocs ? 0 : -1;
+	for (int i=0; i<pids.size(); i++) {
+		int wstatus;
+		if (waitpid(pids[i], &wstatus, 0) < 0) {
+			SetErrMsg("waitpid() : %M");
+			status = -1;
+			continue;
+		}
+		if (! WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+			SetErrMsg("Process %d failed", i);
+			status = -1;
+		}
+	}
+	return(status);
+#endif
+}
@@ -3,6 +3,7 @@
 #include <map>
 #include "vapor/VDC.h"
 #include "vapor/VDCNetCDF.h"
+#include "vapor/VDCInSitu.h"
 #include "vapor/VDC_c.h"
 #include "vapor/MyBase.h"
 
@@ -573,6 +574,49 @@ int VDC_PutVarAtTimeStep(VDC *p, size_t ts, const char *varname, int lod, const
 	return ret;
 }
 
+// ########################
+// #       In-situ        #
+// ########################
+
+VDCInSitu *VDCInSitu_new(int nwriters, size_t maxMemory)
+{ VDC_DEBUG_printff("(%i, %li);\n", nwriters, maxMemory); return new VAPoR::VDCInSitu(nwriters, maxMemory); }
+
+void VDCInSitu_delete(VDCInSitu *p)
+{ VDC_DEBUG_called(); delete p; }
+
+int VDCInSitu_Initialize(VDCInSitu *p, const char *path)
+{
+	VDC_DEBUG_printff("(\"%s\");\n", path);
+	int ret = p->Initialize(string(path));
+	if (ret < 0)
+		VDC_DEBUG_printff_error(": ERROR: code = %i, message = \"%s\"\n", ret, Wasp::MyBase::GetErrMsg());
+	return ret;
+}
+
+int VDCInSitu_Put(VDCInSitu *p, size_t ts, const char *varname, const float *data)
+{
+	VDC_DEBUG_printff("(%li, \"%s\", <data>);\n", ts, varname);
+	int ret = p->Put(ts, string(varname), data);
+	if (ret < 0)
+		VDC_DEBUG_printff_error(": ERROR: code = %i, message = \"%s\"\n", ret, Wasp::MyBase::GetErrMsg());
+	return ret;
+}
+
+int VDCInSitu_Flush(VDCInSitu *p)
+{
+	VDC_DEBUG_called();
+	int ret = p->Flush();
+	if (ret < 0)
+		VDC_DEBUG_printff_error(": ERROR: code = %i, message = \"%s\"\n", ret, Wasp::MyBase::GetErrMsg());
+	return ret;
+}
+
+size_t VDCInSitu_GetBytesWritten(const VDCInSitu *p)
+{ VDC_DEBUG_called(); return p->GetBytesWritten(); }
+
+double VDCInSitu_GetWaitTime(const VDCInSitu *p)
+{ VDC_DEBUG_called(); return p->GetWaitTime(); }
+
 // ########################
 // #       Utility        #
 // ########################
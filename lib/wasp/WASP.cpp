@@ -1,12 +1,16 @@
 #include <cassert>
+#include <cstring>
 #include <sstream>
 #include <sstream>
 #include <iterator>
 #include <sys/stat.h>
+#include <mutex>
+#include <atomic>
 #include "vapor/utils.h"
 #include "vapor/MatWaveBase.h"
 #include "vapor/Compressor.h"
 #include "vapor/WASP.h"
+#include "vapor/Trace.h"
 
 using namespace VAPoR;
 using namespace Wasp;
@@ -207,12 +211,19 @@ bool vectorinc::next(vector <size_t> &start, size_t &offset) {
 	return(done);
 }
 
+// Serializes NetCDF library calls made from pool threads. The NetCDF
+// library is not thread safe, so this is shared by all WASP instances.
+// Other code reaches it through WASP::GetNetCDFMutex().
+//
+static std::mutex NetCDFMutex;
+
 // Execution thread state for data reads and writes
 //
 class thread_state {
 public:
  int _id;
- EasyThreads *_et;	// one per thread
+ std::atomic<int> *_next;	// global: index of next unclaimed block
+ std::atomic<int> *_status;	// global: error indicator
  int _nthreads;
  string _varname;
  vector <NetCDFCpp *> _ncdfcptrs;	// one for each file
@@ -233,10 +244,12 @@ public:
  unsigned char *_maps;	// private (not shared)
  int _level;
  bool _unblock_flag; // unblock the data after reconstruction?
- static int _status;	// error indicator
+ vector <size_t> _nblocks;	// number of blocks along each dimension
+ vector <vector <unsigned char> > *_retained; // global: NULL if not retained
 
  thread_state(
-	int id, EasyThreads *et, int nthreads, string &varname, 
+	int id, std::atomic<int> *next, std::atomic<int> *status, int nthreads,
+	string &varname, 
 	const vector <NetCDFCpp *> &ncdfcptrs, 
 	const vector <size_t> &start, 
 	const vector <size_t> &count, 
@@ -246,21 +259,38 @@ public:
 	void *data, int data_type, unsigned char *mask, void *block, 
 	void *coeffs, int block_type, int xtype, unsigned char *maps, int level, 
 	bool unblock_flag
- ) : _id(id), _et(et), _nthreads(nthreads), _varname(varname), 
+ ) : _id(id), _next(next), _status(status), _nthreads(nthreads),
+	_varname(varname), 
 	_ncdfcptrs(ncdfcptrs), 
 	_start(start), _count(count), _bs(bs), _udims(udims),
 	_ncoeffs(ncoeffs), _encoded_dims(encoded_dims),
 	_compressors(compressors), _data(data), _data_type(data_type), 
 	_mask(mask), _block(block), _coeffs(coeffs), _block_type(block_type),
 	_xtype(xtype), _maps(maps), _level(level),
-	_unblock_flag(unblock_flag)
- {_status = 0;}
+	_unblock_flag(unblock_flag), _retained(NULL)
+ {}
 
 };
-int thread_state::_status = 0;
 
 
 
+// Linear offset of the block with block coordinates 'bcoords' in a grid
+// of blocks with 'nblocks' blocks along each dimension
+//
+size_t linear_block(
+	const vector <size_t> &bcoords, const vector <size_t> &nblocks
+) {
+	assert(bcoords.size() == nblocks.size());
+
+	size_t offset = 0;
+	size_t factor = 1;
+	for (int i=0; i<bcoords.size(); i++) {
+		offset += factor * bcoords[i];
+		factor *= nblocks[i];
+	}
+	return(offset);
+}
+
 // Convert voxel coordinates, 'vcoords', to block coordinates, 'bcoords', 
 // assuming a block size of 'bs'. 'residual' is any offset within
 // the block if 'vcoords' is not block-aligned.
@@ -1111,16 +1141,16 @@ int FetchBlockCompressed(
 template <class T>
 void *RunWriteThreadTemplate(thread_state &s, T dummy) 
 {
+	VAPOR_TRACE_SCOPE("WASP::WriteThread");
 
 	vectorinc vec(s._start, s._count, s._udims, s._bs);
 
-	s._status = 0;
 
 	//
 	// Process blocks of data assigned to this thread
 	//
 	int n = vec.num();
-	for (int i=s._id; i<n; i += s._nthreads) {
+	for (int i = (*s._next)++; i<n; i = (*s._next)++) {
 
 		// Get starting coordinates of i'th block
 		//
@@ -1153,16 +1183,16 @@ void *RunWriteThreadTemplate(thread_state &s, T dummy)
 		// NetCDF library is not thread safe
 		//
 		//
-		s._et->MutexLock();
+		NetCDFMutex.lock();
 			int rc = StoreBlock(
 				s._varname, s._ncdfcptrs[0], bcoords, 
 				s._encoded_dims[0], (T *) s._block
 			);
 			if (rc<0) {
-				s._status = -1;
+				*s._status = -1;
 			}
-		s._et->MutexUnlock();
-		if (s._status < 0) break;
+		NetCDFMutex.unlock();
+		if (*s._status < 0) break;
 	}
 	return(0);
 }
@@ -1200,16 +1230,16 @@ void *RunWriteThread(void *arg) {
 
 template <class T, class U>
 void *RunWriteThreadCompressedTemplate(thread_state &s, T dummy1, U dummy2) {
+	VAPOR_TRACE_SCOPE("WASP::WriteThreadCompressed");
 
 	vectorinc vec(s._start, s._count, s._udims, s._bs);
 
-	s._status = 0;
 
 	//
 	// Process blocks of data assigned to this thread
 	//
 	int n = vec.num();
-	for (int i=s._id; i<n; i += s._nthreads) {
+	for (int i = (*s._next)++; i<n; i = (*s._next)++) {
 
 		// Get starting coordinates of i'th block
 		//
@@ -1239,9 +1269,10 @@ void *RunWriteThreadCompressedTemplate(thread_state &s, T dummy1, U dummy2) {
 			(U *) s._coeffs, s._maps, s._xtype, s._ncoeffs, s._encoded_dims
 		);
 		if (rc<0) {
-			s._status = -1;
+			*s._status = -1;
 			break;
 		}
+		VAPOR_TRACE_COUNTER("WASP blocks encoded", 1);
 
 		// Convert from voxel to block coordinates
 		//
@@ -1254,16 +1285,16 @@ void *RunWriteThreadCompressedTemplate(thread_state &s, T dummy1, U dummy2) {
 		// NetCDF library is not thread safe
 		//
 		//
-		s._et->MutexLock();
+		NetCDFMutex.lock();
 			rc = StoreBlockCompressed(
 				s._varname, s._ncdfcptrs, bcoords, s._ncoeffs, s._encoded_dims,
 				(U *) s._coeffs, datarange, s._maps, s._xtype
 			);
 			if (rc<0) {
-				s._status = -1;
+				*s._status = -1;
 			}
-		s._et->MutexUnlock();
-		if (s._status < 0) break;
+		NetCDFMutex.unlock();
+		if (*s._status < 0) break;
 	}
 	return(0);
 }
@@ -1351,6 +1382,7 @@ void *RunWriteThreadCompressed(void *arg) {
 //
 template <class T>
 void *RunReadThreadTemplate(thread_state &s, T dummy) {
+	VAPOR_TRACE_SCOPE("WASP::ReadThread");
 
 	bool unblock_flag = s._unblock_flag;	// Need to unblock data?
 	T *data = (T *) s._data;
@@ -1364,10 +1396,9 @@ void *RunReadThreadTemplate(thread_state &s, T dummy) {
 
 	vectorinc vec(aligned_start, aligned_count, s._udims, s._bs);
 
-	s._status = 0;
 
 	int n = vec.num();
-	for (int i=s._id; i<n; i += s._nthreads) {
+	for (int i = (*s._next)++; i<n; i = (*s._next)++) {
 
 		size_t offset;
 		vector <size_t> start;
@@ -1389,14 +1420,14 @@ void *RunReadThreadTemplate(thread_state &s, T dummy) {
 		// Read wavelet coefficients from disk. Need a mutex because
 		// NetCDF API is not thread safe
 		//
-		s._et->MutexLock();
+		NetCDFMutex.lock();
 			int rc = FetchBlock(
 				s._varname, s._ncdfcptrs[0], bcoords, s._encoded_dims[0], 
 				blockptr
 			);
-			if (rc<0) s._status = -1;
-		s._et->MutexUnlock();
-		if (s._status < 0) break;
+			if (rc<0) *s._status = -1;
+		NetCDFMutex.unlock();
+		if (*s._status < 0) break;
 
 
 		if (unblock_flag) {
@@ -1451,6 +1482,7 @@ void *RunReadThread(void *arg) {
 
 template <class T, class U>
 void *RunReadThreadCompressedTemplate(thread_state &s, T dummy1, U dummy2) {
+	VAPOR_TRACE_SCOPE("WASP::ReadThreadCompressed");
 
 	bool unblock_flag = s._unblock_flag;	// Need to unblock data?
 	T *data = (T *) s._data;
@@ -1464,10 +1496,9 @@ void *RunReadThreadCompressedTemplate(thread_state &s, T dummy1, U dummy2) {
 
 	vectorinc vec(aligned_start, aligned_count, s._udims, s._bs);
 
-	s._status = 0;
 
 	int n = vec.num();
-	for (int i=s._id; i<n; i += s._nthreads) {
+	for (int i = (*s._next)++; i<n; i = (*s._next)++) {
 
 		size_t offset;
 		vector <size_t> start;
@@ -1479,18 +1510,53 @@ void *RunReadThreadCompressedTemplate(thread_state &s, T dummy1, U dummy2) {
 		to_block_coords(start, s._bs, bcoords, residual);
 		assert(residual == 0);
 
-		// Read wavelet coefficients from disk. Need a mutex because
-		// NetCDF API is not thread safe
+		// Each thread handles different blocks, so no lock is needed
+		// to access the block's entry in the retained coefficients
 		//
+		vector <unsigned char> *retained = NULL;
+		if (s._retained) {
+			retained = &(*s._retained)[linear_block(bcoords, s._nblocks)];
+		}
+
+		// Read wavelet coefficients from disk, unless retained by an
+		// earlier read. Need a mutex because NetCDF API is not thread safe
+		//
+		size_t coeffs_size = vsum(s._ncoeffs) * sizeof(U);
+		size_t maps_size = (
+			vsum(s._encoded_dims) - vsum(s._ncoeffs) - BLK_HDR_SZ
+		) * NetCDFCpp::SizeOf(s._xtype);
+
 		U datarange[2];
-		s._et->MutexLock();
-			int rc = FetchBlockCompressed(
-				s._varname, s._ncdfcptrs, bcoords, s._ncoeffs, 
-				s._encoded_dims, (U *) s._coeffs, datarange, s._maps, s._xtype
-			);
-			if (rc<0) s._status = -1;
-		s._et->MutexUnlock();
-		if (s._status < 0) break;
+		int rc;
+		if (retained && ! retained->empty()) {
+			unsigned char *ptr = retained->data();
+			memcpy(datarange, ptr, sizeof(datarange));
+			ptr += sizeof(datarange);
+			memcpy(s._coeffs, ptr, coeffs_size);
+			ptr += coeffs_size;
+			memcpy(s._maps, ptr, maps_size);
+		}
+		else {
+			NetCDFMutex.lock();
+				rc = FetchBlockCompressed(
+					s._varname, s._ncdfcptrs, bcoords, s._ncoeffs, 
+					s._encoded_dims, (U *) s._coeffs, datarange, s._maps, 
+					s._xtype
+				);
+				if (rc<0) *s._status = -1;
+			NetCDFMutex.unlock();
+			if (*s._status < 0) break;
+
+			if (retained) {
+				retained->resize(sizeof(datarange) + coeffs_size + maps_size);
+				unsigned char *ptr = retained->data();
+				memcpy(ptr, datarange, sizeof(datarange));
+				ptr += sizeof(datarange);
+				memcpy(ptr, s._coeffs, coeffs_size);
+				ptr += coeffs_size;
+				memcpy(ptr, s._maps, maps_size);
+			}
+		}
 
 		// Transform coordinates from global to the region-of-interest
 		//
@@ -1507,9 +1573,10 @@ void *RunReadThreadCompressedTemplate(thread_state &s, T dummy1, U dummy2) {
 			vproduct(s._bs), s._level
 		);
 		if (rc<0) {
-			s._status = -1;
+			*s._status = -1;
             break;
         }
+		VAPOR_TRACE_COUNTER("WASP blocks decoded", 1);
 
 
 		if (unblock_flag) {
@@ -1626,16 +1693,18 @@ WASP::WASP(int nthreads) {
 	_open_write = false;
 	_open_varname.clear();
 
-	_et = NULL;
+	_retain_varname.clear();
+	_retain_lod = -1;
+	_retain_entry_size = 0;
 
-	// Set up execution threads for parallel execution
+	// Work is executed by the shared thread pool. _nthreads determines
+	// the number of concurrent tasks, each with private buffers and
+	// Compressor
 	//
-	if (nthreads < 1) nthreads = EasyThreads::NProc();
+	if (nthreads < 1) nthreads = ThreadPool::Instance()->GetNumThreads();
 	if (nthreads < 1) nthreads = 1;
 
-	_et = new EasyThreads(nthreads);
-
-	_nthreads = _et->GetNumThreads() > 0 ? _et->GetNumThreads() : 1;
+	_nthreads = nthreads;
 
 	// One Compressor instance for each thread
 	//
@@ -1643,10 +1712,43 @@ WASP::WASP(int nthreads) {
 }
 
 WASP::~WASP() {
+	_free_compressors();
+}
+
+std::mutex &WASP::GetNetCDFMutex() {
+	return(NetCDFMutex);
+}
+
+void WASP::_alloc_compressors(const vector <size_t> &bs, string wname) {
+	if (wname.empty()) {
+		_free_compressors();
+		return;
+	}
+
+	vector <size_t> cbs = compressor_bs(bs);
+	if (
+		_open_compressors[0] && _compressors_wname == wname &&
+		_compressors_bs == cbs
+	) return;
+
+	_free_compressors();
+
+	// Create one compressor for each execution thread 
+	//
+	for (int i=0; i<_nthreads; i++) {
+		_open_compressors[i] = new Compressor(cbs, wname);
+	}
+	_compressors_wname = wname;
+	_compressors_bs = cbs;
+}
+
+void WASP::_free_compressors() {
 	for (int i=0; i<_open_compressors.size(); i++) {
 		if (_open_compressors[i]) delete _open_compressors[i];
+		_open_compressors[i] = NULL;
 	}
-	if (_et) delete _et;
+	_compressors_wname.clear();
+	_compressors_bs.clear();
 }
 
 int WASP::Create(
@@ -1819,6 +1921,9 @@ int WASP::Close() {
 
 	_waspFile = false;
 
+	vector <vector <unsigned char> >().swap(_retained);
+	_retain_lod = -1;
+
 	return(rc);
 }
 
@@ -2300,6 +2405,13 @@ int WASP::OpenVarWrite(string name, int lod) {
 		return(-1);
 	}
 
+	// Coefficients retained for this variable are about to be stale
+	//
+	if (name == _retain_varname) {
+		vector <vector <unsigned char> >().swap(_retained);
+		_retain_lod = -1;
+	}
+
 	_open_waspvar = false;
 	int rc = InqVarWASP(name, _open_waspvar);
 	if (rc<0) return(rc);
@@ -2345,13 +2457,7 @@ int WASP::OpenVarWrite(string name, int lod) {
         return(-1);
     }
 
-	// Create one compressor for each execution thread 
-	//
-	if (! wname.empty()) {
-		for (int i=0; i<_nthreads; i++) {
-			_open_compressors[i] = new Compressor(compressor_bs(bs), wname);
-		}
-	}
+	_alloc_compressors(bs, wname);
 
 
 	_open_wname = wname;
@@ -2435,10 +2541,8 @@ int WASP::OpenVarRead(string name, int level, int lod) {
 	if (lod > maxlod) lod = maxlod;
 
 	int numlevels = 1;
+	_alloc_compressors(bs, wname);
 	if (! wname.empty()) {	// May simply be blocked, not compressed
-		for (int i=0; i<_nthreads; i++) {
-			_open_compressors[i] = new Compressor(compressor_bs(bs), wname);
-		}
 		assert(_nthreads >= 1);
 		numlevels = _open_compressors[0]->GetNumLevels();
 	}
@@ -2449,10 +2553,6 @@ int WASP::OpenVarRead(string name, int level, int lod) {
 
 	if (level > numlevels) {
 		SetErrMsg("Invalid refinement level: (%d)", level);
-		for (int i=0; i<_nthreads; i++) {
-			if (_open_compressors[i]) delete _open_compressors[i];
-			_open_compressors[i] = NULL;
-		}
 		return(-1);
 	}
 
@@ -2472,6 +2572,15 @@ int WASP::OpenVarRead(string name, int level, int lod) {
 	return(NC_NOERR);
 }
 
+void WASP::RetainCoeffs(string name) {
+	if (name == _retain_varname) return;
+
+	vector <vector <unsigned char> >().swap(_retained);
+	_retain_varname = name;
+	_retain_lod = -1;
+	_retain_entry_size = 0;
+}
+
 int WASP::CloseVar() {
 
 	if (! _waspFile) {
@@ -2482,13 +2591,8 @@ int WASP::CloseVar() {
 	_open = false;
 	_open_write = false;
 
-	if (! _open_waspvar) return(0);
-
-	for (int i=0; i<_nthreads; i++) {
-		if (_open_compressors[i]) delete _open_compressors[i];
-		_open_compressors[i] = NULL;
-	}
-
+	// The compressors are kept for the next variable opened
+	//
 	return(0);
 }
 
@@ -2625,11 +2729,13 @@ int WASP::_PutVara(
 	//
 	// Set up thread state for parallel (threaded) execution
 	//
+	std::atomic<int> next(0);
+	std::atomic<int> status(0);
 	vector <void *> argvec;
 	for (int i=0; i<_nthreads; i++) {
 
 		argvec.push_back((void *) new thread_state(
-			i, _et, _nthreads, _open_varname, _ncdfcptrs, start, count, 
+			i, &next, &status, _nthreads, _open_varname, _ncdfcptrs, start, count, 
 			_open_bs, _open_udims, ncoeffs, encoded_dims, _open_compressors, 
 			(void *) data, data_type, (unsigned char *) mask,
 			block + i*block_size, coeffs + i*coeffs_size, 
@@ -2647,22 +2753,19 @@ int WASP::_PutVara(
 		}
 	}
 	else {
-		int rc;
-		if (_open_wname.empty()) {
-			rc = _et->ParRun(RunWriteThread, argvec);
-		}
-		else {
-			rc = _et->ParRun(RunWriteThreadCompressed, argvec);
-		}
+		void *(*start_routine)(void *) = _open_wname.empty() ?
+			RunWriteThread : RunWriteThreadCompressed;
 
-		if (rc < 0) {
-			SetErrMsg("Error spawning threads");
-			return(-1);
+		ThreadPool::TaskGroup group;
+		for (int i=0; i<argvec.size(); i++) {
+			void *arg = argvec[i];
+			group.Run([start_routine, arg]() {start_routine(arg);});
 		}
+		group.Wait();
 	}
 	for (int i=0; i<argvec.size(); i++) delete (thread_state *) argvec[i];
 
-	return(thread_state::_status);
+	return(status);
 }
 
 
@@ -2682,6 +2785,7 @@ int WASP::_PutVara(
 	}
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::PutVara(_open_varname, start, count, data));
 	}
 
@@ -2724,6 +2828,7 @@ int WASP::PutVar(const float *data) {
 int WASP::PutVar(const float *data, const unsigned char *mask) {
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::PutVar(_open_varname, data));
 	}
 
@@ -2759,6 +2864,7 @@ int WASP::PutVar(const double *data) {
 int WASP::PutVar(const double *data, const unsigned char *mask) {
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::PutVar(_open_varname, data));
 	}
 
@@ -2794,6 +2900,7 @@ int WASP::PutVar(const int *data) {
 int WASP::PutVar(const int *data, const unsigned char *mask) {
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::PutVar(_open_varname, data));
 	}
 
@@ -2829,6 +2936,7 @@ int WASP::PutVar(const int16_t *data) {
 int WASP::PutVar(const int16_t *data, const unsigned char *mask) {
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::PutVar(_open_varname, data));
 	}
 
@@ -2864,6 +2972,7 @@ int WASP::PutVar(const unsigned char *data) {
 int WASP::PutVar(const unsigned char *data, const unsigned char *mask) {
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::PutVar(_open_varname, data));
 	}
 
@@ -2940,19 +3049,49 @@ int WASP::_GetVara(
 	//
 	// Set up thread state for parallel (threaded) execution
 	//
+	std::atomic<int> next(0);
+	std::atomic<int> status(0);
 	vector <void *> argvec;
+	// If the coefficients of this variable are retained the block grid,
+	// and hence the entries, are the same at every refinement level
+	//
+	vector <size_t> nblocks;
+	for (int i=0; i<_open_udims.size(); i++) {
+		nblocks.push_back((_open_udims[i] + _open_bs[i] - 1) / _open_bs[i]);
+	}
+	bool retain = ! _open_wname.empty() && _retain_varname == _open_varname;
+	if (retain) {
+		size_t entry_size = sizeof(U) * (2 + coeffs_size) + 
+			maps_size * NetCDFCpp::SizeOf(_open_varxtype);
+
+		if (
+			_retain_lod != _open_lod || _retain_entry_size != entry_size ||
+			_retained.size() != vproduct(nblocks)
+		) {
+			_retained.clear();
+			_retained.resize(vproduct(nblocks));
+			_retain_lod = _open_lod;
+			_retain_entry_size = entry_size;
+		}
+	}
+
 	for (int i=0; i<_nthreads; i++) {
 
 		U *blkptr = block + i*block_size;
 
-		argvec.push_back((void *) new thread_state(
-			i, _et, _nthreads, _open_varname, _ncdfcptrs, start, count, 
+		thread_state *ts = new thread_state(
+			i, &next, &status, _nthreads, _open_varname, _ncdfcptrs, start, count, 
 			bs_at_level, dims_at_level, ncoeffs,
 			encoded_dims, _open_compressors, data, data_type, NULL,
 			blkptr, coeffs + i*coeffs_size, block_type, _open_varxtype,
 			maps + i*maps_size*NetCDFCpp::SizeOf(_open_varxtype), 
 			_open_level, unblock_flag
-		));
+		);
+		if (retain) {
+			ts->_nblocks = nblocks;
+			ts->_retained = &_retained;
+		}
+		argvec.push_back((void *) ts);
 	}
 
 	if (_nthreads == 1) {
@@ -2964,22 +3103,20 @@ int WASP::_GetVara(
 		}
 	}
 	else {
-		int rc;
-		if (_open_wname.empty()) {
-			rc = _et->ParRun(RunReadThread, argvec);
-		}
-		else {
-			rc = _et->ParRun(RunReadThreadCompressed, argvec);
-		}
-		if (rc < 0) {
-			SetErrMsg("Error spawning threads");
-			return(-1);
+		void *(*start_routine)(void *) = _open_wname.empty() ?
+			RunReadThread : RunReadThreadCompressed;
+
+		ThreadPool::TaskGroup group;
+		for (int i=0; i<argvec.size(); i++) {
+			void *arg = argvec[i];
+			group.Run([start_routine, arg]() {start_routine(arg);});
 		}
+		group.Wait();
 	}
 
 	for (int i=0; i<argvec.size(); i++) delete (thread_state *) argvec[i];
 
-	return(thread_state::_status);
+	return(status);
 }
 
 
@@ -2999,6 +3136,7 @@ int WASP::_GetVara(
 	}
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::GetVara(_open_varname, start, count, data));
 	}
 
@@ -3037,6 +3175,7 @@ int WASP::GetVaraBlock(
 int WASP::GetVar(float *data) {
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::GetVar(_open_varname, data));
 	}
 
@@ -3069,6 +3208,7 @@ int WASP::GetVaraBlock(
 int WASP::GetVar(double *data) {
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::GetVar(_open_varname, data));
 	}
 
@@ -3101,6 +3241,7 @@ int WASP::GetVaraBlock(
 int WASP::GetVar(int *data) {
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::GetVar(_open_varname, data));
 	}
 
@@ -3133,6 +3274,7 @@ int WASP::GetVaraBlock(
 int WASP::GetVar(int16_t *data) {
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::GetVar(_open_varname, data));
 	}
 
@@ -3165,6 +3307,7 @@ int WASP::GetVaraBlock(
 int WASP::GetVar(unsigned char *data) {
 
 	if (! _open_waspvar) {
+		std::lock_guard<std::mutex> guard(NetCDFMutex);
 		return(NetCDFCpp::GetVar(_open_varname, data));
 	}
 
@@ -3,7 +3,8 @@
 uniform mat4 MVP;
 
 layout (location = 0) in vec3 vertex;
-layout (location = 1) in vec2 vVertexData;
+layout (location = 1) in float vValue;
+layout (location = 2) in float vMissing;
 
 out vec2 vertexData;
 
@@ -13,7 +14,7 @@ out float gl_ClipDistance[6];
 void main()
 {
 	gl_Position = MVP * vec4(vertex, 1.0);
-	vertexData = vVertexData;
+	vertexData = vec2(vValue, vMissing);
 
 	for (int i = 0; i < 6; i++)
 		gl_ClipDistance[i] = dot(vec4(vertex, 1.0), clippingPlanes[i]);
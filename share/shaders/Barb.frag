@@ -0,0 +1,23 @@
+#version 330 core
+
+uniform bool lightingEnabled;
+uniform vec3 lightDir;
+
+in  vec4 fColor;
+in  vec3 fNormal;
+out vec4 fragment;
+
+void main() {
+    vec4 color = fColor;
+    if (lightingEnabled) {
+		vec3 normal;
+		if (gl_FrontFacing)
+			normal = fNormal;
+		else 
+			normal = -fNormal;
+
+        float diffuse = max(dot(normal, -lightDir), 0.0);
+        color.rgb *= diffuse + 0.2;
+    }
+    fragment = color;
+}
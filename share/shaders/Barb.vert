@@ -0,0 +1,42 @@
+#version 330 core
+
+// Barb mesh, in a frame local to the barb. See 
+// BarbRenderer::_buildBarbMesh()
+//
+layout (location = 0) in vec3 vRing;	// cos, sin, radial scale
+layout (location = 1) in vec2 vAxial;	// fraction of length, radii
+layout (location = 2) in vec3 vNormal;
+
+// One per barb
+//
+layout (location = 3) in vec3 iStart;
+layout (location = 4) in vec3 iVector;
+layout (location = 5) in vec4 iColor;
+
+out vec3 fNormal;
+out vec4 fColor;
+
+uniform mat4 P;
+uniform mat4 MV;
+uniform float radius;
+
+
+void main() {
+    float len = length(iVector);
+    vec3 d = iVector / len;
+
+    vec3 u = cross(d, vec3(1.0, 0.0, 0.0));
+    if (dot(u, u) == 0.0)
+        u = cross(d, vec3(0.0, 1.0, 0.0));
+    u = normalize(u);
+    vec3 b = cross(u, d);
+
+    vec3 pos = iStart
+        + d * (vAxial.x * len + vAxial.y * radius)
+        + (u * vRing.x + b * vRing.y) * vRing.z * radius;
+    vec3 normal = vNormal.x * u + vNormal.y * b + vNormal.z * d;
+
+    gl_Position = P * MV * vec4(pos, 1.0f);
+    fNormal = mat3(transpose(inverse(MV))) * normal;
+    fColor = iColor;
+}
@@ -0,0 +1,605 @@
+//
+// vapor_bench : headless benchmark harness for the data path
+//
+// Generates a synthetic VDC (or reuses an existing one) and times the
+// principal data access operations:
+//
+//	DataMgr::GetVariable() (cold and warm cache)
+//	DataMgr::GetDataRange()
+//	Grid iteration
+//	Grid::GetValue() random sampling for each structured grid type
+//	KDTreeRG construction
+//	WASP Compressor compress/decompress and per-level reconstruction
+//
+// Results are written as a single JSON document so that runs can be
+// compared between revisions.
+//
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cassert>
+
+#include <vapor/CFuncs.h>
+#include <vapor/OptionParser.h>
+#include <vapor/VDCNetCDF.h>
+#include <vapor/DataMgr.h>
+#include <vapor/RegularGrid.h>
+#include <vapor/StretchedGrid.h>
+#include <vapor/LayeredGrid.h>
+#include <vapor/CurvilinearGrid.h>
+#include <vapor/KDTreeRG.h>
+#include <vapor/Compressor.h>
+
+using namespace Wasp;
+using namespace VAPoR;
+
+
+struct {
+	OptionParser::Dimension3D_T	dim;
+	std::vector <size_t> bs;
+	std::vector <size_t> cratios;
+	string wname;
+	int	nts;
+	int loop;
+	int memsize;
+	int	nthreads;
+	int	nsamples;
+	string output;
+	OptionParser::Boolean_T	reuse;
+	OptionParser::Boolean_T	help;
+	OptionParser::Boolean_T	debug;
+} opt;
+
+OptionParser::OptDescRec_T	set_opts[] = {
+	{
+		"dimension",1, "128x128x128", "Volume dimensions (NXxNYxNZ) of "
+		"the synthetic data set"
+	},
+	{
+		"bs", 1, "64:64:64", "Internal storage blocking factor "
+		"expressed in grid points (NX:NY:NZ)"
+	},
+	{
+		"cratios",1, "500:100:10:1", "Colon delimited list of compression "
+		"ratios. The default is 500:100:10:1"
+	},
+	{
+		"wname",1, "bior4.4", "Wavelet family used for compression "
+	},
+	{"nts",		1, 	"2","Number of timesteps in the synthetic data set"},
+	{"loop",	1, 	"3","Number of times each timed operation is repeated"},
+	{"memsize",	1, 	"2000","DataMgr cache size in MBs"},
+	{"nthreads",    1,  "0",    "Specify number of execution threads "
+		"0 => use number of cores"},
+	{"nsamples",	1, 	"100000","Number of random Grid::GetValue() samples"},
+	{"output",	1, 	"",	"Path to JSON output file. Default is stdout"},
+	{"reuse",	0,	"",	"Reuse an existing data set at the master path "
+		"instead of regenerating it"},
+	{"help",	0,	"",	"Print this message and exit"},
+	{"debug",	0,	"",	"Debug mode"},
+	{NULL}
+};
+
+
+OptionParser::Option_T	get_options[] = {
+	{"dimension", Wasp::CvtToDimension3D, &opt.dim, sizeof(opt.dim)},
+	{"bs", Wasp::CvtToSize_tVec, &opt.bs, sizeof(opt.bs)},
+	{"cratios", Wasp::CvtToSize_tVec, &opt.cratios, sizeof(opt.cratios)},
+	{"wname", Wasp::CvtToCPPStr, &opt.wname, sizeof(opt.wname)},
+	{"nts", Wasp::CvtToInt, &opt.nts, sizeof(opt.nts)},
+	{"loop", Wasp::CvtToInt, &opt.loop, sizeof(opt.loop)},
+	{"memsize", Wasp::CvtToInt, &opt.memsize, sizeof(opt.memsize)},
+	{"nthreads", Wasp::CvtToInt, &opt.nthreads, sizeof(opt.nthreads)},
+	{"nsamples", Wasp::CvtToInt, &opt.nsamples, sizeof(opt.nsamples)},
+	{"output", Wasp::CvtToCPPStr, &opt.output, sizeof(opt.output)},
+	{"reuse", Wasp::CvtToBoolean, &opt.reuse, sizeof(opt.reuse)},
+	{"help", Wasp::CvtToBoolean, &opt.help, sizeof(opt.help)},
+	{"debug", Wasp::CvtToBoolean, &opt.debug, sizeof(opt.debug)},
+	{NULL}
+};
+
+const char	*ProgName;
+
+const string VarName = "bench";
+
+namespace {
+
+//
+// Accumulates timings for a single named operation over several loops
+//
+class Timing {
+public:
+	Timing(string name) : _name(name), _min(0.0), _max(0.0), _sum(0.0), _n(0) {}
+
+	void Add(double t) {
+		if (_n == 0 || t < _min) _min = t;
+		if (_n == 0 || t > _max) _max = t;
+		_sum += t;
+		_n++;
+	}
+
+	string JSON() const {
+		ostringstream oss;
+		oss << setprecision(9);
+		oss << "{\"name\": \"" << _name << "\", "
+			<< "\"n\": " << _n << ", "
+			<< "\"min\": " << _min << ", "
+			<< "\"max\": " << _max << ", "
+			<< "\"mean\": " << (_n ? _sum / _n : 0.0) << "}";
+		return(oss.str());
+	}
+
+private:
+	string _name;
+	double _min;
+	double _max;
+	double _sum;
+	int _n;
+};
+
+// std::list so that references returned by new_timing() remain valid
+//
+list <Timing> Timings;
+
+Timing &new_timing(string name) {
+	Timings.push_back(Timing(name));
+	return(Timings.back());
+}
+
+// Smooth synthetic field with a few large scale features so that the
+// wavelet coefficients decay the way they do for real simulation output
+//
+float field(double x, double y, double z, double t) {
+	return(
+		sin(6.0 * x + t) * cos(4.0 * y) + 0.5 * sin(10.0 * z * y) +
+		0.1 * cos(20.0 * x * z)
+	);
+}
+
+void fill_field(
+	vector <float> &data, size_t nx, size_t ny, size_t nz, double t
+) {
+	data.resize(nx*ny*nz);
+	for (size_t k=0; k<nz; k++) {
+	for (size_t j=0; j<ny; j++) {
+	for (size_t i=0; i<nx; i++) {
+		data[k*nx*ny + j*nx + i] = field(
+			(double) i / nx, (double) j / ny, (double) k / nz, t
+		);
+	}
+	}
+	}
+}
+
+int generate(string master) {
+
+	VDCNetCDF    vdc(opt.nthreads);
+
+	size_t chunksize = 1024*1024*4;
+	int rc = vdc.Initialize(
+		master, vector <string> (), VDC::W, opt.bs, chunksize
+	);
+	if (rc<0) return(-1);
+
+	vector <string> dimnames;
+	dimnames.push_back("Nx");
+	dimnames.push_back("Ny");
+	dimnames.push_back("Nz");
+	dimnames.push_back("Nt");
+
+	vector <size_t> cratios(1,1);
+	rc = vdc.SetCompressionBlock("", cratios);
+	if (rc<0) return(-1);
+
+	rc = vdc.DefineDimension(dimnames[0], opt.dim.nx, 0);
+	if (rc<0) return(-1);
+	rc = vdc.DefineDimension(dimnames[1], opt.dim.ny, 1);
+	if (rc<0) return(-1);
+	rc = vdc.DefineDimension(dimnames[2], opt.dim.nz, 2);
+	if (rc<0) return(-1);
+	rc = vdc.DefineDimension(dimnames[3], opt.nts, 3);
+	if (rc<0) return(-1);
+
+	rc = vdc.SetCompressionBlock(opt.wname, opt.cratios);
+	if (rc<0) return(-1);
+
+	rc = vdc.DefineDataVar(
+		VarName, dimnames, dimnames, "", DC::XType::FLOAT, true
+	);
+	if (rc<0) return(-1);
+
+	rc = vdc.EndDefine();
+	if (rc<0) return(-1);
+
+	size_t lens[] = {
+		(size_t) opt.dim.nx, (size_t) opt.dim.ny, (size_t) opt.dim.nz
+	};
+	for (int i=0; i<3; i++) {
+		vector <float> coords;
+		for (size_t j=0; j<lens[i]; j++) coords.push_back((float) j);
+		rc = vdc.PutVar(dimnames[i], -1, coords.data());
+		if (rc<0) return(-1);
+	}
+
+	vector <float> data;
+	Timing &t_write = new_timing("VDCNetCDF::PutVar");
+	for (int ts=0; ts<opt.nts; ts++) {
+		float tc = (float) ts;
+		rc = vdc.PutVar(ts, dimnames[3], -1, &tc);
+		if (rc<0) return(-1);
+
+		fill_field(data, opt.dim.nx, opt.dim.ny, opt.dim.nz, (double) ts);
+
+		double t0 = GetTime();
+		rc = vdc.PutVar(ts, VarName, -1, data.data());
+		if (rc<0) return(-1);
+		t_write.Add(GetTime() - t0);
+	}
+
+	return(0);
+}
+
+void bench_datamgr(string master) {
+
+	DataMgr	datamgr("vdc", opt.memsize, opt.nthreads);
+	vector <string> files(1, master);
+	int rc = datamgr.Initialize(files, vector <string> ());
+	if (rc<0) exit(1);
+
+	int nlevels = datamgr.GetNumRefLevels(VarName);
+	int nlods = datamgr.GetCRatios(VarName).size();
+
+	for (int level=0; level<nlevels; level++) {
+	for (int lod=0; lod<nlods; lod++) {
+		ostringstream oss;
+		oss << "[level=" << level << ",lod=" << lod << "]";
+		string suffix = oss.str();
+
+		Timing &t_cold = new_timing("DataMgr::GetVariable(cold)" + suffix);
+		Timing &t_warm = new_timing("DataMgr::GetVariable(warm)" + suffix);
+		Timing &t_range = new_timing("DataMgr::GetDataRange" + suffix);
+		Timing &t_iter = new_timing("Grid::ConstIterator" + suffix);
+
+		for (int l=0; l<opt.loop; l++) {
+		for (int ts=0; ts<opt.nts; ts++) {
+			datamgr.Clear();
+
+			double t0 = GetTime();
+			Grid *g = datamgr.GetVariable(ts, VarName, level, lod);
+			if (! g) exit(1);
+			t_cold.Add(GetTime() - t0);
+			delete g;
+
+			t0 = GetTime();
+			g = datamgr.GetVariable(ts, VarName, level, lod);
+			if (! g) exit(1);
+			t_warm.Add(GetTime() - t0);
+
+			t0 = GetTime();
+			double sum = 0.0;
+			Grid::ConstIterator itr = g->cbegin();
+			Grid::ConstIterator enditr = g->cend();
+			for ( ; itr!=enditr; ++itr) {
+				sum += *itr;
+			}
+			t_iter.Add(GetTime() - t0);
+			if (opt.debug) cerr << "sum : " << sum << endl;
+			delete g;
+
+			vector <double> range;
+			t0 = GetTime();
+			rc = datamgr.GetDataRange(ts, VarName, level, lod, range);
+			if (rc<0) exit(1);
+			t_range.Add(GetTime() - t0);
+		}
+		}
+	}
+	}
+}
+
+// Allocate and populate blocks of size bs covering a grid with dimensions
+// dims
+//
+vector <float *> make_blocks(
+	const vector <size_t> &dims, const vector <size_t> &bs,
+	vector <float> &storage
+) {
+	size_t nblks = 1;
+	size_t blksize = 1;
+	for (int i=0; i<dims.size(); i++) {
+		nblks *= ((dims[i]-1) / bs[i]) + 1;
+		blksize *= bs[i];
+	}
+	storage.resize(nblks * blksize);
+	for (size_t i=0; i<storage.size(); i++) {
+		storage[i] = field((double) (i % 97) / 97, (double) (i % 89) / 89, 0.5, 0.0);
+	}
+
+	vector <float *> blks;
+	for (size_t i=0; i<nblks; i++) {
+		blks.push_back(storage.data() + i*blksize);
+	}
+	return(blks);
+}
+
+void bench_get_value(string name, const Grid *g) {
+
+	vector <double> minu, maxu;
+	g->GetUserExtents(minu, maxu);
+
+	srand48(0);
+	vector <vector <double> > samples;
+	for (int i=0; i<opt.nsamples; i++) {
+		vector <double> coords;
+		for (int d=0; d<minu.size(); d++) {
+			coords.push_back(minu[d] + drand48() * (maxu[d] - minu[d]));
+		}
+		samples.push_back(coords);
+	}
+
+	Timing &t = new_timing("Grid::GetValue[" + name + "]");
+	for (int l=0; l<opt.loop; l++) {
+		double sum = 0.0;
+		double t0 = GetTime();
+		for (int i=0; i<samples.size(); i++) {
+			float v = g->GetValue(samples[i]);
+			if (v != g->GetMissingValue()) sum += v;
+		}
+		t.Add(GetTime() - t0);
+		if (opt.debug) cerr << name << " sum : " << sum << endl;
+	}
+}
+
+void bench_grids() {
+
+	vector <size_t> dims = {
+		(size_t) opt.dim.nx, (size_t) opt.dim.ny, (size_t) opt.dim.nz
+	};
+	vector <size_t> bs = opt.bs;
+	vector <size_t> dims2d = {dims[0], dims[1]};
+	vector <size_t> bs2d = {bs[0], bs[1]};
+
+	vector <double> minu = {0.0, 0.0, 0.0};
+	vector <double> maxu = {
+		(double) dims[0]-1, (double) dims[1]-1, (double) dims[2]-1
+	};
+	vector <double> minu2d = {minu[0], minu[1]};
+	vector <double> maxu2d = {maxu[0], maxu[1]};
+
+	vector <float> data;
+	vector <float *> blks = make_blocks(dims, bs, data);
+
+	RegularGrid rg(dims, bs, blks, minu, maxu);
+	bench_get_value(rg.GetType(), &rg);
+
+	// Stretched grid with quadratically spaced coordinates
+	//
+	vector <double> xcoords, ycoords, zcoords;
+	for (size_t i=0; i<dims[0]; i++) xcoords.push_back(i * (1.0 + 0.01*i));
+	for (size_t i=0; i<dims[1]; i++) ycoords.push_back(i * (1.0 + 0.01*i));
+	for (size_t i=0; i<dims[2]; i++) zcoords.push_back(i * (1.0 + 0.01*i));
+
+	StretchedGrid sg(dims, bs, blks, xcoords, ycoords, zcoords);
+	bench_get_value(sg.GetType(), &sg);
+
+	// Layered grid: Z coordinates are terrain following
+	//
+	vector <float> zdata;
+	vector <float *> zblks = make_blocks(dims, bs, zdata);
+	RegularGrid zrg(dims, bs, zblks, minu, maxu);
+	for (size_t k=0; k<dims[2]; k++) {
+	for (size_t j=0; j<dims[1]; j++) {
+	for (size_t i=0; i<dims[0]; i++) {
+		double terrain = 0.1 * dims[2] * sin(6.0 * i / dims[0]);
+		zrg.SetValueIJK(i,j,k, (float) (terrain + k));
+	}
+	}
+	}
+
+	LayeredGrid lg(dims, bs, blks, minu2d, maxu2d, zrg);
+	bench_get_value(lg.GetType(), &lg);
+
+	// Curvilinear grid built from a rotated and sheared 2D mesh
+	//
+	vector <float> xdata, ydata;
+	vector <float *> xblks = make_blocks(dims2d, bs2d, xdata);
+	vector <float *> yblks = make_blocks(dims2d, bs2d, ydata);
+	RegularGrid xrg(dims2d, bs2d, xblks, minu2d, maxu2d);
+	RegularGrid yrg(dims2d, bs2d, yblks, minu2d, maxu2d);
+	for (size_t j=0; j<dims2d[1]; j++) {
+	for (size_t i=0; i<dims2d[0]; i++) {
+		xrg.SetValueIJK(i,j,0, (float) (i + 0.25 * j));
+		yrg.SetValueIJK(i,j,0, (float) (j + 0.10 * i));
+	}
+	}
+
+	Timing &t_kd = new_timing("KDTreeRG::KDTreeRG");
+	KDTreeRG *kdtree = NULL;
+	for (int l=0; l<opt.loop; l++) {
+		if (kdtree) delete kdtree;
+		double t0 = GetTime();
+		kdtree = new KDTreeRG(xrg, yrg);
+		t_kd.Add(GetTime() - t0);
+	}
+
+	CurvilinearGrid cg(dims, bs, blks, xrg, yrg, zcoords, kdtree);
+	bench_get_value(cg.GetType(), &cg);
+
+	delete kdtree;
+}
+
+void bench_compressor() {
+
+	// Compressor expects dimensions ordered fastest to slowest
+	//
+	vector <size_t> bs = opt.bs;
+	Compressor cmp(bs, opt.wname);
+
+	size_t blksize = 1;
+	for (int i=0; i<bs.size(); i++) blksize *= bs[i];
+
+	vector <float> src;
+	fill_field(src, bs[0], bs[1], bs[2], 0.0);
+	vector <float> dst(blksize);
+	vector <float> coeffs(cmp.GetNumWaveCoeffs());
+
+	size_t ntotal = cmp.GetNumWaveCoeffs();
+	size_t mincmp = cmp.GetMinCompression();
+
+	// Compress and decompress at each compression ratio
+	//
+	for (int i=0; i<opt.cratios.size(); i++) {
+		size_t ncoeffs = ntotal / opt.cratios[i];
+		if (ncoeffs < mincmp) ncoeffs = mincmp;
+
+		ostringstream oss;
+		oss << "[cratio=" << opt.cratios[i] << "]";
+		Timing &t_c = new_timing("Compressor::Compress" + oss.str());
+		Timing &t_d = new_timing("Compressor::Decompress" + oss.str());
+
+		for (int l=0; l<opt.loop; l++) {
+			SignificanceMap sigmap;
+			double t0 = GetTime();
+			int rc = cmp.Compress(src.data(), coeffs.data(), ncoeffs, &sigmap);
+			if (rc<0) exit(1);
+			t_c.Add(GetTime() - t0);
+
+			t0 = GetTime();
+			rc = cmp.Decompress(coeffs.data(), dst.data(), &sigmap);
+			if (rc<0) exit(1);
+			t_d.Add(GetTime() - t0);
+		}
+	}
+
+	// Decompose once into LOD sets, then time reconstruction at every
+	// refinement level using all of the coefficients
+	//
+	vector <size_t> ncoeffs;
+	size_t naccum = 0;
+	for (int i=0; i<opt.cratios.size(); i++) {
+		size_t n = ntotal / opt.cratios[i];
+		if (n < mincmp) n = mincmp;
+		if (n < naccum) n = naccum;
+		ncoeffs.push_back(n - naccum);
+		naccum = n;
+	}
+
+	vector <SignificanceMap> sigmaps(ncoeffs.size());
+	Timing &t_dc = new_timing("Compressor::Decompose");
+	for (int l=0; l<opt.loop; l++) {
+		double t0 = GetTime();
+		int rc = cmp.Decompose(src.data(), coeffs.data(), ncoeffs, sigmaps);
+		if (rc<0) exit(1);
+		t_dc.Add(GetTime() - t0);
+	}
+
+	for (int level=0; level<=cmp.GetNumLevels(); level++) {
+		ostringstream oss;
+		oss << "[level=" << level << "]";
+		Timing &t_r = new_timing("Compressor::Reconstruct" + oss.str());
+		for (int l=0; l<opt.loop; l++) {
+			double t0 = GetTime();
+			int rc = cmp.Reconstruct(
+				coeffs.data(), dst.data(), sigmaps, level
+			);
+			if (rc<0) exit(1);
+			t_r.Add(GetTime() - t0);
+		}
+	}
+}
+
+void write_json(FILE *fp) {
+	fprintf(fp, "{\n");
+	fprintf(
+		fp, "  \"dimension\": [%d, %d, %d],\n",
+		opt.dim.nx, opt.dim.ny, opt.dim.nz
+	);
+	fprintf(fp, "  \"bs\": [");
+	for (int i=0; i<opt.bs.size(); i++) {
+		fprintf(fp, "%s%zu", i ? ", " : "", opt.bs[i]);
+	}
+	fprintf(fp, "],\n");
+	fprintf(fp, "  \"cratios\": [");
+	for (int i=0; i<opt.cratios.size(); i++) {
+		fprintf(fp, "%s%zu", i ? ", " : "", opt.cratios[i]);
+	}
+	fprintf(fp, "],\n");
+	fprintf(fp, "  \"wname\": \"%s\",\n", opt.wname.c_str());
+	fprintf(fp, "  \"nthreads\": %d,\n", opt.nthreads);
+	fprintf(fp, "  \"timings\": [\n");
+	list <Timing>::const_iterator itr;
+	for (itr = Timings.begin(); itr != Timings.end(); ++itr) {
+		fprintf(
+			fp, "    %s%s\n", itr->JSON().c_str(),
+			itr != --Timings.end() ? "," : ""
+		);
+	}
+	fprintf(fp, "  ]\n");
+	fprintf(fp, "}\n");
+}
+
+};
+
+int main(int argc, char **argv) {
+
+	OptionParser op;
+
+	ProgName = Basename(argv[0]);
+
+	MyBase::SetErrMsgFilePtr(stderr);
+
+	if (op.AppendOptions(set_opts) < 0) {
+		cerr << ProgName << " : " << op.GetErrMsg();
+		exit(1);
+	}
+
+	if (op.ParseOptions(&argc, argv, get_options) < 0) {
+		cerr << ProgName << " : " << op.GetErrMsg();
+		exit(1);
+	}
+
+	if (opt.help) {
+		cerr << "Usage: " << ProgName << " [options] master.nc" << endl;
+		op.PrintOptionHelp(stderr);
+		exit(0);
+	}
+
+	if (argc != 2 || opt.bs.size() != 3 || opt.cratios.empty()) {
+		cerr << "Usage: " << ProgName << " [options] master.nc" << endl;
+		op.PrintOptionHelp(stderr);
+		exit(1);
+	}
+
+	if (opt.debug) {
+		MyBase::SetDiagMsgFilePtr(stderr);
+	}
+
+	string master = argv[1];
+
+	if (! (opt.reuse && FileExists(master))) {
+		if (generate(master) < 0) exit(1);
+	}
+
+	bench_datamgr(master);
+	bench_grids();
+	bench_compressor();
+
+	FILE *fp = stdout;
+	if (! opt.output.empty()) {
+		fp = fopen(opt.output.c_str(), "w");
+		if (! fp) {
+			MyBase::SetErrMsg("fopen(%s) : %M", opt.output.c_str());
+			exit(1);
+		}
+	}
+	write_json(fp);
+	if (fp != stdout) fclose(fp);
+
+	exit(0);
+}
@@ -0,0 +1,390 @@
+//
+// vdc_insitu : example in-situ writer and throughput test
+//
+// Stands in for a simulation that writes its state to a VDC every time
+// step. The VDC is defined up front, then each step "computes" a few
+// synthetic fields and hands them to a VDCInSitu, which compresses and
+// writes them in the background while the next step is computed. With
+// -sync the fields are instead written with VDCNetCDF::PutVar() in the
+// time step loop, for comparison. With -verify the VDC is read back
+// afterwards and checked against the fields written.
+//
+// Reports the output bandwidth, and how long the simulation was held up
+// by output: time blocked for queue memory in Put(), and waiting for the
+// last fields in Flush().
+//
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+#include <vapor/CFuncs.h>
+#include <vapor/OptionParser.h>
+#include <vapor/ThreadPool.h>
+#include <vapor/VDCNetCDF.h>
+#include <vapor/VDCInSitu.h>
+
+using namespace Wasp;
+using namespace VAPoR;
+
+
+struct {
+	OptionParser::Dimension3D_T	dim;
+	std::vector <size_t> bs;
+	std::vector <size_t> cratios;
+	string wname;
+	int	nts;
+	int	nvars;
+	int	nwriters;
+	int memsize;
+	double compute;
+	double tolerance;
+	OptionParser::Boolean_T	sync;
+	OptionParser::Boolean_T	verify;
+	OptionParser::Boolean_T	help;
+	OptionParser::Boolean_T	debug;
+} opt;
+
+OptionParser::OptDescRec_T	set_opts[] = {
+	{
+		"dimension",1, "256x256x256", "Volume dimensions (NXxNYxNZ) of "
+		"the simulation grid"
+	},
+	{
+		"bs", 1, "64:64:64", "Internal storage blocking factor "
+		"expressed in grid points (NX:NY:NZ)"
+	},
+	{
+		"cratios",1, "500:100:10:1", "Colon delimited list of compression "
+		"ratios. The default is 500:100:10:1"
+	},
+	{
+		"wname",1, "bior4.4", "Wavelet family used for compression "
+	},
+	{"nts",		1, 	"10","Number of time steps simulated"},
+	{"nvars",	1, 	"3","Number of variables written each time step"},
+	{"nwriters",	1, 	"0","Number of fields written concurrently. "
+		"0 => based on the number of cores"},
+	{"memsize",	1, 	"1024","Memory available for queued fields in MBs"},
+	{"compute",	1, 	"0.0","Seconds spent computing each time step, in "
+		"addition to generating the fields. The time is slept, leaving "
+		"the cores to the writers"},
+	{"sync",	0,	"",	"Write each field in the time step loop"},
+	{"verify",	0,	"",	"Read the VDC back and compare it with the "
+		"fields written"},
+	{"tolerance",	1, 	"1e-4","Largest absolute error accepted by "
+		"-verify at the finest level-of-detail"},
+	{"help",	0,	"",	"Print this message and exit"},
+	{"debug",	0,	"",	"Debug mode"},
+	{NULL}
+};
+
+
+OptionParser::Option_T	get_options[] = {
+	{"dimension", Wasp::CvtToDimension3D, &opt.dim, sizeof(opt.dim)},
+	{"bs", Wasp::CvtToSize_tVec, &opt.bs, sizeof(opt.bs)},
+	{"cratios", Wasp::CvtToSize_tVec, &opt.cratios, sizeof(opt.cratios)},
+	{"wname", Wasp::CvtToCPPStr, &opt.wname, sizeof(opt.wname)},
+	{"nts", Wasp::CvtToInt, &opt.nts, sizeof(opt.nts)},
+	{"nvars", Wasp::CvtToInt, &opt.nvars, sizeof(opt.nvars)},
+	{"nwriters", Wasp::CvtToInt, &opt.nwriters, sizeof(opt.nwriters)},
+	{"memsize", Wasp::CvtToInt, &opt.memsize, sizeof(opt.memsize)},
+	{"compute", Wasp::CvtToDouble, &opt.compute, sizeof(opt.compute)},
+	{"sync", Wasp::CvtToBoolean, &opt.sync, sizeof(opt.sync)},
+	{"verify", Wasp::CvtToBoolean, &opt.verify, sizeof(opt.verify)},
+	{"tolerance", Wasp::CvtToDouble, &opt.tolerance, sizeof(opt.tolerance)},
+	{"help", Wasp::CvtToBoolean, &opt.help, sizeof(opt.help)},
+	{"debug", Wasp::CvtToBoolean, &opt.debug, sizeof(opt.debug)},
+	{NULL}
+};
+
+const char	*ProgName;
+
+const char *DimNames[] = {"Nx", "Ny", "Nz", "Nt"};
+
+namespace {
+
+string var_name(int i) {
+	ostringstream oss;
+	oss << "var" << i;
+	return(oss.str());
+}
+
+// Smooth synthetic field, different for each variable and time step
+//
+void fill_field(vector <float> &data, int var, double t) {
+	size_t nx = opt.dim.nx;
+	size_t ny = opt.dim.ny;
+	size_t nz = opt.dim.nz;
+	data.resize(nx*ny*nz);
+
+	ThreadPool::Instance()->ParallelFor(0, nz, 1, [&](size_t k0, size_t k1) {
+		for (size_t k=k0; k<k1; k++) {
+		for (size_t j=0; j<ny; j++) {
+		for (size_t i=0; i<nx; i++) {
+			double x = (double) i / nx;
+			double y = (double) j / ny;
+			double z = (double) k / nz;
+			data[k*nx*ny + j*nx + i] = (float) (
+				sin(6.0 * x + t + var) * cos(4.0 * y) +
+				0.5 * sin(10.0 * z * y) + 0.1 * cos(20.0 * x * z * (var+1))
+			);
+		}
+		}
+		}
+	});
+}
+
+// Create the VDC, defining everything that will be written, and write
+// the spatial coordinates
+//
+int define(VDCNetCDF &vdc, string master) {
+
+	size_t chunksize = 1024*1024*4;
+	int rc = vdc.Initialize(
+		master, vector <string> (), VDC::W, opt.bs, chunksize
+	);
+	if (rc<0) return(-1);
+
+	vector <string> dimnames(DimNames, DimNames + 4);
+
+	vector <size_t> cratios(1,1);
+	rc = vdc.SetCompressionBlock("", cratios);
+	if (rc<0) return(-1);
+
+	rc = vdc.DefineDimension(dimnames[0], opt.dim.nx, 0);
+	if (rc<0) return(-1);
+	rc = vdc.DefineDimension(dimnames[1], opt.dim.ny, 1);
+	if (rc<0) return(-1);
+	rc = vdc.DefineDimension(dimnames[2], opt.dim.nz, 2);
+	if (rc<0) return(-1);
+	rc = vdc.DefineDimension(dimnames[3], opt.nts, 3);
+	if (rc<0) return(-1);
+
+	rc = vdc.SetCompressionBlock(opt.wname, opt.cratios);
+	if (rc<0) return(-1);
+
+	for (int v=0; v<opt.nvars; v++) {
+		rc = vdc.DefineDataVar(
+			var_name(v), dimnames, dimnames, "", DC::XType::FLOAT, true
+		);
+		if (rc<0) return(-1);
+	}
+
+	rc = vdc.EndDefine();
+	if (rc<0) return(-1);
+
+	size_t lens[] = {
+		(size_t) opt.dim.nx, (size_t) opt.dim.ny, (size_t) opt.dim.nz
+	};
+	for (int i=0; i<3; i++) {
+		vector <float> coords;
+		for (size_t j=0; j<lens[i]; j++) coords.push_back((float) j);
+		rc = vdc.PutVar(dimnames[i], -1, coords.data());
+		if (rc<0) return(-1);
+	}
+
+	return(0);
+}
+
+void compute() {
+	if (opt.compute > 0.0) {
+		std::this_thread::sleep_for(std::chrono::duration<double>(opt.compute));
+	}
+}
+
+// Write the fields of each time step as the simulation produces them.
+// Returns the time spent writing
+//
+double run_sync(VDCNetCDF &vdc, double &bytes) {
+	double t_write = 0.0;
+	vector <float> data;
+
+	for (int ts=0; ts<opt.nts; ts++) {
+		compute();
+
+		float tc = (float) ts;
+		int rc = vdc.PutVar(ts, DimNames[3], -1, &tc);
+		if (rc<0) exit(1);
+
+		for (int v=0; v<opt.nvars; v++) {
+			fill_field(data, v, (double) ts);
+
+			double t0 = GetTime();
+			rc = vdc.PutVar(ts, var_name(v), -1, data.data());
+			if (rc<0) exit(1);
+			t_write += GetTime() - t0;
+
+			bytes += data.size() * sizeof(float);
+		}
+	}
+	return(t_write);
+}
+
+// As run_sync(), but hand the fields to a VDCInSitu. Returns the time
+// spent queueing fields, including the final Flush()
+//
+double run_insitu(string master, double &bytes, double &t_flush) {
+	VDCInSitu insitu(opt.nwriters, (size_t) opt.memsize * 1024 * 1024);
+
+	int rc = insitu.Initialize(master);
+	if (rc<0) exit(1);
+
+	double t_put = 0.0;
+	vector <float> data;
+
+	for (int ts=0; ts<opt.nts; ts++) {
+		compute();
+
+		float tc = (float) ts;
+		rc = insitu.Put(ts, DimNames[3], &tc);
+		if (rc<0) exit(1);
+
+		for (int v=0; v<opt.nvars; v++) {
+			fill_field(data, v, (double) ts);
+
+			double t0 = GetTime();
+			rc = insitu.Put(ts, var_name(v), data.data());
+			if (rc<0) exit(1);
+			t_put += GetTime() - t0;
+		}
+	}
+
+	double t0 = GetTime();
+	rc = insitu.Flush();
+	if (rc<0) exit(1);
+	t_flush = GetTime() - t0;
+
+	bytes = insitu.GetBytesWritten();
+
+	cout << "Time blocked for memory (s) : " << insitu.GetWaitTime() << endl;
+
+	return(t_put + t_flush);
+}
+
+// Read every field back from the VDC and compare it with the values
+// that were written. Returns the largest absolute error, or a negative
+// value if the VDC could not be read
+//
+double verify(string master) {
+	VDCNetCDF vdc;
+	int rc = vdc.Initialize(master, vector <string> (), VDC::R);
+	if (rc<0) return(-1.0);
+
+	double maxerr = 0.0;
+	vector <float> expected;
+	vector <float> data;
+	for (int ts=0; ts<opt.nts; ts++) {
+
+		float tc;
+		rc = vdc.GetVar(ts, DimNames[3], -1, -1, &tc);
+		if (rc<0) return(-1.0);
+		maxerr = std::max(maxerr, fabs((double) tc - ts));
+
+		for (int v=0; v<opt.nvars; v++) {
+			fill_field(expected, v, (double) ts);
+			data.resize(expected.size());
+
+			rc = vdc.GetVar(ts, var_name(v), -1, -1, data.data());
+			if (rc<0) return(-1.0);
+
+			for (size_t i=0; i<data.size(); i++) {
+				maxerr = std::max(maxerr, fabs((double) data[i] - expected[i]));
+			}
+		}
+	}
+	return(maxerr);
+}
+
+};
+
+int main(int argc, char **argv) {
+
+	OptionParser op;
+
+	ProgName = Basename(argv[0]);
+
+	MyBase::SetErrMsgFilePtr(stderr);
+
+	if (op.AppendOptions(set_opts) < 0) {
+		cerr << ProgName << " : " << op.GetErrMsg();
+		exit(1);
+	}
+
+	if (op.ParseOptions(&argc, argv, get_options) < 0) {
+		cerr << ProgName << " : " << op.GetErrMsg();
+		exit(1);
+	}
+
+	if (opt.help) {
+		cerr << "Usage: " << ProgName << " [options] master.nc" << endl;
+		op.PrintOptionHelp(stderr);
+		exit(0);
+	}
+
+	if (
+		argc != 2 || opt.bs.size() != 3 || opt.cratios.empty() ||
+		opt.nts < 1 || opt.nvars < 1
+	) {
+		cerr << "Usage: " << ProgName << " [options] master.nc" << endl;
+		op.PrintOptionHelp(stderr);
+		exit(1);
+	}
+
+	if (opt.debug) {
+		MyBase::SetDiagMsgFilePtr(stderr);
+	}
+
+	string master = argv[1];
+
+	double t0 = GetTime();
+	double bytes = 0.0;
+	double t_output;
+
+	if (opt.sync) {
+		VDCNetCDF vdc;
+		if (define(vdc, master) < 0) exit(1);
+
+		t0 = GetTime();
+		t_output = run_sync(vdc, bytes);
+	}
+	else {
+		{
+			VDCNetCDF vdc;
+			if (define(vdc, master) < 0) exit(1);
+		}
+
+		t0 = GetTime();
+		double t_flush;
+		t_output = run_insitu(master, bytes, t_flush);
+		cout << "Flush (s) : " << t_flush << endl;
+	}
+
+	double t_total = GetTime() - t0;
+
+	cout << "Data written (MB) : " << bytes / (1024*1024) << endl;
+	cout << "Elapsed (s) : " << t_total << endl;
+	cout << "Simulation held up by output (s) : " << t_output << endl;
+	cout << "Output bandwidth (MB/s) : " << bytes / (1024*1024) / t_total
+		<< endl;
+
+	if (opt.verify) {
+		double maxerr = verify(master);
+		if (maxerr < 0.0) exit(1);
+
+		cout << "Largest error read back : " << maxerr << endl;
+		if (maxerr > opt.tolerance) {
+			cerr << ProgName << " : data read back differ from the data "
+				"written" << endl;
+			exit(1);
+		}
+	}
+
+	exit(0);
+}